@@ -0,0 +1,818 @@
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* c++ includes */
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "AddrMap.h"
+
+//#define ADDRMAP_DEBUG 1
+
+#define PT_LOAD 1
+#define PT_NOTE 4
+#define ET_CORE 4
+#define NT_FILE 0x46494C45
+#define SHT_SYMTAB 2
+#define SHT_DYNSYM 11
+#define STT_FUNC 2
+
+/*****************************************************************************/
+/* compare functions */
+/*****************************************************************************/
+
+bool compareSegByVa(const addrmap_seg &a, const addrmap_seg &b)
+{
+	return a.va < b.va;
+}
+
+/*****************************************************************************/
+/* bounds checked, either endian reads */
+/*****************************************************************************/
+
+struct reader {
+	const uint8_t *data;
+	uint64_t len;
+	bool be;
+	bool bad; /* set if anything was out of bounds */
+
+	uint64_t get(uint64_t offs, int width) {
+		uint64_t result = 0;
+		if(offs > len || len - offs < width) {
+			bad = true;
+			return 0;
+		}
+		for(int i=0; i<width; ++i) {
+			int shift = be ? 8*(width-1-i) : 8*i;
+			result |= (uint64_t)data[offs+i] << shift;
+		}
+		return result;
+	}
+
+	uint64_t u16(uint64_t offs) { return get(offs, 2); }
+	uint64_t u32(uint64_t offs) { return get(offs, 4); }
+	uint64_t u64(uint64_t offs) { return get(offs, 8); }
+	uint64_t word(uint64_t offs, bool is64) { return get(offs, is64 ? 8 : 4); }
+};
+
+/*****************************************************************************/
+/* ELF */
+/*****************************************************************************/
+
+struct core_file {
+	uint64_t start, end;
+	string name;
+};
+
+bool compareCoreFileByStart(const core_file &a, const core_file &b)
+{
+	return a.start < b.start;
+}
+
+/* the NT_FILE note of a core: which file is mapped where
+
+	the note is the core's word, a damaged or truncated one can say anything,
+	so nothing is read past the note or the file */
+static void
+elf_core_files(reader &r, uint64_t offs, uint64_t size, bool is64,
+	vector<core_file> &result)
+{
+	uint64_t end;
+	int wsz = is64 ? 8 : 4;
+
+	if(offs >= r.len)
+		return;
+	end = (size > r.len - offs) ? r.len : offs + size;
+
+	while(offs + 12 <= end && !r.bad) {
+		uint32_t namesz = r.u32(offs);
+		uint32_t descsz = r.u32(offs+4);
+		uint32_t type = r.u32(offs+8);
+		uint64_t desc = offs + 12 + ((namesz + 3) & ~3);
+		uint64_t next = desc + ((descsz + 3) & ~3);
+
+		if(next > end || next <= offs)
+			break;
+
+		if(type == NT_FILE && descsz >= 2*wsz) {
+			uint64_t count = r.word(desc, is64);
+			if(count > (descsz - 2*wsz) / (3*wsz))
+				break;
+
+			uint64_t names = desc + 2*wsz + count*3*wsz;
+			const char *p = (const char *)r.data + names;
+			const char *pend = (const char *)r.data +
+				((desc + descsz < r.len) ? desc + descsz : r.len);
+
+			for(uint64_t i=0; i<count; ++i) {
+				core_file f;
+				uint64_t ent = desc + 2*wsz + i*3*wsz;
+				if(p >= pend)
+					break;
+				f.start = r.word(ent, is64);
+				f.end = r.word(ent + wsz, is64);
+				int n = strnlen(p, pend - p);
+				f.name = string(p, n);
+				p += n + 1;
+				result.push_back(f);
+			}
+		}
+
+		offs = next;
+	}
+}
+
+int AddrMap::fromElf(const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	reader r = { data, len, false, false };
+	vector<core_file> files;
+	uint64_t phoff, shoff, phentsize, phnum, type;
+	bool is64;
+
+	if(len < 0x34 || memcmp(data, "\x7F" "ELF", 4))
+		goto cleanup;
+
+	is64 = (data[4] == 2);
+	r.be = (data[5] == 2);
+
+	type = r.u16(0x10);
+	if(is64) {
+		entry = r.u64(0x18);
+		phoff = r.u64(0x20);
+		shoff = r.u64(0x28);
+		phentsize = r.u16(0x36);
+		phnum = r.u16(0x38);
+	}
+	else {
+		entry = r.u32(0x18);
+		phoff = r.u32(0x1C);
+		shoff = r.u32(0x20);
+		phentsize = r.u16(0x2A);
+		phnum = r.u16(0x2C);
+	}
+
+	/* PN_XNUM: the real count is in section 0's sh_info */
+	if(phnum == 0xFFFF)
+		phnum = r.u32(shoff + (is64 ? 0x2C : 0x1C));
+
+	if(r.bad || phentsize < (is64 ? 0x38 : 0x20)) {
+		printf("ERROR: ELF header is damaged\n");
+		goto cleanup;
+	}
+
+	format = string(type == ET_CORE ? "core" : "elf") + (is64 ? "64" : "32");
+
+	for(uint64_t i=0; i<phnum; ++i) {
+		uint64_t ph = phoff + i*phentsize;
+		uint64_t ptype = r.u32(ph);
+		addrmap_seg s;
+
+		if(is64) {
+			s.perms = r.u32(ph+4) & 7;
+			s.offset = r.u64(ph+8);
+			s.va = r.u64(ph+0x10);
+			s.fsize = r.u64(ph+0x20);
+			s.vsize = r.u64(ph+0x28);
+		}
+		else {
+			s.offset = r.u32(ph+4);
+			s.va = r.u32(ph+8);
+			s.fsize = r.u32(ph+0x10);
+			s.vsize = r.u32(ph+0x14);
+			s.perms = r.u32(ph+0x18) & 7;
+		}
+
+		if(r.bad) {
+			printf("ERROR: program header %lld is past the end\n",
+				(long long)i);
+			goto cleanup;
+		}
+
+		if(ptype == PT_NOTE && type == ET_CORE) {
+			elf_core_files(r, s.offset, s.fsize, is64, files);
+			r.bad = false;
+		}
+
+		if(ptype != PT_LOAD)
+			continue;
+
+		/* cores leave out what they didn't dump, that's a hole and not
+			zero-fill */
+		s.dumped = !(type == ET_CORE && s.fsize == 0);
+
+		/* don't trust sizes past the end of the file */
+		if(s.offset >= len) s.fsize = 0;
+		else if(s.fsize > len - s.offset) s.fsize = len - s.offset;
+		if(s.fsize > s.vsize) s.vsize = s.fsize;
+
+		char buf[64];
+		sprintf(buf, "LOAD%lld %c%c%c", (long long)i,
+			(s.perms & ADDRMAP_R) ? 'r' : '-', (s.perms & ADDRMAP_W) ? 'w' : '-',
+			(s.perms & ADDRMAP_X) ? 'x' : '-');
+		s.name = buf;
+
+		segs.push_back(s);
+	}
+
+	/* name core segments after the files mapped there */
+	if(files.size()) {
+		std::sort(files.begin(), files.end(), compareCoreFileByStart);
+		for(auto s=segs.begin(); s!=segs.end(); ++s) {
+			core_file key = { s->va, 0, "" };
+			auto f = std::upper_bound(files.begin(), files.end(), key,
+				compareCoreFileByStart);
+			if(f != files.begin() && s->va < (f-1)->end)
+				s->name += " " + (f-1)->name;
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* an ELF's function symbols (.symtab and .dynsym, STT_FUNC with a value
+	and a section), by address; read from the section headers, since a
+	tagger's symbol tags can be placeholders or missing */
+int elf_func_symbols(const uint8_t *data, uint64_t len,
+	map<uint64_t, string> &result)
+{
+	int rc = -1;
+	reader r = { data, len, false, false };
+	uint64_t shoff, shentsize, shnum;
+	bool is64;
+
+	if(len < 0x34 || memcmp(data, "\x7F" "ELF", 4))
+		goto cleanup;
+
+	is64 = (data[4] == 2);
+	r.be = (data[5] == 2);
+
+	if(is64) {
+		shoff = r.u64(0x28);
+		shentsize = r.u16(0x3A);
+		shnum = r.u16(0x3C);
+	}
+	else {
+		shoff = r.u32(0x20);
+		shentsize = r.u16(0x2E);
+		shnum = r.u16(0x30);
+	}
+
+	/* SHN_UNDEF with headers present: the real count is section 0's sh_size */
+	if(shnum == 0 && shoff)
+		shnum = is64 ? r.u64(shoff + 0x20) : r.u32(shoff + 0x14);
+
+	if(r.bad || (shnum && shentsize < (is64 ? 0x40 : 0x28))) {
+		printf("ERROR: ELF section headers are damaged\n");
+		goto cleanup;
+	}
+
+	for(uint64_t i=0; i<shnum && !r.bad; ++i) {
+		uint64_t sh = shoff + i*shentsize;
+		uint64_t type = r.u32(sh + 4);
+		uint64_t offs, size, link, entsize, strOffs, strSize;
+
+		if(type != SHT_SYMTAB && type != SHT_DYNSYM)
+			continue;
+
+		if(is64) {
+			offs = r.u64(sh + 0x18);
+			size = r.u64(sh + 0x20);
+			link = r.u32(sh + 0x28);
+			entsize = r.u64(sh + 0x38);
+		}
+		else {
+			offs = r.u32(sh + 0x10);
+			size = r.u32(sh + 0x14);
+			link = r.u32(sh + 0x18);
+			entsize = r.u32(sh + 0x24);
+		}
+		if(entsize < (is64 ? 24 : 16))
+			entsize = is64 ? 24 : 16;
+
+		/* the names, in the string table section the symbols link to */
+		if(link >= shnum)
+			continue;
+		strOffs = is64 ? r.word(shoff + link*shentsize + 0x18, true) :
+			r.word(shoff + link*shentsize + 0x10, false);
+		strSize = is64 ? r.word(shoff + link*shentsize + 0x20, true) :
+			r.word(shoff + link*shentsize + 0x14, false);
+		if(r.bad || strOffs >= len)
+			break;
+		strSize = std::min(strSize, len - strOffs);
+
+		/* nothing is read past the file, however big the table claims to be */
+		if(offs >= len)
+			continue;
+		size = std::min(size, len - offs);
+
+		for(uint64_t sym = offs; sym + entsize <= offs + size; sym += entsize) {
+			uint64_t name = r.u32(sym), value;
+			int info, shndx;
+
+			if(is64) {
+				info = data[sym + 4];
+				shndx = r.u16(sym + 6);
+				value = r.u64(sym + 8);
+			}
+			else {
+				value = r.u32(sym + 4);
+				info = data[sym + 12];
+				shndx = r.u16(sym + 14);
+			}
+
+			if((info & 0xF) != STT_FUNC || !value || shndx == 0 /* SHN_UNDEF */)
+				continue;
+
+			string &s = result[value];
+			if(s.empty() && name < strSize)
+				s = string((const char *)data + strOffs + name,
+					strnlen((const char *)data + strOffs + name, strSize - name));
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* PE */
+/*****************************************************************************/
+
+int AddrMap::fromPe(const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	reader r = { data, len, false, false };
+	uint64_t pe, opt, sects, nSects, optSize, imageBase, hdrSize;
+	addrmap_seg hdr;
+
+	if(len < 0x40 || data[0] != 'M' || data[1] != 'Z')
+		goto cleanup;
+
+	pe = r.u32(0x3C);
+	if(r.bad || pe + 24 > len || memcmp(data + pe, "PE\0\0", 4))
+		goto cleanup;
+
+	nSects = r.u16(pe + 6);
+	optSize = r.u16(pe + 20);
+	opt = pe + 24;
+	sects = opt + optSize;
+
+	switch(r.u16(opt)) {
+		case 0x10B:
+			format = "pe32";
+			imageBase = r.u32(opt + 28);
+			break;
+		case 0x20B:
+			format = "pe32+";
+			imageBase = r.u64(opt + 24);
+			break;
+		default:
+			printf("ERROR: unknown PE optional header magic\n");
+			goto cleanup;
+	}
+
+	entry = imageBase + r.u32(opt + 16);
+	hdrSize = r.u32(opt + 60);
+
+	if(r.bad) {
+		printf("ERROR: PE header is damaged\n");
+		goto cleanup;
+	}
+
+	/* the headers are mapped at the image base */
+	hdr.va = imageBase;
+	hdr.offset = 0;
+	hdr.fsize = hdr.vsize = std::min(hdrSize, len);
+	hdr.perms = ADDRMAP_R;
+	hdr.dumped = true;
+	hdr.name = "headers";
+	segs.push_back(hdr);
+
+	for(uint64_t i=0; i<nSects; ++i) {
+		uint64_t sh = sects + i*40;
+		addrmap_seg s;
+
+		if(sh + 40 > len) {
+			printf("ERROR: section header %lld is past the end\n",
+				(long long)i);
+			goto cleanup;
+		}
+
+		uint64_t vsize = r.u32(sh + 8);
+		uint64_t rva = r.u32(sh + 12);
+		uint64_t rawSize = r.u32(sh + 16);
+		uint64_t rawPtr = r.u32(sh + 20);
+		uint64_t chars = r.u32(sh + 36);
+
+		s.va = imageBase + rva;
+		s.vsize = vsize ? vsize : rawSize;
+		s.offset = rawPtr;
+		s.fsize = std::min(rawSize, s.vsize);
+		if(s.offset >= len) s.fsize = 0;
+		else if(s.fsize > len - s.offset) s.fsize = len - s.offset;
+		s.perms = ((chars & 0x40000000) ? ADDRMAP_R : 0) |
+			((chars & 0x80000000) ? ADDRMAP_W : 0) |
+			((chars & 0x20000000) ? ADDRMAP_X : 0);
+		s.dumped = true;
+		s.name = string((const char *)data + sh, strnlen((const char *)data + sh, 8));
+
+		segs.push_back(s);
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* address map */
+/*****************************************************************************/
+
+void AddrMap::clear(void)
+{
+	segs.clear();
+	byOffset.clear();
+	entry = 0;
+	format = "";
+}
+
+/* sort, drop empty and overlapped segments, index the file side */
+void AddrMap::finish(void)
+{
+	vector<addrmap_seg> tmp;
+
+	std::stable_sort(segs.begin(), segs.end(), compareSegByVa);
+
+	for(auto i=segs.begin(); i!=segs.end(); ++i) {
+		if(i->vsize == 0)
+			continue;
+
+		/* overlapping the one before? the earlier one wins */
+		if(tmp.size() && i->va < tmp.back().va + tmp.back().vsize) {
+			uint64_t end = tmp.back().va + tmp.back().vsize;
+			if(i->va + i->vsize <= end)
+				continue;
+			uint64_t cut = end - i->va;
+			i->va += cut;
+			i->vsize -= cut;
+			i->offset += cut;
+			i->fsize = (i->fsize > cut) ? i->fsize - cut : 0;
+		}
+
+		tmp.push_back(*i);
+	}
+
+	segs = tmp;
+
+	byOffset.clear();
+	for(int i=0; i<segs.size(); ++i)
+		if(segs[i].fsize)
+			byOffset.push_back(i);
+
+	std::sort(byOffset.begin(), byOffset.end(),
+		[this](int a, int b) { return segs[a].offset < segs[b].offset; });
+}
+
+int AddrMap::build(const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+
+	clear();
+
+	if(fromElf(data, len) && fromPe(data, len))
+		goto cleanup;
+
+	finish();
+	if(segs.empty())
+		goto cleanup;
+
+	#ifdef ADDRMAP_DEBUG
+	printf("%s(): %s, %ld segments, entry 0x%llX\n", __func__, format.c_str(),
+		segs.size(), (unsigned long long)entry);
+	#endif
+
+	rc = 0;
+	cleanup:
+	if(rc) clear();
+	return rc;
+}
+
+int AddrMap::upperVa(uint64_t va)
+{
+	int lo = 0, hi = segs.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if(segs[mid].va <= va) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+int AddrMap::findVa(uint64_t va)
+{
+	int i = upperVa(va);
+	if(i > 0 && va - segs[i-1].va < segs[i-1].vsize)
+		return i-1;
+	return -1;
+}
+
+/* only bytes actually in the file have an offset (not BSS) */
+bool AddrMap::vaToOffset(uint64_t va, uint64_t *offset)
+{
+	int i = findVa(va);
+	if(i < 0 || va - segs[i].va >= segs[i].fsize)
+		return false;
+
+	*offset = segs[i].offset + (va - segs[i].va);
+	return true;
+}
+
+bool AddrMap::offsetToVa(uint64_t offset, uint64_t *va)
+{
+	int lo = 0, hi = byOffset.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if(segs[byOffset[mid]].offset <= offset) lo = mid + 1;
+		else hi = mid;
+	}
+
+	/* the closest start, or the one before (if they overlap in the file) */
+	for(int j = lo-1; j >= 0 && j >= lo-2; --j) {
+		addrmap_seg &s = segs[byOffset[j]];
+		if(offset - s.offset < s.fsize) {
+			*va = s.va + (offset - s.offset);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*****************************************************************************/
+/* VA source */
+/*****************************************************************************/
+
+VaSource::VaSource(ByteSource *file_, AddrMap *map_)
+{
+	file = file_;
+	map = map_;
+}
+
+uint64_t VaSource::addrStart(void)
+{
+	return map->size() ? map->getSegs().front().va : 0;
+}
+
+uint64_t VaSource::addrEnd(void)
+{
+	if(!map->size())
+		return 0;
+
+	addrmap_seg &s = map->getSegs().back();
+	return s.va + s.vsize;
+}
+
+int VaSource::read(uint64_t addr, uint8_t *buf, int len)
+{
+	int done = 0;
+	vector<addrmap_seg> &segs = map->getSegs();
+
+	while(done < len) {
+		int i = map->findVa(addr);
+		if(i < 0 || !segs[i].dumped)
+			break;
+
+		addrmap_seg &s = segs[i];
+		uint64_t offs = addr - s.va;
+		int n = std::min((uint64_t)(len - done), s.vsize - offs);
+
+		if(offs < s.fsize) {
+			/* from the file */
+			n = std::min((uint64_t)n, s.fsize - offs);
+			int got = file->read(s.offset + offs, buf + done, n);
+			done += got;
+			addr += got;
+			if(got < n)
+				break;
+		}
+		else {
+			/* BSS */
+			memset(buf + done, 0, n);
+			done += n;
+			addr += n;
+		}
+	}
+
+	return done;
+}
+
+/* data is the dumped segments, holes are the gaps and what cores left out */
+bool VaSource::nextData(uint64_t addr, uint64_t *result)
+{
+	vector<addrmap_seg> &segs = map->getSegs();
+
+	int i = map->findVa(addr);
+	if(i >= 0 && segs[i].dumped) {
+		*result = addr;
+		return true;
+	}
+
+	for(i = map->upperVa(addr); i < segs.size(); ++i) {
+		if(segs[i].dumped) {
+			*result = segs[i].va;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool VaSource::nextHole(uint64_t addr, uint64_t *result)
+{
+	vector<addrmap_seg> &segs = map->getSegs();
+
+	int i = map->findVa(addr);
+	if(i < 0 || !segs[i].dumped) {
+		if(addr >= addrEnd())
+			return false;
+		*result = addr;
+		return true;
+	}
+
+	/* run of adjacent dumped segments */
+	while(i+1 < segs.size() && segs[i+1].dumped &&
+	  segs[i+1].va == segs[i].va + segs[i].vsize)
+		++i;
+	if(i+1 == segs.size())
+		return false;
+
+	*result = segs[i].va + segs[i].vsize;
+	return true;
+}
+
+bool VaSource::prevData(uint64_t addr, uint64_t *result)
+{
+	vector<addrmap_seg> &segs = map->getSegs();
+
+	if(addr <= addrStart())
+		return false;
+
+	int i = map->findVa(addr-1);
+	if(i >= 0 && segs[i].dumped) {
+		*result = addr;
+		return true;
+	}
+
+	for(i = map->upperVa(addr-1) - 1; i >= 0; --i) {
+		if(segs[i].dumped && segs[i].va + segs[i].vsize <= addr) {
+			*result = segs[i].va + segs[i].vsize;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool VaSource::prevHole(uint64_t addr, uint64_t *result)
+{
+	vector<addrmap_seg> &segs = map->getSegs();
+
+	if(addr <= addrStart())
+		return false;
+
+	int i = map->findVa(addr-1);
+	if(i < 0 || !segs[i].dumped) {
+		*result = addr;
+		return true;
+	}
+
+	while(i > 0 && segs[i-1].dumped &&
+	  segs[i-1].va + segs[i-1].vsize == segs[i].va)
+		--i;
+	if(i == 0)
+		return false;
+
+	*result = segs[i].va;
+	return true;
+}
+
+/* pass the view on to the file in its own terms, so it can read ahead */
+void VaSource::viewChanged(uint64_t left, uint64_t right)
+{
+	uint64_t offsLeft;
+
+	if(map->vaToOffset(left, &offsLeft))
+		file->viewChanged(offsLeft, offsLeft + (right - left));
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -DTEST1 AddrMap.cxx ByteSource.cxx -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	AddrMap map;
+	uint8_t elf[0x3000];
+	uint8_t buf[16];
+	uint64_t offs, va;
+
+	/* a tiny ELF64 LE with text at 0x400000 and data+bss at 0x600000 */
+	memset(elf, 0, sizeof(elf));
+	memcpy(elf, "\x7F" "ELF\x02\x01\x01", 7);
+	*(uint16_t *)(elf + 0x10) = 2; /* ET_EXEC */
+	*(uint64_t *)(elf + 0x18) = 0x400100; /* entry */
+	*(uint64_t *)(elf + 0x20) = 0x40; /* phoff */
+	*(uint16_t *)(elf + 0x36) = 0x38;
+	*(uint16_t *)(elf + 0x38) = 2;
+	uint8_t *ph = elf + 0x40;
+	*(uint32_t *)(ph) = PT_LOAD; *(uint32_t *)(ph+4) = 5;
+	*(uint64_t *)(ph+8) = 0; *(uint64_t *)(ph+0x10) = 0x400000;
+	*(uint64_t *)(ph+0x20) = 0x1000; *(uint64_t *)(ph+0x28) = 0x1000;
+	ph += 0x38;
+	*(uint32_t *)(ph) = PT_LOAD; *(uint32_t *)(ph+4) = 6;
+	*(uint64_t *)(ph+8) = 0x2000; *(uint64_t *)(ph+0x10) = 0x600000;
+	*(uint64_t *)(ph+0x20) = 0x800; *(uint64_t *)(ph+0x28) = 0x4000;
+	memcpy(elf + 0x100, "entry!", 6);
+	memcpy(elf + 0x2010, "data!", 5);
+	memset(elf + 0x2800, 0xAA, 0x800); /* past filesz, must not show */
+
+	if(map.build(elf, sizeof(elf))) {
+		printf("ERROR: build()\n");
+		goto cleanup;
+	}
+
+	for(auto i=map.getSegs().begin(); i!=map.getSegs().end(); ++i)
+		printf("%s: va [0x%llX,0x%llX) <- file [0x%llX,0x%llX) %s\n",
+			map.format.c_str(), (unsigned long long)i->va,
+			(unsigned long long)(i->va + i->vsize),
+			(unsigned long long)i->offset,
+			(unsigned long long)(i->offset + i->fsize), i->name.c_str());
+
+	{
+		MemSource file(0, elf, sizeof(elf));
+		VaSource vas(&file, &map);
+
+		if(vas.read(map.entry, buf, 6) != 6 || memcmp(buf, "entry!", 6)) {
+			printf("ERROR: reading at entry\n");
+			goto cleanup;
+		}
+		if(vas.read(0x600010, buf, 5) != 5 || memcmp(buf, "data!", 5)) {
+			printf("ERROR: reading data\n");
+			goto cleanup;
+		}
+		if(vas.read(0x600900, buf, 16) != 16 || buf[0] || buf[15]) {
+			printf("ERROR: bss should be zeros\n");
+			goto cleanup;
+		}
+		if(vas.read(0x500000, buf, 16) != 0) {
+			printf("ERROR: gap should be unreadable\n");
+			goto cleanup;
+		}
+		if(!vas.nextData(0x401000, &va) || va != 0x600000) {
+			printf("ERROR: nextData()\n");
+			goto cleanup;
+		}
+	}
+
+	if(!map.vaToOffset(0x600010, &offs) || offs != 0x2010 ||
+	  map.vaToOffset(0x600900, &offs) ||
+	  !map.offsetToVa(0x100, &va) || va != 0x400100 ||
+	  map.offsetToVa(0x1800, &va)) {
+		printf("ERROR: translation\n");
+		goto cleanup;
+	}
+
+	/* and whatever we were given */
+	for(int i=1; i<ac; ++i) {
+		FILE *fp = fopen(av[i], "rb");
+		if(!fp) continue;
+		fseek(fp, 0, SEEK_END);
+		long len = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		vector<uint8_t> data(len);
+		if(fread(&data[0], 1, len, fp) == len && !map.build(&data[0], len))
+			printf("%s: %s, %d segments, entry 0x%llX\n", av[i],
+				map.format.c_str(), map.size(), (unsigned long long)map.entry);
+		fclose(fp);
+	}
+
+	printf("PASS\n");
+	rc = 0;
+	cleanup:
+	return rc;
+}
+#endif
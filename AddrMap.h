@@ -0,0 +1,78 @@
+/* file offset <-> virtual address translation, from a segment table
+
+	ELF (executables, libraries, cores: the PT_LOAD list, named with the
+	NT_FILE note in cores) and PE (sections) are understood
+
+	segments are sorted by address so translation is a binary search, which
+	stays instant on cores with thousands of segments */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ByteSource.h"
+
+#define ADDRMAP_R 4
+#define ADDRMAP_W 2
+#define ADDRMAP_X 1
+
+struct addrmap_seg {
+	uint64_t va, vsize; /* in memory */
+	uint64_t offset, fsize; /* in the file, vsize beyond fsize is zero-fill */
+	int perms; /* ADDRMAP_R|W|X */
+	bool dumped; /* false for core segments with no bytes in the file */
+	string name;
+};
+
+class AddrMap
+{
+	vector<addrmap_seg> segs; /* sorted by va */
+	vector<int> byOffset; /* segs indices sorted by offset */
+
+	void finish(void);
+	int fromElf(const uint8_t *data, uint64_t len);
+	int fromPe(const uint8_t *data, uint64_t len);
+
+	public:
+	uint64_t entry = 0;
+	string format; /* "elf32", "elf64", "pe32", "pe32+", "core64", ... */
+
+	int build(const uint8_t *data, uint64_t len);
+	void clear(void);
+
+	int size(void) { return segs.size(); }
+	vector<addrmap_seg> &getSegs(void) { return segs; }
+
+	int findVa(uint64_t va); /* segment holding va, or -1 */
+	int upperVa(uint64_t va); /* first segment starting after va */
+	bool vaToOffset(uint64_t va, uint64_t *offset);
+	bool offsetToVa(uint64_t offset, uint64_t *va);
+};
+
+/* an ELF's defined function symbols, by address, from .symtab and .dynsym */
+int elf_func_symbols(const uint8_t *data, uint64_t len,
+	map<uint64_t, string> &result);
+
+/* a file's bytes, addressed by VA: unmapped gaps are holes, BSS is zeros */
+class VaSource : public ByteSource
+{
+	ByteSource *file;
+	AddrMap *map;
+
+	public:
+	VaSource(ByteSource *file, AddrMap *map);
+
+	uint64_t addrStart(void);
+	uint64_t addrEnd(void);
+	int read(uint64_t addr, uint8_t *buf, int len);
+	bool nextData(uint64_t addr, uint64_t *result);
+	bool nextHole(uint64_t addr, uint64_t *result);
+	bool prevData(uint64_t addr, uint64_t *result);
+	bool prevHole(uint64_t addr, uint64_t *result);
+	void viewChanged(uint64_t left, uint64_t right);
+};
@@ -0,0 +1,71 @@
+/* c stdlib includes */
+#include <string.h>
+
+/* c++ includes */
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "ByteSource.h"
+
+/*****************************************************************************/
+/* defaults */
+/*****************************************************************************/
+
+bool ByteSource::nextData(uint64_t addr, uint64_t *result)
+{
+	if(addr < addrStart()) addr = addrStart();
+	if(addr >= addrEnd()) return false;
+	*result = addr;
+	return true;
+}
+
+bool ByteSource::prevData(uint64_t addr, uint64_t *result)
+{
+	if(addr > addrEnd()) addr = addrEnd();
+	if(addr <= addrStart()) return false;
+	*result = addr;
+	return true;
+}
+
+bool ByteSource::nextHole(uint64_t addr, uint64_t *result)
+{
+	return false;
+}
+
+bool ByteSource::prevHole(uint64_t addr, uint64_t *result)
+{
+	return false;
+}
+
+/*****************************************************************************/
+/* memory source */
+/*****************************************************************************/
+
+MemSource::MemSource(uint64_t addr, const uint8_t *data, uint64_t len)
+{
+	base = addr;
+	bytes.assign(data, data + len);
+}
+
+uint64_t MemSource::addrStart(void)
+{
+	return base;
+}
+
+uint64_t MemSource::addrEnd(void)
+{
+	return base + bytes.size();
+}
+
+int MemSource::read(uint64_t addr, uint8_t *buf, int len)
+{
+	if(addr < base || addr >= base + bytes.size())
+		return 0;
+
+	uint64_t offs = addr - base;
+	int n = std::min((uint64_t)len, bytes.size() - offs);
+	memcpy(buf, &bytes[offs], n);
+	return n;
+}
@@ -0,0 +1,54 @@
+/* where HexView (and friends) get their bytes from
+
+	a source spans [addrStart,addrEnd) but need not be readable everywhere
+	(eg: holes between the mapped regions of a process) */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+using namespace std;
+
+class ByteSource
+{
+	public:
+	virtual ~ByteSource() {}
+
+	virtual uint64_t addrStart(void) = 0;
+	virtual uint64_t addrEnd(void) = 0; // non-inclusive ')' endpoint
+
+	/* copy up to len bytes at addr into buf, returns how many contiguous
+		bytes starting at addr were readable (0 if addr itself isn't) */
+	virtual int read(uint64_t addr, uint8_t *buf, int len) = 0;
+
+	/* sources with holes (sparse files, unmapped memory) say where the
+		interesting bytes are, like lseek(SEEK_DATA/SEEK_HOLE) in both
+		directions:
+		nextData(): first data byte at or after addr
+		nextHole(): first hole byte at or after addr
+		prevData(): end of the last data before addr
+		prevHole(): end of the last hole before addr
+		all return false if there is none, the default is "all data" */
+	virtual bool nextData(uint64_t addr, uint64_t *result);
+	virtual bool nextHole(uint64_t addr, uint64_t *result);
+	virtual bool prevData(uint64_t addr, uint64_t *result);
+	virtual bool prevHole(uint64_t addr, uint64_t *result);
+
+	/* the viewer moved to [left,right), a chance to read ahead */
+	virtual void viewChanged(uint64_t left, uint64_t right) {}
+};
+
+/* plain memory, copied in */
+class MemSource : public ByteSource
+{
+	uint64_t base;
+	vector<uint8_t> bytes;
+
+	public:
+	MemSource(uint64_t addr, const uint8_t *data, uint64_t len);
+
+	uint64_t addrStart(void);
+	uint64_t addrEnd(void);
+	int read(uint64_t addr, uint8_t *buf, int len);
+};
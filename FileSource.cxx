@@ -0,0 +1,620 @@
+/* c stdlib includes */
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* OS */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* c++ includes */
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "FileSource.h"
+
+//#define FILE_SOURCE_DEBUG 1
+
+static double
+now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long
+major_faults(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_majflt;
+}
+
+/*****************************************************************************/
+/* extent discovery */
+/*****************************************************************************/
+
+/* ask the filesystem, returns -1 if it doesn't know how */
+int FileSource::extentsFromSeek(void)
+{
+	int rc = -1;
+	off_t pos = 0;
+
+	extents.clear();
+
+	while(pos < size) {
+		off_t data = lseek(fd, pos, SEEK_DATA);
+		if(data < 0) {
+			/* ENXIO: no more data, the rest of the file is a hole */
+			if(errno == ENXIO)
+				break;
+			goto cleanup;
+		}
+
+		off_t hole = lseek(fd, data, SEEK_HOLE);
+		if(hole < 0)
+			goto cleanup;
+
+		file_extent e = { (uint64_t)data, (uint64_t)hole };
+		extents.push_back(e);
+		pos = hole;
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* read the whole thing, calling all-zero blocks holes */
+int FileSource::extentsFromScan(void)
+{
+	int rc = -1;
+	uint64_t buf[FILE_SCAN_BLOCK/8];
+
+	extents.clear();
+
+	for(uint64_t pos = 0; pos < size; pos += FILE_SCAN_BLOCK) {
+		ssize_t n = pread(fd, buf, FILE_SCAN_BLOCK, pos);
+		if(n <= 0) {
+			printf("ERROR: pread() at 0x%llX\n", (unsigned long long)pos);
+			goto cleanup;
+		}
+
+		/* pad a short last block, or with zeros so it doesn't matter */
+		if(n < FILE_SCAN_BLOCK)
+			memset((uint8_t *)buf + n, 0, FILE_SCAN_BLOCK - n);
+
+		uint64_t acc = 0;
+		for(int i=0; i<FILE_SCAN_BLOCK/8; ++i)
+			acc |= buf[i];
+		if(!acc)
+			continue;
+
+		uint64_t end = std::min(pos + FILE_SCAN_BLOCK, size);
+		if(extents.size() && extents.back().right == pos) {
+			extents.back().right = end;
+		}
+		else {
+			file_extent e = { pos, end };
+			extents.push_back(e);
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* file source */
+/*****************************************************************************/
+
+FileSource::~FileSource()
+{
+	if(worker.joinable()) {
+		{
+			lock_guard<mutex> lock(mtx);
+			workerQuit = true;
+		}
+		cv.notify_one();
+		worker.join();
+	}
+
+	if(map) munmap(map, size);
+	if(fd >= 0) close(fd);
+}
+
+int FileSource::open(const char *path)
+{
+	int rc = -1;
+	struct stat sb;
+
+	fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		printf("ERROR: open(\"%s\")\n", path);
+		goto cleanup;
+	}
+
+	if(fstat(fd, &sb)) {
+		printf("ERROR: fstat()\n");
+		goto cleanup;
+	}
+	size = sb.st_size;
+
+	if(size) {
+		map = (uint8_t *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED) {
+			map = NULL;
+			printf("ERROR: mmap()\n");
+			goto cleanup;
+		}
+	}
+
+	majfltAtOpen = major_faults();
+	stats.advice = MADV_NORMAL;
+
+	if(extentsFromSeek()) {
+		#ifdef FILE_SOURCE_DEBUG
+		printf("%s(): no SEEK_DATA (errno %d), scanning\n", __func__, errno);
+		#endif
+		if(extentsFromScan())
+			goto cleanup;
+	}
+
+	#ifdef FILE_SOURCE_DEBUG
+	printf("%s(): %ld data extents over 0x%llX bytes\n", __func__,
+		extents.size(), (unsigned long long)size);
+	#endif
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* holes of at least minSize bytes */
+void FileSource::getHoles(vector<file_extent> &result, uint64_t minSize)
+{
+	uint64_t pos = 0;
+
+	result.clear();
+
+	for(unsigned int i=0; i<=extents.size(); ++i) {
+		uint64_t end = (i < extents.size()) ? extents[i].left : size;
+		if(end > pos && end - pos >= minSize) {
+			file_extent e = { pos, end };
+			result.push_back(e);
+		}
+		if(i < extents.size())
+			pos = extents[i].right;
+	}
+}
+
+uint64_t FileSource::addrStart(void)
+{
+	return 0;
+}
+
+uint64_t FileSource::addrEnd(void)
+{
+	return size;
+}
+
+/* index of the first extent ending after addr (the one containing it, or
+	the next one if addr is in a hole), extents.size() if none
+
+	scrolling and jumping stay near the last extent, so try it and its
+	neighbor before searching */
+int FileSource::findExtent(uint64_t addr)
+{
+	int n = extents.size();
+	int h = extentHint;
+
+	if(h < n && (h == 0 || extents[h-1].right <= addr)) {
+		if(addr < extents[h].right) return h;
+		if(h+1 < n && addr < extents[h+1].right) return extentHint = h+1;
+	}
+
+	int i = searchExtent(addr);
+	if(i < n) extentHint = i;
+	return i;
+}
+
+/* same, without the hint (safe from the prefetch worker) */
+int FileSource::searchExtent(uint64_t addr)
+{
+	int lo = 0, hi = extents.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if(extents[mid].right <= addr) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+int FileSource::read(uint64_t addr, uint8_t *buf, int len)
+{
+	int done = 0;
+
+	while(done < len && addr < size) {
+		int n = std::min((uint64_t)(len - done), size - addr);
+		int i = findExtent(addr);
+
+		if(i < extents.size() && addr >= extents[i].left) {
+			/* data, which may fault */
+			n = std::min((uint64_t)n, extents[i].right - addr);
+			double t0 = now_seconds();
+			memcpy(buf + done, map + addr, n);
+			double ms = (now_seconds() - t0) * 1000;
+			if(ms > FILE_STALL_MS) {
+				stats.stalls++;
+				if(ms > stats.worstStall) stats.worstStall = ms;
+			}
+		}
+		else {
+			/* hole, up to the next extent (or the end) */
+			if(i < extents.size())
+				n = std::min((uint64_t)n, extents[i].left - addr);
+			memset(buf + done, 0, n);
+		}
+
+		done += n;
+		addr += n;
+	}
+
+	return done;
+}
+
+bool FileSource::nextData(uint64_t addr, uint64_t *result)
+{
+	int i = findExtent(addr);
+	if(i >= extents.size())
+		return false;
+
+	*result = std::max(addr, extents[i].left);
+	return true;
+}
+
+bool FileSource::prevData(uint64_t addr, uint64_t *result)
+{
+	if(addr > size) addr = size;
+	if(addr == 0)
+		return false;
+
+	/* extent holding the byte just before addr? */
+	int i = findExtent(addr-1);
+	if(i < extents.size() && addr-1 >= extents[i].left) {
+		*result = addr;
+		return true;
+	}
+
+	if(i == 0)
+		return false;
+
+	*result = extents[i-1].right;
+	return true;
+}
+
+bool FileSource::nextHole(uint64_t addr, uint64_t *result)
+{
+	if(addr >= size)
+		return false;
+
+	int i = findExtent(addr);
+	if(i < extents.size() && addr >= extents[i].left) {
+		/* data runs to the end of the file? */
+		if(extents[i].right >= size)
+			return false;
+		addr = extents[i].right;
+	}
+
+	*result = addr;
+	return true;
+}
+
+bool FileSource::prevHole(uint64_t addr, uint64_t *result)
+{
+	if(addr > size) addr = size;
+	if(addr == 0)
+		return false;
+
+	int i = findExtent(addr-1);
+	if(i < extents.size() && addr-1 >= extents[i].left) {
+		/* data from the start of the file? */
+		if(extents[i].left == 0)
+			return false;
+		addr = extents[i].left;
+	}
+
+	*result = addr;
+	return true;
+}
+
+/*****************************************************************************/
+/* prefetching */
+/*****************************************************************************/
+
+const char *
+file_advice_tostr(int advice)
+{
+	switch(advice) {
+		case MADV_NORMAL: return "normal";
+		case MADV_SEQUENTIAL: return "sequential";
+		case MADV_RANDOM: return "random";
+	}
+	return "unknown";
+}
+
+void FileSource::adviseFor(int advice)
+{
+	if(advice == stats.advice || !map)
+		return;
+
+	#ifdef FILE_SOURCE_DEBUG
+	printf("%s(): %s -> %s\n", __func__, file_advice_tostr(stats.advice),
+		file_advice_tostr(advice));
+	#endif
+
+	madvise(map, size, advice);
+	stats.advice = advice;
+}
+
+/* hand a range to the worker, replacing whatever it hasn't started on */
+void FileSource::prefetch(uint64_t left, uint64_t right)
+{
+	left &= ~(uint64_t)0xFFF;
+	if(right > size) right = size;
+	if(!map || left >= right)
+		return;
+
+	{
+		lock_guard<mutex> lock(mtx);
+		pendLeft = left;
+		pendRight = right;
+		pending = true;
+	}
+
+	if(!worker.joinable())
+		worker = thread(&FileSource::workerLoop, this);
+
+	cv.notify_one();
+}
+
+void FileSource::workerLoop(void)
+{
+	unique_lock<mutex> lock(mtx);
+
+	while(1) {
+		cv.wait(lock, [this]{ return pending || workerQuit; });
+		if(workerQuit)
+			break;
+
+		uint64_t left = pendLeft, right = pendRight;
+		pending = false;
+
+		/* holes need no reading, advise only the data in the range */
+		vector<file_extent> todo;
+		for(int i=searchExtent(left); i<extents.size() &&
+		  extents[i].left < right; ++i) {
+			file_extent e = { std::max(left, extents[i].left),
+				std::min(right, extents[i].right) };
+			e.left &= ~(uint64_t)0xFFF;
+			todo.push_back(e);
+		}
+
+		lock.unlock();
+		for(auto i=todo.begin(); i!=todo.end(); ++i)
+			madvise(map + i->left, i->right - i->left, MADV_WILLNEED);
+		lock.lock();
+
+		for(auto i=todo.begin(); i!=todo.end(); ++i) {
+			stats.prefetches++;
+			stats.bytesPrefetched += i->right - i->left;
+		}
+	}
+}
+
+/* called for every view move, must be quick: it's on the UI thread */
+void FileSource::viewChanged(uint64_t left, uint64_t right)
+{
+	double now = now_seconds();
+	int64_t delta = left - lastViewLeft;
+	uint64_t span = std::max(right - left, (uint64_t)0x1000);
+	uint64_t dist;
+	int fwd = 0, back = 0, jumps = 0, dir;
+
+	if(!map || right <= left)
+		return;
+
+	/* was the view already in memory? */
+	{
+		uint64_t pl = left & ~(uint64_t)0xFFF;
+		uint64_t pr = std::min((right + 0xFFF) & ~(uint64_t)0xFFF, size);
+		unsigned char vec[64];
+		if(pr > pl && (pr - pl) / 0x1000 <= sizeof(vec) &&
+		  mincore(map + pl, pr - pl, vec) == 0) {
+			for(uint64_t i=0; i<(pr - pl + 0xFFF) / 0x1000; ++i) {
+				if(!(vec[i] & 1)) {
+					stats.coldViews++;
+					break;
+				}
+			}
+		}
+	}
+
+	if(delta == 0)
+		return;
+
+	/* classify the move: a step is a few views at most, anything more is a
+		jump (goto, tag click, home/end) */
+	uint64_t mag = delta > 0 ? delta : -delta;
+	dir = (mag <= 4*span) ? (delta > 0 ? 1 : -1) : 0;
+	history[historyIdx] = dir;
+	historyIdx = (historyIdx + 1) % FILE_HISTORY;
+
+	double dt = now - lastViewTime;
+	if(dir && dt > 0 && dt < 1)
+		velocity = 0.7*velocity + 0.3*(mag / dt);
+	else
+		velocity = 0;
+
+	lastViewLeft = left;
+	lastViewTime = now;
+
+	/* sustained stepping one way: let kernel readahead go wide, lots of
+		jumping: stop it from reading around every fault */
+	for(int i=0; i<FILE_HISTORY; ++i) {
+		if(history[i] > 0) fwd++;
+		else if(history[i] < 0) back++;
+		else jumps++;
+	}
+
+	if(fwd >= FILE_HISTORY-2 || back >= FILE_HISTORY-2)
+		adviseFor(MADV_SEQUENTIAL);
+	else if(jumps >= FILE_HISTORY/2)
+		adviseFor(MADV_RANDOM);
+	else
+		adviseFor(MADV_NORMAL);
+
+	/* how far ahead to have read, re-issued once we're halfway through what
+		was advised last time (kernel readahead doesn't help going
+		backwards, this does) */
+	dist = velocity * FILE_PREFETCH_SECONDS;
+	dist = std::max(dist, (uint64_t)FILE_PREFETCH_MIN);
+	dist = std::min(dist, (uint64_t)FILE_PREFETCH_MAX);
+
+	if(dir >= 0) {
+		if(left < aheadLeft || right + dist/2 > aheadRight) {
+			aheadLeft = left;
+			aheadRight = std::min(right + dist, size);
+			prefetch(right, aheadRight);
+		}
+	}
+	else {
+		if(right > aheadRight || left < aheadLeft + dist/2) {
+			aheadLeft = (left > dist) ? left - dist : 0;
+			aheadRight = right;
+			prefetch(aheadLeft, left);
+		}
+	}
+}
+
+void FileSource::getStats(file_stats &result)
+{
+	lock_guard<mutex> lock(mtx);
+	result = stats;
+	result.majorFaults = major_faults() - majfltAtOpen;
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -DTEST1 FileSource.cxx ByteSource.cxx -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	FileSource src;
+	vector<file_extent> holes;
+	uint64_t addr;
+	uint8_t buf[32];
+	char path[] = "/tmp/filesource_XXXXXX";
+	int fd = mkstemp(path);
+
+	/* 1GB file with data only at 0, 512MB and the very end */
+	if(fd < 0 || ftruncate(fd, 0x40000000) ||
+	  pwrite(fd, "head", 4, 0) != 4 ||
+	  pwrite(fd, "middle", 6, 0x20000000) != 6 ||
+	  pwrite(fd, "tail", 4, 0x40000000-4) != 4) {
+		printf("ERROR: creating sparse test file\n");
+		goto cleanup;
+	}
+
+	if(src.open(path)) {
+		printf("ERROR: open()\n");
+		goto cleanup;
+	}
+
+	for(auto i=src.getExtents().begin(); i!=src.getExtents().end(); ++i)
+		printf("data [0x%llX,0x%llX)\n", (unsigned long long)i->left,
+			(unsigned long long)i->right);
+
+	src.getHoles(holes, 0x10000);
+	for(auto i=holes.begin(); i!=holes.end(); ++i)
+		printf("hole [0x%llX,0x%llX)\n", (unsigned long long)i->left,
+			(unsigned long long)i->right);
+
+	if(src.getExtents().size() != 3 || holes.size() != 2) {
+		printf("ERROR: expected 3 extents, 2 holes (filesystem not sparse?)\n");
+		goto cleanup;
+	}
+
+	memset(buf, 0xFF, sizeof(buf));
+	if(src.read(0x10000000, buf, 16) != 16 || buf[0] || buf[15]) {
+		printf("ERROR: hole should read as zeros\n");
+		goto cleanup;
+	}
+
+	if(!src.nextData(0x1000000, &addr) || addr != src.getExtents()[1].left) {
+		printf("ERROR: nextData()\n");
+		goto cleanup;
+	}
+	if(src.read(0x20000000, buf, 6) != 6 || memcmp(buf, "middle", 6)) {
+		printf("ERROR: reading middle\n");
+		goto cleanup;
+	}
+	if(!src.prevData(0x30000000, &addr) || addr != src.getExtents()[1].right) {
+		printf("ERROR: prevData()\n");
+		goto cleanup;
+	}
+	if(!src.nextHole(0x20000003, &addr) || addr != src.getExtents()[1].right) {
+		printf("ERROR: nextHole()\n");
+		goto cleanup;
+	}
+	if(!src.prevHole(0x20000003, &addr) || addr != src.getExtents()[1].left) {
+		printf("ERROR: prevHole()\n");
+		goto cleanup;
+	}
+	if(src.nextData(src.getExtents()[2].right, &addr)) {
+		printf("ERROR: nextData() past the end\n");
+		goto cleanup;
+	}
+
+	/* a steady scroll forward turns sequential and reads ahead */
+	for(int i=0; i<16; ++i)
+		src.viewChanged(0x20000000 + i*0x400, 0x20000000 + (i+1)*0x400);
+	{
+		file_stats st;
+		usleep(100000);
+		src.getStats(st);
+		printf("advice: %s, prefetches: %lld (0x%llX bytes)\n",
+			file_advice_tostr(st.advice), (long long)st.prefetches,
+			(unsigned long long)st.bytesPrefetched);
+		if(st.advice != MADV_SEQUENTIAL || st.prefetches == 0) {
+			printf("ERROR: expected sequential advice and a prefetch\n");
+			goto cleanup;
+		}
+	}
+
+	printf("PASS\n");
+	rc = 0;
+	cleanup:
+	if(fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+	return rc;
+}
+#endif
@@ -0,0 +1,106 @@
+/* bytes from a file, mapped (not copied)
+
+	sparse files (disk and VM images) are split into data extents with
+	lseek(SEEK_DATA/SEEK_HOLE), or a zero-block scan where the filesystem
+	can't say, and reads from the holes are answered with zeros without
+	touching the mapping
+
+	view changes drive a prefetcher: the scroll direction and speed decide
+	how far ahead to madvise(MADV_WILLNEED) (done on a worker thread, it can
+	block on slow storage) and whether the kernel should be told the access
+	is sequential or random */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+using namespace std;
+
+#include "ByteSource.h"
+
+#define FILE_SCAN_BLOCK 0x10000 /* granularity of the zero-block fallback */
+
+#define FILE_PREFETCH_MIN 0x200000 /* always have this much read ahead */
+#define FILE_PREFETCH_MAX 0x4000000 /* never more than this */
+#define FILE_PREFETCH_SECONDS 0.5 /* otherwise, this long at current speed */
+#define FILE_STALL_MS 16 /* reads slower than this are a visible hitch */
+#define FILE_HISTORY 8 /* view moves remembered for choosing advice */
+
+struct file_extent {
+	uint64_t left, right; // [,)
+};
+
+struct file_stats {
+	uint64_t prefetches; /* madvise(MADV_WILLNEED) calls */
+	uint64_t bytesPrefetched;
+	uint64_t coldViews; /* views not resident when they were shown */
+	uint64_t majorFaults; /* since open, from getrusage() */
+	uint64_t stalls; /* reads that took longer than FILE_STALL_MS */
+	double worstStall; /* milliseconds */
+	int advice; /* MADV_NORMAL, MADV_SEQUENTIAL or MADV_RANDOM */
+};
+
+class FileSource : public ByteSource
+{
+	int fd = -1;
+	uint8_t *map = NULL;
+	uint64_t size = 0;
+
+	vector<file_extent> extents; /* data, sorted, holes are what's between */
+	int extentHint = 0; /* last extent hit, so sequential lookups are O(1) */
+
+	int findExtent(uint64_t addr);
+	int searchExtent(uint64_t addr);
+	int extentsFromSeek(void);
+	int extentsFromScan(void);
+
+	/* access pattern */
+	uint64_t lastViewLeft = 0;
+	double lastViewTime = 0;
+	double velocity = 0; /* bytes/second, smoothed */
+	int history[FILE_HISTORY] = {0}; /* +1/-1 steps, 0 for jumps */
+	int historyIdx = 0;
+	uint64_t aheadLeft = 0, aheadRight = 0; /* already advised */
+	long majfltAtOpen = 0;
+	file_stats stats = {0};
+
+	void adviseFor(int advice);
+
+	/* prefetch worker */
+	thread worker;
+	mutex mtx;
+	condition_variable cv;
+	bool workerQuit = false;
+	bool pending = false;
+	uint64_t pendLeft = 0, pendRight = 0;
+
+	void prefetch(uint64_t left, uint64_t right);
+	void workerLoop(void);
+
+	public:
+	~FileSource();
+
+	int open(const char *path);
+
+	uint8_t *getData(void) { return map; }
+	uint64_t getSize(void) { return size; }
+	vector<file_extent> &getExtents(void) { return extents; }
+	void getHoles(vector<file_extent> &result, uint64_t minSize);
+
+	uint64_t addrStart(void);
+	uint64_t addrEnd(void);
+	int read(uint64_t addr, uint8_t *buf, int len);
+	bool nextData(uint64_t addr, uint64_t *result);
+	bool prevData(uint64_t addr, uint64_t *result);
+	bool nextHole(uint64_t addr, uint64_t *result);
+	bool prevHole(uint64_t addr, uint64_t *result);
+	void viewChanged(uint64_t left, uint64_t right);
+
+	void getStats(file_stats &result);
+};
+
+const char *file_advice_tostr(int advice);
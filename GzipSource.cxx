@@ -0,0 +1,641 @@
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* OS */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* c++ includes */
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include <zlib.h>
+
+/* local stuff */
+#include "GzipSource.h"
+
+//#define GZIP_SOURCE_DEBUG 1
+
+#define GZ_INDEX_MAGIC "HLGZIDX1"
+
+struct gz_index_header {
+	char magic[8];
+	uint64_t compSize; /* of the .gz, to notice it changed */
+	uint64_t mtime;
+	uint64_t totalOut;
+	uint32_t span;
+	uint32_t count;
+};
+
+/*****************************************************************************/
+/* compare functions */
+/*****************************************************************************/
+
+bool comparePointByOut(const gz_point &a, uint64_t out)
+{
+	return a.out < out;
+}
+
+/*****************************************************************************/
+/* index building */
+/*****************************************************************************/
+
+/* record a checkpoint, window is the circular output buffer whose oldest
+	byte is at window + (GZ_WINDOW - left) */
+static void
+add_point(vector<gz_point> &points, int bits, uint64_t in, uint64_t out,
+	unsigned left, const uint8_t *window)
+{
+	gz_point p;
+	uint8_t flat[GZ_WINDOW];
+
+	p.out = out;
+	p.in = in;
+	p.bits = bits;
+
+	if(bits >= 0) {
+		if(left) memcpy(flat, window + GZ_WINDOW - left, left);
+		if(left < GZ_WINDOW) memcpy(flat + left, window, GZ_WINDOW - left);
+
+		uLongf clen = compressBound(GZ_WINDOW);
+		p.window.resize(clen);
+		compress2(&p.window[0], &clen, flat, GZ_WINDOW, 1);
+		p.window.resize(clen);
+	}
+
+	points.push_back(p);
+}
+
+/* inflate everything once, noting checkpoints at deflate block boundaries
+	every GZ_SPAN bytes of output and at the start of every gzip member */
+int GzipSource::buildIndex(gz_progress_cb cb, void *ctx)
+{
+	int rc = -1, ret = Z_OK;
+	z_stream zs;
+	uint8_t *input = NULL, *window = NULL;
+	uint64_t totin = 0, totout = 0, last = 0, pos = 0;
+	bool zsInit = false;
+
+	points.clear();
+
+	input = (uint8_t *)malloc(GZ_CHUNK);
+	window = (uint8_t *)calloc(GZ_WINDOW, 1);
+	if(!input || !window) {
+		printf("ERROR: malloc()\n");
+		goto cleanup;
+	}
+
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, 47) != Z_OK) { /* 32+15: gzip or zlib header */
+		printf("ERROR: inflateInit2()\n");
+		goto cleanup;
+	}
+	zsInit = true;
+
+	add_point(points, -1, 0, 0, 0, NULL);
+
+	zs.avail_out = 0;
+	while(1) {
+		/* more input */
+		if(zs.avail_in == 0) {
+			ssize_t n = pread(fd, input, GZ_CHUNK, pos);
+			if(n < 0) {
+				printf("ERROR: pread()\n");
+				goto cleanup;
+			}
+			if(n == 0) {
+				printf("ERROR: compressed data ends early\n");
+				goto cleanup;
+			}
+			pos += n;
+			zs.next_in = input;
+			zs.avail_in = n;
+
+			if(cb) cb(pos, compSize, ctx);
+		}
+
+		if(zs.avail_out == 0) {
+			zs.avail_out = GZ_WINDOW;
+			zs.next_out = window;
+		}
+
+		totin += zs.avail_in;
+		totout += zs.avail_out;
+		ret = inflate(&zs, Z_BLOCK);
+		totin -= zs.avail_in;
+		totout -= zs.avail_out;
+
+		if(ret == Z_NEED_DICT || ret == Z_MEM_ERROR || ret == Z_DATA_ERROR) {
+			printf("ERROR: inflate() returned %d at 0x%llX\n", ret,
+				(unsigned long long)totin);
+			goto cleanup;
+		}
+
+		if(ret == Z_STREAM_END) {
+			/* another gzip member after this one? anything else (eg: zero
+				padding) ends the data */
+			uint8_t magic[2];
+			if(zs.avail_in >= 2) {
+				memcpy(magic, zs.next_in, 2);
+			}
+			else if(pread(fd, magic, 2, totin) != 2) {
+				break;
+			}
+			if(magic[0] != 0x1F || magic[1] != 0x8B)
+				break;
+
+			add_point(points, -1, totin, totout, 0, NULL);
+			last = totout;
+			inflateReset(&zs);
+			continue;
+		}
+
+		/* end of a deflate block (but not the last one)? */
+		if((zs.data_type & 128) && !(zs.data_type & 64) &&
+		  totout - last > GZ_SPAN) {
+			add_point(points, zs.data_type & 7, totin, totout, zs.avail_out,
+				window);
+			last = totout;
+		}
+	}
+
+	totalOut = totout;
+
+	#ifdef GZIP_SOURCE_DEBUG
+	printf("%s(): 0x%llX -> 0x%llX bytes, %ld checkpoints\n", __func__,
+		(unsigned long long)totin, (unsigned long long)totout, points.size());
+	#endif
+
+	rc = 0;
+	cleanup:
+	if(zsInit) inflateEnd(&zs);
+	if(input) free(input);
+	if(window) free(window);
+	return rc;
+}
+
+int GzipSource::saveIndex(const char *path)
+{
+	int rc = -1;
+	FILE *fp = NULL;
+	gz_index_header hdr;
+
+	fp = fopen(path, "wb");
+	if(!fp) {
+		printf("ERROR: fopen(\"%s\") (index won't be saved)\n", path);
+		goto cleanup;
+	}
+
+	memcpy(hdr.magic, GZ_INDEX_MAGIC, 8);
+	hdr.compSize = compSize;
+	hdr.mtime = mtime;
+	hdr.totalOut = totalOut;
+	hdr.span = GZ_SPAN;
+	hdr.count = points.size();
+	if(fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto cleanup;
+
+	for(auto i=points.begin(); i!=points.end(); ++i) {
+		uint64_t out = i->out, in = i->in;
+		int32_t bits = i->bits;
+		uint32_t wlen = i->window.size();
+
+		if(fwrite(&out, 8, 1, fp) != 1 || fwrite(&in, 8, 1, fp) != 1 ||
+		  fwrite(&bits, 4, 1, fp) != 1 || fwrite(&wlen, 4, 1, fp) != 1)
+			goto cleanup;
+		if(wlen && fwrite(&i->window[0], wlen, 1, fp) != 1)
+			goto cleanup;
+	}
+
+	rc = 0;
+	cleanup:
+	if(fp) {
+		fclose(fp);
+		if(rc) unlink(path);
+	}
+	return rc;
+}
+
+/* load a saved index, if there is one and it matches the file */
+int GzipSource::loadIndex(const char *path)
+{
+	int rc = -1;
+	FILE *fp = NULL;
+	gz_index_header hdr;
+
+	points.clear();
+
+	fp = fopen(path, "rb");
+	if(!fp)
+		goto cleanup;
+
+	if(fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	  memcmp(hdr.magic, GZ_INDEX_MAGIC, 8) || hdr.compSize != compSize ||
+	  hdr.mtime != mtime || hdr.span != GZ_SPAN || hdr.count == 0) {
+		printf("index %s is stale, rebuilding\n", path);
+		goto cleanup;
+	}
+
+	for(uint32_t i=0; i<hdr.count; ++i) {
+		gz_point p;
+		uint64_t out, in;
+		int32_t bits;
+		uint32_t wlen;
+
+		if(fread(&out, 8, 1, fp) != 1 || fread(&in, 8, 1, fp) != 1 ||
+		  fread(&bits, 4, 1, fp) != 1 || fread(&wlen, 4, 1, fp) != 1 ||
+		  wlen > compressBound(GZ_WINDOW)) {
+			printf("ERROR: index %s is truncated\n", path);
+			goto cleanup;
+		}
+
+		p.out = out;
+		p.in = in;
+		p.bits = bits;
+		p.window.resize(wlen);
+		if(wlen && fread(&p.window[0], wlen, 1, fp) != 1) {
+			printf("ERROR: index %s is truncated\n", path);
+			goto cleanup;
+		}
+
+		points.push_back(p);
+	}
+
+	totalOut = hdr.totalOut;
+
+	rc = 0;
+	cleanup:
+	if(fp) fclose(fp);
+	if(rc) points.clear();
+	return rc;
+}
+
+/*****************************************************************************/
+/* gzip source */
+/*****************************************************************************/
+
+GzipSource::~GzipSource()
+{
+	for(auto i=cache.begin(); i!=cache.end(); ++i)
+		delete i->second;
+
+	if(live) inflateEnd(&strm);
+	if(fd >= 0) close(fd);
+}
+
+/* gzip magic, or a zlib header on a file named like one */
+bool GzipSource::sniff(const char *path)
+{
+	uint8_t hdr[2];
+	bool result = false;
+	FILE *fp = fopen(path, "rb");
+
+	if(!fp)
+		return false;
+
+	if(fread(hdr, 1, 2, fp) == 2) {
+		if(hdr[0] == 0x1F && hdr[1] == 0x8B) {
+			result = true;
+		}
+		else if((hdr[0] & 0xF) == 8 && ((hdr[0] << 8) | hdr[1]) % 31 == 0) {
+			int len = strlen(path);
+			result = (len > 5 && !strcmp(path + len - 5, ".zlib")) ||
+				(len > 3 && !strcmp(path + len - 3, ".zz"));
+		}
+	}
+
+	fclose(fp);
+	return result;
+}
+
+int GzipSource::open(const char *path, gz_progress_cb cb, void *ctx)
+{
+	int rc = -1;
+	struct stat sb;
+	string idxPath = string(path) + GZ_INDEX_EXT;
+
+	fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		printf("ERROR: open(\"%s\")\n", path);
+		goto cleanup;
+	}
+
+	if(fstat(fd, &sb)) {
+		printf("ERROR: fstat()\n");
+		goto cleanup;
+	}
+	compSize = sb.st_size;
+	mtime = sb.st_mtime;
+
+	if(loadIndex(idxPath.c_str())) {
+		if(buildIndex(cb, ctx))
+			goto cleanup;
+		saveIndex(idxPath.c_str());
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+uint64_t GzipSource::addrStart(void)
+{
+	return 0;
+}
+
+uint64_t GzipSource::addrEnd(void)
+{
+	return totalOut;
+}
+
+/*****************************************************************************/
+/* decompression */
+/*****************************************************************************/
+
+/* point the live stream at a checkpoint */
+int GzipSource::restart(int i)
+{
+	int rc = -1;
+	gz_point &p = points[i];
+
+	if(live) inflateEnd(&strm);
+	live = false;
+
+	nRestarts++;
+
+	memset(&strm, 0, sizeof(strm));
+
+	if(p.bits < 0) {
+		/* member start, inflate reads the header itself */
+		if(inflateInit2(&strm, 47) != Z_OK)
+			goto cleanup;
+		live = true;
+		liveIn = p.in;
+	}
+	else {
+		/* mid-stream: raw deflate, primed with the leftover bits and the
+			window it may refer back into */
+		uint8_t window[GZ_WINDOW];
+		uLongf wlen = GZ_WINDOW;
+
+		if(inflateInit2(&strm, -15) != Z_OK)
+			goto cleanup;
+		live = true;
+		liveIn = p.in;
+
+		if(p.bits) {
+			uint8_t c;
+			if(pread(fd, &c, 1, p.in - 1) != 1)
+				goto cleanup;
+			inflatePrime(&strm, p.bits, c >> (8 - p.bits));
+		}
+
+		if(uncompress(window, &wlen, &p.window[0], p.window.size()) != Z_OK ||
+		  wlen != GZ_WINDOW) {
+			printf("ERROR: checkpoint %d window is corrupt\n", i);
+			goto cleanup;
+		}
+		inflateSetDictionary(&strm, window, GZ_WINDOW);
+	}
+
+	strm.avail_in = 0;
+	liveOut = p.out;
+
+	rc = 0;
+	cleanup:
+	if(rc && live) {
+		inflateEnd(&strm);
+		live = false;
+	}
+	return rc;
+}
+
+/* inflate len bytes from the live stream (fewer at the end), continuing
+	into the next gzip member if need be, returns -1 on error */
+int GzipSource::inflateSome(uint8_t *dst, int len)
+{
+	int produced = 0;
+
+	while(produced < len) {
+		if(strm.avail_in == 0) {
+			ssize_t n = pread(fd, inbuf, GZ_CHUNK, liveIn);
+			if(n <= 0)
+				break;
+			liveIn += n;
+			strm.next_in = inbuf;
+			strm.avail_in = n;
+		}
+
+		strm.next_out = dst + produced;
+		strm.avail_out = len - produced;
+		int ret = inflate(&strm, Z_NO_FLUSH);
+		int n = (len - produced) - strm.avail_out;
+		produced += n;
+		liveOut += n;
+
+		if(ret == Z_STREAM_END) {
+			/* next member (all have checkpoints), or the end */
+			auto i = std::lower_bound(points.begin(), points.end(), liveOut,
+				comparePointByOut);
+			while(i != points.end() && i->out == liveOut && i->bits >= 0)
+				++i;
+			if(i == points.end() || i->out != liveOut)
+				break;
+			if(restart(i - points.begin()))
+				return -1;
+			continue;
+		}
+
+		if(ret != Z_OK && ret != Z_BUF_ERROR) {
+			printf("ERROR: inflate() returned %d\n", ret);
+			inflateEnd(&strm);
+			live = false;
+			return -1;
+		}
+	}
+
+	return produced;
+}
+
+GzipSource::cache_page *GzipSource::newPage(uint64_t page)
+{
+	cache_page *cp;
+
+	if(cache.size() >= GZ_CACHE_PAGES) {
+		auto victim = cache.begin();
+		for(auto j=cache.begin(); j!=cache.end(); ++j)
+			if(j->second->lastUse < victim->second->lastUse)
+				victim = j;
+		cp = victim->second;
+		cache.erase(victim);
+	}
+	else {
+		cp = new cache_page;
+	}
+
+	cp->lastUse = ++useClock;
+	cp->len = 0;
+	cache[page] = cp;
+	return cp;
+}
+
+GzipSource::cache_page *GzipSource::getPage(uint64_t page)
+{
+	uint64_t target = page * GZ_PAGE;
+	uint8_t scratch[GZ_PAGE];
+
+	auto i = cache.find(page);
+	if(i != cache.end()) {
+		nHits++;
+		i->second->lastUse = ++useClock;
+		return i->second;
+	}
+
+	nMisses++;
+
+	/* continue the live stream if it's between the best checkpoint and the
+		target, otherwise restart at that checkpoint */
+	auto p = std::lower_bound(points.begin(), points.end(), target + 1,
+		comparePointByOut);
+	int best = (p - points.begin()) - 1;
+
+	if(!live || liveOut > target || liveOut < points[best].out) {
+		if(restart(best))
+			return NULL;
+	}
+
+	/* skip up to a page boundary */
+	if(liveOut % GZ_PAGE) {
+		int n = std::min(GZ_PAGE - liveOut % GZ_PAGE, target - liveOut);
+		if(inflateSome(scratch, n) != n)
+			return NULL;
+	}
+
+	/* whole pages on the way are cached too, for scrolling back */
+	while(liveOut <= target) {
+		uint64_t pg = liveOut / GZ_PAGE;
+		bool have = cache.find(pg) != cache.end();
+		cache_page *cp = have ? NULL : newPage(pg);
+		int n = inflateSome(cp ? cp->data : scratch, GZ_PAGE);
+
+		if(n <= 0) {
+			if(cp) { cache.erase(pg); delete cp; }
+			return NULL;
+		}
+		if(cp) cp->len = n;
+
+		if(pg == page)
+			return cp ? cp : cache[pg];
+	}
+
+	return NULL;
+}
+
+int GzipSource::read(uint64_t addr, uint8_t *buf, int len)
+{
+	int done = 0;
+
+	while(done < len && addr < totalOut) {
+		cache_page *cp = getPage(addr / GZ_PAGE);
+		if(!cp)
+			break;
+
+		int offs = addr % GZ_PAGE;
+		if(offs >= cp->len)
+			break;
+
+		int n = std::min(len - done, cp->len - offs);
+		memcpy(buf + done, cp->data + offs, n);
+		done += n;
+		addr += n;
+	}
+
+	return done;
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -DTEST1 GzipSource.cxx ByteSource.cxx -lz -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	const char *path = "/tmp/gzipsource_test.gz";
+	string idxPath = string(path) + GZ_INDEX_EXT;
+	uint64_t size = 0x1400000; /* 20MB per member, two members */
+	vector<uint8_t> plain(2*size);
+	uint8_t buf[0x3000];
+	uint32_t x = 1;
+
+	/* compressible, but not trivially */
+	for(uint64_t i=0; i<plain.size(); ++i) {
+		x = x * 1103515245 + 12345;
+		plain[i] = "abcdefgh"[(x >> 16) & 7] + ((i >> 12) & 1);
+	}
+
+	for(int m=0; m<2; ++m) {
+		gzFile gz = gzopen(path, m ? "ab" : "wb");
+		if(!gz || gzwrite(gz, &plain[m*size], size) != size) {
+			printf("ERROR: writing test file\n");
+			goto cleanup;
+		}
+		gzclose(gz);
+	}
+	unlink(idxPath.c_str());
+
+	for(int pass=0; pass<2; ++pass) {
+		GzipSource src;
+
+		if(!GzipSource::sniff(path) || src.open(path)) {
+			printf("ERROR: open() pass %d\n", pass);
+			goto cleanup;
+		}
+
+		printf("pass %d: %d checkpoints, 0x%llX bytes\n", pass,
+			src.getPointCount(), (unsigned long long)src.addrEnd());
+		if(src.addrEnd() != plain.size()) {
+			printf("ERROR: wrong size\n");
+			goto cleanup;
+		}
+
+		/* random reads, some straddling pages and the member boundary */
+		uint64_t offsets[] = { 0x123456, 0x10, size - 0x1000, 0x1300000,
+			plain.size() - 0x3000, 0x800000 - 7, size + 0x1000 };
+		for(int i=0; i<sizeof(offsets)/sizeof(offsets[0]); ++i) {
+			if(src.read(offsets[i], buf, sizeof(buf)) != sizeof(buf) ||
+			  memcmp(buf, &plain[offsets[i]], sizeof(buf))) {
+				printf("ERROR: mismatch at 0x%llX\n",
+					(unsigned long long)offsets[i]);
+				goto cleanup;
+			}
+		}
+
+		/* sequential scrolling shouldn't restart */
+		uint64_t restarts = src.nRestarts;
+		for(uint64_t a=0x200000; a<0x300000; a+=0x400)
+			src.read(a, buf, 0x400);
+		printf("restarts while scrolling: %lld\n",
+			(long long)(src.nRestarts - restarts));
+		if(src.nRestarts - restarts > 1) {
+			printf("ERROR: too many restarts\n");
+			goto cleanup;
+		}
+	}
+
+	printf("PASS\n");
+	rc = 0;
+	cleanup:
+	unlink(path);
+	unlink(idxPath.c_str());
+	return rc;
+}
+#endif
@@ -0,0 +1,87 @@
+/* bytes from a gzip (or zlib) compressed file, without decompressing all of it
+
+	the first open inflates the whole thing once, saving a checkpoint (the
+	bit position in the input plus the 32K of output before it) every
+	GZ_SPAN bytes of output, same idea as zlib's examples/zran.c
+
+	after that a page is served by starting inflate at the nearest checkpoint
+	before it, decompressed pages are kept in an LRU cache, and the stream is
+	kept live so scrolling forward doesn't restart
+
+	the checkpoints are saved to <file>.hlidx so the next open skips the
+	full inflate */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+using namespace std;
+
+#include <zlib.h>
+
+#include "ByteSource.h"
+
+#define GZ_SPAN 0x400000 /* checkpoint every 4MB of output */
+#define GZ_WINDOW 0x8000 /* deflate's 32K history */
+#define GZ_CHUNK 0x10000 /* compressed input read size */
+#define GZ_PAGE 0x10000 /* cache granularity */
+#define GZ_CACHE_PAGES 256 /* 16MB of decompressed pages */
+#define GZ_INDEX_EXT ".hlidx"
+
+typedef void (*gz_progress_cb)(uint64_t done, uint64_t total, void *ctx);
+
+struct gz_point {
+	uint64_t out; /* uncompressed offset */
+	uint64_t in; /* compressed offset of the first full byte */
+	int bits; /* bits from the byte before in, or -1 at a member start */
+	vector<uint8_t> window; /* the 32K before out, itself compressed */
+};
+
+class GzipSource : public ByteSource
+{
+	struct cache_page {
+		uint64_t lastUse;
+		int len;
+		uint8_t data[GZ_PAGE];
+	};
+
+	int fd = -1;
+	uint64_t compSize = 0, mtime = 0;
+	uint64_t totalOut = 0;
+	vector<gz_point> points; /* sorted by out */
+
+	map<uint64_t, cache_page *> cache; /* page number -> page */
+	uint64_t useClock = 0;
+
+	/* the live stream, positioned at liveOut */
+	z_stream strm;
+	bool live = false;
+	uint64_t liveOut = 0, liveIn = 0;
+	uint8_t inbuf[GZ_CHUNK];
+
+	int buildIndex(gz_progress_cb cb, void *ctx);
+	int loadIndex(const char *path);
+	int saveIndex(const char *path);
+
+	int restart(int point);
+	int inflateSome(uint8_t *dst, int len);
+	cache_page *getPage(uint64_t page);
+	cache_page *newPage(uint64_t page);
+
+	public:
+	~GzipSource();
+
+	static bool sniff(const char *path);
+	int open(const char *path, gz_progress_cb cb=NULL, void *ctx=NULL);
+
+	int getPointCount(void) { return points.size(); }
+
+	uint64_t addrStart(void);
+	uint64_t addrEnd(void);
+	int read(uint64_t addr, uint8_t *buf, int len);
+
+	/* stats */
+	uint64_t nHits = 0, nMisses = 0, nRestarts = 0;
+};
@@ -70,6 +70,8 @@ HexView::HexView(int x_, int y_, int w, int h, const char *label):
 	/* initial color, selection */
 	//selActive = 0;
 	cursorOffs = 0;
+	addrStart = addrEnd = 0;
+	addrViewStart = addrViewEnd = 0;
 }
 
 /*****************************************************************************/
@@ -85,25 +87,38 @@ void HexView::clrCallback(void)
 	callback = NULL;
 }
 
-void HexView::setBytes(uint64_t addr, unsigned char *data, int len)
+/* copy of the given bytes, for small stuff like assembler output */
+void HexView::setBytes(uint64_t addr, unsigned char *data, uint64_t len)
 {
-	//printf("setBytes(addr=%016llX, data=<ptr>, len=0x%X)\n", addr, len);
+	//printf("setBytes(addr=%016llX, data=<ptr>, len=0x%llX)\n", addr, len);
 	//dump_bytes(data, len, (uintptr_t)0);
 
+	setSource(new MemSource(addr, data, len), true);
+}
+
+/* view an arbitrary source, if own then it's deleted when replaced */
+void HexView::setSource(ByteSource *src, bool own)
+{
 	/* maybe clear highlight data? */
 
 	/* clear the selection */
 	selEditing = selActive = 0;
 	addrSelStart = addrSelEnd = 0;
 
-	addrStart = addr;
-	addrEnd = addr + len; // non-inclusive ')' endpoint
-	nBytes = len;
+	if(source && sourceOwned && source != src) delete source;
+	source = src;
+	sourceOwned = own;
+
+	addrStart = source->addrStart();
+	addrEnd = source->addrEnd(); // non-inclusive ')' endpoint
+	nBytes = addrEnd - addrStart;
 
-	bytes = (uint8_t *)malloc(len);
-	memcpy(bytes, data, len);
+	/* wide addresses if any of them need it */
+	addrMode = (addrEnd > 0x100000000ULL) ? 64 : 32;
+	addrWidth = (addrMode == 64) ? addrWidth64 : addrWidth32;
 
-	setView(addr);
+	cursorOffs = 0;
+	setView(addrStart);
 	
 	if(callback) callback(HV_CB_NEW_BYTES, 0);
 }
@@ -115,8 +130,8 @@ void HexView::clearBytes(void)
 	addrStart = addrEnd = 0;
 	addrViewStart = addrViewEnd = 0;
 
-	if(bytes) free(bytes);
-	bytes = NULL;
+	if(source && sourceOwned) delete source;
+	source = NULL;
 	nBytes = 0;
 	
 	setView(0);
@@ -126,7 +141,8 @@ void HexView::clearBytes(void)
 void HexView::setView(uint64_t addr)
 {
 	// filter address
-	if(addr > addrViewEnd) addr = addrViewEnd;
+	if(addr >= addrEnd && addrEnd > addrStart) addr = addrEnd - 1;
+	if(addr < addrStart) addr = addrStart;
 	if(addr % 16) addr -= (addr % 16);
 
 	// capacity info
@@ -141,15 +157,17 @@ void HexView::setView(uint64_t addr)
 		addrViewEnd = addr + bytesPerPage;
 
 	// amount of bytes, lines 
-	bytesInView = std::min(bytesPerPage, (int)(addrViewEnd - addrViewStart));
+	bytesInView = std::min((uint64_t)bytesPerPage, addrViewEnd - addrViewStart);
 	linesInView = (bytesInView + (bytesPerLine-1)) / bytesPerLine;
 
 	//
-	pageTotal = (nBytes + (bytesPerPage-1))/bytesPerPage;
+	pageTotal = nBytes/bytesPerPage + ((nBytes % bytesPerPage) ? 1 : 0);
 	uint64_t viewOffs = addrViewStart - addrStart;
 	pageCurrent = (viewOffs + (bytesPerPage-1))/bytesPerPage;
 	viewPercent = 100.0 * (((float)pageCurrent+1.0)/(float)pageTotal);
 
+	if(source) source->viewChanged(addrViewStart, addrViewEnd);
+
 	if(callback) callback(HV_CB_VIEW_MOVE, 0);
 
 	redraw();
@@ -160,6 +178,77 @@ void HexView::setView()
 	setView(addrViewStart);
 }
 
+/* view the start of the data after the next hole (sparse files, process
+	memory, etc.), with the cursor on its first byte */
+int HexView::jumpNextData(void)
+{
+	uint64_t addr = addrViewStart + cursorOffs, hole, data;
+
+	if(!source || !source->nextHole(addr, &hole) ||
+	  !source->nextData(hole, &data))
+		return -1;
+
+	setView(data);
+	cursorOffs = data - addrViewStart;
+	redraw();
+	return 0;
+}
+
+/* view the start of the data before the current (or previous) hole */
+int HexView::jumpPrevData(void)
+{
+	uint64_t addr = addrViewStart + cursorOffs, data, start;
+
+	if(!source)
+		return -1;
+
+	/* back out of the run we're in, if we're in one */
+	if(source->nextData(addr, &data) && data == addr) {
+		if(!source->prevHole(addr, &addr))
+			return -1;
+	}
+
+	/* end, then start, of the run before */
+	if(!source->prevData(addr, &data))
+		return -1;
+	if(!source->prevHole(data, &start))
+		start = addrStart;
+
+	setView(start);
+	cursorOffs = start - addrViewStart;
+	redraw();
+	return 0;
+}
+
+/* paging into a page that's all hole skips ahead (or back) to data, so big
+	holes collapse to the one page on either side of them */
+uint64_t HexView::collapseHoles(uint64_t addr, int direction)
+{
+	uint64_t data;
+
+	if(!source)
+		return addr;
+
+	/* any data on the page? */
+	if(source->nextData(addr, &data) && data < addr + bytesPerPage)
+		return addr;
+
+	if(direction > 0) {
+		if(source->nextData(addr, &data))
+			addr = data - (data % bytesPerLine);
+	}
+	else {
+		/* last line of the previous data at the bottom of the page */
+		if(source->prevData(addr, &data)) {
+			addr = (data - 1) - ((data - 1) % bytesPerLine);
+			addr = (addr >= addrStart + bytesPerPage - bytesPerLine) ?
+				addr - (bytesPerPage - bytesPerLine) : addrStart;
+		}
+	}
+
+	return addr;
+}
+
 void HexView::setSelection(uint64_t start, uint64_t end)
 {
 	if(start < addrEnd || end < addrEnd || end >= start) {
@@ -278,9 +367,23 @@ void HexView::draw(void)
 	/* draw the bytes */
 	#define TO_RGB_COLOR(p) fl_rgb_color(((p)&0xFF0000)>>16, ((p)&0xFF00)>>8, (p&0xFF))
 	#define SET_PACKED_COLOR(p) fl_color((p)<<8)
-	uint8_t *b = bytes + (addrViewStart - addrStart);
-	for(uint64_t addr=addrViewStart; addr<addrViewEnd; ++addr, ++b) {
+	/* fetch what's visible, noting what couldn't be read */
+	vector<uint8_t> viewBytes(addrViewEnd - addrViewStart);
+	vector<bool> viewReadable(addrViewEnd - addrViewStart, false);
+	for(uint64_t addr=addrViewStart; source && addr<addrViewEnd; ) {
+		int offs = addr - addrViewStart;
+		int n = source->read(addr, &viewBytes[offs], addrViewEnd - addr);
+		if(n <= 0) { addr++; continue; }
+		std::fill(viewReadable.begin()+offs, viewReadable.begin()+offs+n, true);
+		addr += n;
+	}
+
+	IntervalMgr hlVisible;
+	hlRanges.searchRange(addrViewStart, addrViewEnd, hlVisible);
+	for(uint64_t addr=addrViewStart; addr<addrViewEnd; ++addr) {
 		uint32_t color = 0xFFFFFF;
+		int offs = addr - addrViewStart;
+		uint8_t b = viewBytes[offs];
 		Interval ival(0,0);
 
 		/* 
@@ -290,7 +393,7 @@ void HexView::draw(void)
 		viewAddrToAsciiXY(addr, &x2, &y2);
 
 		/* highlighter? */
-		if(hlRanges.search(addr, ival)) {
+		if(hlVisible.search(addr, ival)) {
 			// sort by size
 			color = ival.data_u32; 
 			//printf("search hit for addr 0x%llx, color is: %X\n", addr, color);
@@ -320,11 +423,19 @@ void HexView::draw(void)
 			color = 0xFFFFFF;
 			SET_PACKED_COLOR(color);
 		}
-		sprintf(buf, "%02X", b[0]);
+
+		/* unreadable (eg: unmapped in a process) */
+		if(!viewReadable[offs]) {
+			fl_color(FL_GRAY);
+			fl_draw("??", x1, y1+r2c_bias_y);
+			continue;
+		}
+
+		sprintf(buf, "%02X", b);
 		fl_draw(buf, x1, y1+r2c_bias_y);
 
 		if(showAscii) {
-			sprintf(buf, "%c", ((b[0])>=' ' && (b[0])<='~') ? (b[0]) : '.');
+			sprintf(buf, "%c", (b>=' ' && b<='~') ? b : '.');
 			fl_draw(buf, x2, y2+r2c_bias_y);
 		}
 	}
@@ -451,6 +562,11 @@ int HexView::handle(int event)
 				break;
 
 			case FL_Page_Up:
+				if(Fl::event_state(FL_CTRL)) {
+					if(jumpPrevData()) printf("no previous data\n");
+					rc = 1;
+				}
+				else
 				if(addrViewStart == addrStart) {
 					printf("at page 0\n");
 				}
@@ -461,11 +577,17 @@ int HexView::handle(int event)
 					else {
 						addrViewStart = addrStart;
 					}
+					addrViewStart = collapseHoles(addrViewStart, -1);
 					setView();
 				}
 				break;
 			
 			case FL_Page_Down:
+				if(Fl::event_state(FL_CTRL)) {
+					if(jumpNextData()) printf("no more data\n");
+					rc = 1;
+				}
+				else
 				if(addrViewStart + bytesPerPage >= addrEnd) {
 					printf("at last page\n");
 				}
@@ -479,6 +601,7 @@ int HexView::handle(int event)
 					else {
 						addrViewStart += bytesPerPage;
 					}
+					addrViewStart = collapseHoles(addrViewStart, 1);
 					setView();
 				}
 				break;
@@ -8,6 +8,7 @@ using namespace std;
 #include <FL/Fl_Widget.H>
 
 #include "IntervalMgr.h"
+#include "ByteSource.h"
 
 typedef void (*HexView_callback)(int type, void *data);
 
@@ -22,16 +23,20 @@ class HexView : public Fl_Widget {
     /* the entire memory buffer */
     int addrMode; // 32 or 64
     uint64_t addrStart, addrEnd;
-    uint8_t *bytes;
-    int nBytes;
+    ByteSource *source=NULL;
+    bool sourceOwned=false;
+    uint64_t nBytes=0;
    
     void setCallback(HexView_callback cb);
     void clrCallback(void);
 
-    void setBytes(uint64_t addr, uint8_t *bytes, int len);
+    void setBytes(uint64_t addr, uint8_t *bytes, uint64_t len);
+    void setSource(ByteSource *src, bool own=false);
     void setView(uint64_t addr);
     void setView();
     void setSelection(uint64_t start, uint64_t end);
+    int jumpNextData(void);
+    int jumpPrevData(void);
     void clearBytes(void);
 	void setShowAddress(bool);
 	void setShowAscii(bool);
@@ -44,10 +49,12 @@ class HexView : public Fl_Widget {
     int bytesPerPage;
     int linesInView;
     int bytesInView;
-    int pageTotal, pageCurrent;
+    uint64_t pageTotal, pageCurrent;
     float viewPercent;
     uint64_t addrViewStart, addrViewEnd; // [,)
 
+    uint64_t collapseHoles(uint64_t addr, int direction);
+
     int viewAddrToBytesXY(uint64_t addr, int *x, int *y);
     int viewAddrToAsciiXY(uint64_t addr, int *x, int *y);
     int viewAddrToAddressesXY(uint64_t addr, int *x, int *y);
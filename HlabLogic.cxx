@@ -1,19 +1,31 @@
 /* c stdlib includes */
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* OS */
 #include <sys/mman.h>
+#include <poll.h>
 
 /* c++ includes */
 #include <map>
 #include <string>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 #include "rsrc.h"
 #include "HlabGui.h"
 #include "tagging.h"
+#include "xrefs.h"
+#include "dupes.h"
+#include "ProcSource.h"
+#include "FileSource.h"
+#include "GzipSource.h"
+#include "AddrMap.h"
+#include "llvm_svcs.h"
+#include "cfg.h"
 
 /* fltk includes */
 #include <FL/Fl.H>
@@ -22,6 +34,8 @@ using namespace std;
 #include <FL/Fl_File_Chooser.H>
 #include <FL/Fl_Tree.H>
 #include <FL/Fl_Tree_Item.H>
+#include <FL/Fl_Hold_Browser.H>
+#include <FL/fl_ask.H>
 
 /* autils */
 extern "C" {
@@ -31,226 +45,1799 @@ extern "C" {
 
 /* forward dec's */
 void tree_cb(Fl_Tree *, void *);
-int tags_load_file(const char *target);
+void va_view_reset(void);
+bool view_addr(uint64_t offset, uint64_t *result);
+bool view_range(uint64_t left, uint64_t right, uint64_t *l, uint64_t *r);
+void va_status_suffix(char *msg, int size);
+int tags_load_file(const char *target, const uint8_t *data=NULL,
+	uint64_t len=0);
+void tags_show_tree(void);
+void tags_cancel(const char *why);
+void tags_clear(void);
+void proc_sample_timeout(void *);
+void proc_sample_stop(void);
 
 /* globals */
 HlabGui *gui = NULL;
 
-FILE *fileOpenFp = NULL;
-void *fileOpenPtrMap = NULL;
+/* what the hex view shows, owned here (the hex view only borrows them) */
+FileSource *fileSource = NULL; /* open file */
+GzipSource *gzipSource = NULL; /* open compressed file */
+ProcSource *procSource = NULL; /* attached process */
+VaSource *vaSource = NULL; /* the open file by virtual address */
+
+void *fileOpenPtrMap = NULL; /* open file's mapping, for whole-file analyses */
 size_t fileOpenSize = 0;
 
-IntervalMgr intervMgr; /* global to hold all intervals */
-map<Fl_Tree_Item *, Interval *> treeItemToInterv;
-Fl_Window *winTags = NULL;
-Fl_Tree *tree = NULL;
+bool procSampling = false;
+
+AddrMap addrMap; /* segments of the open file, if it has them */
+bool vaView = false; /* showing vaSource instead of fileSource */
+
+IntervalMgr intervMgr; /* global to hold all intervals */
+map<Fl_Tree_Item *, Interval *> treeItemToInterv;
+Fl_Window *winTags = NULL;
+Fl_Tree *tree = NULL;
+
+vector<xrefs_hit> xrefsIndex; /* pointer scan results, sorted by target */
+vector<xrefs_hit> xrefsShown; /* what's currently in the xrefs list */
+Fl_Window *winXrefs = NULL;
+Fl_Hold_Browser *xrefsList = NULL;
+
+vector<dupes_region> dupRegions; /* duplicate regions, linked by group */
+map<Fl_Tree_Item *, int> dupItemToGroup;
+map<Fl_Tree_Item *, int> dupItemToRegion;
+Fl_Window *winDupes = NULL;
+Fl_Tree *dupesTree = NULL;
+
+const char *initStr = "This_is_the_default_bytes_when_no_file_is_open._Here's_some_deadbeef:_\xDE\xAD\xBE\xEF";
+
+int file_unload(void)
+{
+	int rc = -1;
+
+	/* don't let the hex view draw from what's about to be freed */
+	if(gui->hexView->source && !gui->hexView->sourceOwned)
+		gui->hexView->clearBytes();
+
+	proc_sample_stop();
+
+	/* the tagger is tagging what's being closed */
+	tags_cancel(NULL);
+
+	va_view_reset();
+
+	delete vaSource;
+	delete fileSource;
+	delete gzipSource;
+	delete procSource;
+	vaSource = NULL;
+	fileSource = NULL;
+	gzipSource = NULL;
+	procSource = NULL;
+
+	fileOpenPtrMap = NULL;
+	fileOpenSize = 0;
+
+	xrefsIndex.clear();
+	xrefsShown.clear();
+	if(xrefsList) xrefsList->clear();
+
+	dupRegions.clear();
+	dupItemToGroup.clear();
+	dupItemToRegion.clear();
+	if(dupesTree) dupesTree->clear_children(dupesTree->root());
+
+	if(!fileSource && !fileOpenPtrMap && !fileOpenSize) {
+		rc = 0;
+	}
+
+	return rc;
+}
+
+/* holes smaller than this (bytes) aren't worth a tag, and no more than this
+	many holes are tagged */
+#define HOLE_TAG_MIN 0x10000
+#define HOLE_TAG_COUNT_MAX 4096
+
+/* indexing a big .gz takes a while, show how far along it is */
+void file_gz_progress(uint64_t done, uint64_t total, void *ctx)
+{
+	static uint64_t last = 0;
+	char buf[128];
+
+	if(done < last) last = 0;
+	if(done - last < 0x4000000 && done < total)
+		return;
+	last = done;
+
+	sprintf(buf, "indexing compressed file... %d%%",
+		total ? (int)(100 * done / total) : 0);
+	gui->statusBar->value(buf);
+	Fl::check();
+}
+
+/* compressed files are viewed decompressed, taggers (which read the file
+	themselves) and the whole-file analyses don't apply */
+int file_load_gz(const char *path)
+{
+	int rc = -1;
+	char buf[128];
+	GzipSource *src = new GzipSource();
+
+	gui->statusBar->value("indexing compressed file...");
+	Fl::check();
+
+	if(src->open(path, file_gz_progress, NULL)) {
+		printf("ERROR: opening %s\n", path);
+		delete src;
+		goto cleanup;
+	}
+
+	file_unload();
+	gzipSource = src;
+	tags_clear();
+	gui->hexView->setSource(gzipSource);
+	gui->mainWindow->label(path);
+
+	sprintf(buf, "decompressed view, %d checkpoints (taggers skipped)",
+		src->getPointCount());
+	gui->statusBar->value(buf);
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+int file_load(const char *path) 
+{
+	int rc = -1;
+	char buf[128];
+	FileSource *src;
+	vector<file_extent> holes;
+
+	if(GzipSource::sniff(path))
+		return file_load_gz(path);
+
+	src = new FileSource();
+	if(src->open(path)) {
+		printf("ERROR: opening %s\n", path);
+		delete src;
+		goto cleanup;
+	}
+
+	file_unload();
+
+	fileSource = src;
+	fileOpenPtrMap = fileSource->getData();
+	fileOpenSize = fileSource->getSize();
+
+	gui->hexView->setSource(fileSource);
+	
+	gui->mainWindow->label(path);
+
+	/* executables and cores can be viewed by virtual address too */
+	if(0 == addrMap.build(fileSource->getData(), fileSource->getSize())) {
+		vaSource = new VaSource(fileSource, &addrMap);
+		sprintf(buf, "%s, %d segments (Go -> Virtual addresses)",
+			addrMap.format.c_str(), addrMap.size());
+		gui->statusBar->value(buf);
+	}
+
+	/* sparse? tag the big holes so they can be seen (and skipped) */
+	tags_clear();
+	fileSource->getHoles(holes, HOLE_TAG_MIN);
+	for(int i=0; i<holes.size() && i<HOLE_TAG_COUNT_MAX; ++i) {
+		sprintf(buf, "[hole] 0x%llX bytes", holes[i].right - holes[i].left);
+		intervMgr.add(Interval(holes[i].left, holes[i].right, string(buf)));
+	}
+
+	if(intervMgr.size())
+		tags_show_tree();
+
+	/* tags stream in from here, the file's already viewable */
+	tags_load_file(path, (uint8_t *)fileOpenPtrMap, fileOpenSize);
+		
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* FILE READ TAGS */
+/*****************************************************************************/
+
+/* placeholders left: what to ask the tagger for, the dummy child that
+	makes each openable */
+map<Interval *, Fl_Tree_Item *> tagPlaceholders;
+
+/* the other way, so a merge can grey out or relabel what's shown */
+map<Interval *, Fl_Tree_Item *> tagIntervToItem;
+
+/* add a tag's item, closed, under <parent> */
+Fl_Tree_Item *tags_item_add(Fl_Tree_Item *parent, Interval *tag)
+{
+	Fl_Tree_Item *item = tree->add(parent, tag->data_string.c_str());
+	item->close();
+
+	/* save the Tree_Item -> Interval Mapping */
+	treeItemToInterv[item] = tag;
+	tagIntervToItem[tag] = item;
+
+	/* not tagged inside yet, but openable (which asks for it) */
+	if(tag->expandable) {
+		vector<pair<uint64_t, uint64_t> > gaps;
+		intervMgr.rangeUntagged(tag->left, tag->right, gaps);
+		if(gaps.size())
+			tagPlaceholders[tag] = tree->add(item, "...");
+	}
+
+	return item;
+}
+
+void tags_fill_tree_dfs(Fl_Tree *tree, Fl_Tree_Item *item, Interval *tag)
+{
+	/* insert current guy */
+	Fl_Tree_Item *itemNew = tags_item_add(item, tag);
+
+	/* insert all his children */
+	vector<Interval *> children = tag->childRetrieve();
+	for(auto iter = children.begin(); iter != children.end(); iter++) {
+		Interval *childTag = (*iter);
+		tags_fill_tree_dfs(tree, itemNew, childTag);
+	}
+}
+
+/* one tagger's tags under <root>, merged with the others' first so what
+	another tagger has is left out */
+void tags_fill_source(Fl_Tree_Item *root, int source)
+{
+	intervMgr.merge(source);
+
+	vector<Interval *> tags = intervMgr.findParentChild(source);
+	for(int i=0; i<tags.size(); ++i)
+		tags_fill_tree_dfs(tree, root, tags[i]);
+}
+
+/* drop the mappings of what's under <item>, before it's cleared */
+void tags_forget(Fl_Tree_Item *item)
+{
+	for(int i=0; i<item->children(); ++i) {
+		Fl_Tree_Item *child = item->child(i);
+		auto it = treeItemToInterv.find(child);
+		if(it != treeItemToInterv.end()) {
+			tagIntervToItem.erase(it->second);
+			tagPlaceholders.erase(it->second);
+			treeItemToInterv.erase(it);
+		}
+		tags_forget(child);
+	}
+}
+
+/*****************************************************************************/
+/* TAG STREAMING */
+/*****************************************************************************/
+
+/* tagging runs off the event loop: candidates are polled with their stdout
+	watched by Fl::add_fd, then every acceptor's tags are parsed and inserted
+	in the tree a batch at a time as they arrive */
+
+#define TAGS_READ_BUDGET (256*1024) /* bytes taken per wakeup, keeps UI live */
+
+tagging_poller tagPoller;
+bool tagBusy = false; /* polling or streaming */
+string tagTarget;
+vector<int> tagFds; /* registered with Fl::add_fd */
+tagging_proc tagRangeProc; /* streaming the insides of a placeholder */
+bool tagExpanding = false; /* streaming into an already populated tree */
+int tagFailed = 0; /* taggers that failed this round */
+
+/* whole targets, or ranges of placeholders in the current target (source is
+	the tagger that left them) */
+struct tags_request {
+	string target;
+	bool ranged;
+	int source;
+	uint64_t left, right;
+};
+vector<tags_request> tagQueue; /* waiting for the current one to finish */
+
+/* a tagger whose tags are going in the tree
+
+	streamed tags are placed under the parent they name, else the most
+	recent tag that contains them, which is what findParentChild() decides
+	too when taggers print parents before children (they do); stack holds
+	the open ancestors */
+struct tags_stream {
+	tagging_proc *proc; /* NULL: a plugin, done before it's a stream */
+	int source;
+	Fl_Tree_Item *root; /* its tags go under this */
+	vector<pair<Interval *, Fl_Tree_Item *> > stack;
+	Interval *prev;
+	bool done;
+};
+vector<tags_stream> tagStreams;
+
+/* with several taggers each gets a top level item, which hides or shows
+	its tags when clicked */
+map<int, Fl_Tree_Item *> tagSourceItems;
+map<int, bool> tagSourceHidden;
+
+unsigned int tagPublished = 0; /* intervMgr entries already in the tree */
+bool tagTreeStale = false; /* streamed placement may be off, rebuild at end */
+
+void tags_window(void);
+void tags_poll_fd_cb(int fd, void *);
+void tags_stream_fd_cb(int fd, void *);
+int tags_load_range(int source, uint64_t left, uint64_t right);
+
+const char *tags_tagger_name(int source)
+{
+	static string name;
+	name = intervMgr.sourceName(source);
+	size_t slash = name.rfind('/');
+	if(slash != string::npos)
+		name = name.substr(slash + 1);
+	return name.c_str();
+}
+
+void tags_fds_set(vector<int> &fds, Fl_FD_Handler cb)
+{
+	for(int i=0; i<tagFds.size(); ++i)
+		Fl::remove_fd(tagFds[i]);
+	tagFds = fds;
+	for(int i=0; i<tagFds.size(); ++i)
+		Fl::add_fd(tagFds[i], FL_READ, cb);
+}
+
+/* where <source>'s tags go */
+Fl_Tree_Item *tags_source_root(int source)
+{
+	auto it = tagSourceItems.find(source);
+	if(it != tagSourceItems.end())
+		return it->second;
+	return tree->root();
+}
+
+bool tags_source_hidden(int source)
+{
+	auto it = tagSourceHidden.find(source);
+	return it != tagSourceHidden.end() && it->second;
+}
+
+tags_stream *tags_stream_find(int source)
+{
+	for(int i=0; i<tagStreams.size(); ++i)
+		if(tagStreams[i].source == source)
+			return &tagStreams[i];
+	return NULL;
+}
+
+void tags_stream_add(tagging_proc *proc, int source)
+{
+	tags_stream s;
+	s.proc = proc;
+	s.source = source;
+	s.root = NULL;
+	s.prev = NULL;
+	s.done = false;
+	tagStreams.push_back(s);
+}
+
+/* the open ancestors of <tag> when it goes in a tree built earlier: walk
+	down from the stream's root through whatever contains it */
+void tags_descend(tags_stream &s, Interval *tag)
+{
+	Fl_Tree_Item *item = s.root;
+
+	s.stack.clear();
+	while(item) {
+		Fl_Tree_Item *next = NULL;
+		for(int i=0; i<item->children() && !next; ++i) {
+			Fl_Tree_Item *child = item->child(i);
+			auto it = treeItemToInterv.find(child);
+			if(it == treeItemToInterv.end() || !it->second->contains(*tag))
+				continue;
+			s.stack.push_back(make_pair(it->second, child));
+			next = child;
+		}
+		item = next;
+	}
+}
+
+/* put intervMgr entries that arrived since last time into the tree */
+void tags_publish(void)
+{
+	char buf[256];
+
+	if(tagPublished >= intervMgr.size())
+		return;
+
+	for(; tagPublished < intervMgr.size(); ++tagPublished) {
+		Interval *tag = intervMgr.get(tagPublished);
+		tags_stream *s = tags_stream_find(tag->source);
+
+		if(!s) {
+			tags_item_add(tree->root(), tag);
+			continue;
+		}
+		if(tags_source_hidden(s->source))
+			continue;
+
+		while(s->stack.size() && !s->stack.back().first->contains(*tag))
+			s->stack.pop_back();
+
+		if(s->stack.empty() && tagExpanding)
+			tags_descend(*s, tag);
+
+		/* enveloping an earlier tag means parents didn't come first */
+		if(s->prev && tag->contains(*s->prev) && !s->prev->contains(*tag))
+			tagTreeStale = true;
+
+		Fl_Tree_Item *parent = s->stack.size() ? s->stack.back().second : s->root;
+		if(tag->parent) {
+			auto it = tagIntervToItem.find(tag->parent);
+			if(it != tagIntervToItem.end())
+				parent = it->second;
+		}
+		Fl_Tree_Item *item = tags_item_add(parent, tag);
+
+		s->stack.push_back(make_pair(tag, item));
+		s->prev = tag;
+	}
+
+	tree->redraw();
+
+	if(tagStreams.size() == 1)
+		snprintf(buf, sizeof(buf), "tagging with %s... %d tags",
+			tags_tagger_name(tagStreams[0].source), intervMgr.size());
+	else
+		snprintf(buf, sizeof(buf), "tagging with %d taggers... %d tags",
+			(int)tagStreams.size(), intervMgr.size());
+	gui->statusBar->value(buf);
+}
+
+/* placeholders whose insides have all been asked for lose their dummy */
+void tags_placeholders_check(void)
+{
+	vector<pair<uint64_t, uint64_t> > gaps;
+
+	for(auto it = tagPlaceholders.begin(); it != tagPlaceholders.end(); ) {
+		intervMgr.rangeUntagged(it->first->left, it->first->right, gaps);
+		if(gaps.size()) {
+			++it;
+			continue;
+		}
+		tree->remove(it->second);
+		it = tagPlaceholders.erase(it);
+	}
+}
+
+/* a stream's tags are all in: merge them with the other taggers', greying
+	out what another tagger already has and relabeling who has it */
+void tags_stream_merge(tags_stream &s)
+{
+	vector<Interval *> changed;
+
+	s.done = true;
+	intervMgr.merge(s.source, &changed);
+
+	for(int i=0; i<changed.size(); ++i) {
+		auto it = tagIntervToItem.find(changed[i]);
+		if(it == tagIntervToItem.end())
+			continue;
+		if(changed[i]->shadowed)
+			it->second->deactivate();
+		else
+			it->second->label(changed[i]->data_string.c_str());
+	}
+}
+
+/* stop watching and collect every tagger, then do what's queued */
+void tags_stream_end(const char *msg)
+{
+	vector<int> none;
+
+	tags_fds_set(none, NULL);
+	tagging_poll_cancel(tagPoller);
+	for(int i=0; i<tagStreams.size(); ++i)
+		if(tagStreams[i].proc == &tagRangeProc)
+			tagging_reap(tagRangeProc, true);
+	tagBusy = false;
+	tagStreams.clear();
+
+	if(tagTreeStale && tree) {
+		tagTreeStale = false;
+		tags_show_tree();
+	}
+
+	if(tagExpanding && tree) {
+		tagExpanding = false;
+		tags_placeholders_check();
+		tree->redraw();
+	}
+
+	if(msg)
+		gui->statusBar->value(msg);
+
+	/* until something's running, requests can finish (or be moot) at once */
+	while(!tagBusy && tagQueue.size()) {
+		tags_request next = tagQueue.front();
+		tagQueue.erase(tagQueue.begin());
+		if(next.ranged)
+			tags_load_range(next.source, next.left, next.right);
+		else
+			tags_load_file(next.target.c_str());
+	}
+}
+
+/* every stream is done: say how it went */
+void tags_streams_check(void)
+{
+	char buf[256];
+
+	for(int i=0; i<tagStreams.size(); ++i)
+		if(!tagStreams[i].done)
+			return;
+
+	if(tagStreams.size() == 1 && tagFailed)
+		snprintf(buf, sizeof(buf), "%s failed, %d tags so far are kept",
+			tags_tagger_name(tagStreams[0].source), intervMgr.size());
+	else if(tagStreams.size() == 1)
+		snprintf(buf, sizeof(buf), "%d tags from %s", intervMgr.size(),
+			tags_tagger_name(tagStreams[0].source));
+	else
+		snprintf(buf, sizeof(buf), "%d tags from %d taggers (%d failed)",
+			intervMgr.size(), (int)tagStreams.size(), tagFailed);
+	tags_stream_end(buf);
+}
+
+/* stop tagging (closing the file, or the user asked), why is for the status
+	bar (NULL to leave it alone) */
+void tags_cancel(const char *why)
+{
+	tagQueue.clear();
+	if(!tagBusy)
+		return;
+
+	printf("tagging of %s cancelled\n", tagTarget.c_str());
+	tags_stream_end(why);
+}
+
+void tags_stop_cb(Fl_Widget *, void *)
+{
+	if(!tagBusy) {
+		gui->statusBar->value("not tagging");
+		return;
+	}
+	tags_cancel("tagging stopped, tags so far are kept");
+}
+
+static bool fd_readable(int fd)
+{
+	struct pollfd pfd = {fd, POLLIN, 0};
+	return poll(&pfd, 1, 0) > 0;
+}
+
+/* a stream has output (or it's done): take up to a budget of it, parse,
+	publish the batch */
+void tags_stream_service(tags_stream &s)
+{
+	tagging_proc &proc = *s.proc;
+	int fd = proc.fd;
+	bool malformed = false;
+
+	if(!proc.eof) {
+		size_t before = proc.output.size(), taken = 0;
+		do {
+			tagging_read(proc);
+			taken = proc.output.size() - before;
+		} while(!proc.eof && taken < TAGS_READ_BUDGET && fd_readable(proc.fd));
+	}
+
+	/* a warm tagger died and was retried one-shot, watch the new pipe */
+	if(!proc.eof && proc.fd != fd) {
+		for(int i=0; i<tagFds.size(); ++i) {
+			if(tagFds[i] != fd)
+				continue;
+			Fl::remove_fd(fd);
+			tagFds[i] = proc.fd;
+			Fl::add_fd(proc.fd, FL_READ, tags_stream_fd_cb);
+			break;
+		}
+		fd = proc.fd;
+	}
+
+	if(tagging_parse(proc, intervMgr)) {
+		printf("ERROR: %s output is malformed, tags so far are kept\n",
+			proc.tagger.c_str());
+		malformed = true;
+		tagging_reap(proc, true);
+		proc.eof = true;
+	}
+	tags_publish();
+
+	if(!proc.eof)
+		return;
+
+	if(malformed || tagging_finished(proc))
+		tagFailed++;
+
+	/* the others keep streaming */
+	for(int i=0; i<tagFds.size(); ++i) {
+		if(tagFds[i] != fd)
+			continue;
+		Fl::remove_fd(fd);
+		tagFds.erase(tagFds.begin() + i);
+		break;
+	}
+
+	tags_stream_merge(s);
+}
+
+/* polling's over: publish the plugins' tags, stream every acceptor */
+void tags_poll_done(void)
+{
+	vector<int> winners, fds;
+
+	tagging_poll_winners(tagPoller, winners);
+	for(int i=0; i<winners.size(); ++i) {
+		tagging_proc *proc = &tagPoller.procs[winners[i]];
+		printf("going with tagger: %s\n", proc->tagger.c_str());
+		tags_stream_add(proc, intervMgr.sourceAdd(proc->tagger));
+	}
+
+	if(tagStreams.empty()) {
+		printf("no tagger recognized the file\n");
+		tags_stream_end("no tagger recognized the file");
+		return;
+	}
+
+	tags_window();
+	winTags->show();
+
+	/* several taggers, the tree is grouped by tagger */
+	if(tagStreams.size() > 1) {
+		for(int i=0; i<tagStreams.size(); ++i) {
+			int source = tagStreams[i].source;
+			Fl_Tree_Item *item = tree->add(tree->root(),
+				tags_tagger_name(source));
+			tagSourceItems[source] = item;
+		}
+	}
+	for(int i=0; i<tagStreams.size(); ++i)
+		tagStreams[i].root = tags_source_root(tagStreams[i].source);
+
+	/* the plugins are done, and what was read while polling */
+	tags_publish();
+	for(int i=0; i<tagStreams.size(); ++i) {
+		tags_stream &s = tagStreams[i];
+		if(!s.proc)
+			tags_stream_merge(s);
+		else if(s.proc->eof || s.proc->output.size())
+			tags_stream_service(s);
+		if(!s.done)
+			fds.push_back(s.proc->fd);
+	}
+
+	tags_fds_set(fds, tags_stream_fd_cb);
+	tags_streams_check();
+}
+
+void tags_poll_fd_cb(int fd, void *)
+{
+	vector<int> fds;
+
+	if(tagging_poll_step(tagPoller, fd)) {
+		tags_poll_done();
+		return;
+	}
+
+	tagging_poll_fds(tagPoller, fds);
+	tags_fds_set(fds, tags_poll_fd_cb);
+}
+
+void tags_stream_fd_cb(int fd, void *)
+{
+	for(int i=0; i<tagStreams.size(); ++i) {
+		tags_stream &s = tagStreams[i];
+		if(s.done || !s.proc || s.proc->fd != fd)
+			continue;
+		tags_stream_service(s);
+		tags_streams_check();
+		return;
+	}
+}
+
+/* start tagging <target> with every tagger that will; returns before any
+	tags arrive
+
+	data/len: target's contents, if it's the open file, so the tagger
+	manifests are checked without reading it again */
+int tags_load_file(const char *target, const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	vector<string> candidates, plugins;
+	vector<int> fds;
+
+	/* one file at a time, the tree follows its streams */
+	if(tagBusy) {
+		tags_request req = {target, false, -1, 0, 0};
+		tagQueue.push_back(req);
+		rc = 0;
+		goto cleanup;
+	}
+
+	/* entries already present were placed by findParentChild(), streamed
+		ones could belong under them */
+	tags_window();
+	tagPublished = intervMgr.size();
+	tagTreeStale = (tagPublished > 0);
+	tagStreams.clear();
+	tagFailed = 0;
+	tagTarget = target;
+	tagBusy = true;
+	gui->statusBar->value("tagging...");
+
+	/* plugins tag in process and are done before this returns, their tags
+		are published with the first of the script taggers' */
+	if(0 != tagging_plugin_tag(target, data, len, intervMgr, plugins, false) &&
+	  plugins.size())
+		tagFailed++;
+	for(int i=0; i<plugins.size(); ++i)
+		tags_stream_add(NULL, intervMgr.sourceAdd(plugins[i]));
+
+	if(0 != tagging_findall(candidates) ||
+	  0 != tagging_filter(target, data, len, candidates))
+		candidates.clear();
+
+	/* sources are numbered in tagger order, so are conflicts settled */
+	for(int i=0; i<candidates.size(); ++i)
+		intervMgr.sourceAdd(candidates[i]);
+
+	tagging_poll_start(tagPoller, target, candidates, 0, TAGGING_POLL_ALL);
+	if(tagPoller.done) {
+		tags_poll_done();
+	}
+	else {
+		tagging_poll_fds(tagPoller, fds);
+		tags_fds_set(fds, tags_poll_fd_cb);
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* a tagger's item was clicked: hide its tags, or bring them back */
+bool tags_source_toggle(Fl_Tree_Item *item)
+{
+	char buf[256];
+	int source = -1;
+
+	for(auto it = tagSourceItems.begin(); it != tagSourceItems.end(); ++it)
+		if(it->second == item)
+			source = it->first;
+	if(source == -1)
+		return false;
+
+	tags_stream *s = tags_stream_find(source);
+	if(s && !s->done) {
+		snprintf(buf, sizeof(buf), "%s is still tagging",
+			tags_tagger_name(source));
+		gui->statusBar->value(buf);
+		return true;
+	}
+
+	tagSourceHidden[source] = !tags_source_hidden(source);
+	tags_forget(item);
+	tree->clear_children(item);
+
+	if(tags_source_hidden(source)) {
+		snprintf(buf, sizeof(buf), "%s (hidden)", tags_tagger_name(source));
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%s", tags_tagger_name(source));
+		tags_fill_source(item, source);
+	}
+	item->label(buf);
+	tree->redraw();
+	return true;
+}
+
+/*****************************************************************************/
+/* LAZY TAGGING */
+/*****************************************************************************/
+
+/* placeholder tags (see tagging.h) are filled in as they're looked at: when
+	their tree item is opened, or when the hex view shows part of them */
+
+#define TAGS_RANGE_CHUNK 0x10000 /* viewport requests are rounded to this */
+#define TAGS_VIEW_SETTLE 0.15 /* seconds the view must rest before asking */
+
+/* ask the tagger <source> for [left,right) of tagTarget, minus what was
+	asked before */
+int tags_load_range(int source, uint64_t left, uint64_t right)
+{
+	int rc = -1;
+	vector<pair<uint64_t, uint64_t> > gaps;
+	vector<int> fds;
+	string tagger = intervMgr.sourceName(source);
+	char buf[256];
+
+	if(tagger.empty())
+		goto cleanup;
+
+	if(tagBusy) {
+		tags_request req = {"", true, source, left, right};
+		tagQueue.push_back(req);
+		rc = 0;
+		goto cleanup;
+	}
+
+	/* the first gap now, the rest after it */
+	intervMgr.rangeUntagged(left, right, gaps);
+	if(gaps.empty()) {
+		rc = 0;
+		goto cleanup;
+	}
+	for(int i=gaps.size()-1; i>0; --i) {
+		tags_request req = {"", true, source, gaps[i].first, gaps[i].second};
+		tagQueue.insert(tagQueue.begin(), req);
+	}
+	left = gaps[0].first;
+	right = gaps[0].second;
+
+	printf("tagging [0x%llX,0x%llX) of %s\n", (unsigned long long)left,
+		(unsigned long long)right, tagTarget.c_str());
+	intervMgr.rangeTagged(left, right);
+
+	tagPublished = intervMgr.size();
+	tagStreams.clear();
+	tagFailed = 0;
+	tagExpanding = true;
+
+	/* plugins are done before they return */
+	if(tagging_is_plugin(tagger)) {
+		tags_stream_add(NULL, source);
+		tagStreams[0].root = tags_source_root(source);
+		if(tagging_plugin_range(tagTarget, tagger, NULL, 0, left, right,
+		  intervMgr))
+			snprintf(buf, sizeof(buf), "tagging [0x%llX,0x%llX) failed",
+				(unsigned long long)left, (unsigned long long)right);
+		else
+			snprintf(buf, sizeof(buf), "%d tags", intervMgr.size());
+		tags_publish();
+		tags_stream_merge(tagStreams[0]);
+		tags_stream_end(buf);
+		rc = 0;
+		goto cleanup;
+	}
+
+	if(tagging_launch_range(tagTarget, tagger, left, right, tagRangeProc)) {
+		tags_stream_end("tagger wouldn't start");
+		goto cleanup;
+	}
+
+	tagBusy = true;
+	tags_stream_add(&tagRangeProc, source);
+	tagStreams[0].root = tags_source_root(source);
+	fds.push_back(tagRangeProc.fd);
+	tags_fds_set(fds, tags_stream_fd_cb);
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* everything in [left,right) that's inside a placeholder and not asked for */
+void tags_expand(uint64_t left, uint64_t right)
+{
+	vector<tags_request> wanted;
+
+	/* collected first, a plugin's finishing retires placeholders */
+	for(auto it = tagPlaceholders.begin(); it != tagPlaceholders.end(); ++it) {
+		Interval *tag = it->first;
+		if(tag->right <= left || tag->left >= right)
+			continue;
+		tags_request req = {"", true, tag->source, max(left, tag->left),
+			min(right, tag->right)};
+		wanted.push_back(req);
+	}
+
+	for(int i=0; i<wanted.size(); ++i)
+		tags_load_range(wanted[i].source, wanted[i].left, wanted[i].right);
+}
+
+/* the view rested on part of a placeholder */
+void tags_view_timeout(void *)
+{
+	HexView *hv = gui->hexView;
+	uint64_t left, right;
+
+	if(!fileSource || hv->source != fileSource)
+		return;
+
+	left = hv->addrViewStart - (hv->addrViewStart % TAGS_RANGE_CHUNK);
+	right = hv->addrViewEnd + TAGS_RANGE_CHUNK - 1;
+	right -= right % TAGS_RANGE_CHUNK;
+	tags_expand(left, right);
+}
+
+/* create the tags window the first time */
+void tags_window(void)
+{
+	if(!winTags) {
+		winTags = new Fl_Window(
+			gui->mainWindow->x()+gui->mainWindow->w()+32, 
+			gui->mainWindow->y(), gui->mainWindow->w(), 
+			gui->mainWindow->h(), 
+			"tags"
+		);
+		tree = new Fl_Tree(0, 0, winTags->w(), winTags->h());
+		tree->end();
+		tree->showroot(0);
+		tree->callback((Fl_Callback *)tree_cb);
+		winTags->end();
+		winTags->resizable(tree);
+	}
+}
+
+/* forget all tags, the tree items point at them */
+void tags_clear(void)
+{
+	intervMgr.clear();
+	treeItemToInterv.clear();
+	tagPlaceholders.clear();
+	tagIntervToItem.clear();
+	tagSourceItems.clear();
+	tagSourceHidden.clear();
+	Fl::remove_timeout(tags_view_timeout);
+	if(tree) {
+		tree->clear_children(tree->root());
+		tree->redraw();
+	}
+}
+
+/* (re)fill the tags window from intervMgr */
+void tags_show_tree(void)
+{
+	vector<Interval *> tags;
+
+	tags_window();
+
+	//tree->root_label("file");
+	tree->clear_children(tree->root());
+	treeItemToInterv.clear();
+	tagPlaceholders.clear();
+	tagIntervToItem.clear();
+
+	if(tagSourceItems.empty()) {
+		tags = intervMgr.findParentChild();
+		for(int i=0; i<tags.size(); ++i) {
+			tags_fill_tree_dfs(tree, tree->root(), tags[i]);
+		}
+	}
+	/* several taggers: what none of them made, then each under its item */
+	else {
+		tags_fill_source(tree->root(), -1);
+		for(auto it = tagSourceItems.begin(); it != tagSourceItems.end(); ++it) {
+			string label = tags_tagger_name(it->first);
+			if(tags_source_hidden(it->first))
+				label += " (hidden)";
+			it->second = tree->add(tree->root(), label.c_str());
+			if(!tags_source_hidden(it->first))
+				tags_fill_source(it->second, it->first);
+		}
+	}
+
+	/* show window */
+	winTags->show();
+}
+
+/*****************************************************************************/
+/* HEXVIEW CALLBACK */
+/*****************************************************************************/
+
+void HexView_cb(int type, void *data)
+{
+	char msg[512] = {0};
+	uint64_t tmp;
+	HexView *hv = gui->hexView;
+
+	char strAddrSelStart[32];
+	char strAddrSelEnd[32];
+	char strAddrViewStart[32];
+	char strAddrViewEnd[32];
+	char strAddrStart[32];
+	char strAddrEnd[32];
+
+	if(hv->addrMode == 64) {
+		sprintf(strAddrSelStart, "0x%016llX", hv->addrSelStart);
+		sprintf(strAddrSelEnd, "0x%016llX", hv->addrSelEnd);
+		sprintf(strAddrViewStart, "0x%016llX", hv->addrViewStart);
+		sprintf(strAddrViewEnd, "0x%016llX", hv->addrViewEnd);
+		sprintf(strAddrStart, "0x%016llX", hv->addrStart);
+		sprintf(strAddrEnd, "0x%016llX", hv->addrEnd);
+	}
+	else {
+		sprintf(strAddrSelStart, "0x%08llX", hv->addrSelStart);
+		sprintf(strAddrSelEnd, "0x%08llX", hv->addrSelEnd);
+		sprintf(strAddrViewStart, "0x%08llX", hv->addrViewStart);
+		sprintf(strAddrViewEnd, "0x%08llX", hv->addrViewEnd);
+		sprintf(strAddrStart, "0x%08llX", hv->addrStart);
+		sprintf(strAddrEnd, "0x%08llX", hv->addrEnd);
+	}
+
+	switch(type) {
+		case HV_CB_SELECTION:
+			if(hv->selActive) {
+				tmp = hv->addrSelEnd - hv->addrSelStart;
+				sprintf(msg, "selected 0x%llX (%lld) bytes [%s,%s)",
+					tmp, tmp, strAddrSelStart, strAddrSelEnd);
+			}
+			else {
+				sprintf(msg, "selection cleared");
+			}
+			va_status_suffix(msg, sizeof(msg));
+			break;
+
+		case HV_CB_VIEW_MOVE:
+			sprintf(msg, "view moved [%s,%s) %.1f%%",
+				strAddrViewStart, strAddrViewEnd, hv->viewPercent);
+
+			/* scrolled into a placeholder? once scrolling stops */
+			if(tagPlaceholders.size()) {
+				Fl::remove_timeout(tags_view_timeout);
+				Fl::add_timeout(TAGS_VIEW_SETTLE, tags_view_timeout);
+			}
+
+			/* how the file is keeping up */
+			if(fileSource && hv->source == fileSource) {
+				file_stats st;
+				fileSource->getStats(st);
+				sprintf(msg + strlen(msg), "  (%s, %lld faults, %lld stalls "
+					"worst %.0fms, %lld cold, %lldMB ahead)",
+					file_advice_tostr(st.advice), (long long)st.majorFaults,
+					(long long)st.stalls, st.worstStall, (long long)st.coldViews,
+					(long long)(st.bytesPrefetched >> 20));
+			}
+			va_status_suffix(msg, sizeof(msg));
+			break;
+			
+		case HV_CB_NEW_BYTES:
+			sprintf(msg, "0x%llX (%lld) bytes to [%s,%s)",
+				hv->nBytes, hv->nBytes, strAddrStart, strAddrEnd);
+			break;
+	}
+
+	if(msg[0]) {
+		gui->statusBar->value(msg);
+	}
+}
+
+/*****************************************************************************/
+/* POINTER SCAN / XREFS */
+/*****************************************************************************/
+
+#define XREFS_LIST_MAX 10000
+
+void xrefs_list_cb(Fl_Widget *, void *)
+{
+	int line = xrefsList->value();
+	if(line <= 0 || line > xrefsShown.size())
+		return;
+
+	xrefs_hit &hit = xrefsShown[line-1];
+	uint64_t width = xrefs_kind_width(hit.kind);
+	uint64_t left, right;
+	if(!view_range(hit.offset, hit.offset + width, &left, &right)) {
+		gui->statusBar->value("not loaded, see it in the file offset view");
+		return;
+	}
+	gui->hexView->setView((left > 0x40) ? left - 0x40 : 0);
+	gui->hexView->setSelection(left, right);
+}
+
+/* fill (creating if necessary) the list window with hits, and highlight
+	the values in the hex view */
+void xrefs_show(vector<xrefs_hit> &hits, const char *title)
+{
+	char buf[128];
+
+	if(!winXrefs) {
+		winXrefs = new Fl_Window(
+			gui->mainWindow->x(),
+			gui->mainWindow->y()+gui->mainWindow->h()+32,
+			gui->mainWindow->w(), 200, "xrefs"
+		);
+		xrefsList = new Fl_Hold_Browser(0, 0, winXrefs->w(), winXrefs->h());
+		xrefsList->callback(xrefs_list_cb);
+		winXrefs->end();
+		winXrefs->resizable(xrefsList);
+	}
+
+	winXrefs->copy_label(title);
+	xrefsList->clear();
+	xrefsShown.clear();
+
+	gui->hexView->hlClear();
+	for(auto i=hits.begin(); i!=hits.end(); ++i) {
+		uint64_t width = xrefs_kind_width(i->kind);
+		uint64_t left, right;
+		if(view_range(i->offset, i->offset + width, &left, &right))
+			gui->hexView->hlAdd(left, right, 0x66d9ff);
+
+		if(xrefsShown.size() >= XREFS_LIST_MAX)
+			continue;
+
+		sprintf(buf, "0x%08llX: %s -> 0x%llX", i->offset,
+			xrefs_kind_tostr(i->kind), i->target);
+		xrefsList->add(buf);
+		xrefsShown.push_back(*i);
+	}
+
+	winXrefs->show();
+}
+
+/* where the tagged sections ("section "<name>" contents") are loaded, as
+	"left-right, ..." with neighbors joined, empty if none of them is */
+void xrefs_section_ranges(string &result)
+{
+	vector<pair<uint64_t, uint64_t> > vas;
+	char buf[64];
+
+	result.clear();
+
+	for(unsigned int i=0; i<intervMgr.size(); ++i) {
+		Interval *tag = intervMgr.get(i);
+		string &label = tag->data_string;
+		uint64_t left, last;
+
+		if(tag->shadowed || tag->right <= tag->left ||
+		  !xrefs_section_label(label))
+			continue;
+		if(!addrMap.offsetToVa(tag->left, &left) ||
+		  !addrMap.offsetToVa(tag->right - 1, &last))
+			continue;
+		vas.push_back(make_pair(left, last + 1));
+	}
+
+	std::sort(vas.begin(), vas.end());
+	for(unsigned int i=0; i<vas.size(); ) {
+		uint64_t left = vas[i].first, right = vas[i].second;
+		for(++i; i<vas.size() && vas[i].first <= right; ++i)
+			right = std::max(right, vas[i].second);
+
+		snprintf(buf, sizeof(buf), "%s0x%llX-0x%llX", result.empty() ? "" : ", ",
+			(unsigned long long)left, (unsigned long long)right);
+		result += buf;
+	}
+}
+
+/* scan the whole file for values landing in user supplied ranges, default
+	to the selection, else where the tagged sections are loaded, else the
+	entire file, treated as addresses */
+void xrefs_scan_cb(Fl_Widget *, void *)
+{
+	char buf[128];
+	HexView *hv = gui->hexView;
+	vector<xrefs_range> ranges;
+	string defaults;
+
+	if(!fileOpenPtrMap) {
+		printf("ERROR: no file open\n");
+		return;
+	}
+
+	if(hv->selActive && hv->addrSelEnd > hv->addrSelStart) {
+		sprintf(buf, "0x%llX-0x%llX", hv->addrSelStart, hv->addrSelEnd);
+		defaults = buf;
+	}
+	else {
+		xrefs_section_ranges(defaults);
+		if(defaults.empty()) {
+			sprintf(buf, "0x0-0x%llX", (unsigned long long)fileOpenSize);
+			defaults = buf;
+		}
+	}
+
+	const char *input = fl_input("address ranges (eg: 0x1000-0x2000, ...)",
+		defaults.c_str());
+	if(!input)
+		return;
 
-const char *initStr = "This_is_the_default_bytes_when_no_file_is_open._Here's_some_deadbeef:_\xDE\xAD\xBE\xEF";
+	if(xrefs_parse_ranges(input, ranges)) {
+		fl_alert("couldn't parse ranges: %s", input);
+		return;
+	}
 
-int file_unload(void)
+	if(xrefs_scan((uint8_t *)fileOpenPtrMap, fileOpenSize, ranges, XREFS_ALL,
+	  0, xrefsIndex)) {
+		printf("ERROR: xrefs_scan()\n");
+		return;
+	}
+
+	sprintf(buf, "%ld pointer candidates", xrefsIndex.size());
+	gui->statusBar->value(buf);
+	xrefs_show(xrefsIndex, buf);
+}
+
+/* "who points here?" for the selection, or the byte under the cursor */
+void xrefs_here_cb(Fl_Widget *, void *)
 {
-	int rc = -1;
+	char buf[128];
+	HexView *hv = gui->hexView;
+	vector<xrefs_hit> hits;
+	uint64_t left, right;
 
-	if(fileOpenPtrMap && fileOpenSize) {
-		munmap(fileOpenPtrMap, fileOpenSize);
-		fileOpenPtrMap = NULL;
-		fileOpenSize = 0;
+	if(xrefsIndex.empty()) {
+		gui->statusBar->value("no pointer scan yet (Analysis -> Scan pointers)");
+		return;
 	}
 
-	if(fileOpenFp) {
-		fclose(fileOpenFp);
-		fileOpenFp = NULL;
+	if(hv->selActive && hv->addrSelEnd > hv->addrSelStart) {
+		left = hv->addrSelStart;
+		right = hv->addrSelEnd;
 	}
-
-	if(!fileOpenFp && !fileOpenPtrMap && !fileOpenSize) {
-		rc = 0;
+	else {
+		left = hv->addrViewStart + hv->cursorOffs;
+		right = left + 1;
 	}
 
-	return rc;
+	xrefs_lookup(xrefsIndex, left, right, hits);
+
+	sprintf(buf, "%ld xrefs to [0x%llX,0x%llX)", hits.size(), left, right);
+	gui->statusBar->value(buf);
+	xrefs_show(hits, buf);
 }
 
-int file_load(const char *path) 
+/*****************************************************************************/
+/* DUPLICATE REGIONS */
+/*****************************************************************************/
+
+/* selecting a region highlights its twins, selecting a group highlights all
+	of its members */
+void dupes_tree_cb(Fl_Tree *, void *)
 {
-	int rc = -1;
+	if(dupesTree->callback_reason() != FL_TREE_REASON_SELECTED)
+		return;
 
-	if(fileOpenFp)
-		file_unload();
+	Fl_Tree_Item *item = dupesTree->callback_item();
+	int group = -1, region = -1;
 
-	fileOpenFp = fopen(path, "rb");
-	if(!fileOpenFp) {
-		printf("ERROR: fopen()\n");
-		goto cleanup;
+	if(dupItemToRegion.find(item) != dupItemToRegion.end()) {
+		region = dupItemToRegion[item];
+		group = dupRegions[region].group;
+	}
+	else if(dupItemToGroup.find(item) != dupItemToGroup.end()) {
+		group = dupItemToGroup[item];
+	}
+	else {
+		return;
 	}
 
-	fseek(fileOpenFp, 0, SEEK_END);
-	fileOpenSize = ftell(fileOpenFp);
-	fseek(fileOpenFp, 0, SEEK_SET);
+	gui->hexView->hlClear();
+	for(unsigned int i=0; i<dupRegions.size(); ++i) {
+		if(dupRegions[i].group != group)
+			continue;
+		if(region == -1)
+			region = i;
+		uint64_t left, right;
+		if(view_range(dupRegions[i].left, dupRegions[i].right, &left, &right))
+			gui->hexView->hlAdd(left, right, (i == region) ? 0xff66d9 : 0x66d9ff);
+	}
 
-	fileOpenPtrMap = mmap(0, fileOpenSize, PROT_READ, MAP_PRIVATE, fileno(fileOpenFp), 0);
-	if(fileOpenPtrMap == MAP_FAILED) {
-		printf("ERROR: mmap()\n");
-		goto cleanup;
+	dupes_region &r = dupRegions[region];
+	uint64_t left, right;
+	if(!view_range(r.left, r.right, &left, &right)) {
+		gui->statusBar->value("not loaded, see it in the file offset view");
+		return;
 	}
+	gui->hexView->setView((left > 0x40) ? left - 0x40 : 0);
+	gui->hexView->setSelection(left, right);
+}
 
-	gui->hexView->setBytes(0, (uint8_t *)fileOpenPtrMap, fileOpenSize);
-	
-	gui->mainWindow->label(path);
+void dupes_find_cb(Fl_Widget *, void *)
+{
+	char buf[128];
+	map<int, Fl_Tree_Item *> groupItems;
+	map<int, int> groupCounts;
 
-	tags_load_file(path);
-		
-	rc = 0;
-	cleanup:
+	if(!fileOpenPtrMap) {
+		printf("ERROR: no file open\n");
+		return;
+	}
+
+	gui->statusBar->value("searching for duplicate regions...");
+	Fl::check();
 
-	if(rc) {
-		if(0 != file_unload()) {
-			printf("ERROR: file_unload()\n");
+	if(dupes_find((uint8_t *)fileOpenPtrMap, fileOpenSize, 0, 0, dupRegions)) {
+		printf("ERROR: dupes_find()\n");
+		return;
+	}
+
+	if(!winDupes) {
+		winDupes = new Fl_Window(
+			gui->mainWindow->x()+gui->mainWindow->w()+32,
+			gui->mainWindow->y()+gui->mainWindow->h()/2,
+			gui->mainWindow->w(), gui->mainWindow->h()/2, "duplicates"
+		);
+		dupesTree = new Fl_Tree(0, 0, winDupes->w(), winDupes->h());
+		dupesTree->end();
+		dupesTree->showroot(0);
+		dupesTree->callback((Fl_Callback *)dupes_tree_cb);
+		winDupes->end();
+		winDupes->resizable(dupesTree);
+	}
+
+	dupesTree->clear_children(dupesTree->root());
+	dupItemToGroup.clear();
+	dupItemToRegion.clear();
+
+	for(auto i=dupRegions.begin(); i!=dupRegions.end(); ++i)
+		groupCounts[i->group] += 1;
+
+	for(unsigned int i=0; i<dupRegions.size(); ++i) {
+		dupes_region &r = dupRegions[i];
+
+		if(groupItems.find(r.group) == groupItems.end()) {
+			sprintf(buf, "group %d: %d copies of 0x%llX bytes", r.group,
+				groupCounts[r.group], r.right - r.left);
+			Fl_Tree_Item *item = dupesTree->add(dupesTree->root(), buf);
+			item->close();
+			groupItems[r.group] = item;
+			dupItemToGroup[item] = r.group;
 		}
+
+		sprintf(buf, "[0x%llX,0x%llX)", r.left, r.right);
+		Fl_Tree_Item *item = dupesTree->add(groupItems[r.group], buf);
+		dupItemToRegion[item] = i;
 	}
 
-	return rc;
+	sprintf(buf, "%ld duplicate regions in %ld groups", dupRegions.size(),
+		groupItems.size());
+	gui->statusBar->value(buf);
+	winDupes->show();
 }
 
 /*****************************************************************************/
-/* FILE READ TAGS */
+/* DISASSEMBLY */
 /*****************************************************************************/
 
-void tags_fill_tree_dfs(Fl_Tree *tree, Fl_Tree_Item *item, Interval *tag)
+/* a function tag per function, its blocks tagged under it */
+void cfg_tags_add(cfg_graph &graph, addrmap_seg &seg, int source,
+	map<uint64_t, string> &names, int idBase)
 {
-	/* insert current guy */
-	const char *tagName = tag->data_string.c_str();
-	Fl_Tree_Item *itemNew = tree->add(item, tagName);
-	itemNew->close();
+	char buf[256];
+	string label;
 
-	/* save the Tree_Item -> Interval Mapping */
-	treeItemToInterv[itemNew] = tag;
+	for(uint32_t i=0; i<graph.funcs.size(); ++i) {
+		cfg_func &f = graph.funcs[i];
+		uint64_t left = (uint64_t)-1, right = 0;
 
-	/* insert all his children */
-	vector<Interval *> children = tag->childRetrieve();
-	for(auto iter = children.begin(); iter != children.end(); iter++) {
-		Interval *childTag = (*iter);
-		tags_fill_tree_dfs(tree, itemNew, childTag);
+		for(uint32_t j=f.firstBlock; j<f.firstBlock+f.nBlocks; ++j) {
+			left = std::min(left, graph.blocks[j].left);
+			right = std::max(right, graph.blocks[j].right);
+		}
+
+		auto name = names.find(f.entry);
+		if(name != names.end() && name->second.size())
+			snprintf(buf, sizeof(buf), INTERVAL_ID "%d} function %s", idBase + i,
+				name->second.c_str());
+		else
+			snprintf(buf, sizeof(buf), INTERVAL_ID "%d} function sub_%llX",
+				idBase + i, (unsigned long long)f.entry);
+		intervMgr.add(left - seg.va + seg.offset, right - seg.va + seg.offset,
+			buf, strlen(buf), source);
+
+		for(uint32_t j=f.firstBlock; j<f.firstBlock+f.nBlocks; ++j) {
+			cfg_block &b = graph.blocks[j];
+
+			snprintf(buf, sizeof(buf), INTERVAL_PARENT "%d} block 0x%llX",
+				idBase + i, (unsigned long long)b.left);
+			label = buf;
+			for(uint32_t k=0; k<b.nSuccs; ++k) {
+				snprintf(buf, sizeof(buf), "%s0x%llX", k ? ", " : " -> ",
+					(unsigned long long)graph.blocks[graph.succs[b.firstSucc+k]].left);
+				label += buf;
+			}
+			if(b.flags & CFG_BLOCK_RETURN) label += " (return)";
+			if(b.flags & CFG_BLOCK_INDIRECT) label += " (indirect)";
+			if(b.flags & CFG_BLOCK_INVALID) label += " (invalid)";
+
+			intervMgr.add(b.left - seg.va + seg.offset,
+				b.right - seg.va + seg.offset, label.c_str(), label.size(), source);
+		}
 	}
 }
 
-int tags_load_file(const char *target)
+/* follow the code of an ELF's executable segments from its entry point and
+	function symbols, functions and basic blocks become tags */
+void cfg_tags_cb(Fl_Widget *, void *)
 {
-	int rc = -1;
-
-	vector<string> taggers;
-	vector<Interval *> tags;
-	Fl_Tree_Item *rootItem;
+	char buf[128];
+	const uint8_t *data = (uint8_t *)fileOpenPtrMap;
+	const char *triplet;
+	map<uint64_t, string> symbols, names;
+	vector<uint64_t> entries;
+	int source, nFuncs = 0, nBlocks = 0;
+	uint64_t mask;
+
+	if(!fileOpenPtrMap) {
+		printf("ERROR: no file open\n");
+		return;
+	}
+	if(tagBusy) {
+		gui->statusBar->value("tagging, try again when it's done");
+		return;
+	}
 
-	if(0 != tagging_pollall(target, taggers)) goto cleanup;
-	// TODO: popup and let user decide if there are >1 taggers
-	if(taggers.size()) {
-		printf("going with tagger: %s\n", taggers[0].c_str());
+	triplet = cfg_elf_triplet(data, fileOpenSize);
+	if(!triplet || addrMap.format.compare(0, 3, "elf")) {
+		gui->statusBar->value("not an ELF executable of a known machine");
+		return;
 	}
-	else {
-		printf("no tagger recognized the file\n");
-		goto cleanup;
+
+	gui->statusBar->value("disassembling...");
+	Fl::check();
+
+	/* thumb addresses have their low bit set */
+	mask = strncmp(triplet, "thumb", 5) ? ~0ULL : ~1ULL;
+
+	elf_func_symbols(data, fileOpenSize, symbols);
+	for(auto i=symbols.begin(); i!=symbols.end(); ++i) {
+		names[i->first & mask] = i->second;
+		entries.push_back(i->first & mask);
 	}
+	entries.push_back(addrMap.entry & mask);
 
-	if(0 != tagging_tag(target, taggers[0], /* out */ intervMgr)) {
-		printf("ERROR: tagging_tag()\n");
-		goto cleanup;
+	/* again? the last run's tags go first, nothing in between may hold on
+		to a tag: the tree is rebuilt below */
+	source = intervMgr.sourceAdd("recursive disassembly");
+	intervMgr.sourceClear(source);
+
+	vector<addrmap_seg> &segs = addrMap.getSegs();
+	for(auto i=segs.begin(); i!=segs.end(); ++i) {
+		cfg_graph graph;
+		uint64_t len = std::min(i->fsize, i->vsize);
+
+		if(!(i->perms & ADDRMAP_X) || !i->dumped || i->offset >= fileOpenSize)
+			continue;
+		len = std::min(len, fileOpenSize - i->offset);
+
+		if(cfg_build(triplet, data + i->offset, len, i->va, entries, 0, graph)) {
+			printf("ERROR: cfg_build()\n");
+			continue;
+		}
+
+		cfg_tags_add(graph, *i, source, names, nFuncs);
+		nFuncs += graph.funcs.size();
+		nBlocks += graph.blocks.size();
 	}
 
-	/* add new tree item to the tree window */
-	if(0 == intervMgr.size()) {
-		printf("ERROR: no data received from tagger\n");
-		goto cleanup;
+	intervMgr.merge(source);
+	if(!tagSourceItems.empty())
+		tagSourceItems[source] = NULL;
+	tags_show_tree();
+
+	snprintf(buf, sizeof(buf), "%d functions, %d basic blocks", nFuncs, nBlocks);
+	gui->statusBar->value(buf);
+}
+
+/*****************************************************************************/
+/* LIVE PROCESS */
+/*****************************************************************************/
+
+#define PROC_SAMPLE_INTERVAL 0.1 /* seconds */
+#define PROC_SAMPLE_MENU_PATH "&File/&Sample process"
+
+/* each mapped region becomes a top level tag */
+void proc_tags_fill(void)
+{
+	char buf[256];
+	vector<proc_region> &regions = procSource->getRegions();
+
+	tags_cancel(NULL);
+	tags_clear();
+	for(auto i=regions.begin(); i!=regions.end(); ++i) {
+		snprintf(buf, sizeof(buf), "[0x%llX,0x%llX) %s %s", i->left, i->right,
+			i->perms, i->path.size() ? i->path.c_str() : "[anon]");
+		intervMgr.add(Interval(i->left, i->right, string(buf)));
 	}
 
-	winTags = new Fl_Window(
-		gui->mainWindow->x()+gui->mainWindow->w()+32, 
-		gui->mainWindow->y(), gui->mainWindow->w(), 
-		gui->mainWindow->h(), 
-		"tags"
-	);
-	tree = new Fl_Tree(0, 0, winTags->w(), winTags->h());
-	tree->end();
-	tree->showroot(0);
-	tree->callback((Fl_Callback *)tree_cb);
-	winTags->end();
-	winTags->resizable(tree);
+	tags_show_tree();
+}
 
-	//tree->root_label("file");
-	rootItem = tree->root();
+int proc_attach(int pid)
+{
+	int rc = -1;
+	char buf[64];
+	ProcSource *src = new ProcSource();
 
-	tags = intervMgr.findParentChild();
-	for(int i=0; i<tags.size(); ++i) {
-		tags_fill_tree_dfs(tree, rootItem, tags[i]);
+	if(src->attach(pid)) {
+		printf("ERROR: attaching to pid %d\n", pid);
+		delete src;
+		goto cleanup;
 	}
 
-	/* show window */
-	winTags->show();
+	file_unload();
+	procSource = src;
+	gui->hexView->hlClear();
+	gui->hexView->setSource(procSource);
+
+	sprintf(buf, "pid %d", pid);
+	gui->mainWindow->copy_label(buf);
+
+	proc_tags_fill();
 
 	rc = 0;
 	cleanup:
 	return rc;
 }
 
+void proc_attach_cb(Fl_Widget *, void *)
+{
+	const char *input = fl_input("process id", "");
+	if(!input)
+		return;
+
+	int pid = atoi(input);
+	if(pid <= 0 || proc_attach(pid)) {
+		fl_alert("couldn't attach to process \"%s\"", input);
+	}
+}
+
+/* re-read the region list (it may have grown or shrunk) and drop the page
+	cache, staying where we were */
+void proc_refresh_cb(Fl_Widget *, void *)
+{
+	char buf[128];
+	HexView *hv = gui->hexView;
+
+	if(!procSource) {
+		gui->statusBar->value("no process attached");
+		return;
+	}
+
+	uint64_t addrView = hv->addrViewStart;
+	if(procSource->refresh()) {
+		fl_alert("process %d is gone", procSource->getPid());
+		return;
+	}
+
+	hv->setSource(procSource);
+	hv->setView(addrView);
+	proc_tags_fill();
+
+	sprintf(buf, "pid %d: %ld regions", procSource->getPid(),
+		procSource->getRegions().size());
+	gui->statusBar->value(buf);
+}
+
+/* re-read just what's on screen */
+void proc_sample_timeout(void *)
+{
+	HexView *hv = gui->hexView;
+
+	if(!procSource || !procSampling)
+		return;
+
+	procSource->invalidate(hv->addrViewStart, hv->addrViewEnd);
+	hv->redraw();
+
+	Fl::repeat_timeout(PROC_SAMPLE_INTERVAL, proc_sample_timeout);
+}
+
+/* no more sampling, and the menu says so */
+void proc_sample_stop(void)
+{
+	Fl_Menu_Item *item = gui->menuBar->find_item(PROC_SAMPLE_MENU_PATH);
+	if(item) item->clear();
+	if(procSampling)
+		Fl::remove_timeout(proc_sample_timeout);
+	procSampling = false;
+}
+
+void proc_sample_cb(Fl_Widget *widg, void *)
+{
+	const Fl_Menu_Item *item = ((Fl_Menu_Bar *)widg)->mvalue();
+	bool want = item && item->value();
+
+	if(want && !procSource) {
+		proc_sample_stop();
+		gui->statusBar->value("no process attached");
+		return;
+	}
+
+	if(want && !procSampling)
+		Fl::add_timeout(PROC_SAMPLE_INTERVAL, proc_sample_timeout);
+	if(!want && procSampling)
+		Fl::remove_timeout(proc_sample_timeout);
+
+	procSampling = want;
+}
 
 /*****************************************************************************/
-/* HEXVIEW CALLBACK */
+/* VIRTUAL ADDRESSES */
 /*****************************************************************************/
 
-void HexView_cb(int type, void *data)
+#define VA_VIEW_MENU_PATH "&Go/&Virtual addresses"
+
+/* tags, xrefs and dupes are file offsets, this is where they are in the
+	current view (false: nowhere, the VA view and the offset isn't loaded) */
+bool view_addr(uint64_t offset, uint64_t *result)
+{
+	if(!vaView) {
+		*result = offset;
+		return true;
+	}
+	return addrMap.offsetToVa(offset, result);
+}
+
+/* a range [left,right) of offsets in the current view, each end translated
+	on its own since a range can cross segments */
+bool view_range(uint64_t left, uint64_t right, uint64_t *l, uint64_t *r)
+{
+	if(right <= left)
+		return view_addr(left, l) && view_addr(left, r);
+	if(!view_addr(left, l) || !view_addr(right - 1, r))
+		return false;
+	*r += 1;
+	return *r > *l;
+}
+
+/* cursor position in the other address space, and which segment it's in */
+void va_status_suffix(char *msg, int size)
 {
-	char msg[256] = {0};
-	uint64_t tmp;
 	HexView *hv = gui->hexView;
+	uint64_t addr = hv->addrViewStart + hv->cursorOffs, other;
+	int len = strlen(msg);
+	int seg;
 
-	char strAddrSelStart[16];
-	char strAddrSelEnd[16];
-	char strAddrViewStart[16];
-	char strAddrViewEnd[16];
-	char strAddrStart[16];
-	char strAddrEnd[16];
+	if(!vaSource)
+		return;
 
-	if(hv->addrMode == 64) {
-		sprintf(strAddrSelStart, "0x%016llX", hv->addrSelStart);
-		sprintf(strAddrSelEnd, "0x%016llX", hv->addrSelEnd);
-		sprintf(strAddrViewStart, "0x%016llX", hv->addrViewStart);
-		sprintf(strAddrViewEnd, "0x%016llX", hv->addrViewEnd);
-		sprintf(strAddrStart, "0x%016llX", hv->addrStart);
-		sprintf(strAddrEnd, "0x%016llX", hv->addrEnd);
+	if(vaView) {
+		seg = addrMap.findVa(addr);
+		if(addrMap.vaToOffset(addr, &other))
+			snprintf(msg + len, size - len, "  file 0x%llX",
+				(unsigned long long)other);
+		else
+			snprintf(msg + len, size - len, "  file -");
 	}
 	else {
-		sprintf(strAddrSelStart, "0x%08llX", hv->addrSelStart);
-		sprintf(strAddrSelEnd, "0x%08llX", hv->addrSelEnd);
-		sprintf(strAddrViewStart, "0x%08llX", hv->addrViewStart);
-		sprintf(strAddrViewEnd, "0x%08llX", hv->addrViewEnd);
-		sprintf(strAddrStart, "0x%08llX", hv->addrStart);
-		sprintf(strAddrEnd, "0x%08llX", hv->addrEnd);
+		if(addrMap.offsetToVa(addr, &other))
+			snprintf(msg + len, size - len, "  va 0x%llX",
+				(unsigned long long)other);
+		else
+			snprintf(msg + len, size - len, "  va -");
+		seg = addrMap.offsetToVa(addr, &other) ? addrMap.findVa(other) : -1;
 	}
 
-	switch(type) {
-		case HV_CB_SELECTION:
-			if(hv->selActive) {
-				tmp = hv->addrSelEnd - hv->addrSelStart;
-				sprintf(msg, "selected 0x%llX (%lld) bytes [%s,%s)",
-					tmp, tmp, strAddrSelStart, strAddrSelEnd);
-			}
-			else {
-				sprintf(msg, "selection cleared");
-			}
-			break;
+	if(seg >= 0) {
+		len = strlen(msg);
+		snprintf(msg + len, size - len, " (%s)",
+			addrMap.getSegs()[seg].name.c_str());
+	}
+}
 
-		case HV_CB_VIEW_MOVE:
-			sprintf(msg, "view moved [%s,%s) %.1f%%",
-				strAddrViewStart, strAddrViewEnd, hv->viewPercent);
-			break;
-			
-		case HV_CB_NEW_BYTES:
-			sprintf(msg, "0x%X (%d) bytes to [%s,%s)",
-				hv->nBytes, hv->nBytes, strAddrStart, strAddrEnd);
-			break;
+void goto_addr(uint64_t addr)
+{
+	HexView *hv = gui->hexView;
+
+	hv->setView(addr);
+	if(addr >= hv->addrViewStart && addr < hv->addrViewEnd)
+		hv->cursorOffs = addr - hv->addrViewStart;
+	hv->redraw();
+}
+
+void va_view_reset(void)
+{
+	Fl_Menu_Item *item = gui->menuBar->find_item(VA_VIEW_MENU_PATH);
+	if(item) item->clear();
+	vaView = false;
+	addrMap.clear();
+}
+
+/* switch between file offsets and virtual addresses, staying on the same
+	byte if it has an address in both */
+void va_view_set(bool want)
+{
+	HexView *hv = gui->hexView;
+	uint64_t addr = hv->addrViewStart + hv->cursorOffs, other;
+	Fl_Menu_Item *item = gui->menuBar->find_item(VA_VIEW_MENU_PATH);
+
+	if(want && !vaSource) {
+		gui->statusBar->value("no segment table (not ELF, PE or a core?)");
+		want = false;
 	}
 
-	if(msg[0]) {
-		gui->statusBar->value(msg);
+	if(item) {
+		if(want) item->set();
+		else item->clear();
+	}
+
+	if(want == vaView)
+		return;
+
+	hv->hlClear();
+	vaView = want;
+
+	if(vaView) {
+		if(!addrMap.offsetToVa(addr, &other)) other = addrMap.entry;
+		hv->setSource(vaSource);
+	}
+	else {
+		if(!addrMap.vaToOffset(addr, &other)) other = 0;
+		hv->setSource(fileSource);
+	}
+
+	goto_addr(other);
+}
+
+void va_view_cb(Fl_Widget *widg, void *)
+{
+	const Fl_Menu_Item *item = ((Fl_Menu_Bar *)widg)->mvalue();
+	va_view_set(item && item->value());
+}
+
+void goto_va_cb(Fl_Widget *, void *)
+{
+	uint64_t va, offs;
+
+	if(!vaSource) {
+		gui->statusBar->value("no segment table (not ELF, PE or a core?)");
+		return;
 	}
+
+	const char *input = fl_input("virtual address (hex)", "");
+	if(!input)
+		return;
+	va = strtoull(input, NULL, 16);
+
+	if(vaView) {
+		goto_addr(va);
+	}
+	else if(addrMap.vaToOffset(va, &offs)) {
+		goto_addr(offs);
+	}
+	else {
+		/* BSS or a hole, only the VA view can show it */
+		va_view_set(true);
+		goto_addr(va);
+	}
+}
+
+void goto_offset_cb(Fl_Widget *, void *)
+{
+	const char *input = fl_input("file offset (hex)", "");
+	if(!input)
+		return;
+
+	uint64_t addr;
+	if(!view_addr(strtoull(input, NULL, 16), &addr)) {
+		/* not loaded, only the file offset view can show it */
+		va_view_set(false);
+		addr = strtoull(input, NULL, 16);
+	}
+	goto_addr(addr);
+}
+
+/*****************************************************************************/
+/* SPARSE NAVIGATION */
+/*****************************************************************************/
+
+void next_data_cb(Fl_Widget *, void *)
+{
+	if(gui->hexView->jumpNextData())
+		gui->statusBar->value("no more data");
+}
+
+void prev_data_cb(Fl_Widget *, void *)
+{
+	if(gui->hexView->jumpPrevData())
+		gui->statusBar->value("no previous data");
 }
 
 /*****************************************************************************/
@@ -314,8 +1901,11 @@ void close_cb(Fl_Widget *, void *) {
 
 void quit_cb(Fl_Widget *, void *) {
 	file_unload();
+	tagging_shutdown();
 	gui->mainWindow->hide();
 	if(winTags) { winTags->hide(); }
+	if(winXrefs) { winXrefs->hide(); }
+	if(winDupes) { winDupes->hide(); }
 }
 
 void cut_cb(Fl_Widget *, void *) {
@@ -387,6 +1977,9 @@ void tree_cb(Fl_Tree *, void *)
 		{
 			Fl_Tree_Item *item = tree->callback_item();
 			//printf("tree item %p clicked!\n", item);
+			if(tags_source_toggle(item)) {
+				break;
+			}
 			if(treeItemToInterv.find(item) == treeItemToInterv.end()) {
 				printf("tree item not found in item->ival map!\n");
 			}
@@ -415,22 +2008,34 @@ void tree_cb(Fl_Tree *, void *)
 					}
 					else {
 						Interval *ival = treeItemToInterv[lineage[i]];
-						if(ival) {
-							gui->hexView->hlAdd(ival->left, ival->right, palette[i % 5]);
-						}
+						uint64_t left, right;
+						if(ival && view_range(ival->left, ival->right, &left, &right))
+							gui->hexView->hlAdd(left, right,
+								i ? palette[i % 5] : intervMgr.color(ival));
 					}
 				}
 
-				gui->hexView->setView((ival->left > 0x40) ? ival->left - 0x40 : 0);
-				gui->hexView->setSelection(ival->left, ival->right);
+				uint64_t left, right;
+				if(view_range(ival->left, ival->right, &left, &right)) {
+					gui->hexView->setView((left > 0x40) ? left - 0x40 : 0);
+					gui->hexView->setSelection(left, right);
+				}
+				else {
+					gui->statusBar->value("not loaded, see it in the file offset view");
+				}
 			}
 		}
 		case FL_TREE_REASON_DESELECTED: 
 			//printf("tree, deselected\n");
 			break;
 		case FL_TREE_REASON_OPENED: 
-			//printf("tree, opened\n");
+		{
+			/* a placeholder's insides are tagged when it's opened */
+			auto it = treeItemToInterv.find(tree->callback_item());
+			if(it != treeItemToInterv.end() && it->second->expandable)
+				tags_expand(it->second->left, it->second->right);
 			break;
+		}
 		case FL_TREE_REASON_CLOSED: 
 			//printf("tree, closed\n");
 			break;
@@ -455,11 +2060,17 @@ onGuiFinished(HlabGui *gui_, int argc, char **argv)
 
 	gui = gui_;
 
+	llvm_svcs_init();
+
 	/* menu bar */
 	static Fl_Menu_Item menuItems[] = {
 		{ "&File",			  0, 0, 0, FL_SUBMENU },
 //		{ "&New File",		0, (Fl_Callback *)new_cb },
 		{ "&Open",	FL_COMMAND + 'o', (Fl_Callback *)open_cb },
+		{ "Attach to &process...", FL_COMMAND + 'a', (Fl_Callback *)proc_attach_cb },
+		{ "&Refresh process", FL_F + 5, (Fl_Callback *)proc_refresh_cb },
+		{ "&Sample process", FL_COMMAND + 'e', (Fl_Callback *)proc_sample_cb, 0, FL_MENU_TOGGLE },
+		{ "S&top tagging", FL_COMMAND + '.', (Fl_Callback *)tags_stop_cb, 0, FL_MENU_DIVIDER },
 //		{ "&Insert File...",  FL_COMMAND + 'i', (Fl_Callback *)insert_cb, 0, FL_MENU_DIVIDER },
 //		{ "&Save File",	   FL_COMMAND + 's', (Fl_Callback *)save_cb },
 //		{ "Save File &As...", FL_COMMAND + FL_SHIFT + 's', (Fl_Callback *)saveas_cb, 0, FL_MENU_DIVIDER },
@@ -468,6 +2079,20 @@ onGuiFinished(HlabGui *gui_, int argc, char **argv)
 		{ 0 },
 
 		{ "&Tags", FL_COMMAND, (Fl_Callback *)tags_cb },
+
+		{ "&Go", 0, 0, 0, FL_SUBMENU },
+		{ "&Next data", FL_COMMAND + FL_Page_Down, (Fl_Callback *)next_data_cb },
+		{ "&Previous data", FL_COMMAND + FL_Page_Up, (Fl_Callback *)prev_data_cb, 0, FL_MENU_DIVIDER },
+		{ "&Virtual addresses", FL_COMMAND + 'r', (Fl_Callback *)va_view_cb, 0, FL_MENU_TOGGLE },
+		{ "Goto &VA...", FL_COMMAND + 'g', (Fl_Callback *)goto_va_cb },
+		{ "Goto &offset...", FL_COMMAND + FL_SHIFT + 'g', (Fl_Callback *)goto_offset_cb },
+		{ 0 },
+
+		{ "&Analysis", 0, 0, 0, FL_SUBMENU },
+		{ "Scan &pointers...", FL_COMMAND + 'p', (Fl_Callback *)xrefs_scan_cb },
+		{ "&Xrefs to here", FL_COMMAND + 'x', (Fl_Callback *)xrefs_here_cb },
+		{ "Find &duplicates", FL_COMMAND + 'd', (Fl_Callback *)dupes_find_cb },
+		{ "Disassemble &code", FL_COMMAND + 'k', (Fl_Callback *)cfg_tags_cb },
 		{ 0 },
 
 //		{ "&Edit", 0, 0, 0, FL_SUBMENU },
@@ -491,7 +2116,11 @@ onGuiFinished(HlabGui *gui_, int argc, char **argv)
 	
 	gui->hexView->setCallback(HexView_cb);
 
-	/* if command line parameter, open that */
+	/* if command line parameter, open that (or "-p <pid>" for a process) */
+	if(argc > 2 && !strcmp(argv[1], "-p")) {
+		proc_attach(atoi(argv[2]));
+	}
+	else
 	if(argc > 1) {
 		file_load(argv[1]); 
 
@@ -1,7 +1,10 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* c++ */
+#include <deque>
+#include <map>
 #include <vector>
 #include <algorithm>
 using namespace std;
@@ -49,18 +52,28 @@ bool compareByLengthP(Interval *a, Interval *b)
 	return a->length > b->length;
 }
 
+/* the merged index's order: parents before children, then by tagger */
+bool compareForIndex(Interval *a, Interval *b)
+{
+	if(a->left != b->left)
+		return a->left < b->left;
+	if(a->right != b->right)
+		return a->right > b->right;
+	return a->source < b->source;
+}
+
 /*****************************************************************************/
 /* interval class */
 /*****************************************************************************/
 
-Interval::Interval(uint64_t left_, int right_)
+Interval::Interval(uint64_t left_, uint64_t right_)
 {
 	left = left_;
 	right = right_; // [,)
 	length = right - left;
 }
 
-Interval::Interval(uint64_t left_, int right_, void *data_void_ptr_)
+Interval::Interval(uint64_t left_, uint64_t right_, void *data_void_ptr_)
 {
 	left = left_;
 	right = right_; // [,)
@@ -69,7 +82,7 @@ Interval::Interval(uint64_t left_, int right_, void *data_void_ptr_)
 	data_void_ptr = data_void_ptr_;
 }
 
-Interval::Interval(uint64_t left_, int right_, uint32_t data_u32_)
+Interval::Interval(uint64_t left_, uint64_t right_, uint32_t data_u32_)
 {
 	left = left_;
 	right = right_; // [,)
@@ -78,7 +91,7 @@ Interval::Interval(uint64_t left_, int right_, uint32_t data_u32_)
 	data_u32 = data_u32_;
 }
 
-Interval::Interval(uint64_t left_, int right_, string data_string_)
+Interval::Interval(uint64_t left_, uint64_t right_, string data_string_)
 {
 	left = left_;
 	right = right_; // [,)
@@ -111,6 +124,11 @@ void Interval::childAdd(Interval *child)
 	children.push_back(child);
 }
 
+void Interval::childClear(void)
+{
+	children.clear();
+}
+
 void Interval::childSortByAddr(void)
 {
 	std::sort(children.begin(), children.end(), compareByStartAddrP); 
@@ -181,6 +199,103 @@ IntervalMgr::~IntervalMgr()
 	intervals.clear(); 
 }
 
+/* "{<word> N}" at pos, N decimal and >= 0? */
+static bool label_number(const string &s, size_t pos, const char *word,
+	int64_t *n, size_t *end)
+{
+	size_t len = strlen(word);
+	char *stop;
+
+	if(s.compare(pos, len, word) || !isdigit(s.c_str()[pos + len]))
+		return false;
+	*n = strtoll(s.c_str() + pos + len, &stop, 10);
+	if(*stop != '}' || *n < 0)
+		return false;
+	*end = stop - s.c_str() + 1;
+	return true;
+}
+
+/* placeholder, id or parent prefixes? then say so and drop them */
+static void label_check(Interval &iv)
+{
+	static const size_t n = strlen(INTERVAL_EXPAND);
+	size_t skip = 0, end;
+
+	if(iv.data_type != 3)
+		return;
+
+	string &s = iv.data_string;
+	while(skip < s.size() && s[skip] == '{') {
+		if(!s.compare(skip, n, INTERVAL_EXPAND)) {
+			iv.expandable = true;
+			end = skip + n;
+		}
+		else
+		if(!label_number(s, skip, INTERVAL_ID, &iv.id, &end) &&
+		  !label_number(s, skip, INTERVAL_PARENT, &iv.parentId, &end))
+			break;
+
+		for(skip = end; skip < s.size() && s[skip] == ' '; )
+			skip++;
+	}
+	s.erase(0, skip);
+}
+
+/* the prefixes label_check() took off, to write the tag back out */
+static string label_prefix(Interval &iv)
+{
+	char buf[64];
+	string prefix;
+
+	if(iv.expandable)
+		prefix = INTERVAL_EXPAND " ";
+	if(iv.id >= 0) {
+		snprintf(buf, sizeof(buf), INTERVAL_ID "%lld} ", (long long)iv.id);
+		prefix += buf;
+	}
+	if(iv.parentId >= 0) {
+		snprintf(buf, sizeof(buf), INTERVAL_PARENT "%lld} ",
+			(long long)iv.parentId);
+		prefix += buf;
+	}
+	return prefix;
+}
+
+/* find the parent a tag names, then name the tag; a parent must be named
+	before its children, so they can't form a cycle */
+void IntervalMgr::idsCheck(Interval &iv)
+{
+	if(iv.id < 0 && iv.parentId < 0)
+		return;
+
+	unsigned int slot = iv.source < -1 ? 0 : iv.source + 1;
+	if(slot >= ids.size())
+		ids.resize(slot + 1);
+
+	iv.parent = NULL;
+	if(iv.parentId >= 0) {
+		auto it = ids[slot].find(iv.parentId);
+		if(it != ids[slot].end())
+			iv.parent = it->second;
+		#ifdef INTERVAL_MGR_DEBUG
+		else
+			printf("parent %lld of %s not named yet\n", (long long)iv.parentId,
+			  iv.data_string.c_str());
+		#endif
+	}
+
+	if(iv.id >= 0)
+		ids[slot][iv.id] = &iv;
+}
+
+/* intervals were moved around, the pointers to them are stale */
+void IntervalMgr::idsForget(void)
+{
+	ids.clear();
+	for(unsigned int i=0; i<intervals.size(); ++i)
+		intervals[i].parent = NULL;
+}
+
 void IntervalMgr::add(Interval iv)
 {
 	#ifdef INTERVAL_MGR_DEBUG
@@ -188,6 +303,19 @@ void IntervalMgr::add(Interval iv)
 	iv.print();
 	#endif
 	intervals.push_back(iv);
+	label_check(intervals.back());
+	idsCheck(intervals.back());
+}
+
+/* constructed in place, for in-process taggers emitting many small tags */
+void IntervalMgr::add(uint64_t left, uint64_t right, const char *label,
+	int labelLen, int source, uint32_t color)
+{
+	intervals.emplace_back(left, right, string(label, labelLen));
+	intervals.back().source = source;
+	intervals.back().color = color;
+	label_check(intervals.back());
+	idsCheck(intervals.back());
 }
 	
 unsigned int IntervalMgr::size(void)
@@ -195,64 +323,387 @@ unsigned int IntervalMgr::size(void)
 	return intervals.size();
 }
 
+Interval *IntervalMgr::get(unsigned int i)
+{
+	return &intervals[i];
+}
+
 void IntervalMgr::clear()
 {
 	searchPrepared = false;
 	intervals.clear();
+	tagged.clear();
+	sources.clear();
+	index.clear();
+	firstUnindexed = 0;
+	ids.clear();
+	joined.clear();
+}
+
+/*****************************************************************************/
+/* several taggers */
+/*****************************************************************************/
+
+/* id for a tagger's intervals, the same one each time it's asked */
+int IntervalMgr::sourceAdd(string name)
+{
+	for(unsigned int i=0; i<sources.size(); ++i)
+		if(sources[i] == name)
+			return i;
+	sources.push_back(name);
+	return sources.size() - 1;
+}
+
+string IntervalMgr::sourceName(int source)
+{
+	if(source < 0 || source >= sources.size())
+		return "";
+	return sources[source];
+}
+
+int IntervalMgr::sourceCount(void)
+{
+	return sources.size();
+}
+
+/* each tagger's colors are its own; what it leaves uncolored gets a color
+	per tagger, so taggers can be told apart */
+uint32_t IntervalMgr::color(Interval *iv)
+{
+	static const uint32_t perSource[] = {
+		0xff00ff, 0x00c0ff, 0x40ff40, 0xffa000, 0xff4040, 0xc0c0ff
+	};
+
+	if(iv->color)
+		return iv->color;
+	if(iv->source < 0)
+		return perSource[0];
+	return perSource[iv->source % (sizeof(perSource)/sizeof(perSource[0]))];
+}
+
+/* settle index[i,j), a run of identical intervals, by mergePolicy */
+void IntervalMgr::settle(unsigned int i, unsigned int j,
+	vector<Interval *> *changed)
+{
+	Interval *winner = NULL;
+
+	for(unsigned int k=i; k<j; ++k) {
+		Interval *iv = index[k];
+		if(iv->shadowed)
+			continue;
+		if(!winner) {
+			winner = iv;
+			continue;
+		}
+		if(iv->source == winner->source)
+			continue;
+
+		iv->shadowed = true;
+		if(mergePolicy == INTERVAL_MERGE_JOIN) {
+			if(!joined.count(winner))
+				joined[winner] = winner->data_string;
+			winner->data_string += " | " + iv->data_string;
+		}
+		if(changed) {
+			changed->push_back(iv);
+			changed->push_back(winner);
+		}
+	}
+}
+
+/* merge a tagger's intervals (INTERVAL_ALL_SOURCES for everyone's) added
+	since its last merge into the index
+
+	the new run is sorted on its own, then merged with the index in one
+	linear pass of pointer copies; identical intervals are settled by
+	mergePolicy, but only where the run landed, so a merge doesn't rescan
+	what earlier merges settled; changed receives whatever was shadowed or
+	relabeled */
+void IntervalMgr::merge(int source, vector<Interval *> *changed)
+{
+	vector<Interval *> run, merged;
+	vector<unsigned int> landed; /* where run's intervals went in the index */
+
+	for(unsigned int i=firstUnindexed; i<intervals.size(); ++i) {
+		Interval *iv = &intervals[i];
+		if(iv->indexed)
+			continue;
+		if(source != INTERVAL_ALL_SOURCES && iv->source != source)
+			continue;
+		iv->indexed = true;
+		run.push_back(iv);
+	}
+
+	while(firstUnindexed < intervals.size() && intervals[firstUnindexed].indexed)
+		firstUnindexed++;
+
+	if(run.empty())
+		return;
+
+	/* as std::merge (the index first among equals), noting where run goes */
+	std::sort(run.begin(), run.end(), compareForIndex);
+	merged.reserve(index.size() + run.size());
+	landed.reserve(run.size());
+	for(unsigned int a=0, b=0; a<index.size() || b<run.size(); ) {
+		if(b < run.size() &&
+		  (a == index.size() || compareForIndex(run[b], index[a]))) {
+			landed.push_back(merged.size());
+			merged.push_back(run[b++]);
+		}
+		else
+			merged.push_back(index[a++]);
+	}
+	index.swap(merged);
+
+	if(mergePolicy == INTERVAL_MERGE_KEEP)
+		return;
+
+	/* identical intervals are adjacent, earliest tagger first */
+	unsigned int done = 0;
+	for(unsigned int n=0; n<landed.size(); ++n) {
+		unsigned int i = landed[n], j = landed[n] + 1;
+		if(i < done)
+			continue;
+		while(i > 0 && index[i-1]->left == index[i]->left &&
+		  index[i-1]->right == index[i]->right)
+			i--;
+		while(j < index.size() && index[j]->left == index[i]->left &&
+		  index[j]->right == index[i]->right)
+			j++;
+		settle(i, j, changed);
+		done = j;
+	}
+}
+
+/* take a tagger's intervals back out, so it can tag again from scratch
+
+	what they shadowed comes back and joined labels lose theirs; the rest
+	are moved, so Interval pointers taken before this are stale */
+void IntervalMgr::sourceClear(int source)
+{
+	deque<Interval> kept;
+
+	/* undo every settlement, they're redone below without this tagger */
+	for(auto it = joined.begin(); it != joined.end(); ++it)
+		it->first->data_string = it->second;
+	joined.clear();
+
+	for(unsigned int i=0; i<intervals.size(); ++i) {
+		if(intervals[i].source == source)
+			continue;
+		kept.push_back(intervals[i]);
+		kept.back().shadowed = false;
+	}
+	intervals.swap(kept);
+	searchPrepared = false;
+
+	/* added order is kept, so parents are still named before children */
+	idsForget();
+	index.clear();
+	for(unsigned int i=0; i<intervals.size(); ++i) {
+		idsCheck(intervals[i]);
+		if(intervals[i].indexed)
+			index.push_back(&intervals[i]);
+	}
+	std::stable_sort(index.begin(), index.end(), compareForIndex);
+
+	firstUnindexed = 0;
+	while(firstUnindexed < intervals.size() && intervals[firstUnindexed].indexed)
+		firstUnindexed++;
+
+	if(mergePolicy == INTERVAL_MERGE_KEEP)
+		return;
+
+	for(unsigned int i=0; i<index.size(); ) {
+		unsigned int j = i + 1;
+		while(j < index.size() && index[j]->left == index[i]->left &&
+		  index[j]->right == index[i]->right)
+			j++;
+		settle(i, j, NULL);
+		i = j;
+	}
+}
+
+vector<Interval *> &IntervalMgr::sorted(void)
+{
+	return index;
+}
+
+/* remember [left,right) was asked of the tagger, merging with neighbors */
+void IntervalMgr::rangeTagged(uint64_t left, uint64_t right)
+{
+	if(left >= right)
+		return;
+
+	auto it = tagged.upper_bound(left);
+	if(it != tagged.begin()) {
+		auto prev = std::prev(it);
+		if(prev->second >= left) {
+			left = prev->first;
+			right = max(right, prev->second);
+			it = prev;
+		}
+	}
+
+	while(it != tagged.end() && it->first <= right) {
+		right = max(right, it->second);
+		it = tagged.erase(it);
+	}
+
+	tagged[left] = right;
+}
+
+/* the parts of [left,right) not yet asked of the tagger, in order */
+void IntervalMgr::rangeUntagged(uint64_t left, uint64_t right,
+	vector<pair<uint64_t, uint64_t> > &result)
+{
+	uint64_t cur = left;
+
+	result.clear();
+
+	auto it = tagged.upper_bound(left);
+	if(it != tagged.begin()) {
+		auto prev = std::prev(it);
+		if(prev->second > cur)
+			cur = prev->second;
+	}
+
+	for(; it != tagged.end() && it->first < right; ++it) {
+		if(it->first > cur)
+			result.push_back(make_pair(cur, it->first));
+		cur = max(cur, it->second);
+	}
+
+	if(cur < right)
+		result.push_back(make_pair(cur, right));
+}
+
+/* one line of tagger output: an interval, whitespace, or a comment
+	returns -1 if it's none of those */
+int IntervalMgr::readLine(const char *line, int source)
+{
+	uint64_t start, end;
+	uint32_t color;
+
+	static RE2 reWhite("\\s*");
+	static RE2 reComment("\\s*//.*\n?");
+	static RE2 reInterval(
+		"\\s*\\[\\s*"
+		"(?:0x)?([[:xdigit:]]{1,16})" /* start address */
+		"\\s*,\\s*"
+		"(?:0x)?([[:xdigit:]]{1,16})" /* end address */
+		"\\s*\\)\\s+"
+		"(?:0x)?([[:xdigit:]]{1,8})" /* color */
+		"\\s+"
+		"(.*)\n?"						/* comment */
+	);
+
+	/* if whitespace */
+	if(RE2::FullMatch(line, reWhite))
+		return 0;
+
+	/* if comment */
+	if(RE2::FullMatch(line, reComment))
+		return 0;
+
+	/* if interval */
+	string a, b, c, d;
+	if(!RE2::FullMatch(line, reInterval, &a, &b, &c, &d))
+		return -1;
+
+	parse_uint64_hex(a.c_str(), &start);
+	parse_uint64_hex(b.c_str(), &end);
+	parse_uint32_hex(c.c_str(), &color);
+
+	/* done, add interval */
+	Interval ival = Interval(start, end, d);
+	ival.source = source;
+	ival.color = color;
+	add(ival);
+	return 0;
+}
+
+static uint64_t rd_le(const uint8_t *p, int n)
+{
+	uint64_t v = 0;
+	for(int i=n-1; i>=0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void wr_le(uint8_t *p, uint64_t v, int n)
+{
+	for(int i=0; i<n; ++i, v >>= 8)
+		p[i] = v & 0xFF;
+}
+
+/* binary records (INTERVAL_BINARY_MAGIC), the magic already stripped: every
+	whole record in buf, added straight from the buffer
+
+	used: set to the bytes taken, a partial record at the end is left
+	returns the number of records, -1 if one is malformed */
+int IntervalMgr::readBinary(const uint8_t *buf, size_t len, int source,
+	size_t *used)
+{
+	size_t i = 0;
+	int n = 0;
+
+	while(len - i >= INTERVAL_RECORD_SIZE) {
+		const uint8_t *rec = buf + i;
+		uint32_t labelLen = rd_le(rec + 20, 4);
+
+		if(labelLen > INTERVAL_LABEL_MAX) {
+			printf("ERROR: record %d has a %u byte label\n", n, labelLen);
+			*used = i;
+			return -1;
+		}
+		if(len - i - INTERVAL_RECORD_SIZE < labelLen)
+			break;
+
+		add(rd_le(rec, 8), rd_le(rec + 8, 8),
+			(const char *)rec + INTERVAL_RECORD_SIZE, labelLen, source,
+			rd_le(rec + 16, 4));
+		i += INTERVAL_RECORD_SIZE + labelLen;
+		n++;
+	}
+
+	*used = i;
+	return n;
 }
 
 int IntervalMgr::readFromFilePointer(FILE *fp)
 {
 	int rc = -1;
 	char *line = NULL;
-	int len;
+	size_t line_allocd = 0;
+	vector<uint8_t> buf;
+	size_t n, used;
 
 	for(int line_num=1; 1; ++line_num) {
-		uint64_t start, end;
-		uint32_t color;
-		size_t line_allocd = 0;
-
-		if(line) {
-			free(line);
-			line = NULL;
-			line_allocd = 0;
-		}
 		if(getline(&line, &line_allocd, fp) <= 0) {
 			break; // don't whine, either error or EOF
 		}
 
-		/* if whitespace */
-		if(RE2::FullMatch(line, "\\s*"))
-			continue;
-
-		/* if comment */
-		if(RE2::FullMatch(line, "\\s*//.*"))
-			continue;
+		/* the rest is records */
+		if(line_num == 1 && !strcmp(line, INTERVAL_BINARY_MAGIC)) {
+			buf.resize(65536);
+			for(n=0; 1; ) {
+				n += fread(buf.data() + n, 1, buf.size() - n, fp);
+				if(n < buf.size())
+					break;
+				buf.resize(buf.size() * 2);
+			}
+			if(readBinary(buf.data(), n, -1, &used) < 0 || used != n) {
+				printf("ERROR: malformed or truncated records\n");
+				goto cleanup;
+			}
+			break;
+		}
 
-		/* if interval */
-		string regex;
-		regex += "\\s*\\[\\s*";
-		regex += "(?:0x)?([[:xdigit:]]{1,16})"; /* start address */
-		regex += "\\s*,\\s*";
-		regex += "(?:0x)?([[:xdigit:]]{1,16})"; /* end address */
-		regex += "\\s*\\)\\s+";
-		regex += "(?:0x)?([[:xdigit:]]{1,8})"; /* color */
-		regex += "\\s+";
-		regex += "(.*)\n?";						/* comment */
-
-		string a, b, c, d;
-		if(!RE2::FullMatch(line, regex.c_str(), &a, &b, &c, &d)) {
+		if(readLine(line)) {
 			printf("ERROR: malformed input on line %d: -%s-\n", line_num, line);
 			goto cleanup;
 		}
-
-		parse_uint64_hex(a.c_str(), &start);
-		parse_uint64_hex(b.c_str(), &end);
-		parse_uint32_hex(c.c_str(), &color);
-
-		/* done, add interval */
-		Interval ival = Interval(start, end, d);
-		add(ival);
 	}
 
 	rc = 0;
@@ -282,16 +733,62 @@ int IntervalMgr::readFromFile(char *fpath)
 	return rc;	
 }
 
+/* the same as records, INTERVAL_BINARY_MAGIC not included */
+int IntervalMgr::writeBinaryToFilePointer(FILE *fp, int source)
+{
+	uint8_t hdr[INTERVAL_RECORD_SIZE];
+
+	for(unsigned int i=0; i<intervals.size(); ++i) {
+		Interval &iv = intervals[i];
+		if(source != INTERVAL_ALL_SOURCES && iv.source != source)
+			continue;
+		string label = label_prefix(iv) + iv.data_string;
+
+		wr_le(hdr, iv.left, 8);
+		wr_le(hdr + 8, iv.right, 8);
+		wr_le(hdr + 16, iv.color, 4);
+		wr_le(hdr + 20, label.size(), 4);
+		if(fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+		  (label.size() && fwrite(label.data(), label.size(), 1, fp) != 1)) {
+			printf("ERROR: fwrite()\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* the tags as a tagger would print them, in the order they were added,
+	readFromFilePointer() reads them back */
+int IntervalMgr::writeToFilePointer(FILE *fp, int source)
+{
+	for(unsigned int i=0; i<intervals.size(); ++i) {
+		Interval &iv = intervals[i];
+		if(source != INTERVAL_ALL_SOURCES && iv.source != source)
+			continue;
+		if(fprintf(fp, "[0x%llX,0x%llX) 0x%X %s%s\n",
+		  (unsigned long long)iv.left, (unsigned long long)iv.right, iv.color,
+		  label_prefix(iv).c_str(), iv.data_string.c_str()) < 0) {
+			printf("ERROR: fprintf()\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /* sort by interval start address */
 void IntervalMgr::sortByStartAddr()
 {
 	std::sort(intervals.begin(), intervals.end(), compareByStartAddr); 
+	idsForget();
 }
 
 /* sort by interval lengths */
 void IntervalMgr::sortByLength()
 {
 	std::sort(intervals.begin(), intervals.end(), compareByLength); 
+	idsForget();
 }
 
 /* GOAL: log_2(n) search in set of possibly overlapping intervals, with
@@ -405,7 +902,7 @@ void IntervalMgr::searchFastPrep()
 	}
 
 	// STEP 3: sort the list by starting address
-	intervals = flatList;
+	intervals.assign(flatList.begin(), flatList.end());
 	sortByStartAddr();
 
 	searchPrepared = true;
@@ -465,77 +962,143 @@ bool IntervalMgr::search(uint64_t target, Interval &result)
 	return length_lowest != 0;
 }
 
+// collect every interval intersecting [left,right), so callers doing many
+// point searches in a small window (like drawing a page) scan a short list
+void IntervalMgr::searchRange(uint64_t left, uint64_t right, IntervalMgr &result)
+{
+	result.clear();
+
+	for(auto i=intervals.begin(); i!=intervals.end(); ++i) {
+		if(i->left < right && i->right > left)
+			result.add(*i);
+	}
+}
+
+/* the tree's order: parents before children (stable, so of identical
+	intervals the one listed first envelops the rest) */
+bool compareForTree(Interval *a, Interval *b)
+{
+	if(a->left != b->left)
+		return a->left < b->left;
+	return a->right > b->right;
+}
+
 // arrange the intervals into a tree structure
 // intervals towards root are enveloping intervals
 // intervals towards branches are enveloped intervals
+//
+// <source>: one tagger's intervals, INTERVAL_ALL_SOURCES for all of them,
+// shadowed intervals are left out
 // 
 // returns a vector of the root nodes of the tree
 //
-// but instead (for now) we'll use the simple O(n^2) algo:
-// for each interval, scan over the entire list of intervals
+// a tag naming its parent ({parent N}) goes under it as told; the rest go
+// under the tightest interval containing them
+//
+// in parents-first order the intervals still open (not ended before the
+// current one starts) are kept in a list; while they nest, the tightest
+// container is the innermost open one that contains the tag, but once tags
+// cross (eg: ELF segments vs. sections) the whole list is searched for the
+// shortest container, as a popped crossing interval may still hold later tags
 //
 // return (by copy) a vector of pointers (within our internal intervals) of the
 // parents
-// 
-vector<Interval *> IntervalMgr::findParentChild()
+//
+vector<Interval *> IntervalMgr::findParentChild(int source)
 {
-	vector<Interval *> listRoot;
-	
+	vector<Interval *> listRoot, order, open;
+	unordered_map<Interval *, Interval *> placed;
+	bool nested = true;
+
 	for(unsigned int i=0; i<intervals.size(); ++i) {
-		//printf("interval @%p ", &(intervals[i]));
-		//intervals[i].print();
-	}
-
-	/* we search for children backwards in the vector
-
-		this means that priority to being enveloped is given to tags listed later
-
-		priority to enveloping is given to tags listed earlier
-	*/
-	for(int i=intervals.size()-1; i>=0; --i) {
-		/* smallest interval yet */
-		unsigned int parent_i = -1;
-		uint64_t parent_length = 0;
-
-		for(int j=intervals.size()-1; j>=0; --j) {
-			/* can't envelop yourself */
-			if(i==j) continue;
-			/* if it envelopes */
-			if(!intervals[j].contains(intervals[i])) continue;
-			/* is it the smallest we've seen so far? */
-			if(parent_length && !(intervals[j].length < parent_length)) continue;
-			/* is there already an enveloping relationship?
-				(happens when taggers specify two tags with same interval) */
-			Interval *candidateChild = &intervals[i];
-			Interval *candidateParent = &intervals[j];
-			if(candidateChild->childCheck(candidateParent)) continue;
-			/* ok, update best (tightest enveloping) parent */
-			parent_i = j;
-			parent_length = candidateParent->length;
+		Interval *iv = &intervals[i];
+		if(iv->shadowed)
+			continue;
+		if(source != INTERVAL_ALL_SOURCES && iv->source != source)
+			continue;
+		iv->childClear();
+		order.push_back(iv);
+	}
+
+	std::stable_sort(order.begin(), order.end(), compareForTree);
+
+	for(unsigned int i=0; i<order.size(); ++i) {
+		Interval *iv = order[i];
+		Interval *parent = iv->parent;
+
+		Interval *container = NULL;
+
+		/* drop the ones that ended, nested ones end innermost first */
+		if(nested) {
+			while(open.size() && open.back()->right <= iv->left)
+				open.pop_back();
+		}
+		else {
+			unsigned int n = 0;
+			for(unsigned int j=0; j<open.size(); ++j)
+				if(open[j]->right > iv->left)
+					open[n++] = open[j];
+			open.resize(n);
+
+			nested = true;
+			for(unsigned int j=1; nested && j<open.size(); ++j)
+				nested = open[j-1]->contains(*open[j]);
 		}
 
-		/* if parent found, add to parent */
-		if(parent_length) {
+		/* tightest container, later ones win ties */
+		if(nested) {
+			for(int j=open.size()-1; j>=0 && !container; --j)
+				if(open[j]->contains(*iv))
+					container = open[j];
+		}
+		else {
+			for(int j=open.size()-1; j>=0; --j)
+				if(open[j]->contains(*iv) &&
+				  (!container || open[j]->length < container->length))
+					container = open[j];
+		}
+
+		if(parent && parent->shadowed)
+			parent = NULL;
+
+		/* enveloped; but not by its own descendant, which it can have if
+			it's named and a child named it before being sorted here */
+		if(!parent && container) {
+			parent = container;
+			for(Interval *up = parent; iv->id >= 0 && up; ) {
+				if(up == iv) {
+					parent = NULL;
+					break;
+				}
+				auto it = placed.find(up);
+				if(it != placed.end())
+					up = it->second;
+				else
+					up = (up->parent && !up->parent->shadowed) ? up->parent : NULL;
+			}
+		}
+
+		if(parent) {
 			#ifdef INTERVAL_MGR_DEBUG
-			printf("%s enveloped by %s\n",
-			  intervals[i].data_string.c_str(),
-			  intervals[parent_i].data_string.c_str()
-			);
+			printf("%s enveloped by %s\n", iv->data_string.c_str(),
+			  parent->data_string.c_str());
 			#endif
-			intervals[parent_i].childAdd(&(intervals[i]));
+			parent->childAdd(iv);
+			placed[iv] = parent;
 		}
-		/* if not parent found, add to root */
 		else {
 			#ifdef INTERVAL_MGR_DEBUG
-			printf("%s stands alone\n",
-			  intervals[i].data_string.c_str()
-			);
+			printf("%s stands alone\n", iv->data_string.c_str());
 			#endif
-			listRoot.push_back(&(intervals[i]));
+			listRoot.push_back(iv);
 		}
+
+		if(open.size() && !open.back()->contains(*iv))
+			nested = false;
+		open.push_back(iv);
 	}
 
-	// STEP 3: sort the list by starting address
+	// sort the list by starting address
 	std::sort(listRoot.begin(), listRoot.end(), compareByStartAddrP); 
 
 	// and the children
@@ -558,12 +1121,27 @@ void IntervalMgr::print()
 /*****************************************************************************/
 
 #ifdef TEST1
+/* crossing tags, like a segment cutting through sections: B crosses A, yet
+	C and E are tightest in A and D only fits in B */
+struct {
+	uint64_t left, right;
+	const char *label, *parent;
+} crossing[] = {
+	{0x0, 0x80, "A", NULL},
+	{0x10, 0x20, "E", "A"},
+	{0x50, 0x150, "B", NULL},
+	{0x60, 0x70, "C", "A"},
+	{0x100, 0x120, "D", "B"},
+	{0x108, 0x110, "F", "D"}
+};
+
 // g++ -std=c++11 -DTEST1 IntervalMgr.cxx -o test -lre2 -lautils
 int main(int ac, char **av)
 {
 	int rc = -1;
 	IntervalMgr mgr;
 	vector<Interval *> roots;
+	unordered_map<string, string> parents;
 
 	if(ac > 1) {
 		printf("loading %s as a tags file\n", av[1]);
@@ -573,8 +1151,10 @@ int main(int ac, char **av)
 		}
 	}
 	else {
-		printf("ERROR: expected arguments\n");
-		goto cleanup;
+		printf("no tags file given, checking crossing tags\n");
+		for(unsigned int i=0; i<sizeof(crossing)/sizeof(crossing[0]); ++i)
+			mgr.add(crossing[i].left, crossing[i].right, crossing[i].label,
+			  strlen(crossing[i].label), 0, 0);
 	}
 
 	roots = mgr.findParentChild();
@@ -582,6 +1162,28 @@ int main(int ac, char **av)
 	for(auto iter = roots.begin(); iter != roots.end(); iter++)
 		(*iter)->print(true);
 
+	if(ac > 1) {
+		rc = 0;
+		goto cleanup;
+	}
+
+	for(unsigned int i=0; i<mgr.size(); ++i) {
+		vector<Interval *> children = mgr.get(i)->childRetrieve();
+		for(auto iter = children.begin(); iter != children.end(); iter++)
+			parents[(*iter)->data_string] = mgr.get(i)->data_string;
+	}
+
+	for(unsigned int i=0; i<sizeof(crossing)/sizeof(crossing[0]); ++i) {
+		string want = crossing[i].parent ? crossing[i].parent : "";
+		string got = parents.count(crossing[i].label) ?
+		  parents[crossing[i].label] : "";
+		if(want != got) {
+			printf("ERROR: %s placed under \"%s\", expected \"%s\"\n",
+			  crossing[i].label, got.c_str(), want.c_str());
+			goto cleanup;
+		}
+	}
+
 	rc = 0;
 	cleanup:
 	return rc;
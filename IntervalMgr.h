@@ -1,4 +1,26 @@
 #include <string>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+/* label prefix of a placeholder tag, whose insides can be tagged on request
+	(see tagging.h), stripped from the label on the way in */
+#define INTERVAL_EXPAND "{expand}"
+
+/* label prefixes giving the hierarchy outright: "{id N}" names a tag,
+	"{parent N}" puts a tag under the one its tagger named N earlier, with no
+	containment check (so it needn't be inside it); N is decimal, >= 0 */
+#define INTERVAL_ID "{id "
+#define INTERVAL_PARENT "{parent "
+
+/* tags can also come as binary records instead of text lines, a stream
+	(or file) of them starts with this line
+
+	record: u64 left, u64 right, u32 color, u32 label length, label bytes
+	(little-endian, no terminator, labels at most INTERVAL_LABEL_MAX) */
+#define INTERVAL_BINARY_MAGIC "//hltag binary 1\n"
+#define INTERVAL_RECORD_SIZE 24
+#define INTERVAL_LABEL_MAX (1024*1024)
 
 class Interval
 {
@@ -11,11 +33,19 @@ class Interval
     void *data_void_ptr = NULL; // data type 1
     uint32_t data_u32; // data type 2
     string data_string; // data type 3
+    bool expandable = false; // INTERVAL_EXPAND placeholder
+    int source = -1; // IntervalMgr::sourceAdd() of the tagger, -1 for none
+    uint32_t color = 0; // as the tagger gave it, see IntervalMgr::color()
+    bool shadowed = false; // another tagger's identical interval stands for it
+    bool indexed = false; // merged into IntervalMgr's sorted index
+    int64_t id = -1; // INTERVAL_ID, -1 for none
+    int64_t parentId = -1; // INTERVAL_PARENT, -1 for none
+    Interval *parent = NULL; // what parentId named, if it was named already
     
-    Interval(uint64_t left, int right);
-    Interval(uint64_t left, int right, void *data);
-    Interval(uint64_t left, int right, uint32_t data);
-    Interval(uint64_t left, int right, string data);
+    Interval(uint64_t left, uint64_t right);
+    Interval(uint64_t left, uint64_t right, void *data);
+    Interval(uint64_t left, uint64_t right, uint32_t data);
+    Interval(uint64_t left, uint64_t right, string data);
     ~Interval();
 
     void setDestructorFree(void);
@@ -25,6 +55,7 @@ class Interval
     bool intersects(Interval &ival);
 
     void childAdd(Interval *);
+    void childClear(void);
     void childSortByAddr(void);
     void childSortByLength(void);
 	bool childCheck(Interval *orphan);
@@ -40,13 +71,37 @@ class Interval
 #define INTERVAL_MGR_STATE_EMPTY 0 /* no intervals read in */
 #define INTERVAL_MGR_STATE_RAW 1 /* intervals read in, but no search prep, no sorting */
 
+/* identical intervals from different taggers, when merged */
+#define INTERVAL_MERGE_KEEP 0 /* all stay */
+#define INTERVAL_MERGE_FIRST 1 /* earliest added tagger's stays, others shadowed */
+#define INTERVAL_MERGE_JOIN 2 /* as FIRST, the survivor's label lists them all */
+
+#define INTERVAL_ALL_SOURCES -2
+
 class IntervalMgr
 {
 	int state;
-    vector<Interval> intervals;
+    /* deque: Interval pointers handed out stay valid as more are added */
+    deque<Interval> intervals;
     bool searchPrepared=false;
+    /* ranges asked of a tagger, [left,right) by left, disjoint */
+    map<uint64_t, uint64_t> tagged;
+
+    /* taggers, an Interval's source indexes this */
+    vector<string> sources;
+    /* merged intervals, left ascending then right descending then source */
+    vector<Interval *> index;
+    unsigned int firstUnindexed = 0;
+    /* INTERVAL_MERGE_JOIN winners' labels before they were joined */
+    unordered_map<Interval *, string> joined;
+
+    /* INTERVAL_ID names, per source (+1, so -1 has one too) */
+    vector<unordered_map<int64_t, Interval *> > ids;
+    void idsCheck(Interval &iv);
+    void idsForget(void);
     
     bool searchFast(uint64_t target, int i, int j, Interval **result);
+    void settle(unsigned int i, unsigned int j, vector<Interval *> *changed);
 
     public:
     ~IntervalMgr();
@@ -54,20 +109,41 @@ class IntervalMgr
     /* you can add various things with the integer intervals with simple over-
         loaded methods here */
     void add(Interval);
+    void add(uint64_t left, uint64_t right, const char *label, int labelLen,
+        int source=-1, uint32_t color=0);
     unsigned int size(void);
+    Interval *get(unsigned int i);
     void clear(void);
 
+    int mergePolicy = INTERVAL_MERGE_JOIN;
+    int sourceAdd(string name);
+    string sourceName(int source);
+    int sourceCount(void);
+    void sourceClear(int source);
+    uint32_t color(Interval *iv);
+    void merge(int source, vector<Interval *> *changed=NULL);
+    vector<Interval *> &sorted(void);
+
+    void rangeTagged(uint64_t left, uint64_t right);
+    void rangeUntagged(uint64_t left, uint64_t right,
+        vector<pair<uint64_t, uint64_t> > &result);
+
     void sortByStartAddr();
     void sortByLength();
 
     void searchFastPrep();
     bool searchFast(uint64_t target, Interval **result);
     bool search(uint64_t target, Interval &result);
+    void searchRange(uint64_t left, uint64_t right, IntervalMgr &result);
 
+	int readLine(const char *line, int source=-1);
 	int readFromFilePointer(FILE *fp);
 	int readFromFile(char *fpath);
+	int readBinary(const uint8_t *buf, size_t len, int source, size_t *used);
+	int writeToFilePointer(FILE *fp, int source=INTERVAL_ALL_SOURCES);
+	int writeBinaryToFilePointer(FILE *fp, int source=INTERVAL_ALL_SOURCES);
 
-    vector<Interval *> findParentChild(void);
+    vector<Interval *> findParentChild(int source=INTERVAL_ALL_SOURCES);
 
     void setDestructorFree(void);
 
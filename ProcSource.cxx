@@ -0,0 +1,385 @@
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* OS */
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* c++ includes */
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "ProcSource.h"
+
+//#define PROC_SOURCE_DEBUG 1
+
+/*****************************************************************************/
+/* compare functions */
+/*****************************************************************************/
+
+bool compareRegionByLeft(const proc_region &a, const proc_region &b)
+{
+	return a.left < b.left;
+}
+
+/*****************************************************************************/
+/* /proc/<pid>/maps */
+/*****************************************************************************/
+
+/* lines look like:
+	00400000-0040c000 r-xp 00000000 08:01 1048602    /bin/cat
+	7ffd4c5e1000-7ffd4c602000 rw-p 00000000 00:00 0  [stack] */
+int
+proc_read_maps(int pid, vector<proc_region> &result)
+{
+	int rc = -1;
+	char path[64];
+	char *line = NULL;
+	size_t line_allocd = 0;
+	FILE *fp = NULL;
+
+	result.clear();
+
+	sprintf(path, "/proc/%d/maps", pid);
+	fp = fopen(path, "r");
+	if(!fp) {
+		printf("ERROR: fopen(\"%s\")\n", path);
+		goto cleanup;
+	}
+
+	while(getline(&line, &line_allocd, fp) > 0) {
+		proc_region r;
+		unsigned long long left, right, offset;
+		char perms[8];
+		int n = 0;
+
+		if(sscanf(line, "%llx-%llx %7s %llx %*s %*s%n", &left, &right, perms,
+		  &offset, &n) < 4) {
+			printf("ERROR: couldn't parse maps line: %s", line);
+			goto cleanup;
+		}
+
+		r.left = left;
+		r.right = right;
+		strncpy(r.perms, perms, 4);
+		r.perms[4] = '\0';
+		r.offset = offset;
+
+		/* rest of the line (after whitespace) is the path, if any */
+		char *p = line + n;
+		while(*p == ' ' || *p == '\t') ++p;
+		char *end = p + strlen(p);
+		while(end > p && (end[-1] == '\n' || end[-1] == ' ')) --end;
+		r.path = string(p, end - p);
+
+		result.push_back(r);
+	}
+
+	/* the kernel lists them in order, but don't depend on it */
+	std::sort(result.begin(), result.end(), compareRegionByLeft);
+
+	rc = result.size() ? 0 : -1;
+	cleanup:
+	if(line) free(line);
+	if(fp) fclose(fp);
+	return rc;
+}
+
+/*****************************************************************************/
+/* process source */
+/*****************************************************************************/
+
+ProcSource::~ProcSource()
+{
+	invalidate();
+}
+
+int ProcSource::attach(int pid_)
+{
+	pid = pid_;
+	return refresh();
+}
+
+/* re-read the region list and forget all cached bytes */
+int ProcSource::refresh(void)
+{
+	int rc = -1;
+	vector<proc_region> tmp;
+
+	invalidate();
+
+	if(proc_read_maps(pid, tmp)) {
+		printf("ERROR: proc_read_maps(%d)\n", pid);
+		goto cleanup;
+	}
+
+	regions = tmp;
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* drop cached pages intersecting [left,right) */
+void ProcSource::invalidate(uint64_t left, uint64_t right)
+{
+	if(right <= left)
+		return;
+
+	uint64_t page = left & ~(uint64_t)(PROC_PAGE_SIZE-1);
+	auto i = cache.lower_bound(page);
+	while(i != cache.end() && i->first < right) {
+		delete i->second;
+		i = cache.erase(i);
+	}
+}
+
+void ProcSource::invalidate(void)
+{
+	for(auto i=cache.begin(); i!=cache.end(); ++i)
+		delete i->second;
+	cache.clear();
+}
+
+uint64_t ProcSource::addrStart(void)
+{
+	return regions.size() ? regions.front().left : 0;
+}
+
+uint64_t ProcSource::addrEnd(void)
+{
+	return regions.size() ? regions.back().right : 0;
+}
+
+/* index of the first region starting after addr */
+int ProcSource::upperRegion(uint64_t addr)
+{
+	int lo = 0, hi = regions.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if(regions[mid].left <= addr) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+/* index of the region containing addr, or -1 if it's in a hole */
+int ProcSource::findRegion(uint64_t addr)
+{
+	int i = upperRegion(addr);
+
+	if(i > 0 && addr < regions[i-1].right)
+		return i-1;
+	return -1;
+}
+
+ProcSource::cache_page *ProcSource::getPage(uint64_t page)
+{
+	cache_page *cp;
+
+	auto i = cache.find(page);
+	if(i != cache.end()) {
+		nHits++;
+		cp = i->second;
+		cp->lastUse = ++useClock;
+		return cp;
+	}
+
+	nMisses++;
+
+	/* full? evict the least recently used, a linear scan is nothing next
+		to the syscall we're about to make */
+	if(cache.size() >= PROC_CACHE_PAGES) {
+		auto victim = cache.begin();
+		for(auto j=cache.begin(); j!=cache.end(); ++j)
+			if(j->second->lastUse < victim->second->lastUse)
+				victim = j;
+		delete victim->second;
+		cache.erase(victim);
+	}
+
+	cp = new cache_page;
+	cp->lastUse = ++useClock;
+
+	struct iovec local = { cp->data, PROC_PAGE_SIZE };
+	struct iovec remote = { (void *)page, PROC_PAGE_SIZE };
+	ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+	cp->readable = (n == PROC_PAGE_SIZE);
+
+	#ifdef PROC_SOURCE_DEBUG
+	if(!cp->readable)
+		printf("%s(): page 0x%llX unreadable\n", __func__, page);
+	#endif
+
+	cache[page] = cp;
+	return cp;
+}
+
+int ProcSource::read(uint64_t addr, uint8_t *buf, int len)
+{
+	int done = 0;
+
+	while(done < len) {
+		if(findRegion(addr) < 0)
+			break;
+
+		uint64_t page = addr & ~(uint64_t)(PROC_PAGE_SIZE-1);
+		cache_page *cp = getPage(page);
+		if(!cp->readable)
+			break;
+
+		int offs = addr - page;
+		int n = std::min(len - done, PROC_PAGE_SIZE - offs);
+		memcpy(buf + done, cp->data + offs, n);
+		done += n;
+		addr += n;
+
+		/* wrapped at the top of the address space */
+		if(addr == 0)
+			break;
+	}
+
+	return done;
+}
+
+/* holes are the gaps between regions */
+bool ProcSource::nextData(uint64_t addr, uint64_t *result)
+{
+	int i = upperRegion(addr);
+
+	if(i > 0 && addr < regions[i-1].right)
+		*result = addr;
+	else if(i < regions.size())
+		*result = regions[i].left;
+	else
+		return false;
+
+	return true;
+}
+
+bool ProcSource::prevData(uint64_t addr, uint64_t *result)
+{
+	if(addr == 0)
+		return false;
+
+	/* last region starting before addr, data either reaches addr or ends
+		at its right */
+	int i = upperRegion(addr-1);
+	if(i == 0)
+		return false;
+
+	*result = std::min(addr, regions[i-1].right);
+	return true;
+}
+
+/* adjacent regions are one run of data */
+bool ProcSource::nextHole(uint64_t addr, uint64_t *result)
+{
+	int i = findRegion(addr);
+
+	if(i < 0) {
+		if(addr >= addrEnd())
+			return false;
+		*result = addr;
+		return true;
+	}
+
+	while(i+1 < regions.size() && regions[i+1].left == regions[i].right)
+		++i;
+	if(i+1 == regions.size())
+		return false;
+
+	*result = regions[i].right;
+	return true;
+}
+
+bool ProcSource::prevHole(uint64_t addr, uint64_t *result)
+{
+	if(addr <= addrStart())
+		return false;
+
+	int i = findRegion(addr-1);
+
+	if(i < 0) {
+		*result = addr;
+		return true;
+	}
+
+	while(i > 0 && regions[i-1].right == regions[i].left)
+		--i;
+	if(i == 0)
+		return false;
+
+	*result = regions[i].left;
+	return true;
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -DTEST1 ProcSource.cxx ByteSource.cxx -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	ProcSource src;
+	uint8_t buf[64];
+	char secret[] = "hello from the other side of process_vm_readv";
+
+	if(src.attach(ac > 1 ? atoi(av[1]) : getpid())) {
+		printf("ERROR: attach()\n");
+		goto cleanup;
+	}
+
+	for(auto i=src.getRegions().begin(); i!=src.getRegions().end(); ++i)
+		printf("[0x%llX,0x%llX) %s %s\n", (unsigned long long)i->left,
+			(unsigned long long)i->right, i->perms, i->path.c_str());
+
+	if(ac > 1) {
+		rc = 0;
+		goto cleanup;
+	}
+
+	if(src.read((uintptr_t)secret, buf, sizeof(secret)) != sizeof(secret) ||
+	  memcmp(buf, secret, sizeof(secret))) {
+		printf("ERROR: reading back our own stack\n");
+		goto cleanup;
+	}
+
+	/* changes are invisible until invalidated */
+	secret[0] = 'J';
+	src.read((uintptr_t)secret, buf, 1);
+	if(buf[0] != 'h') {
+		printf("ERROR: expected the cached byte\n");
+		goto cleanup;
+	}
+	src.invalidate((uintptr_t)secret, (uintptr_t)secret + 1);
+	src.read((uintptr_t)secret, buf, 1);
+	if(buf[0] != 'J') {
+		printf("ERROR: expected the fresh byte\n");
+		goto cleanup;
+	}
+
+	/* the zero page is never mapped */
+	if(src.read(0, buf, 16) != 0) {
+		printf("ERROR: read at address 0 should fail\n");
+		goto cleanup;
+	}
+
+	printf("hits: %lld, misses: %lld\n", (long long)src.nHits,
+		(long long)src.nMisses);
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+#endif
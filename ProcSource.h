@@ -0,0 +1,71 @@
+/* bytes from the address space of a live process (linux)
+
+	the regions come from /proc/<pid>/maps, the bytes are paged in on demand
+	with process_vm_readv() and kept in a small page cache until refresh() or
+	invalidate() says they're stale
+
+	holes between regions are never read (or stored), they're just reported
+	as unreadable */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ByteSource.h"
+
+#define PROC_PAGE_SIZE 4096
+#define PROC_CACHE_PAGES 1024 /* 4MB of cached memory */
+
+struct proc_region {
+	uint64_t left, right; // [,)
+	char perms[5]; // "r-xp" etc.
+	uint64_t offset; // into the mapped file
+	string path; // file, "[heap]", "[stack]", or empty
+};
+
+class ProcSource : public ByteSource
+{
+	struct cache_page {
+		bool readable; /* false caches a failed read (eg: PROT_NONE guard) */
+		uint64_t lastUse;
+		uint8_t data[PROC_PAGE_SIZE];
+	};
+
+	int pid = 0;
+	vector<proc_region> regions; /* sorted by left */
+	map<uint64_t, cache_page *> cache; /* page address -> page */
+	uint64_t useClock = 0;
+
+	int upperRegion(uint64_t addr);
+	int findRegion(uint64_t addr);
+	cache_page *getPage(uint64_t page);
+
+	public:
+	~ProcSource();
+
+	int attach(int pid);
+	int refresh(void);
+	void invalidate(uint64_t left, uint64_t right);
+	void invalidate(void);
+
+	int getPid(void) { return pid; }
+	vector<proc_region> &getRegions(void) { return regions; }
+
+	uint64_t addrStart(void);
+	uint64_t addrEnd(void);
+	int read(uint64_t addr, uint8_t *buf, int len);
+	bool nextData(uint64_t addr, uint64_t *result);
+	bool prevData(uint64_t addr, uint64_t *result);
+	bool nextHole(uint64_t addr, uint64_t *result);
+	bool prevHole(uint64_t addr, uint64_t *result);
+
+	/* stats */
+	uint64_t nHits = 0, nMisses = 0;
+};
+
+int proc_read_maps(int pid, vector<proc_region> &result);
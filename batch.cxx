@@ -0,0 +1,628 @@
+/* hltag-batch: tag a corpus without the GUI, keeping every core busy
+
+	hltag-batch [-j workers] [-b] -o outdir [-l listfile] [file|dir]...
+
+	every (file, tagger) pair that survives the manifest prefilter is a job;
+	jobs go to a pool of forked workers, biggest file first, and each worker
+	is handed its next job the moment it finishes one, so a few huge files
+	start early instead of holding up the end of the run
+
+	outdir/<absolute path of file>.tags gets each accepting tagger's tags,
+	plugins first then in search order, each set under a "// tagger <path>"
+	comment; a file whose output is newer than it and every tagger is
+	skipped, so an interrupted run picks up where it left off; if a tagger
+	failed (or its worker died) the output goes to <file>.tags.failed
+	instead, so the next run tries the file again; with -b the
+	output is binary records instead (see IntervalMgr.h), the taggers' sets
+	one after another with no comments between
+
+	outdir/summary.txt (and stdout) gets per tagger counts and timings,
+	outdir/batch.log whatever the taggers and workers had to say
+
+	workers are processes, not threads: the tagging functions keep warm
+	servers and caches in statics, each worker gets its own */
+
+/* c stdlib includes */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* OS */
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+
+/* c++ includes */
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "IntervalMgr.h"
+#include "tagging.h"
+#include "util.h"
+
+#define BATCH_EXT ".tags"
+#define BATCH_PART ".part" /* one tagger's output, until the file's done */
+#define BATCH_FAILED ".failed" /* output of a file a tagger failed on */
+
+struct batch_file {
+	string path;
+	string out;
+	uint64_t size;
+	vector<int> jobs; /* in tagger order */
+	int pending;
+	bool current; /* output's up to date, nothing to do */
+	bool failed; /* a tagger failed, the output isn't current */
+};
+
+struct batch_job {
+	int file;
+	int tagger;
+	int state; /* TAGGING_IDLE until it's done */
+	unsigned int tags;
+	double secs;
+};
+
+struct batch_worker {
+	pid_t pid;
+	int fdJob; /* job numbers go out */
+	int fdDone; /* results come back */
+	int job; /* running, -1 when idle */
+	string buf;
+};
+
+struct batch_stats {
+	int accepted, rejected, failed;
+	unsigned long long tags;
+	double secs, secsAccepted;
+};
+
+vector<string> taggers;
+vector<batch_file> files;
+vector<batch_job> jobs;
+vector<batch_worker> workers;
+unsigned int jobsDone = 0;
+bool binaryOut = false;
+
+static time_t mtime_of(string path)
+{
+	struct stat sb;
+	if(stat(path.c_str(), &sb))
+		return 0;
+	return sb.st_mtime;
+}
+
+/* mkdir -p of everything before the last slash */
+static int mkdirs(string path)
+{
+	for(size_t i=1; i<path.size(); ++i) {
+		if(path[i] != '/')
+			continue;
+		string dir = path.substr(0, i);
+		if(mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+			printf("ERROR: mkdir(%s)\n", dir.c_str());
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+/* CORPUS */
+/*****************************************************************************/
+
+/* the files to tag, each output under outDir by the file's absolute path */
+static void files_make(vector<string> &paths, string outDir)
+{
+	char real[PATH_MAX];
+	struct stat sb;
+
+	for(int i=0; i<paths.size(); ++i) {
+		batch_file f;
+
+		if(stat(paths[i].c_str(), &sb) || !realpath(paths[i].c_str(), real))
+			continue;
+
+		f.path = real;
+		f.out = outDir + f.path + BATCH_EXT;
+		f.size = sb.st_size;
+		f.pending = 0;
+		f.current = false;
+		f.failed = false;
+		files.push_back(f);
+	}
+}
+
+static int list_read(const char *list, vector<string> &paths)
+{
+	FILE *fp = strcmp(list, "-") ? fopen(list, "r") : stdin;
+	char *line = NULL;
+	size_t allocd = 0;
+	ssize_t n;
+
+	if(!fp) {
+		printf("ERROR: fopen(%s)\n", list);
+		return -1;
+	}
+	while((n = getline(&line, &allocd, fp)) > 0) {
+		while(n && (line[n-1] == '\n' || line[n-1] == '\r'))
+			line[--n] = '\0';
+		if(n)
+			util_file_add(line, paths);
+	}
+	free(line);
+	if(fp != stdin)
+		fclose(fp);
+	return 0;
+}
+
+/* jobs for every file not already up to date, the taggers' manifests
+	weed out pairs that can't possibly match */
+static void jobs_make(int *skipped)
+{
+	vector<string> scripts, plugins;
+	time_t newest = 0;
+
+	for(int i=0; i<taggers.size(); ++i) {
+		time_t t = mtime_of(taggers[i]);
+		if(t > newest)
+			newest = t;
+		if(tagging_is_plugin(taggers[i]))
+			plugins.push_back(taggers[i]);
+		else
+			scripts.push_back(taggers[i]);
+	}
+
+	*skipped = 0;
+	for(int i=0; i<files.size(); ++i) {
+		batch_file &f = files[i];
+		vector<string> candidates = scripts;
+		time_t out = mtime_of(f.out);
+
+		if(out && out >= mtime_of(f.path) && out >= newest) {
+			f.current = true;
+			(*skipped)++;
+			continue;
+		}
+
+		/* a plugin's probe is as cheap as a manifest, it runs in the job */
+		if(tagging_filter(f.path, NULL, 0, candidates))
+			candidates.clear();
+		candidates.insert(candidates.begin(), plugins.begin(), plugins.end());
+
+		for(int j=0; j<taggers.size(); ++j) {
+			if(std::find(candidates.begin(), candidates.end(), taggers[j]) ==
+			  candidates.end())
+				continue;
+			batch_job job = {i, j, TAGGING_IDLE, 0, 0};
+			f.jobs.push_back(jobs.size());
+			jobs.push_back(job);
+		}
+		f.pending = f.jobs.size();
+	}
+}
+
+/* longest processing time first: the file's size stands in for the time */
+static bool compare_job_size(int a, int b)
+{
+	return files[jobs[a].file].size > files[jobs[b].file].size;
+}
+
+/*****************************************************************************/
+/* WORKERS */
+/*****************************************************************************/
+
+/* run jobs as they're handed over until the pipe closes
+
+	the tags go in the file's <out>.part<tagger>, the result goes back as
+	"<job> <state> <tags> <seconds>" */
+static void worker_loop(int fdJob, int fdDone)
+{
+	FILE *in = fdopen(fdJob, "r");
+	char line[64], result[128];
+
+	while(in && fgets(line, sizeof(line), in)) {
+		int j = atoi(line);
+		batch_job &job = jobs[j];
+		batch_file &f = files[job.file];
+		IntervalMgr mgr;
+		double start = util_now();
+		char part[32];
+
+		int state = tagging_run(f.path, taggers[job.tagger], mgr);
+
+		snprintf(part, sizeof(part), BATCH_PART "%d", job.tagger);
+		if(state != TAGGING_REJECTED && mgr.size()) {
+			FILE *fp = NULL;
+			if(mkdirs(f.out) || !(fp = fopen((f.out + part).c_str(), "w")) ||
+			  (binaryOut ? mgr.writeBinaryToFilePointer(fp) :
+			  mgr.writeToFilePointer(fp)))
+				state = TAGGING_FAILED;
+			if(fp)
+				fclose(fp);
+		}
+
+		snprintf(result, sizeof(result), "%d %d %u %f\n", j, state, mgr.size(),
+			util_now() - start);
+		if(write(fdDone, result, strlen(result)) != (ssize_t)strlen(result))
+			break;
+	}
+
+	tagging_shutdown();
+	fflush(stdout);
+	_exit(0);
+}
+
+static int worker_start(batch_worker &w)
+{
+	int toWorker[2], fromWorker[2];
+
+	if(pipe(toWorker))
+		return -1;
+	if(pipe(fromWorker)) {
+		close(toWorker[0]);
+		close(toWorker[1]);
+		return -1;
+	}
+	/* taggers the workers launch mustn't hold these open */
+	for(int i=0; i<2; ++i) {
+		fcntl(toWorker[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fromWorker[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	fflush(stdout);
+	w.pid = fork();
+	if(w.pid == -1) {
+		printf("ERROR: fork()\n");
+		close(toWorker[0]); close(toWorker[1]);
+		close(fromWorker[0]); close(fromWorker[1]);
+		return -1;
+	}
+
+	if(w.pid == 0) {
+		/* the other workers' ends */
+		for(int i=0; i<workers.size(); ++i) {
+			if(&workers[i] == &w || workers[i].pid <= 0)
+				continue;
+			close(workers[i].fdJob);
+			close(workers[i].fdDone);
+		}
+		close(toWorker[1]);
+		close(fromWorker[0]);
+		worker_loop(toWorker[0], fromWorker[1]);
+	}
+
+	close(toWorker[0]);
+	close(fromWorker[1]);
+	w.fdJob = toWorker[1];
+	w.fdDone = fromWorker[0];
+	w.job = -1;
+	w.buf.clear();
+	return 0;
+}
+
+static void worker_stop(batch_worker &w)
+{
+	if(w.pid <= 0)
+		return;
+	close(w.fdJob);
+	close(w.fdDone);
+	waitpid(w.pid, NULL, 0);
+	w.pid = -1;
+}
+
+/*****************************************************************************/
+/* RESULTS */
+/*****************************************************************************/
+
+/* every tagger is done with the file: join the parts, in tagger order,
+	into the output, which appears all at once
+
+	unless a tagger failed: then it's set aside as BATCH_FAILED, an output
+	newer than the file would have the next run skip it */
+static void file_finish(batch_file &f)
+{
+	string tmp = f.out + ".tmp";
+	string dest = f.out;
+	FILE *out;
+	char buf[65536];
+
+	if(mkdirs(f.out) || !(out = fopen(tmp.c_str(), "w"))) {
+		printf("ERROR: creating %s\n", tmp.c_str());
+		return;
+	}
+	if(binaryOut)
+		fputs(INTERVAL_BINARY_MAGIC, out);
+
+	for(int i=0; i<f.jobs.size(); ++i) {
+		batch_job &job = jobs[f.jobs[i]];
+		char part[32];
+		FILE *in;
+		size_t n;
+
+		snprintf(part, sizeof(part), BATCH_PART "%d", job.tagger);
+		if(job.state == TAGGING_REJECTED || !(in = fopen((f.out + part).c_str(), "r")))
+			continue;
+
+		if(!binaryOut)
+			fprintf(out, "// tagger %s%s\n", taggers[job.tagger].c_str(),
+				job.state == TAGGING_FAILED ? " (failed)" : "");
+		while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+			fwrite(buf, 1, n, out);
+		fclose(in);
+		unlink((f.out + part).c_str());
+	}
+
+	for(int i=0; i<f.jobs.size(); ++i)
+		if(jobs[f.jobs[i]].state == TAGGING_FAILED)
+			f.failed = true;
+	if(f.failed) {
+		dest = f.out + BATCH_FAILED;
+		printf("%s: a tagger failed, output left in %s\n", f.path.c_str(),
+			dest.c_str());
+	}
+	else
+		unlink((f.out + BATCH_FAILED).c_str());
+
+	if(fclose(out) || rename(tmp.c_str(), dest.c_str()))
+		printf("ERROR: writing %s\n", dest.c_str());
+}
+
+static void job_done(int j, int state, unsigned int tags, double secs)
+{
+	batch_job &job = jobs[j];
+	batch_file &f = files[job.file];
+
+	job.state = state;
+	job.tags = tags;
+	job.secs = secs;
+	jobsDone++;
+
+	if(--f.pending == 0)
+		file_finish(f);
+}
+
+/* a worker has something to say, or died (taking its job with it) */
+static int worker_service(batch_worker &w)
+{
+	char buf[4096];
+	size_t newline;
+	ssize_t n = read(w.fdDone, buf, sizeof(buf));
+
+	if(n < 0 && errno == EINTR)
+		return 0;
+
+	if(n <= 0) {
+		if(w.job != -1) {
+			printf("ERROR: worker %d died on %s with %s\n", w.pid,
+				files[jobs[w.job].file].path.c_str(),
+				taggers[jobs[w.job].tagger].c_str());
+			job_done(w.job, TAGGING_FAILED, 0, 0);
+		}
+		worker_stop(w);
+		return worker_start(w);
+	}
+
+	w.buf.append(buf, n);
+	while((newline = w.buf.find('\n')) != string::npos) {
+		int j, state;
+		unsigned int tags;
+		double secs;
+
+		if(4 == sscanf(w.buf.c_str(), "%d %d %u %lf", &j, &state, &tags, &secs) &&
+		  j == w.job) {
+			job_done(j, state, tags, secs);
+			w.job = -1;
+		}
+		w.buf.erase(0, newline + 1);
+	}
+	return 0;
+}
+
+static void summary(FILE *fp, double wall, int nWorkers, int skipped)
+{
+	map<int, batch_stats> stats;
+	double busy = 0;
+	int nFiles = 0, nFailed = 0;
+
+	for(int i=0; i<jobs.size(); ++i) {
+		batch_job &job = jobs[i];
+		batch_stats &s = stats[job.tagger];
+		s.secs += job.secs;
+		busy += job.secs;
+		if(job.state == TAGGING_ACCEPTED) {
+			s.accepted++;
+			s.tags += job.tags;
+			s.secsAccepted += job.secs;
+		}
+		else if(job.state == TAGGING_REJECTED)
+			s.rejected++;
+		else
+			s.failed++;
+	}
+	for(int i=0; i<files.size(); ++i) {
+		if(!files[i].current)
+			nFiles++;
+		if(files[i].failed)
+			nFailed++;
+	}
+
+	fprintf(fp, "%d files tagged (%d failed, retried next run), %d up to date, "
+		"%d jobs on %d workers in %.2fs (%.0f%% busy)\n", nFiles, nFailed,
+		skipped, (int)jobs.size(), nWorkers, wall,
+		wall > 0 ? 100 * busy / (wall * nWorkers) : 0);
+	fprintf(fp, "%-32s %8s %8s %8s %10s %10s %12s\n", "tagger", "ok",
+		"rejected", "failed", "seconds", "tags", "tags/sec");
+	for(auto it = stats.begin(); it != stats.end(); ++it) {
+		batch_stats &s = it->second;
+		const char *name = strrchr(taggers[it->first].c_str(), '/');
+		name = name ? name + 1 : taggers[it->first].c_str();
+		fprintf(fp, "%-32s %8d %8d %8d %10.2f %10llu %12.0f\n", name,
+			s.accepted, s.rejected, s.failed, s.secs, s.tags,
+			s.secsAccepted > 0 ? s.tags / s.secsAccepted : 0);
+	}
+}
+
+/*****************************************************************************/
+/* MAIN */
+/*****************************************************************************/
+
+static void usage(void)
+{
+	printf("usage: hltag-batch [-j workers] [-b] -o outdir [-l listfile|-] "
+		"[file|dir]...\n");
+}
+
+int main(int ac, char **av)
+{
+	int rc = -1;
+	int nWorkers = 0, skipped = 0, opt;
+	const char *outArg = NULL, *listArg = NULL;
+	string outDir;
+	vector<string> paths;
+	vector<int> order;
+	unsigned int next = 0;
+	double start;
+	FILE *console = NULL, *fp;
+	int fdLog = -1;
+
+	while((opt = getopt(ac, av, "j:bo:l:h")) != -1) {
+		switch(opt) {
+			case 'j': nWorkers = atoi(optarg); break;
+			case 'b': binaryOut = true; break;
+			case 'o': outArg = optarg; break;
+			case 'l': listArg = optarg; break;
+			default: usage(); goto cleanup;
+		}
+	}
+	if(!outArg || (optind >= ac && !listArg)) {
+		usage();
+		goto cleanup;
+	}
+	if(nWorkers <= 0)
+		nWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nWorkers <= 0)
+		nWorkers = 1;
+
+	outDir = outArg;
+	while(outDir.size() > 1 && outDir[outDir.size()-1] == '/')
+		outDir.erase(outDir.size()-1);
+	if(mkdirs(outDir + "/"))
+		goto cleanup;
+
+	/* the summary goes to the console, the chatter to the log */
+	fdLog = open((outDir + "/batch.log").c_str(), O_WRONLY|O_CREAT|O_APPEND, 0644);
+	if(fdLog == -1) {
+		printf("ERROR: opening %s/batch.log\n", outDir.c_str());
+		goto cleanup;
+	}
+	fflush(stdout);
+	console = fdopen(dup(1), "w");
+	dup2(fdLog, 1);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if(listArg && list_read(listArg, paths))
+		goto cleanup;
+	for(int i=optind; i<ac; ++i) {
+		struct stat sb;
+		if(!stat(av[i], &sb) && S_ISDIR(sb.st_mode))
+			util_dir_walk(av[i], paths);
+		else
+			util_file_add(av[i], paths);
+	}
+	files_make(paths, outDir);
+
+	/* plugins are loaded and manifests taken once, workers inherit them */
+	if(tagging_findall(taggers))
+		goto cleanup;
+	{
+		vector<tagging_plugin *> plugins;
+		if(0 == tagging_plugins(plugins))
+			for(int i=plugins.size()-1; i>=0; --i)
+				taggers.insert(taggers.begin(), plugins[i]->path);
+	}
+
+	start = util_now();
+	jobs_make(&skipped);
+	fprintf(console, "%d files, %d up to date, %d jobs for %d taggers\n",
+		(int)files.size(), skipped, (int)jobs.size(), (int)taggers.size());
+
+	/* no tagger could want it, that's an empty output */
+	for(int i=0; i<files.size(); ++i)
+		if(files[i].jobs.empty() && !files[i].current)
+			file_finish(files[i]);
+
+	for(int i=0; i<jobs.size(); ++i)
+		order.push_back(i);
+	std::stable_sort(order.begin(), order.end(), compare_job_size);
+
+	signal(SIGPIPE, SIG_IGN);
+	if(nWorkers > (int)jobs.size())
+		nWorkers = jobs.size() ? jobs.size() : 1;
+	workers.resize(nWorkers);
+	for(int i=0; i<nWorkers; ++i)
+		workers[i].pid = -1;
+	for(int i=0; i<nWorkers; ++i)
+		if(worker_start(workers[i]))
+			goto cleanup;
+
+	while(jobsDone < jobs.size()) {
+		vector<struct pollfd> pfds;
+
+		/* idle workers get the biggest job left */
+		for(int i=0; i<workers.size() && next < order.size(); ++i) {
+			batch_worker &w = workers[i];
+			char line[32];
+			if(w.job != -1 || w.pid <= 0)
+				continue;
+			snprintf(line, sizeof(line), "%d\n", order[next]);
+			if(write(w.fdJob, line, strlen(line)) != (ssize_t)strlen(line))
+				continue;
+			w.job = order[next++];
+		}
+
+		for(int i=0; i<workers.size(); ++i) {
+			struct pollfd pfd = {workers[i].fdDone, POLLIN, 0};
+			if(workers[i].pid > 0)
+				pfds.push_back(pfd);
+		}
+		if(pfds.empty()) {
+			printf("ERROR: no workers left\n");
+			goto cleanup;
+		}
+		if(poll(pfds.data(), pfds.size(), -1) < 0 && errno != EINTR)
+			goto cleanup;
+
+		for(int i=0, k=0; i<workers.size(); ++i) {
+			if(workers[i].pid <= 0)
+				continue;
+			if(pfds[k++].revents && worker_service(workers[i]))
+				printf("ERROR: restarting a worker\n");
+		}
+	}
+
+	summary(console, util_now() - start, nWorkers, skipped);
+	if((fp = fopen((outDir + "/summary.txt").c_str(), "w"))) {
+		summary(fp, util_now() - start, nWorkers, skipped);
+		fclose(fp);
+	}
+
+	rc = 0;
+	cleanup:
+	for(int i=0; i<workers.size(); ++i)
+		worker_stop(workers[i]);
+	if(console)
+		fclose(console);
+	if(fdLog != -1)
+		close(fdLog);
+	return rc;
+}
@@ -0,0 +1,623 @@
+/* hltag-bench: how fast is each tagger, and did a change slow it down?
+
+	hltag-bench [-r runs] [-T] -o report.tsv [file|dir]...
+	hltag-bench -c old.tsv new.tsv [-t percent]
+
+	every tagger whose manifest (or probe, for plugins) admits a file is run
+	on it one-shot, no warm servers, so each run pays what hlab pays the
+	first time; per (tagger, file) the report gets:
+
+		wall_s      launch to exit, the tagger's own time
+		maxrss_kb   the tagger's peak RSS (0 for plugins, they're in process)
+		tags        intervals emitted
+		tags_per_s  tags / wall_s
+		ingest_s    hlab's side: the captured output parsed into an
+		            IntervalMgr, as tagging_parse() does it (0 for plugins,
+		            whose tags go straight in while they run)
+		tree_s      merging those into the index and building the tree
+
+	with -r each is run that many times and the best of each figure is kept;
+	taggers are offered binary records (HLTAG_BINARY) like hlab offers them,
+	-T withholds the offer so the text path is what's measured
+
+	the report is tab separated with a "# hltag-bench 1" line first and a
+	header line naming the columns; -c compares two of them by tagger and
+	file name, printing what got slower or bigger by more than the
+	threshold (10% by default), and exits 1 if anything did
+
+	gencorpus.py makes a corpus, "make bench" runs both */
+
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* OS */
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+/* c++ includes */
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "IntervalMgr.h"
+#include "tagging.h"
+#include "util.h"
+
+#define BENCH_MAGIC "# hltag-bench 1"
+#define BENCH_COLUMNS "tagger\tfile\tbytes\tstatus\twall_s\tmaxrss_kb\ttags\t" \
+	"tags_per_s\tingest_s\ttree_s"
+
+/* below these, differences are noise whatever the percentage */
+#define BENCH_FLOOR_SECS 0.02
+#define BENCH_FLOOR_KB 1024
+
+struct bench_row {
+	string tagger;
+	string file;
+	uint64_t bytes;
+	string status; /* ok, rejected or failed */
+	double wall;
+	long maxrss;
+	unsigned int tags;
+	double ingest;
+	double tree;
+};
+
+static const char *base_name(const string &path)
+{
+	const char *name = strrchr(path.c_str(), '/');
+	return name ? name + 1 : path.c_str();
+}
+
+/*****************************************************************************/
+/* RUNNER */
+/*****************************************************************************/
+
+/* script taggers are forked from a runner process that is itself forked
+	before anything big is loaded: a child's peak RSS starts out as its
+	parent's at the fork, so forking them from here, holding the tags of the
+	last run, would report that instead of the tagger's own; for the same
+	reason the runner doesn't hold the output either, the tagger writes it
+	to an unlinked temporary file the two processes share
+
+	request:  <tagger>\t<target>\t<binary>\n
+	response: <exit status> <maxrss kb> <wall seconds>\n */
+
+#define BENCH_TMP "/tmp/hltag-bench.XXXXXX"
+
+struct bench_runner {
+	pid_t pid;
+	int fdReq;
+	FILE *res;
+	int fdOut; /* the temporary file */
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while(len) {
+		ssize_t n = write(fd, buf, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* "<tagger> <target>" with its stdout to fdOut, stderr dropped */
+static int run_script(string tagger, string target, bool binary, int fdOut,
+	int &status, struct rusage &ru)
+{
+	int rc = -1;
+	pid_t pid;
+
+	if(ftruncate(fdOut, 0) || lseek(fdOut, 0, SEEK_SET)) {
+		printf("ERROR: truncating the output file\n");
+		goto cleanup;
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if(pid == -1) {
+		printf("ERROR: fork()\n");
+		goto cleanup;
+	}
+
+	if(pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(fdOut, 1);
+		if(null != -1)
+			dup2(null, 2);
+		if(binary)
+			setenv("HLTAG_BINARY", "1", 1);
+		else
+			unsetenv("HLTAG_BINARY");
+		execl(tagger.c_str(), tagger.c_str(), target.c_str(), (char *)NULL);
+		_exit(-1);
+	}
+
+	while(wait4(pid, &status, 0, &ru) == -1) {
+		if(errno != EINTR) {
+			printf("ERROR: wait4() on pid=%d\n", pid);
+			goto cleanup;
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+static void runner_loop(int fdReq, int fdRes, int fdOut)
+{
+	FILE *in = fdopen(fdReq, "r");
+	char line[2*PATH_MAX+16];
+
+	while(in && fgets(line, sizeof(line), in)) {
+		char *target, *binary;
+		int status = -1;
+		struct rusage ru;
+		double start = util_now(), wall;
+		char hdr[128];
+
+		if(!(target = strchr(line, '\t')) || !(binary = strchr(target+1, '\t')))
+			break;
+		*target++ = '\0';
+		*binary++ = '\0';
+
+		memset(&ru, 0, sizeof(ru));
+		run_script(line, target, atoi(binary), fdOut, status, ru);
+		wall = util_now() - start;
+
+		snprintf(hdr, sizeof(hdr), "%d %ld %f\n", status, ru.ru_maxrss, wall);
+		if(write_all(fdRes, hdr, strlen(hdr)))
+			break;
+	}
+
+	_exit(0);
+}
+
+static int runner_start(bench_runner &r)
+{
+	int toRunner[2], fromRunner[2];
+	char tmp[] = BENCH_TMP;
+
+	if((r.fdOut = mkstemp(tmp)) == -1) {
+		printf("ERROR: mkstemp(%s)\n", tmp);
+		return -1;
+	}
+	unlink(tmp);
+
+	if(pipe(toRunner))
+		return -1;
+	if(pipe(fromRunner)) {
+		close(toRunner[0]);
+		close(toRunner[1]);
+		return -1;
+	}
+	/* the taggers the runner launches mustn't hold these open */
+	for(int i=0; i<2; ++i) {
+		fcntl(toRunner[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fromRunner[i], F_SETFD, FD_CLOEXEC);
+	}
+	fcntl(r.fdOut, F_SETFD, FD_CLOEXEC);
+
+	fflush(stdout);
+	r.pid = fork();
+	if(r.pid == -1) {
+		printf("ERROR: fork()\n");
+		close(toRunner[0]); close(toRunner[1]);
+		close(fromRunner[0]); close(fromRunner[1]);
+		return -1;
+	}
+
+	if(r.pid == 0) {
+		close(toRunner[1]);
+		close(fromRunner[0]);
+		runner_loop(toRunner[0], fromRunner[1], r.fdOut);
+	}
+
+	close(toRunner[0]);
+	close(fromRunner[1]);
+	r.fdReq = toRunner[1];
+	r.res = fdopen(fromRunner[0], "r");
+	return 0;
+}
+
+static void runner_stop(bench_runner &r)
+{
+	if(r.fdOut != -1)
+		close(r.fdOut);
+	if(r.pid <= 0)
+		return;
+	close(r.fdReq);
+	if(r.res)
+		fclose(r.res);
+	waitpid(r.pid, NULL, 0);
+	r.pid = -1;
+}
+
+/* run a script tagger through the runner, its output goes in proc as if
+	hlab had read it */
+static int runner_run(bench_runner &r, string tagger, string target,
+	bool binary, tagging_proc &proc, double &wall, long &maxrss)
+{
+	int rc = -1;
+	string req = tagger + "\t" + target + "\t" + (binary ? "1" : "0") + "\n";
+	char hdr[128];
+	struct stat sb;
+
+	proc.tagger = tagger;
+	proc.pid = -1;
+	proc.fd = -1;
+	proc.server = NULL;
+	proc.output.clear();
+	proc.eof = true;
+	proc.status = -1;
+	proc.lineNum = 1;
+	proc.state = TAGGING_RUNNING;
+	proc.binary = false;
+	proc.binScan = 0;
+
+	if(write_all(r.fdReq, req.data(), req.size()) || !fgets(hdr, sizeof(hdr),
+	  r.res) || 3 != sscanf(hdr, "%d %ld %lf", &proc.status, &maxrss, &wall)) {
+		printf("ERROR: lost the runner\n");
+		goto cleanup;
+	}
+
+	if(fstat(r.fdOut, &sb)) {
+		printf("ERROR: fstat() on the output file\n");
+		goto cleanup;
+	}
+	proc.output.resize(sb.st_size);
+	for(off_t o=0; o<sb.st_size; ) {
+		ssize_t n = pread(r.fdOut, &proc.output[o], sb.st_size - o, o);
+		if(n <= 0) {
+			printf("ERROR: reading the output file\n");
+			goto cleanup;
+		}
+		o += n;
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* MEASURE */
+/*****************************************************************************/
+
+/* one run of <tagger> on <target>, filling in the figures of <row> */
+static void measure(bench_runner &runner, string tagger, string target,
+	bool binary, bench_row &row)
+{
+	IntervalMgr mgr;
+	double start;
+
+	row.wall = 0;
+	row.maxrss = 0;
+	row.tags = 0;
+	row.ingest = 0;
+	row.tree = 0;
+
+	if(tagging_is_plugin(tagger)) {
+		start = util_now();
+		int state = tagging_run(target, tagger, mgr);
+		row.wall = util_now() - start;
+		row.status = state == TAGGING_ACCEPTED ? "ok" :
+			state == TAGGING_REJECTED ? "rejected" : "failed";
+	}
+	else {
+		tagging_proc proc;
+
+		if(runner_run(runner, tagger, target, binary, proc, row.wall,
+		  row.maxrss)) {
+			row.status = "failed";
+			return;
+		}
+
+		if(tagging_classify(proc) != TAGGING_ACCEPTED) {
+			row.status = "rejected";
+			return;
+		}
+
+		start = util_now();
+		row.status = tagging_parse(proc, mgr) ? "failed" : "ok";
+		row.ingest = util_now() - start;
+	}
+
+	start = util_now();
+	mgr.merge(mgr.sourceAdd(tagger));
+	mgr.findParentChild();
+	row.tree = util_now() - start;
+	row.tags = mgr.size();
+}
+
+static int report_write(FILE *fp, vector<bench_row> &rows)
+{
+	fprintf(fp, "%s\n%s\n", BENCH_MAGIC, BENCH_COLUMNS);
+	for(int i=0; i<rows.size(); ++i) {
+		bench_row &r = rows[i];
+		fprintf(fp, "%s\t%s\t%llu\t%s\t%.6f\t%ld\t%u\t%.0f\t%.6f\t%.6f\n",
+			r.tagger.c_str(), r.file.c_str(), (unsigned long long)r.bytes,
+			r.status.c_str(), r.wall, r.maxrss, r.tags,
+			r.wall > 0 ? r.tags / r.wall : 0, r.ingest, r.tree);
+	}
+	return ferror(fp) ? -1 : 0;
+}
+
+/*****************************************************************************/
+/* COMPARE */
+/*****************************************************************************/
+
+static int report_read(const char *path, map<string, bench_row> &rows)
+{
+	int rc = -1;
+	FILE *fp;
+	char *line = NULL;
+	size_t allocd = 0;
+	ssize_t n;
+	int lineNum = 0;
+
+	if(!(fp = fopen(path, "r"))) {
+		printf("ERROR: fopen(%s)\n", path);
+		goto cleanup;
+	}
+
+	while((n = getline(&line, &allocd, fp)) > 0) {
+		char tagger[1024], file[1024], status[32];
+		unsigned long long bytes;
+		double tagsPerSec;
+		bench_row r;
+
+		lineNum++;
+		while(n && (line[n-1] == '\n' || line[n-1] == '\r'))
+			line[--n] = '\0';
+		if(lineNum == 1) {
+			if(strcmp(line, BENCH_MAGIC)) {
+				printf("ERROR: %s isn't an hltag-bench report\n", path);
+				goto cleanup;
+			}
+			continue;
+		}
+		if(!n || line[0] == '#' || !strcmp(line, BENCH_COLUMNS))
+			continue;
+
+		if(10 != sscanf(line, "%1023[^\t]\t%1023[^\t]\t%llu\t%31[^\t]\t%lf\t%ld"
+		  "\t%u\t%lf\t%lf\t%lf", tagger, file, &bytes, status, &r.wall,
+		  &r.maxrss, &r.tags, &tagsPerSec, &r.ingest, &r.tree)) {
+			printf("ERROR: %s line %d is malformed\n", path, lineNum);
+			goto cleanup;
+		}
+		r.tagger = tagger;
+		r.file = file;
+		r.bytes = bytes;
+		r.status = status;
+		rows[string(base_name(r.tagger)) + "\t" + base_name(r.file)] = r;
+	}
+
+	rc = 0;
+	cleanup:
+	free(line);
+	if(fp)
+		fclose(fp);
+	return rc;
+}
+
+/* is b worse than a by more than pct percent (and more than floor)? */
+static bool regressed(double a, double b, double pct, double floor)
+{
+	return b - a > floor && b > a * (1 + pct / 100);
+}
+
+static void compare_print(const char *what, const string &key, const char *metric,
+	double a, double b)
+{
+	printf("%-10s %s\t%s %g -> %g", what, key.c_str(), metric, a, b);
+	if(a > 0)
+		printf(" (%+.0f%%)", 100 * (b - a) / a);
+	printf("\n");
+}
+
+static int compare(const char *pathOld, const char *pathNew, double pct)
+{
+	int rc = -1;
+	map<string, bench_row> rowsOld, rowsNew;
+	int regressions = 0, compared = 0;
+
+	if(report_read(pathOld, rowsOld) || report_read(pathNew, rowsNew))
+		goto cleanup;
+
+	for(auto it = rowsNew.begin(); it != rowsNew.end(); ++it) {
+		const string &key = it->first;
+		bench_row &b = it->second;
+		auto found = rowsOld.find(key);
+
+		if(found == rowsOld.end()) {
+			printf("%-10s %s\n", "NEW", key.c_str());
+			continue;
+		}
+		bench_row &a = found->second;
+
+		if(a.status != b.status) {
+			printf("%-10s %s\tstatus %s -> %s\n", a.status == "ok" ?
+				"REGRESSION" : "CHANGED", key.c_str(), a.status.c_str(),
+				b.status.c_str());
+			if(a.status == "ok")
+				regressions++;
+			continue;
+		}
+		if(b.status != "ok")
+			continue;
+		compared++;
+
+		if(a.tags != b.tags)
+			compare_print("CHANGED", key, "tags", a.tags, b.tags);
+
+		struct { const char *metric; double a, b, floor; } checks[] = {
+			{"wall_s", a.wall, b.wall, BENCH_FLOOR_SECS},
+			{"maxrss_kb", (double)a.maxrss, (double)b.maxrss, BENCH_FLOOR_KB},
+			{"ingest_s", a.ingest, b.ingest, BENCH_FLOOR_SECS},
+			{"tree_s", a.tree, b.tree, BENCH_FLOOR_SECS}
+		};
+		for(int i=0; i<sizeof(checks)/sizeof(checks[0]); ++i) {
+			if(!regressed(checks[i].a, checks[i].b, pct, checks[i].floor))
+				continue;
+			compare_print("REGRESSION", key, checks[i].metric, checks[i].a,
+				checks[i].b);
+			regressions++;
+		}
+	}
+	for(auto it = rowsOld.begin(); it != rowsOld.end(); ++it)
+		if(rowsNew.find(it->first) == rowsNew.end())
+			printf("%-10s %s\n", "GONE", it->first.c_str());
+
+	printf("%d compared, %d regressions beyond %g%%\n", compared, regressions,
+		pct);
+	rc = regressions ? 1 : 0;
+
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* MAIN */
+/*****************************************************************************/
+
+static void usage(void)
+{
+	printf("usage: hltag-bench [-r runs] [-T] -o report.tsv [file|dir]...\n");
+	printf("       hltag-bench -c old.tsv new.tsv [-t percent]\n");
+}
+
+int main(int ac, char **av)
+{
+	int rc = -1;
+	int runs = 1, opt;
+	bool binary = true, comparing = false;
+	double pct = 10;
+	const char *outArg = NULL;
+	vector<string> files, taggers, scripts, plugins;
+	vector<bench_row> rows;
+	bench_runner runner = {-1, -1, NULL, -1};
+	FILE *fp = NULL;
+
+	while((opt = getopt(ac, av, "r:To:ct:h")) != -1) {
+		switch(opt) {
+			case 'r': runs = atoi(optarg); break;
+			case 'T': binary = false; break;
+			case 'o': outArg = optarg; break;
+			case 'c': comparing = true; break;
+			case 't': pct = atof(optarg); break;
+			default: usage(); goto cleanup;
+		}
+	}
+
+	if(comparing) {
+		if(optind + 2 != ac) {
+			usage();
+			goto cleanup;
+		}
+		rc = compare(av[optind], av[optind+1], pct);
+		goto cleanup;
+	}
+
+	if(!outArg || optind >= ac) {
+		usage();
+		goto cleanup;
+	}
+	if(runs < 1)
+		runs = 1;
+	if(runner_start(runner))
+		goto cleanup;
+
+	for(int i=optind; i<ac; ++i) {
+		struct stat sb;
+		if(!stat(av[i], &sb) && S_ISDIR(sb.st_mode))
+			util_dir_walk(av[i], files);
+		else
+			util_file_add(av[i], files);
+	}
+
+	if(tagging_findall(scripts))
+		goto cleanup;
+	{
+		vector<tagging_plugin *> loaded;
+		if(0 == tagging_plugins(loaded))
+			for(int i=0; i<loaded.size(); ++i)
+				plugins.push_back(loaded[i]->path);
+	}
+
+	for(int i=0; i<files.size(); ++i) {
+		vector<string> candidates = scripts;
+		struct stat sb;
+
+		if(stat(files[i].c_str(), &sb))
+			continue;
+		if(tagging_filter(files[i], NULL, 0, candidates))
+			candidates.clear();
+		candidates.insert(candidates.begin(), plugins.begin(), plugins.end());
+
+		for(int j=0; j<candidates.size(); ++j) {
+			bench_row best;
+
+			for(int k=0; k<runs; ++k) {
+				bench_row r;
+				measure(runner, candidates[j], files[i], binary, r);
+				if(k == 0) {
+					best = r;
+					continue;
+				}
+				if(r.status != best.status)
+					best.status = "failed";
+				best.wall = min(best.wall, r.wall);
+				best.maxrss = min(best.maxrss, r.maxrss);
+				best.ingest = min(best.ingest, r.ingest);
+				best.tree = min(best.tree, r.tree);
+			}
+			best.tagger = candidates[j];
+			best.file = files[i];
+			best.bytes = sb.st_size;
+
+			/* plugins get asked about everything, don't clutter the report */
+			if(best.status == "rejected" && tagging_is_plugin(candidates[j]))
+				continue;
+
+			printf("%-24s %-28s %-8s %8.3fs %8ldKB %8u tags\n",
+				base_name(best.tagger), base_name(best.file),
+				best.status.c_str(), best.wall, best.maxrss, best.tags);
+			rows.push_back(best);
+		}
+	}
+
+	if(!(fp = fopen(outArg, "w"))) {
+		printf("ERROR: fopen(%s)\n", outArg);
+		goto cleanup;
+	}
+	if(report_write(fp, rows)) {
+		printf("ERROR: writing %s\n", outArg);
+		goto cleanup;
+	}
+	printf("%d results in %s\n", (int)rows.size(), outArg);
+
+	rc = 0;
+	cleanup:
+	if(fp)
+		fclose(fp);
+	runner_stop(runner);
+	tagging_shutdown();
+	return rc;
+}
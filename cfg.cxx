@@ -0,0 +1,523 @@
+/* recursive descent disassembly
+
+	STEP1: functions are explored in parallel, threads taking entries off a
+		shared queue; entries are claimed in a bitmap all threads share (an
+		atomic OR, a bit per byte of code) so each function is explored
+		once, and the calls a function makes queue their targets if they
+		weren't claimed already
+	STEP2: a function is explored with a worklist of addresses, decoding a
+		basic block's worth at a time (llvm_svcs_disasm_block()) up to the
+		next instruction it has already seen, seen being a bitmap per thread
+		that's cleared of just the function's bits after it
+	STEP3: the function's instructions, sorted, are cut into blocks at the
+		leaders (the entry, branch targets, what follows a branch) and where
+		they're not contiguous, and successors are found by binary search
+	STEP4: functions are sorted by entry and their blocks concatenated, so
+		the graph is the same however the work was divided
+
+	code reached from two functions (a tail jump, shared epilogues) is in
+	both, a block belongs to exactly one function */
+
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* c++ includes */
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/* local stuff */
+#include "llvm_svcs.h"
+#include "cfg.h"
+
+/* how far a run looks ahead for an instruction it has already seen */
+#define CFG_RUN_MAX 0x1000
+
+/* a function's blocks before they're placed in the graph, successors are
+	indices into its own blocks */
+struct cfg_part {
+	uint64_t entry;
+	vector<cfg_block> blocks;
+	vector<uint32_t> succs;
+};
+
+bool compareCfgPart(const cfg_part &a, const cfg_part &b)
+{
+	return a.entry < b.entry;
+}
+
+bool compareInsnByOffset(const llvm_svcs_insn &a, const llvm_svcs_insn &b)
+{
+	return a.offset < b.offset;
+}
+
+bool compareBlockByLeft(const cfg_block &a, const cfg_block &b)
+{
+	return a.left < b.left;
+}
+
+struct cfg_shared {
+	const char *triplet;
+	const uint8_t *code;
+	uint64_t len, addr;
+	vector<uint64_t> claimed; /* function entries, a bit per byte offset */
+	mutex lock;
+	condition_variable cv;
+	vector<uint64_t> queue; /* claimed, not yet explored (offsets) */
+	int busy; /* threads exploring */
+	int rc;
+};
+
+struct cfg_worker {
+	vector<uint64_t> seen; /* instruction starts of the current function */
+	vector<llvm_svcs_insn> insns;
+	string arena; /* stays empty, no text is asked for */
+	vector<uint64_t> work, leaders, calls;
+	vector<uint32_t> lasts; /* each block's last instruction */
+	vector<cfg_part> parts;
+};
+
+/*****************************************************************************/
+/* bitmaps */
+/*****************************************************************************/
+
+static inline bool bit_test(const vector<uint64_t> &bits, uint64_t i)
+{
+	return bits[i >> 6] & (1ULL << (i & 63));
+}
+
+static inline void bit_set(vector<uint64_t> &bits, uint64_t i)
+{
+	bits[i >> 6] |= 1ULL << (i & 63);
+}
+
+static inline void bit_clear(vector<uint64_t> &bits, uint64_t i)
+{
+	bits[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+/* first set bit in [from,limit), else limit */
+static uint64_t bit_next(const vector<uint64_t> &bits, uint64_t from,
+	uint64_t limit)
+{
+	while(from < limit) {
+		uint64_t word = bits[from >> 6] >> (from & 63);
+		if(word)
+			return std::min(limit, from + __builtin_ctzll(word));
+		from = (from | 63) + 1;
+	}
+	return limit;
+}
+
+/* true for the one thread that claims offs */
+static bool claim(cfg_shared &s, uint64_t offs)
+{
+	uint64_t bit = 1ULL << (offs & 63);
+	return !(__atomic_fetch_or(&s.claimed[offs >> 6], bit, __ATOMIC_RELAXED) &
+		bit);
+}
+
+/*****************************************************************************/
+/* one function */
+/*****************************************************************************/
+
+/* STEP2: decode everything reachable from entry without calls */
+static int explore(cfg_shared &s, cfg_worker &w, uint64_t entry)
+{
+	w.insns.clear();
+	w.work.clear();
+	w.leaders.clear();
+	w.calls.clear();
+
+	w.work.push_back(entry);
+	w.leaders.push_back(entry);
+
+	while(!w.work.empty()) {
+		uint64_t offs = w.work.back();
+		w.work.pop_back();
+		if(bit_test(w.seen, offs))
+			continue;
+
+		size_t first = w.insns.size();
+		uint64_t end = bit_next(w.seen, offs + 1,
+			std::min(s.len, offs + CFG_RUN_MAX));
+		if(llvm_svcs_disasm_block(s.triplet, s.code, s.len, s.addr, offs, end,
+		  w.insns, w.arena, LLVM_SVCS_DISASM_NO_TEXT))
+			return -1;
+		if(w.insns.size() == first)
+			continue;
+
+		for(size_t i=first; i<w.insns.size(); ++i) {
+			llvm_svcs_insn &insn = w.insns[i];
+			bit_set(w.seen, insn.offset);
+
+			if(!(insn.flags & LLVM_SVCS_INSN_TARGET))
+				continue;
+			if(insn.target < s.addr || insn.target - s.addr >= s.len)
+				continue;
+			if(insn.flags & LLVM_SVCS_INSN_CALL) {
+				w.calls.push_back(insn.target - s.addr);
+			}
+			else {
+				w.work.push_back(insn.target - s.addr);
+				w.leaders.push_back(insn.target - s.addr);
+			}
+		}
+
+		/* falls through? (a run stopped at a seen instruction does too) */
+		llvm_svcs_insn &last = w.insns.back();
+		uint64_t next = last.offset + last.length;
+		if(last.flags & (LLVM_SVCS_INSN_RETURN|LLVM_SVCS_INSN_INVALID))
+			continue;
+		if((last.flags & LLVM_SVCS_INSN_BRANCH) &&
+		  !(last.flags & LLVM_SVCS_INSN_COND))
+			continue;
+		if(next >= s.len)
+			continue;
+		w.work.push_back(next);
+		if(last.flags & LLVM_SVCS_INSN_BRANCH)
+			w.leaders.push_back(next);
+	}
+
+	return 0;
+}
+
+/* STEP3: cut the explored instructions into blocks */
+static void partition(cfg_shared &s, cfg_worker &w, uint64_t entry)
+{
+	cfg_part part;
+	size_t li = 0;
+	bool ended = true;
+	uint64_t prevEnd = 0;
+
+	part.entry = s.addr + entry;
+
+	std::sort(w.insns.begin(), w.insns.end(), compareInsnByOffset);
+	std::sort(w.leaders.begin(), w.leaders.end());
+	w.lasts.clear();
+
+	for(uint32_t i=0; i<w.insns.size(); ++i) {
+		llvm_svcs_insn &insn = w.insns[i];
+
+		while(li < w.leaders.size() && w.leaders[li] < insn.offset)
+			li++;
+		bool leader = li < w.leaders.size() && w.leaders[li] == insn.offset;
+
+		if(ended || leader || insn.offset != prevEnd) {
+			cfg_block b = {s.addr + insn.offset, 0, 0, 0, 0, 0, 0};
+			part.blocks.push_back(b);
+			w.lasts.push_back(i);
+		}
+
+		cfg_block &b = part.blocks.back();
+		b.right = s.addr + insn.offset + insn.length;
+		b.nInsns++;
+		if(insn.flags & LLVM_SVCS_INSN_CALL)
+			b.flags |= CFG_BLOCK_CALLS;
+		w.lasts.back() = i;
+
+		ended = insn.flags & (LLVM_SVCS_INSN_BRANCH|LLVM_SVCS_INSN_RETURN|
+			LLVM_SVCS_INSN_INVALID);
+		prevEnd = insn.offset + insn.length;
+	}
+
+	for(uint32_t j=0; j<part.blocks.size(); ++j) {
+		cfg_block &b = part.blocks[j];
+		llvm_svcs_insn &last = w.insns[w.lasts[j]];
+		int taken = -1;
+
+		b.firstSucc = part.succs.size();
+
+		if(last.flags & LLVM_SVCS_INSN_RETURN)
+			b.flags |= CFG_BLOCK_RETURN;
+		if(last.flags & LLVM_SVCS_INSN_INVALID)
+			b.flags |= CFG_BLOCK_INVALID;
+
+		if(last.flags & LLVM_SVCS_INSN_BRANCH) {
+			if(!(last.flags & LLVM_SVCS_INSN_TARGET)) {
+				b.flags |= CFG_BLOCK_INDIRECT;
+			}
+			else {
+				cfg_block key;
+				key.left = last.target;
+				auto it = std::lower_bound(part.blocks.begin(),
+					part.blocks.end(), key, compareBlockByLeft);
+				if(it != part.blocks.end() && it->left == last.target) {
+					taken = it - part.blocks.begin();
+					part.succs.push_back(taken);
+				}
+			}
+		}
+
+		if(!(last.flags & (LLVM_SVCS_INSN_RETURN|LLVM_SVCS_INSN_INVALID)) &&
+		  !((last.flags & LLVM_SVCS_INSN_BRANCH) &&
+		  !(last.flags & LLVM_SVCS_INSN_COND)) &&
+		  j+1 < part.blocks.size() && part.blocks[j+1].left == b.right &&
+		  (int)(j+1) != taken)
+			part.succs.push_back(j+1);
+
+		b.nSuccs = part.succs.size() - b.firstSucc;
+	}
+
+	/* the next function starts with nothing seen */
+	for(size_t i=0; i<w.insns.size(); ++i)
+		bit_clear(w.seen, w.insns[i].offset);
+
+	w.parts.push_back(std::move(part));
+}
+
+/*****************************************************************************/
+/* threads */
+/*****************************************************************************/
+
+/* STEP1: explore queued functions until there are none and nobody is
+	exploring (who could queue more) */
+static void worker_run(cfg_shared *s, cfg_worker *w)
+{
+	w->seen.assign((s->len + 63) / 64, 0);
+
+	unique_lock<mutex> lk(s->lock);
+	for(;;) {
+		if(s->queue.empty()) {
+			if(!s->busy)
+				break;
+			s->cv.wait(lk);
+			continue;
+		}
+
+		uint64_t entry = s->queue.back();
+		s->queue.pop_back();
+		s->busy++;
+		lk.unlock();
+
+		int rc = explore(*s, *w, entry);
+		if(rc == 0) {
+			partition(*s, *w, entry);
+
+			/* keep only the calls to functions nobody has claimed */
+			size_t n = 0;
+			for(size_t i=0; i<w->calls.size(); ++i)
+				if(claim(*s, w->calls[i]))
+					w->calls[n++] = w->calls[i];
+			w->calls.resize(n);
+		}
+
+		lk.lock();
+		s->busy--;
+		if(rc) {
+			s->rc = -1;
+			s->queue.clear();
+		}
+		else {
+			s->queue.insert(s->queue.end(), w->calls.begin(), w->calls.end());
+		}
+		s->cv.notify_all();
+	}
+}
+
+/*****************************************************************************/
+/* main API */
+/*****************************************************************************/
+
+int
+cfg_build(const char *triplet, const uint8_t *code, uint64_t len,
+	uint64_t addr, const vector<uint64_t> &entries, int nThreads,
+	cfg_graph &result)
+{
+	int rc = -1;
+	cfg_shared s;
+	vector<cfg_worker> workers;
+	vector<thread> threads;
+	vector<cfg_part> parts;
+
+	result.funcs.clear();
+	result.blocks.clear();
+	result.succs.clear();
+
+	if(nThreads <= 0)
+		nThreads = std::max(1u, thread::hardware_concurrency());
+
+	s.triplet = triplet;
+	s.code = code;
+	s.len = len;
+	s.addr = addr;
+	s.claimed.assign((len + 63) / 64, 0);
+	s.busy = 0;
+	s.rc = 0;
+
+	for(auto i=entries.begin(); i!=entries.end(); ++i) {
+		if(*i < addr || *i - addr >= len)
+			continue;
+		if(claim(s, *i - addr))
+			s.queue.push_back(*i - addr);
+	}
+
+	workers.resize(nThreads);
+	for(int i=0; i<nThreads; ++i)
+		threads.push_back(thread(worker_run, &s, &workers[i]));
+	for(auto i=threads.begin(); i!=threads.end(); ++i)
+		i->join();
+
+	if(s.rc) {
+		printf("ERROR: llvm_svcs_disasm_block()\n");
+		goto cleanup;
+	}
+
+	/* STEP4: by entry, then placed */
+	for(int i=0; i<nThreads; ++i) {
+		for(auto j=workers[i].parts.begin(); j!=workers[i].parts.end(); ++j)
+			parts.push_back(std::move(*j));
+		vector<cfg_part>().swap(workers[i].parts);
+	}
+	std::sort(parts.begin(), parts.end(), compareCfgPart);
+
+	result.funcs.reserve(parts.size());
+	for(uint32_t i=0; i<parts.size(); ++i) {
+		cfg_part &p = parts[i];
+		cfg_func f = {p.entry, (uint32_t)result.blocks.size(),
+			(uint32_t)p.blocks.size()};
+		uint32_t succBase = result.succs.size();
+
+		for(auto j=p.blocks.begin(); j!=p.blocks.end(); ++j) {
+			j->func = i;
+			j->firstSucc += succBase;
+			result.blocks.push_back(*j);
+		}
+		for(auto j=p.succs.begin(); j!=p.succs.end(); ++j)
+			result.succs.push_back(*j + f.firstBlock);
+
+		result.funcs.push_back(f);
+		vector<cfg_block>().swap(p.blocks);
+		vector<uint32_t>().swap(p.succs);
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+const char *
+cfg_elf_triplet(const uint8_t *data, uint64_t len)
+{
+	bool is64, be;
+	uint16_t machine;
+	uint32_t entry;
+
+	if(len < 0x34 || memcmp(data, "\x7F" "ELF", 4))
+		return NULL;
+
+	is64 = (data[4] == 2);
+	be = (data[5] == 2);
+	machine = be ? (data[0x12] << 8 | data[0x13]) : (data[0x13] << 8 | data[0x12]);
+	entry = be ? (data[0x18] << 24 | data[0x19] << 16 | data[0x1A] << 8 |
+		data[0x1B]) : (data[0x1B] << 24 | data[0x1A] << 16 | data[0x19] << 8 |
+		data[0x18]);
+
+	switch(machine) {
+		case 3: /* EM_386 */
+			return "i386-none-none";
+		case 62: /* EM_X86_64 */
+			return "x86_64-none-none";
+		case 40: /* EM_ARM, an odd entry is thumb */
+			if(be)
+				return NULL;
+			return (entry & 1) ? "thumbv7-none-none" : "armv7-none-none";
+		case 183: /* EM_AARCH64 */
+			return be ? "aarch64_be-none-none" : "aarch64-none-none";
+		case 8: /* EM_MIPS */
+			if(is64)
+				return be ? "mips64-none-none" : "mips64el-none-none";
+			return be ? "mips-none-none" : "mipsel-none-none";
+		case 20: /* EM_PPC */
+			return be ? "powerpc-none-none" : NULL;
+		case 21: /* EM_PPC64 */
+			return be ? "powerpc64-none-none" : "powerpc64le-none-none";
+	}
+
+	return NULL;
+}
+
+#ifdef TEST1
+// g++ -std=c++11 -pthread -DTEST1 cfg.cxx llvm_svcs.o util.o `llvm-config --ldflags --libs` -lautils -o test
+#include "util.h"
+
+/* ./test <triple> <file> <offset> <length> <address> <entry>...
+	(numbers in hex), one thread and seven must agree */
+int main(int ac, char **av)
+{
+	int rc = -1;
+	FILE *fp = NULL;
+	uint8_t *buf = NULL;
+	uint64_t offset, len, addr;
+	vector<uint64_t> entries;
+	cfg_graph graph1, graphN;
+	double t1, tN;
+
+	if(ac < 7) {
+		printf("usage: %s <triple> <file> <offset> <length> <address> "
+			"<entry>...\n", av[0]);
+		goto cleanup;
+	}
+
+	offset = strtoull(av[3], NULL, 16);
+	len = strtoull(av[4], NULL, 16);
+	addr = strtoull(av[5], NULL, 16);
+	for(int i=6; i<ac; ++i)
+		entries.push_back(strtoull(av[i], NULL, 16));
+
+	buf = (uint8_t *)malloc(len);
+	fp = fopen(av[2], "rb");
+	if(!buf || !fp || fseek(fp, offset, SEEK_SET) || fread(buf, 1, len, fp) != len) {
+		printf("ERROR: reading 0x%llX bytes at 0x%llX of %s\n",
+			(unsigned long long)len, (unsigned long long)offset, av[2]);
+		goto cleanup;
+	}
+
+	llvm_svcs_init();
+
+	t1 = util_now();
+	if(cfg_build(av[1], buf, len, addr, entries, 1, graph1))
+		goto cleanup;
+	t1 = util_now() - t1;
+
+	tN = util_now();
+	if(cfg_build(av[1], buf, len, addr, entries, 7, graphN))
+		goto cleanup;
+	tN = util_now() - tN;
+
+	printf("%ld functions, %ld blocks, %ld edges, %.3fs on one thread, "
+		"%.3fs on 7\n", graph1.funcs.size(), graph1.blocks.size(),
+		graph1.succs.size(), t1, tN);
+
+	/* threading must not change the answer */
+	if(graph1.funcs.size() != graphN.funcs.size() ||
+	  graph1.blocks.size() != graphN.blocks.size() ||
+	  graph1.succs != graphN.succs) {
+		printf("ERROR: results differ\n");
+		goto cleanup;
+	}
+	for(unsigned int i=0; i<graph1.blocks.size(); ++i) {
+		cfg_block &a = graph1.blocks[i], &b = graphN.blocks[i];
+		if(a.left != b.left || a.right != b.right || a.func != b.func ||
+		  a.firstSucc != b.firstSucc || a.nSuccs != b.nSuccs ||
+		  a.nInsns != b.nInsns || a.flags != b.flags) {
+			printf("ERROR: results differ at block %d\n", i);
+			goto cleanup;
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	if(fp)
+		fclose(fp);
+	free(buf);
+	return rc;
+}
+#endif
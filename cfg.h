@@ -0,0 +1,51 @@
+/* recursive descent disassembly: the functions and basic blocks of a code
+	region, found by following calls and branches from entry points
+
+	the graph is index based: a function's blocks are consecutive in blocks,
+	and a block's successors are succs[firstSucc, firstSucc+nSuccs), indices
+	into blocks */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+/* cfg_block flags */
+#define CFG_BLOCK_RETURN 1      /* ends in a return */
+#define CFG_BLOCK_INDIRECT 2    /* ends in a branch whose target isn't known */
+#define CFG_BLOCK_INVALID 4     /* ends in bytes that don't decode */
+#define CFG_BLOCK_CALLS 8       /* has a call */
+
+struct cfg_func {
+	uint64_t entry; /* address */
+	uint32_t firstBlock, nBlocks; /* the entry's block is not always first */
+};
+
+struct cfg_block {
+	uint64_t left, right; /* addresses, [,) */
+	uint32_t func;
+	uint32_t firstSucc, nSuccs;
+	uint32_t nInsns;
+	int flags; /* CFG_BLOCK_* */
+};
+
+struct cfg_graph {
+	vector<cfg_func> funcs; /* by entry */
+	vector<cfg_block> blocks; /* by function, then address */
+	vector<uint32_t> succs;
+};
+
+/* code[0,len) is at address addr, entries are addresses in it (others are
+	ignored), calls found add functions, nThreads 0 is one per core
+
+	the result doesn't depend on nThreads */
+int cfg_build(const char *triplet, const uint8_t *code, uint64_t len,
+	uint64_t addr, const vector<uint64_t> &entries, int nThreads,
+	cfg_graph &result);
+
+/* the triple to decode an ELF's code with, NULL if it's not an ELF or the
+	machine isn't known */
+const char *cfg_elf_triplet(const uint8_t *data, uint64_t len);
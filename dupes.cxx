@@ -0,0 +1,626 @@
+/* duplicate region detector
+
+	the buffer is cut into content-defined chunks with a gear rolling hash,
+	identical chunks are grouped, and each chunk with an earlier copy seeds a
+	duplicate region that's extended byte by byte to its true bounds
+
+	STEP1: chunk boundaries, a window at a time, each thread chunks its own
+		segment of the window speculatively as though a boundary were at the
+		segment start, then the true chain of boundaries is stitched together
+		serially (the gear hash only sees the last 64 bytes, so once the true
+		chain lands on a speculative boundary the two agree from there on)
+	STEP2: hash the window's chunks, in parallel, and hand the records to a
+		sink that keeps them in memory until they'd pass the memory limit,
+		then spills them, partitioned by hash, to temporary files
+	STEP3: group identical chunks a partition at a time, each chunk with an
+		earlier copy becomes a match (chunk, earliest copy), sorted by offset
+	STEP4: walk the matches in offset order, extending each past its chunk
+		backward and forward while the bytes agree and the copies don't
+		overlap
+*/
+
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* c++ includes */
+#include <map>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "dupes.h"
+
+//#define DUPES_DEBUG 1
+
+#define DUPES_CHUNK_MIN 0x400
+#define DUPES_CHUNK_MAX 0x10000
+#define DUPES_CHUNK_MASK 0xFFF /* averages ~4k past the minimum */
+#define DUPES_MEM_DEFAULT (64*1024*1024)
+
+struct chunk_rec {
+	uint64_t hash;
+	uint64_t left;
+	uint64_t length;
+};
+
+/* a chunk and the earliest chunk identical to it */
+struct chunk_match {
+	uint64_t left;
+	uint64_t twin;
+};
+
+bool compareChunkRec(const chunk_rec &a, const chunk_rec &b)
+{
+	if(a.hash != b.hash) return a.hash < b.hash;
+	if(a.length != b.length) return a.length < b.length;
+	return a.left < b.left;
+}
+
+bool compareChunkMatch(const chunk_match &a, const chunk_match &b)
+{
+	return a.left < b.left;
+}
+
+/*****************************************************************************/
+/* hashing */
+/*****************************************************************************/
+
+static uint64_t gear[256];
+
+static void
+gear_init(void)
+{
+	/* splitmix64, any fixed random table works */
+	uint64_t x = 0x1234567887654321ULL;
+
+	for(int i=0; i<256; ++i) {
+		uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+static uint64_t
+chunk_hash(const uint8_t *p, uint64_t n)
+{
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+	uint64_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	}
+	for(; i < n; ++i)
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*****************************************************************************/
+/* STEP1: chunking */
+/*****************************************************************************/
+
+/* the boundary following the one at last
+
+	no cut can happen before last+MIN, and the hash there only depends on the
+	64 bytes before it, so start rolling just 64 bytes short */
+static uint64_t
+next_boundary(const uint8_t *data, uint64_t len, uint64_t last)
+{
+	uint64_t h = 0, p;
+	uint64_t limit = std::min(len, last + DUPES_CHUNK_MAX);
+
+	if(len - last <= DUPES_CHUNK_MIN)
+		return len;
+
+	for(p = last + DUPES_CHUNK_MIN - 64; p < last + DUPES_CHUNK_MIN - 1; ++p)
+		h = (h << 1) + gear[data[p]];
+
+	for(; p < limit; ++p) {
+		h = (h << 1) + gear[data[p]];
+		if(!(h & DUPES_CHUNK_MASK))
+			return p + 1;
+	}
+
+	return limit;
+}
+
+/* boundaries as if one were at start, up to and including the first at or
+	beyond end */
+static void
+chunk_segment(const uint8_t *data, uint64_t len, uint64_t start, uint64_t end,
+	vector<uint64_t> &bounds)
+{
+	uint64_t last = start;
+
+	while(last < end) {
+		last = next_boundary(data, len, last);
+		bounds.push_back(last);
+	}
+}
+
+/* the true chain of boundaries after last, through segments chunked
+	speculatively from starts[], up to and including the first at or beyond
+	the last segment's end */
+static uint64_t
+chunk_stitch(const uint8_t *data, uint64_t len, vector<uint64_t> &starts,
+	vector< vector<uint64_t> > &spec, uint64_t last, vector<uint64_t> &bounds)
+{
+	for(unsigned int k=0; k<spec.size(); ++k) {
+		vector<uint64_t> &s = spec[k];
+
+		while(last < s.back()) {
+			/* in sync? adopt the rest of this segment's boundaries */
+			if(last == starts[k]) {
+				bounds.insert(bounds.end(), s.begin(), s.end());
+				last = s.back();
+				break;
+			}
+			auto it = std::lower_bound(s.begin(), s.end(), last);
+			if(*it == last) {
+				bounds.insert(bounds.end(), it+1, s.end());
+				last = s.back();
+				break;
+			}
+
+			last = next_boundary(data, len, last);
+			bounds.push_back(last);
+		}
+	}
+
+	return last;
+}
+
+/*****************************************************************************/
+/* STEP2: chunk hashing */
+/*****************************************************************************/
+
+/* chunk i ends at bounds[i] and starts at the one before (left for i=0) */
+static void
+hash_chunks(const uint8_t *data, vector<uint64_t> &bounds, uint64_t left,
+	uint32_t first, uint32_t last, vector<chunk_rec> &recs)
+{
+	for(uint32_t i=first; i<last; ++i) {
+		recs[i].left = i ? bounds[i-1] : left;
+		recs[i].length = bounds[i] - recs[i].left;
+		recs[i].hash = chunk_hash(data + recs[i].left, recs[i].length);
+	}
+}
+
+/* where the chunk records go: memory until they'd pass memLimit, then
+	temporary files, partitioned by hash so identical chunks share one and
+	each one fits in the limit */
+struct chunk_sink {
+	uint64_t memLimit;
+	uint64_t maxRecs; /* if every chunk were the minimum size */
+	vector<chunk_rec> recs;
+	vector<FILE *> spills;
+
+	int write(const chunk_rec *r, uint64_t n) {
+		for(uint64_t i=0; i<n; ++i) {
+			FILE *fp = spills[(r[i].hash >> 32) % spills.size()];
+			if(fwrite(r + i, sizeof(chunk_rec), 1, fp) != 1) {
+				printf("ERROR: fwrite()\n");
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	int add(vector<chunk_rec> &batch) {
+		if(spills.empty() &&
+		  (recs.size() + batch.size()) * sizeof(chunk_rec) <= memLimit) {
+			recs.insert(recs.end(), batch.begin(), batch.end());
+			return 0;
+		}
+
+		if(spills.empty()) {
+			int nParts = (maxRecs * sizeof(chunk_rec) + memLimit - 1) /
+				memLimit * 2;
+
+			#ifdef DUPES_DEBUG
+			printf("%s(): spilling chunk records to %d files\n", __func__,
+				nParts);
+			#endif
+
+			for(int i=0; i<nParts; ++i) {
+				FILE *fp = tmpfile();
+				if(!fp) {
+					printf("ERROR: tmpfile()\n");
+					return -1;
+				}
+				spills.push_back(fp);
+			}
+
+			if(recs.size() && write(&recs[0], recs.size()))
+				return -1;
+			vector<chunk_rec>().swap(recs);
+		}
+
+		return batch.size() ? write(&batch[0], batch.size()) : 0;
+	}
+
+	~chunk_sink() {
+		for(auto i=spills.begin(); i!=spills.end(); ++i)
+			fclose(*i);
+	}
+};
+
+/*****************************************************************************/
+/* STEP3: grouping */
+/*****************************************************************************/
+
+/* within a partition, match every chunk with the earliest identical one,
+	then sort the matches by offset */
+static void
+group_partition(const uint8_t *data, vector<chunk_rec> &part,
+	vector<chunk_match> &matches)
+{
+	std::sort(part.begin(), part.end(), compareChunkRec);
+
+	for(unsigned int i=0; i<part.size(); ) {
+		unsigned int j = i + 1;
+		while(j < part.size() && part[j].hash == part[i].hash &&
+		  part[j].length == part[i].length)
+			++j;
+
+		for(unsigned int k=i+1; k<j; ++k) {
+			/* hash collision? leave it ungrouped */
+			if(memcmp(data + part[i].left, data + part[k].left, part[k].length))
+				continue;
+			chunk_match m = { part[k].left, part[i].left };
+			matches.push_back(m);
+		}
+
+		i = j;
+	}
+
+	std::sort(matches.begin(), matches.end(), compareChunkMatch);
+}
+
+/* the matches of every partition, merged into offset order as they're read
+
+	in memory there's one partition; spilled, each partition's matches go
+	back to its own file (over its records) and the files are merged */
+struct match_stream {
+	vector<chunk_match> mem;
+	uint64_t memNext = 0;
+	vector<FILE *> files;
+	vector<chunk_match> heads; /* each file's next match */
+	vector<uint64_t> remain; /* matches left in each file, heads included */
+
+	int fill(chunk_sink &sink, const uint8_t *data) {
+		vector<chunk_rec> part;
+		vector<chunk_match> matches;
+
+		if(sink.spills.empty()) {
+			group_partition(data, sink.recs, mem);
+			vector<chunk_rec>().swap(sink.recs);
+			return 0;
+		}
+
+		for(unsigned int i=0; i<sink.spills.size(); ++i) {
+			FILE *fp = sink.spills[i];
+			long size = ftell(fp);
+			rewind(fp);
+
+			part.resize(size / sizeof(chunk_rec));
+			if(part.size() && fread(&part[0], sizeof(chunk_rec), part.size(),
+			  fp) != part.size()) {
+				printf("ERROR: fread()\n");
+				return -1;
+			}
+
+			matches.clear();
+			group_partition(data, part, matches);
+
+			rewind(fp);
+			if(matches.size() && fwrite(&matches[0], sizeof(chunk_match),
+			  matches.size(), fp) != matches.size()) {
+				printf("ERROR: fwrite()\n");
+				return -1;
+			}
+			rewind(fp);
+
+			files.push_back(fp);
+			heads.push_back(chunk_match());
+			remain.push_back(matches.size());
+			if(advance(files.size() - 1))
+				return -1;
+		}
+
+		return 0;
+	}
+
+	/* read file i's next match into its head, if it has one */
+	int advance(unsigned int i) {
+		if(!remain[i])
+			return 0;
+		if(fread(&heads[i], sizeof(chunk_match), 1, files[i]) != 1) {
+			printf("ERROR: fread()\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	/* false when there are no more (or reading failed, bad says which) */
+	bool next(chunk_match &m, bool &bad) {
+		int best = -1;
+
+		if(files.empty()) {
+			if(memNext >= mem.size())
+				return false;
+			m = mem[memNext++];
+			return true;
+		}
+
+		for(unsigned int i=0; i<files.size(); ++i)
+			if(remain[i] && (best < 0 || heads[i].left < heads[best].left))
+				best = i;
+		if(best < 0)
+			return false;
+
+		m = heads[best];
+		if(--remain[best] && advance(best)) {
+			bad = true;
+			return false;
+		}
+		return true;
+	}
+};
+
+/*****************************************************************************/
+/* STEP4: extension */
+/*****************************************************************************/
+
+#define DUPES_CMP_BLOCK 256
+
+/* how far a and b agree going forward, at most n bytes, a block at a time */
+static uint64_t
+agree_forward(const uint8_t *a, const uint8_t *b, uint64_t n)
+{
+	uint64_t i = 0;
+
+	while(n - i >= DUPES_CMP_BLOCK && !memcmp(a + i, b + i, DUPES_CMP_BLOCK))
+		i += DUPES_CMP_BLOCK;
+	while(i < n && a[i] == b[i])
+		++i;
+	return i;
+}
+
+/* how far the bytes before a and b agree going backward, at most n */
+static uint64_t
+agree_backward(const uint8_t *a, const uint8_t *b, uint64_t n)
+{
+	uint64_t i = 0;
+
+	while(n - i >= DUPES_CMP_BLOCK && !memcmp(a - i - DUPES_CMP_BLOCK,
+	  b - i - DUPES_CMP_BLOCK, DUPES_CMP_BLOCK))
+		i += DUPES_CMP_BLOCK;
+	while(i < n && a[-1-(int64_t)i] == b[-1-(int64_t)i])
+		++i;
+	return i;
+}
+
+/*****************************************************************************/
+/* main API */
+/*****************************************************************************/
+
+int
+dupes_find(const uint8_t *data, uint64_t len, int nThreads, uint64_t memLimit,
+	vector<dupes_region> &result)
+{
+	int rc = -1;
+	vector<thread> workers;
+	vector<uint64_t> starts;
+	vector< vector<uint64_t> > spec;
+	vector<uint64_t> bounds;
+	vector<chunk_rec> recs;
+	chunk_sink sink;
+	match_stream matches;
+	chunk_match m;
+	map<pair<uint64_t,uint64_t>, int> twinToGroup;
+	uint64_t segSize, last = 0, coveredUntil = 0;
+	bool bad = false;
+
+	result.clear();
+
+	if(len < DUPES_CHUNK_MIN * 2) {
+		rc = 0;
+		goto cleanup;
+	}
+
+	if(nThreads <= 0)
+		nThreads = std::max(1u, thread::hardware_concurrency());
+	if(!memLimit)
+		memLimit = DUPES_MEM_DEFAULT;
+
+	gear_init();
+
+	/* a window is a segment per thread, small enough that its boundaries and
+		records (were every chunk the minimum size) take at most a quarter of
+		the limit */
+	segSize = memLimit / 4 / nThreads /
+		(sizeof(uint64_t) + sizeof(chunk_rec)) * DUPES_CHUNK_MIN;
+	segSize = std::min(segSize, (len + nThreads - 1) / nThreads);
+	segSize = std::max(segSize, (uint64_t)DUPES_CHUNK_MAX * 16);
+
+	sink.memLimit = memLimit;
+	sink.maxRecs = len / DUPES_CHUNK_MIN + 1;
+
+	for(uint64_t window=0; last < len; window += segSize * nThreads) {
+		uint64_t left = last;
+
+		/* STEP1: speculative chunking per segment, then stitch */
+		starts.clear();
+		for(uint64_t s=window; s<len && starts.size()<nThreads; s+=segSize)
+			starts.push_back(s);
+
+		spec.clear();
+		spec.resize(starts.size());
+		for(unsigned int k=0; k<starts.size(); ++k) {
+			uint64_t end = std::min(starts[k] + segSize, len);
+			workers.push_back(thread(chunk_segment, data, len, starts[k], end,
+				std::ref(spec[k])));
+		}
+		for(auto i=workers.begin(); i!=workers.end(); ++i)
+			i->join();
+		workers.clear();
+
+		bounds.clear();
+		last = chunk_stitch(data, len, starts, spec, last, bounds);
+
+		/* STEP2: hash the window's chunks, off to the sink */
+		uint32_t nChunks = bounds.size();
+		recs.resize(nChunks);
+		for(int t=0; t<nThreads; ++t) {
+			uint32_t first = (uint64_t)nChunks * t / nThreads;
+			uint32_t end = (uint64_t)nChunks * (t+1) / nThreads;
+			workers.push_back(thread(hash_chunks, data, std::ref(bounds), left,
+				first, end, std::ref(recs)));
+		}
+		for(auto i=workers.begin(); i!=workers.end(); ++i)
+			i->join();
+		workers.clear();
+
+		if(sink.add(recs))
+			goto cleanup;
+	}
+
+	/* STEP3: group */
+	if(matches.fill(sink, data)) {
+		printf("ERROR: grouping chunks\n");
+		goto cleanup;
+	}
+
+	/* STEP4: extend each match not already inside a region to where the
+		copies stop agreeing, without the duplicate reaching back into the
+		last region or forward into its twin */
+	while(matches.next(m, bad)) {
+		if(m.left < coveredUntil)
+			continue;
+
+		uint64_t back = agree_backward(data + m.left, data + m.twin,
+			std::min(m.twin, m.left - coveredUntil));
+		dupes_region dup = { m.left - back, 0, 0 };
+		dupes_region twin = { m.twin - back, 0, 0 };
+		uint64_t fwd = agree_forward(data + dup.left, data + twin.left,
+			std::min(len - dup.left, m.left - m.twin));
+		dup.right = dup.left + fwd;
+		twin.right = twin.left + fwd;
+		coveredUntil = dup.right;
+
+		/* a lone short tail chunk isn't interesting */
+		if(dup.right - dup.left < DUPES_CHUNK_MIN)
+			continue;
+
+		pair<uint64_t,uint64_t> key(twin.left, twin.right);
+		if(twinToGroup.find(key) == twinToGroup.end()) {
+			int group = twinToGroup.size();
+			twinToGroup[key] = group;
+			twin.group = group;
+			result.push_back(twin);
+		}
+
+		dup.group = twinToGroup[key];
+		result.push_back(dup);
+	}
+	if(bad)
+		goto cleanup;
+
+	#ifdef DUPES_DEBUG
+	printf("%s(): %ld regions in %ld groups\n", __func__, result.size(),
+		twinToGroup.size());
+	#endif
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -pthread -DTEST1 dupes.cxx -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	uint64_t len = 0x800000;
+	vector<dupes_region> regions1, regionsN, regionsSpill;
+	uint8_t *buf = (uint8_t *)malloc(len);
+	uint64_t expect[3] = { 0x10000, 0x200000, 0x611111 };
+
+	/* noise with a 0x30000 byte block copied twice */
+	srand(1);
+	for(uint64_t i=0; i<len; ++i)
+		buf[i] = rand();
+	memcpy(buf + 0x200000, buf + 0x10000, 0x30000);
+	memcpy(buf + 0x611111, buf + 0x10000, 0x30000);
+	/* noise that happens to agree just past a copy would widen it */
+	buf[0xFFFF] = 0; buf[0x40000] = 0;
+	buf[0x1FFFFF] = buf[0x611110] = 1; buf[0x230000] = buf[0x641111] = 1;
+
+	if(dupes_find(buf, len, 1, 0, regions1) ||
+	  dupes_find(buf, len, 7, 0, regionsN) ||
+	  dupes_find(buf, len, 3, 4096, regionsSpill)) {
+		printf("ERROR: dupes_find()\n");
+		goto cleanup;
+	}
+
+	for(auto i=regionsN.begin(); i!=regionsN.end(); ++i)
+		printf("group %d: [0x%llX,0x%llX)\n", i->group,
+			(unsigned long long)i->left, (unsigned long long)i->right);
+
+	/* threading and spilling must not change the answer */
+	if(regions1.size() != regionsN.size() ||
+	  regions1.size() != regionsSpill.size()) {
+		printf("ERROR: results differ\n");
+		goto cleanup;
+	}
+	for(unsigned int i=0; i<regions1.size(); ++i) {
+		if(regions1[i].left != regionsN[i].left ||
+		  regions1[i].right != regionsN[i].right ||
+		  regions1[i].left != regionsSpill[i].left ||
+		  regions1[i].right != regionsSpill[i].right) {
+			printf("ERROR: results differ at %d\n", i);
+			goto cleanup;
+		}
+	}
+
+	/* the copies exactly, the earlier copy first */
+	if(regions1.size() != 3) {
+		printf("ERROR: expected 3 regions, got %ld\n", regions1.size());
+		goto cleanup;
+	}
+	for(unsigned int i=0; i<3; ++i) {
+		if(regions1[i].left != expect[i] ||
+		  regions1[i].right != expect[i] + 0x30000 || regions1[i].group) {
+			printf("ERROR: region %d is [0x%llX,0x%llX), expected [0x%llX,0x%llX)\n",
+				i, (unsigned long long)regions1[i].left,
+				(unsigned long long)regions1[i].right,
+				(unsigned long long)expect[i],
+				(unsigned long long)expect[i] + 0x30000);
+			goto cleanup;
+		}
+	}
+
+	rc = 0;
+	cleanup:
+	free(buf);
+	return rc;
+}
+#endif
@@ -0,0 +1,20 @@
+/* find regions of a buffer that occur more than once
+
+	regions with the same group number have identical contents */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+using namespace std;
+
+struct dupes_region {
+	uint64_t left, right; // [,)
+	int group;
+};
+
+/* memLimit bounds the chunk boundaries and records held at once, beyond it
+	the records spill to temporary files (0 means use the default) */
+int dupes_find(const uint8_t *data, uint64_t len, int nThreads,
+	uint64_t memLimit, vector<dupes_region> &result);
@@ -0,0 +1,278 @@
+#!/usr/bin/env python
+# gencorpus.py <outdir> [entries]...
+#
+# synthesize files for hltag-bench: ELF32/64, PE32/64, Mach-O, DEX and GPG,
+# each at several sizes, the size being how many table entries (symbols,
+# relocations, sections, dex items, packets) the file holds, so every
+# tagger has about that many structures to walk
+#
+# files are named <format>_<entries>.<ext> and are well formed enough for
+# the included taggers to tag completely; their contents are otherwise junk
+import os
+import sys
+import struct
+
+def align(data, n):
+    return data + b'\x00' * ((n - len(data) % n) % n)
+
+def strtab(names):
+    parts = [b'\x00']
+    offsets = []
+    size = 1
+    for name in names:
+        offsets.append(size)
+        parts.append(name.encode('ascii') + b'\x00')
+        size += len(parts[-1])
+    return (b''.join(parts), offsets)
+
+###############################################################################
+# ELF: header, .shstrtab, .strtab, .symtab of <n> symbols, section headers
+###############################################################################
+
+def elf(n, is64):
+    (symNames, symOffs) = strtab(['sym_%d' % i for i in range(n)])
+    (scnNames, scnOffs) = strtab(['.shstrtab', '.strtab', '.symtab', '.text'])
+
+    if is64:
+        (hdrSize, shdrSize, symSize) = (64, 64, 24)
+    else:
+        (hdrSize, shdrSize, symSize) = (52, 40, 16)
+
+    syms = []
+    for i in range(n):
+        info = (1 << 4) | (2 if i % 2 else 1) # GLOBAL, FUNC/OBJECT
+        if is64:
+            syms.append(struct.pack('<IBBHQQ', symOffs[i], info, 0, 4,
+              0x1000+i*16, 16))
+        else:
+            syms.append(struct.pack('<IIIBBH', symOffs[i], 0x1000+i*16, 16,
+              info, 0, 4))
+    syms = b''.join(syms)
+    text = b'\xc3' * 64
+
+    # (name, type, offset, size, link, entsize) after the header
+    body = b''
+    scns = [(0, 0, 0, 0, 0, 0)]
+    for (name, stype, data, link, entsize) in [
+      (scnOffs[0], 3, scnNames, 0, 0), (scnOffs[1], 3, symNames, 0, 0),
+      (scnOffs[2], 2, syms, 2, symSize), (scnOffs[3], 1, text, 0, 0)]:
+        body = align(body, 8)
+        scns.append((name, stype, hdrSize + len(body), len(data), link, entsize))
+        body += data
+    body = align(body, 8)
+    shoff = hdrSize + len(body)
+
+    shdrs = b''
+    for (name, stype, offs, size, link, entsize) in scns:
+        if is64:
+            shdrs += struct.pack('<IIQQQQIIQQ', name, stype, 0, 0, offs, size,
+              link, 0, 8, entsize)
+        else:
+            shdrs += struct.pack('<IIIIIIIIII', name, stype, 0, 0, offs, size,
+              link, 0, 4, entsize)
+
+    ident = b'\x7fELF' + struct.pack('BBBB', 2 if is64 else 1, 1, 1, 0) + b'\x00'*8
+    if is64:
+        hdr = ident + struct.pack('<HHIQQQIHHHHHH', 1, 0x3E, 1, 0, 0, shoff,
+          0, hdrSize, 56, 0, shdrSize, len(scns), 1)
+    else:
+        hdr = ident + struct.pack('<HHIIIIIHHHHHH', 1, 3, 1, 0, 0, shoff,
+          0, hdrSize, 32, 0, shdrSize, len(scns), 1)
+
+    return hdr + body + shdrs
+
+###############################################################################
+# PE: headers, .text, and a .reloc section of <n> entries
+###############################################################################
+
+def pe(n, is64):
+    lfanew = 0x80
+    optSize = 240 if is64 else 224
+    fileAlign = 0x200
+
+    relocs = []
+    for block in range(0, n, 512):
+        count = min(512, n - block)
+        relocs.append(struct.pack('<II', 0x1000 * (1 + block // 512),
+          8 + count*2))
+        for i in range(count):
+            relocs.append(struct.pack('<H',
+              ((10 if is64 else 3) << 12) | (i*8 & 0xFFF)))
+    relocs = b''.join(relocs) + b'\x00' * 8
+
+    hdrsEnd = lfanew + 4 + 20 + optSize + 2*40
+    oText = (hdrsEnd + fileAlign - 1) // fileAlign * fileAlign
+    text = align(b'\xc3' * 16, fileAlign)
+    oReloc = oText + len(text)
+    relocRaw = align(relocs, fileAlign)
+
+    dos = b'MZ' + b'\x00' * 58 + struct.pack('<I', lfanew)
+    dos = dos + b'\x00' * (lfanew - len(dos))
+
+    fileHdr = struct.pack('<HHIIIHH', 0x8664 if is64 else 0x14C, 2, 0, 0, 0,
+      optSize, 0x22)
+
+    dirs = [(0, 0)] * 16
+    dirs[5] = (0x2000, len(relocs)) # BASERELOC
+    if is64:
+        opt = struct.pack('<HBBIIIII', 0x20B, 1, 0, len(text), len(relocRaw),
+          0, 0x1000, 0x1000)
+        opt += struct.pack('<QIIHHHHHHIIIIHHQQQQII', 0x140000000, 0x1000,
+          fileAlign, 6, 0, 0, 0, 6, 0, 0, 0x3000, oText, 0, 3, 0x8160,
+          0x100000, 0x1000, 0x100000, 0x1000, 0, 16)
+    else:
+        opt = struct.pack('<HBBIIIIII', 0x10B, 1, 0, len(text), len(relocRaw),
+          0, 0x1000, 0x1000, 0x2000)
+        opt += struct.pack('<IIIHHHHHHIIIIHHIIIIII', 0x400000, 0x1000,
+          fileAlign, 6, 0, 0, 0, 6, 0, 0, 0x3000, oText, 0, 3, 0x8140,
+          0x100000, 0x1000, 0x100000, 0x1000, 0, 16)
+    for (va, size) in dirs:
+        opt += struct.pack('<II', va, size)
+
+    scns = struct.pack('<8sIIIIIIHHI', b'.text', 16, 0x1000, len(text), oText,
+      0, 0, 0, 0, 0x60000020)
+    scns += struct.pack('<8sIIIIIIHHI', b'.reloc', len(relocs), 0x2000,
+      len(relocRaw), oReloc, 0, 0, 0, 0, 0x42000040)
+
+    hdrs = dos + b'PE\x00\x00' + fileHdr + opt + scns
+    hdrs = hdrs + b'\x00' * (oText - len(hdrs))
+    return hdrs + text + relocRaw
+
+###############################################################################
+# Mach-O (64-bit): <n> sections, 64 to a segment, then uuid and symtab
+###############################################################################
+
+def macho(n):
+    cmds = []
+    ncmds = 0
+    for seg in range(0, n, 64):
+        nsects = min(64, n - seg)
+        segname = ('__SEG%d' % (seg // 64)).encode('ascii')
+        cmds.append(struct.pack('<II16sQQQQiiII', 0x19, 72 + nsects*80,
+          segname, 0x100000000 + seg*0x1000, nsects*0x1000, 0, 0, 7, 5,
+          nsects, 0))
+        for i in range(nsects):
+            cmds.append(struct.pack('<16s16sQQIIIIIIII',
+              ('__sect%d' % (seg + i)).encode('ascii'), segname,
+              0x100000000 + (seg+i)*0x1000, 0x1000, 0, 0, 0, 0, 0, 0, 0, 0))
+        ncmds += 1
+    cmds.append(struct.pack('<II', 0x1B, 24) + bytes(bytearray(range(16))))
+    cmds.append(struct.pack('<IIIIII', 0x2, 24, 0, 0, 0, 0))
+    cmds = b''.join(cmds)
+    ncmds += 2
+
+    hdr = struct.pack('<IiiIIIII', 0xFEEDFACF, 0x01000007, 3, 2, ncmds,
+      len(cmds), 0, 0)
+    return hdr + cmds
+
+###############################################################################
+# DEX: <n> each of strings, types, protos, fields, methods and classes
+###############################################################################
+
+def uleb(v):
+    out = bytearray()
+    while 1:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+def dex(n):
+    strings = [('Lcls%d;' % i).encode('ascii') for i in range(n)]
+
+    oStrIds = 0x70
+    oTypeIds = oStrIds + n*4
+    oProtoIds = oTypeIds + n*4
+    oFieldIds = oProtoIds + n*12
+    oMethodIds = oFieldIds + n*8
+    oClassDefs = oMethodIds + n*8
+    oData = oClassDefs + n*32
+
+    # one field and method of each kind per class
+    classData = uleb(1) + uleb(1) + uleb(1) + uleb(1) + \
+      uleb(0) + uleb(1) + uleb(0) + uleb(1) + \
+      uleb(0) + uleb(1) + uleb(0) + uleb(0) + uleb(1) + uleb(0)
+
+    data = []
+    size = 0
+    strOffs = []
+    for s in strings:
+        strOffs.append(oData + size)
+        data.append(uleb(len(s)) + s + b'\x00')
+        size += len(data[-1])
+    classDataOffs = []
+    for i in range(n):
+        classDataOffs.append(oData + size)
+        data.append(classData)
+        size += len(classData)
+    data = align(b''.join(data), 4)
+
+    body = b''
+    body += b''.join(struct.pack('<I', o) for o in strOffs)
+    body += b''.join(struct.pack('<I', i) for i in range(n))
+    body += b''.join(struct.pack('<III', i, i, 0) for i in range(n))
+    body += b''.join(struct.pack('<HHI', i & 0xFFFF, i & 0xFFFF, i)
+      for i in range(n))
+    body += b''.join(struct.pack('<HHI', i & 0xFFFF, i & 0xFFFF, i)
+      for i in range(n))
+    body += b''.join(struct.pack('<IIIIIIII', i, 1, 0xFFFFFFFF, 0, 0xFFFFFFFF,
+      0, classDataOffs[i], 0) for i in range(n))
+
+    size = 0x70 + len(body) + len(data)
+    hdr = b'dex\n035\x00' + struct.pack('<I', 0) + b'\x00'*20
+    hdr += struct.pack('<IIIIII', size, 0x70, 0x12345678, 0, 0, 0)
+    hdr += struct.pack('<IIIIIIIIIIIIII', n, oStrIds, n, oTypeIds, n,
+      oProtoIds, n, oFieldIds, n, oMethodIds, n, oClassDefs, len(data), oData)
+    return hdr + body + data
+
+###############################################################################
+# GPG: <n> packets, alternating symmetric session keys and literal data
+###############################################################################
+
+def gpg(n):
+    out = []
+    for i in range(n):
+        if i % 2 == 0:
+            body = struct.pack('BBBBB', 4, 9, 3, 8, 0x60) + b'saltsalt'
+            out.append(struct.pack('BB', 0x8C, len(body)) + body) # old, tag 3
+        else:
+            name = ('file%d' % i).encode('ascii')
+            body = b'b' + struct.pack('B', len(name)) + name + \
+              struct.pack('<I', i) + b'x' * 32
+            out.append(struct.pack('BB', 0xAC, len(body)) + body) # old, tag 11
+    return b''.join(out)
+
+###############################################################################
+# main
+###############################################################################
+
+GENERATORS = [
+    ('elf32', '.o', lambda n: elf(n, False)),
+    ('elf64', '.o', lambda n: elf(n, True)),
+    ('pe32', '.exe', lambda n: pe(n, False)),
+    ('pe64', '.exe', lambda n: pe(n, True)),
+    ('macho', '.macho', macho),
+    ('dex', '.dex', dex),
+    ('gpg', '.gpg', gpg),
+]
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.stderr.write('usage: gencorpus.py <outdir> [entries]...\n')
+        sys.exit(-1)
+
+    outDir = sys.argv[1]
+    sizes = [int(x) for x in sys.argv[2:]] or [100, 10000, 100000]
+    if not os.path.isdir(outDir):
+        os.makedirs(outDir)
+
+    for (name, ext, gen) in GENERATORS:
+        for n in sizes:
+            path = os.path.join(outDir, '%s_%d%s' % (name, n, ext))
+            fobj = open(path, 'wb')
+            fobj.write(gen(n))
+            fobj.close()
+            print(path)
@@ -4,9 +4,16 @@
 	anything else is internal use
 */
 
+/* c includes */
+#include <string.h>
+
 /* c++ includes */
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
@@ -17,7 +24,9 @@ using namespace std;
 #include <llvm/MC/MCContext.h>
 #include <llvm/MC/MCDisassembler.h>
 #include <llvm/MC/MCCodeEmitter.h>
+#include <llvm/MC/MCInst.h>
 #include <llvm/MC/MCInstPrinter.h>
+#include <llvm/MC/MCInstrAnalysis.h>
 #include <llvm/MC/MCInstrInfo.h>
 #include <llvm/MC/MCObjectFileInfo.h>
 #include <llvm/MC/MCRegisterInfo.h>
@@ -318,6 +327,119 @@ obj_output_to_bytes(uint8_t *data, string &result)
 	return rc;
 }
 
+/* what a target needs to assemble that doesn't change from one assembly to
+	the next (register, instruction and subtarget descriptions, asm syntax),
+	made the first time a (triple, cpu, features) is seen and kept; the
+	assembly itself gets a fresh MCContext, streamer and friends each time
+
+	the subtarget info is never written: target asm parsers work on a copy
+	(MCTargetAsmParser::copySTI()), so one bundle serves any number of calls */
+struct mc_bundle {
+	std::string machSpec; /* normalized triple */
+	std::string cpu;
+	std::string features;
+	Triple triple;
+	const Target *target;
+	std::unique_ptr<MCRegisterInfo> regInfo;
+	std::unique_ptr<MCAsmInfo> asmInfo;
+	std::unique_ptr<MCInstrInfo> instrInfo;
+	std::unique_ptr<MCSubtargetInfo> subTargetInfo;
+};
+
+/* shared: a caller (or a thread's decoder) keeps its bundle alive through
+	llvm_svcs_cache_clear() */
+static map<string, shared_ptr<mc_bundle> > bundles;
+static std::mutex bundlesLock;
+
+static mc_bundle *
+bundle_create(const string &machSpec, const char *cpu, const char *features,
+	string &strErr)
+{
+	mc_bundle *b = new mc_bundle;
+
+	b->machSpec = machSpec;
+	b->cpu = cpu;
+	b->features = features;
+	b->triple = Triple(machSpec);
+
+	/* get the target specific parser
+		if arch is blank, the triple is consulted */
+	b->target = TargetRegistry::lookupTarget(/*arch*/"", b->triple, strErr);
+	if(!b->target) {
+		strErr = "TargetRegistry::lookupTarget() failed\n" + strErr;
+		goto fail;
+	}
+
+	/* from the target we get almost everything */
+	b->regInfo.reset(b->target->createMCRegInfo(machSpec));
+	if(!b->regInfo) {
+		strErr = "creating mc register info\n";
+		goto fail;
+	}
+
+	b->asmInfo.reset(b->target->createMCAsmInfo(*b->regInfo, machSpec));
+	if(!b->asmInfo) {
+		strErr = "creating MCAsmInfo\n";
+		goto fail;
+	}
+
+	/* describes target instruction set */
+	b->instrInfo.reset(b->target->createMCInstrInfo());
+	if(!b->instrInfo) {
+		strErr = "creating MCInstrInfo\n";
+		goto fail;
+	}
+
+	/* subtarget instr set */
+	b->subTargetInfo.reset(b->target->createMCSubtargetInfo(machSpec, cpu,
+		features));
+	if(!b->subTargetInfo) {
+		strErr = "creating MCSubtargetInfo\n";
+		goto fail;
+	}
+
+	return b;
+
+	fail:
+	delete b;
+	return NULL;
+}
+
+/* forward, see DISASSEMBLE related functions */
+static void disasm_pool_clear(void);
+
+/* drop the bundles and the calling thread's disassembler contexts, they're
+	remade as needed */
+void
+llvm_svcs_cache_clear(void)
+{
+	disasm_pool_clear();
+
+	std::lock_guard<std::mutex> lock(bundlesLock);
+
+	bundles.clear();
+}
+
+/* the bundle for a triple (any spelling of it), made if need be */
+static shared_ptr<mc_bundle>
+bundle_get(const char *triplet, const char *cpu, const char *features,
+	string &strErr)
+{
+	// see /lib/Support/Triple.cpp for the details
+	std::string machSpec = Triple::normalize(triplet);
+	std::string key = machSpec + "\t" + cpu + "\t" + features;
+	std::lock_guard<std::mutex> lock(bundlesLock);
+
+	auto it = bundles.find(key);
+	if(it != bundles.end())
+		return it->second;
+
+	shared_ptr<mc_bundle> b(bundle_create(machSpec, cpu, features, strErr));
+	if(b)
+		bundles[key] = b;
+	return b;
+}
+
 /* source manager diagnostics handler
 	(instead of printing to stderr) */
 /* we set LLVM's callback to this thunk which then calls the user
@@ -415,57 +537,22 @@ llvm_svcs_assemble(
 	std::unique_ptr<MemoryBuffer> mbSrc;
 
 	/*************************************************************************/
-	/* the triple and the target */
+	/* the target and its descriptions, cached */
 	/*************************************************************************/
 
-	// see /lib/Support/Triple.cpp for the details
-	printf("triplet: %s\n", triplet);
-	std::string machSpec(triplet);
-	machSpec = Triple::normalize(machSpec);
-	Triple TheTriple(machSpec);
-
-	/* get the target specific parser
-		if arch is blank, the triple is consulted */
-	const Target *target = TargetRegistry::lookupTarget(/*arch*/"", TheTriple, strErr);
-	if (!target) {
-		strErr = "TargetRegistry::lookupTarget() failed\n" + strErr;
-		return -1;
-	}
-
-	printf("machine spec: %s\n", machSpec.c_str());
-	printf("Target.getName(): %s\n", target->getName());
-	printf("Target.getShortDescription(): %s\n", target->getShortDescription());
-	printf("Target.hasJIT(): %d\n", target->hasJIT());
-	printf("Target.hasTargetMachine(): %d (Check if this target supports code generation)\n", target->hasTargetMachine());
-	printf("Target.hasMCAsmBackend(): %d (Check if this target supports .o generation)\n", target->hasMCAsmBackend());
-
-	/* from the target we get almost everything */
-	std::unique_ptr<MCRegisterInfo> regInfo(target->createMCRegInfo(machSpec));
-	if(!regInfo) {
-		strErr = "creating mc register info\n";
+	shared_ptr<mc_bundle> bundle = bundle_get(triplet, "", "", strErr);
+	if(!bundle)
 		return -1;
-	}
 
-	std::unique_ptr<MCAsmInfo> asmInfo(target->createMCAsmInfo(*regInfo, machSpec));
-	if(!asmInfo) {
-		strErr = "creating MCAsmInfo\n";
-		return -1;
-	}
+	const Target *target = bundle->target;
 
-	std::unique_ptr<MCInstrInfo> instrInfo(target->createMCInstrInfo()); /* describes target instruction set */
-	if(!instrInfo) {
-		strErr = "creating MCInstrInfo\n";
-		return -1;
-	}
+	/* fixups, relaxations, objs, elfs
 
-	std::unique_ptr<MCSubtargetInfo> subTargetInfo(target->createMCSubtargetInfo(machSpec, "", "")); /* subtarget instr set */
-	if(!subTargetInfo) {
-		strErr = "creating MCSubtargetInfo\n";
-		return -1;
-	}
-
-	/* fixups, relaxations, objs, elfs */
-	MCAsmBackend *asmBackend = target->createMCAsmBackend(*regInfo, machSpec, /* specific CPU */ "");
+		per call: the object streamer takes ownership of it, and ARM's keeps
+		the .arm/.thumb state in it; held here until the streamer has it, so
+		it's freed on every path out */
+	std::unique_ptr<MCAsmBackend> asmBackend(target->createMCAsmBackend(
+		*bundle->regInfo, bundle->machSpec, bundle->cpu));
 	if(!asmBackend) {
 		strErr = "creating MCAsmBackend\n";
 		return -1;
@@ -490,7 +577,8 @@ llvm_svcs_assemble(
 	MCObjectFileInfo objFileInfo;
 
 	/* MC/MCContext.h */
-	MCContext context(asmInfo.get(), regInfo.get(), &objFileInfo, &srcMgr);
+	MCContext context(bundle->asmInfo.get(), bundle->regInfo.get(),
+		&objFileInfo, &srcMgr);
 
 	/* yes, this is circular (MCContext requiring MCObjectFileInfo and visa
 		versa, and is marked "FIXME" in llvm-mc.cpp */
@@ -499,7 +587,7 @@ llvm_svcs_assemble(
 		initCOFFMCObjectFileInfo() ... will ask TT.getObjectFormat() if not
 		specified */
 	objFileInfo.InitMCObjectFileInfo(
-		TheTriple,
+		bundle->triple,
 		map_reloc_mode(relocMode),
 		map_code_model(codeModel),
 		context
@@ -510,8 +598,8 @@ llvm_svcs_assemble(
 
 		target returns with X86MCCodeEmitter, ARMMCCodeEmitter, etc.
 	*/
-	//std::unique_ptr<MCCodeEmitter> codeEmitter(target->createMCCodeEmitter(*instrInfo, *regInfo, context));
-	MCCodeEmitter *codeEmitter = target->createMCCodeEmitter(*instrInfo, *regInfo, context);
+	std::unique_ptr<MCCodeEmitter> codeEmitter(target->createMCCodeEmitter(
+		*bundle->instrInfo, *bundle->regInfo, context));
 	if(!codeEmitter) {
 		strErr = "creating code emitter\n";
 		return -1;
@@ -527,23 +615,30 @@ llvm_svcs_assemble(
 	/* assemble to object */
 	/*************************************************************************/
 
+	/* the streamer owns the backend and code emitter from here on, and
+		deletes them (and its object writer) with itself; it goes before the
+		context does, being declared after it */
 	std::unique_ptr<MCStreamer> streamer(target->createMCObjectStreamer(
-	//streamer = target->createMCObjectStreamer(
-		TheTriple,
+		bundle->triple,
 		context,
 		*asmBackend,  /* (fixups, relaxation, objs and elfs) */
 		rsvo, /* output stream raw_pwrite_stream */
-		//codeEmitter.get(),
-		codeEmitter,
-		*subTargetInfo,
+		codeEmitter.get(),
+		*bundle->subTargetInfo,
 		true, /* relax all fixups */
 		true, /* incremental linker compatible */
 		false /* DWARFMustBeAtTheEnd */
 	));
-	//);
+	if(!streamer) {
+		strErr = "creating object streamer\n";
+		goto cleanup;
+	}
+	asmBackend.release();
+	codeEmitter.release();
 
-	if(invoke_llvm_parsers(target, &srcMgr, context, *streamer, *asmInfo,
-	  *subTargetInfo, *instrInfo, targetOpts, dialect)) {
+	if(invoke_llvm_parsers(target, &srcMgr, context, *streamer,
+	  *bundle->asmInfo, *bundle->subTargetInfo, *bundle->instrInfo, targetOpts,
+	  dialect)) {
 		strErr = "invoking llvm parsers\n";
 		goto cleanup;
 	}
@@ -653,6 +748,76 @@ disasm_single(
 	return rc;
 }
 
+/* disassembler contexts are expensive to make and cheap to use, so each
+	thread keeps the ones it has used, one per (triple, options); being per
+	thread, a context is never used by two threads at once and handing one
+	out takes no lock */
+struct disasm_decoder;
+
+struct disasm_pool {
+	map<string, LLVMDisasmContextRef> contexts;
+	map<string, disasm_decoder *> decoders; /* see llvm_svcs_disasm_batch() */
+
+	~disasm_pool()
+	{
+		clear();
+	}
+
+	void clear(void);
+};
+
+static thread_local disasm_pool disasmPool;
+
+static void
+disasm_pool_clear(void)
+{
+	disasmPool.clear();
+}
+
+/* the calling thread's context for a triple and LLVM_SVCS_DISASM_* options,
+	made if need be, NULL if the triple can't be disassembled */
+static LLVMDisasmContextRef
+disasm_context(const char *triplet, int options)
+{
+	LLVMDisasmContextRef context;
+	uint64_t llvmOptions = 0;
+	char key[16];
+
+	snprintf(key, sizeof(key), "\t%d", options);
+	string name = string(triplet) + key;
+
+	auto it = disasmPool.contexts.find(name);
+	if(it != disasmPool.contexts.end())
+		return it->second;
+
+	/* see /lib/MC/MCDisassembler/Disassembler.h */
+	context = LLVMCreateDisasm (
+		triplet, /* triple */
+		NULL, /* void *DisInfo */
+		0, /* TagType */
+		NULL, /* LLVMOpInfoCallback GetOpInfo */
+		symbol_lookup_cb /* LLVMSymbolLookupCallback SymbolLookUp */
+	);
+
+	if(!context) {
+		//printf("ERROR: LLVMCreateDisasm()\n");
+		return NULL;
+	}
+
+	if(options & LLVM_SVCS_DISASM_HEX_IMM)
+		llvmOptions |= LLVMDisassembler_Option_PrintImmHex;
+	if(options & LLVM_SVCS_DISASM_ALT_SYNTAX)
+		llvmOptions |= LLVMDisassembler_Option_AsmPrinterVariant;
+	if(llvmOptions && !LLVMSetDisasmOptions(context, llvmOptions)) {
+		//printf("ERROR: LLVMSetDisasmOptions()\n");
+		LLVMDisasmDispose(context);
+		return NULL;
+	}
+
+	disasmPool.contexts[name] = context;
+	return context;
+}
+
 /* disassemble a single instruction from the start of an input buffer */
 int
 llvm_svcs_disasm_single(
@@ -661,23 +826,16 @@ llvm_svcs_disasm_single(
 	uint8_t *src, int src_len,
 	uint64_t addr,
 	/* out parameters */
-	string &result, int &instrLen
+	string &result, int &instrLen,
+	/* LLVM_SVCS_DISASM_* */
+	int options
 )
 {
 	int rc = -1;
-	LLVMDisasmContextRef context = NULL;
-
-	/* see /lib/MC/MCDisassembler/Disassembler.h */
-	context = LLVMCreateDisasm (
-		triplet, /* triple */
-		NULL, /* void *DisInfo */
-		0, /* TagType */
-		NULL, /* LLVMOpInfoCallback GetOpInfo */
-		symbol_lookup_cb /* LLVMSymbolLookupCallback SymbolLookUp */
-	);
+	LLVMDisasmContextRef context = disasm_context(triplet, options);
 
 	if(context == NULL) {
-		//printf("ERROR: LLVMCreateDisasm()\n");
+		//printf("ERROR: disasm_context()\n");
 		goto cleanup;
 	}
 
@@ -689,13 +847,11 @@ llvm_svcs_disasm_single(
 
 	rc = 0;
 	cleanup:
-	if(context) {
-		LLVMDisasmDispose(context);
-		context = NULL;
-	}
 	return rc;
 }
 
+/* lengths of the instructions from the start of src, up to the first that
+	can't be decoded (best effort) */
 int
 llvm_svcs_disasm_lengths(
 	/* in parameters */
@@ -703,56 +859,487 @@ llvm_svcs_disasm_lengths(
 	uint8_t *src, int src_len,
 	uint64_t addr,
 	/* out parameters */
-	vector<int> &lengths
+	vector<int> &lengths,
+	/* LLVM_SVCS_DISASM_* */
+	int options
 )
 {
 	int rc = -1;
-	int length;
-	string result;
-	LLVMDisasmContextRef context = NULL;
-
-	/* see /lib/MC/MCDisassembler/Disassembler.h */
-	//printf("disassembling with triplet: %s\n", triplet);
-	context = LLVMCreateDisasm (
-		triplet, /* triple */
-		NULL, /* void *DisInfo */
-		0, /* TagType */
-		NULL, /* LLVMOpInfoCallback GetOpInfo */
-		symbol_lookup_cb /* LLVMSymbolLookupCallback SymbolLookUp */
-	);
+	vector<llvm_svcs_insn> insns;
+	string arena;
 
-	if(!context) {
-		//printf("ERROR: LLVMCreateDisasm()\n");
+	if(llvm_svcs_disasm_batch(triplet, src, src_len, addr, insns, arena,
+	  options | LLVM_SVCS_DISASM_NO_TEXT)) {
+		//printf("ERROR: llvm_svcs_disasm_batch()\n");
 		goto cleanup;
 	}
 
 	lengths.clear();
-	for(int i=0; i<src_len; ) {
-		//printf("first few bytes are: %02X %02X %02X %02X\n",
-		//	src[i], src[i+1], src[i+2], src[i+3]);
-		if(disasm_single(triplet, src+i, src_len-i, addr+i, result, length,
-		  context)) {
-			if(0) {
-				printf("ERROR: disasm_single()\n");
-				goto cleanup;
-			}
-			else {
-				/* make it best effort */
+	for(int i=0; i<insns.size(); ++i) {
+		if(insns[i].flags & LLVM_SVCS_INSN_INVALID)
+			break;
+		lengths.push_back(insns[i].length);
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* BATCH DISASSEMBLY */
+/*****************************************************************************/
+
+/* the C++ MC layer rather than LLVMDisasmInstruction(): decoding and
+	printing are separate steps there, so a batch can skip the printing, and
+	the instruction descriptions give the control flow flags for free */
+struct disasm_decoder {
+	shared_ptr<mc_bundle> bundle;
+	std::unique_ptr<MCContext> context;
+	std::unique_ptr<MCDisassembler> disasm;
+	std::unique_ptr<MCInstPrinter> printer;
+	std::unique_ptr<MCInstrAnalysis> analysis;
+	int minLength; /* to step over undecodable bytes */
+};
+
+void
+disasm_pool::clear(void)
+{
+	for(auto it = contexts.begin(); it != contexts.end(); ++it)
+		LLVMDisasmDispose(it->second);
+	contexts.clear();
+
+	for(auto it = decoders.begin(); it != decoders.end(); ++it)
+		delete it->second;
+	decoders.clear();
+}
+
+/* the calling thread's decoder for a triple and LLVM_SVCS_DISASM_* options,
+	made if need be */
+static disasm_decoder *
+disasm_decoder_get(const char *triplet, int options)
+{
+	disasm_decoder *d;
+	mc_bundle *b;
+	unsigned variant;
+	string strErr;
+	char key[16];
+
+	snprintf(key, sizeof(key), "\t%d", options);
+	string name = string(triplet) + key;
+
+	auto it = disasmPool.decoders.find(name);
+	if(it != disasmPool.decoders.end())
+		return it->second;
+
+	d = new disasm_decoder;
+	d->bundle = bundle_get(triplet, "", "", strErr);
+	if(!d->bundle)
+		goto fail;
+
+	b = d->bundle.get();
+
+	d->context.reset(new MCContext(b->asmInfo.get(), b->regInfo.get(), nullptr));
+	d->disasm.reset(b->target->createMCDisassembler(*b->subTargetInfo,
+		*d->context));
+	if(!d->disasm)
+		goto fail;
+
+	if(!(options & LLVM_SVCS_DISASM_NO_TEXT)) {
+		/* as LLVMSetDisasmOptions() picks the other syntax */
+		variant = b->asmInfo->getAssemblerDialect();
+		if(options & LLVM_SVCS_DISASM_ALT_SYNTAX)
+			variant = 1 - variant;
+
+		d->printer.reset(b->target->createMCInstPrinter(b->triple, variant,
+			*b->asmInfo, *b->instrInfo, *b->regInfo));
+		/* targets with one syntax, as LLVMSetDisasmOptions() leaves it */
+		if(!d->printer && (options & LLVM_SVCS_DISASM_ALT_SYNTAX))
+			d->printer.reset(b->target->createMCInstPrinter(b->triple,
+				b->asmInfo->getAssemblerDialect(), *b->asmInfo, *b->instrInfo,
+				*b->regInfo));
+		if(!d->printer)
+			goto fail;
+		d->printer->setPrintImmHex(options & LLVM_SVCS_DISASM_HEX_IMM);
+	}
+
+	d->analysis.reset(b->target->createMCInstrAnalysis(b->instrInfo.get()));
+
+	switch(b->triple.getArch()) {
+		case Triple::x86:
+		case Triple::x86_64:
+			d->minLength = 1; break;
+		case Triple::thumb:
+		case Triple::thumbeb:
+			d->minLength = 2; break;
+		default:
+			d->minLength = 4;
+	}
+
+	disasmPool.decoders[name] = d;
+	return d;
+
+	fail:
+	delete d;
+	return NULL;
+}
+
+/* split "\tmnemonic\toperands" as printed into the record's slices */
+static void
+insn_text(string &arena, size_t start, llvm_svcs_insn &insn)
+{
+	size_t end = arena.size(), i = start, j;
+
+	while(i < end && (arena[i] == '\t' || arena[i] == ' '))
+		i++;
+	for(j = i; j < end && arena[j] != '\t' && arena[j] != ' '; ++j)
+		;
+	insn.text = i;
+	insn.mnemonicLen = j - i;
+	insn.textLen = end - i;
+
+	/* one space between mnemonic and operands */
+	if(j < end)
+		arena[j] = ' ';
+}
+
+/* decode the instructions of src that start in [start,end), appending
+	their records to insns and text to arena, returns the offset after the
+	last (which may be past end, instructions can straddle it)
+
+	with blockEnd, stops after the first instruction that ends a basic block
+	(branch, return, undecodable)
+
+	the decoder sees all of src past each instruction, so an instruction
+	decodes the same whatever range it's reached from */
+static uint64_t
+decode_range(disasm_decoder *d, const uint8_t *src, uint64_t src_len,
+	uint64_t addr, uint64_t start, uint64_t end, vector<llvm_svcs_insn> &insns,
+	string &arena, bool blockEnd=false)
+{
+	raw_string_ostream textStream(arena);
+	MCInst inst;
+	uint64_t offs;
+
+	textStream.SetUnbuffered();
+
+	for(offs=start; offs<end && offs<src_len; ) {
+		llvm_svcs_insn insn = {offs, 0, (uint32_t)arena.size(), 0, 0, 0, 0};
+		uint64_t size = 0;
+
+		inst.clear();
+		if(d->disasm->getInstruction(inst, size,
+		  ArrayRef<uint8_t>(src + offs, src_len - offs), addr + offs, nulls(),
+		  nulls()) != MCDisassembler::Success || !size) {
+			insn.length = min((uint64_t)d->minLength, src_len - offs);
+			insn.flags = LLVM_SVCS_INSN_INVALID;
+			insns.push_back(insn);
+			offs += insn.length;
+			if(blockEnd)
 				break;
-			}
+			continue;
+		}
+		insn.length = size;
+
+		const MCInstrDesc &desc = d->bundle->instrInfo->get(inst.getOpcode());
+		if(desc.isBranch())
+			insn.flags |= LLVM_SVCS_INSN_BRANCH;
+		if(desc.isConditionalBranch())
+			insn.flags |= LLVM_SVCS_INSN_COND;
+		if(desc.isIndirectBranch())
+			insn.flags |= LLVM_SVCS_INSN_INDIRECT;
+		if(desc.isCall())
+			insn.flags |= LLVM_SVCS_INSN_CALL;
+		if(desc.isReturn())
+			insn.flags |= LLVM_SVCS_INSN_RETURN;
+		if((desc.isBranch() || desc.isCall()) && d->analysis &&
+		  d->analysis->evaluateBranch(inst, addr + offs, size, insn.target))
+			insn.flags |= LLVM_SVCS_INSN_TARGET;
+
+		if(d->printer) {
+			size_t textStart = arena.size();
+			d->printer->printInst(&inst, textStream, "", *d->bundle->subTargetInfo);
+			insn_text(arena, textStart, insn);
 		}
 
-		printf("%s(): %s has length %d\n", __func__, result.c_str(), length);
+		insns.push_back(insn);
+		offs += size;
 
-		lengths.push_back(length);
-		i += length;
+		if(blockEnd && (insn.flags & (LLVM_SVCS_INSN_BRANCH|LLVM_SVCS_INSN_RETURN)))
+			break;
 	}
 
+	return offs;
+}
+
+/* decode all of src[0,src_len) (at address addr), appending a record per
+	instruction to insns and their text to arena
+
+	undecodable bytes get a record flagged LLVM_SVCS_INSN_INVALID, one
+	instruction unit long (a byte on x86, 2 on thumb, 4 elsewhere), and
+	decoding carries on after them
+
+	nothing is allocated per instruction: records go in insns' storage and
+	text in arena's, both reused across calls if the caller clears rather
+	than frees them, and nothing is printed */
+int
+llvm_svcs_disasm_batch(
+	/* in parameters */
+	const char *triplet,
+	const uint8_t *src, uint64_t src_len,
+	uint64_t addr,
+	/* out parameters */
+	vector<llvm_svcs_insn> &insns,
+	string &arena,
+	/* LLVM_SVCS_DISASM_* */
+	int options
+)
+{
+	int rc = -1;
+	disasm_decoder *d = disasm_decoder_get(triplet, options);
+
+	if(!d) {
+		//printf("ERROR: disasm_decoder_get()\n");
+		goto cleanup;
+	}
+
+	/* a guess at the count, instructions average 4 bytes or so */
+	insns.reserve(insns.size() + src_len / 4 + 1);
+
+	decode_range(d, src, src_len, addr, 0, src_len, insns, arena);
+
 	rc = 0;
 	cleanup:
-	if(context) {
-		LLVMDisasmDispose(context);
-		context = NULL;
+	return rc;
+}
+
+/* decode from src[start], instructions starting before end, through the
+	first that ends a basic block: a branch (conditional or not), a return,
+	or bytes that don't decode (calls don't end blocks)
+
+	for following control flow, where a run goes only until the next known
+	instruction (end) or jump */
+int
+llvm_svcs_disasm_block(
+	/* in parameters */
+	const char *triplet,
+	const uint8_t *src, uint64_t src_len,
+	uint64_t addr,
+	uint64_t start, uint64_t end,
+	/* out parameters */
+	vector<llvm_svcs_insn> &insns,
+	string &arena,
+	/* LLVM_SVCS_DISASM_* */
+	int options
+)
+{
+	int rc = -1;
+	disasm_decoder *d = disasm_decoder_get(triplet, options);
+
+	if(!d) {
+		//printf("ERROR: disasm_decoder_get()\n");
+		goto cleanup;
+	}
+
+	decode_range(d, src, src_len, addr, start, end, insns, arena, true);
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/*****************************************************************************/
+/* PARALLEL LINEAR SWEEP */
+/*****************************************************************************/
+
+/* a thread's share of the buffer: decoded from a start that is only a guess
+	at an instruction boundary (except for the first chunk), records from
+	index first on are found to be right once the seams are checked */
+struct sweep_chunk {
+	uint64_t start, end;
+	vector<llvm_svcs_insn> insns;
+	string arena;
+	size_t first;
+	int rc;
+};
+
+static void
+sweep_decode(const char *triplet, int options, const uint8_t *src,
+	uint64_t src_len, uint64_t addr, sweep_chunk *c)
+{
+	/* a new thread, so its own decoder (the per target bundle is shared) */
+	disasm_decoder *d = disasm_decoder_get(triplet, options);
+
+	c->rc = -1;
+	if(!d)
+		return;
+
+	c->insns.reserve((c->end - c->start) / 4 + 1);
+	decode_range(d, src, src_len, addr, c->start, c->end, c->insns, c->arena);
+	c->rc = 0;
+}
+
+/* copy a chunk's right records and their text into place */
+static void
+sweep_gather(sweep_chunk *c, llvm_svcs_insn *insns, char *arena,
+	uint64_t textBase)
+{
+	uint32_t textFirst;
+
+	if(c->first >= c->insns.size())
+		return;
+
+	textFirst = c->insns[c->first].text;
+	memcpy(arena, c->arena.data() + textFirst, c->arena.size() - textFirst);
+
+	for(size_t i=c->first; i<c->insns.size(); ++i) {
+		*insns = c->insns[i];
+		insns->text = insns->text - textFirst + textBase;
+		insns++;
+	}
+
+	vector<llvm_svcs_insn>().swap(c->insns);
+	string().swap(c->arena);
+}
+
+/* offset after a chunk's last record */
+static uint64_t
+sweep_end(sweep_chunk &c)
+{
+	if(c.insns.empty())
+		return c.start;
+	return c.insns.back().offset + c.insns.back().length;
+}
+
+/* as llvm_svcs_disasm_batch(), the result identical, but the buffer split
+	among nThreads threads (0: one per core)
+
+	chunks start on multiples of the instruction unit. on fixed width targets
+	that is a boundary and the seams agree at once. on x86 (and thumb) a
+	chunk's start is a guess, so after the threads are done each seam is
+	checked in order: the true stream carried over from the chunk before is
+	decoded onward until it lands on an offset where the chunk also has an
+	instruction, from where the chunk's decode is the true one (both being
+	decodes from the same offset of the same bytes). misaligned decodes
+	usually fall into step within a few instructions */
+int
+llvm_svcs_disasm_parallel(
+	/* in parameters */
+	const char *triplet,
+	const uint8_t *src, uint64_t src_len,
+	uint64_t addr,
+	/* out parameters */
+	vector<llvm_svcs_insn> &insns,
+	string &arena,
+	/* LLVM_SVCS_DISASM_* */
+	int options,
+	int nThreads
+)
+{
+	int rc = -1;
+	disasm_decoder *d = disasm_decoder_get(triplet, options);
+	vector<thread> workers;
+	vector<sweep_chunk> chunks;
+	uint64_t chunkSize, next, nInsns, nText;
+	size_t insnsBase, arenaBase;
+	int prev, nChunks;
+
+	if(!d) {
+		//printf("ERROR: disasm_decoder_get()\n");
+		goto cleanup;
+	}
+
+	if(nThreads <= 0)
+		nThreads = std::max(1u, thread::hardware_concurrency());
+
+	/* tiny inputs aren't worth splitting */
+	chunkSize = (src_len + nThreads - 1) / nThreads;
+	chunkSize = (chunkSize + d->minLength - 1) / d->minLength * d->minLength;
+	if(chunkSize < 0x10000) chunkSize = 0x10000;
+	nChunks = (src_len + chunkSize - 1) / chunkSize;
+
+	if(nChunks <= 1) {
+		rc = llvm_svcs_disasm_batch(triplet, src, src_len, addr, insns, arena,
+			options);
+		goto cleanup;
+	}
+
+	chunks.resize(nChunks);
+	for(int i=0; i<nChunks; ++i) {
+		chunks[i].start = i * chunkSize;
+		chunks[i].end = std::min(chunks[i].start + chunkSize, src_len);
+		chunks[i].first = 0;
+		workers.push_back(thread(sweep_decode, triplet, options, src, src_len,
+			addr, &chunks[i]));
 	}
+
+	for(auto i=workers.begin(); i!=workers.end(); ++i)
+		i->join();
+	workers.clear();
+
+	for(int i=0; i<nChunks; ++i)
+		if(chunks[i].rc)
+			goto cleanup;
+
+	/* seams, in order: prev is the chunk the true stream is being decoded
+		onto and next is where that stream is up to */
+	prev = 0;
+	next = sweep_end(chunks[0]);
+	for(int k=1; k<nChunks; ++k) {
+		sweep_chunk &c = chunks[k];
+		size_t i = 0;
+
+		while(next < c.end) {
+			while(i < c.insns.size() && c.insns[i].offset < next)
+				i++;
+			if(i < c.insns.size() && c.insns[i].offset == next)
+				break;
+			next = decode_range(d, src, src_len, addr, next, next + 1,
+				chunks[prev].insns, chunks[prev].arena);
+		}
+
+		if(next < c.end) {
+			/* in step: the rest of this chunk is right */
+			c.first = i;
+			prev = k;
+			next = sweep_end(c);
+		}
+		else {
+			/* never in step, the true stream covered the whole chunk */
+			c.first = c.insns.size();
+		}
+	}
+
+	/* place each chunk's records and text after the ones before it */
+	nInsns = insns.size();
+	nText = arena.size();
+	for(int k=0; k<nChunks; ++k) {
+		sweep_chunk &c = chunks[k];
+		if(c.first >= c.insns.size())
+			continue;
+		nInsns += c.insns.size() - c.first;
+		nText += c.arena.size() - c.insns[c.first].text;
+	}
+
+	insnsBase = insns.size();
+	arenaBase = arena.size();
+	insns.resize(nInsns);
+	arena.resize(nText);
+
+	for(int k=0; k<nChunks; ++k) {
+		sweep_chunk &c = chunks[k];
+		if(c.first >= c.insns.size())
+			continue;
+		workers.push_back(thread(sweep_gather, &c, &insns[insnsBase],
+			&arena[0] + arenaBase, arenaBase));
+		insnsBase += c.insns.size() - c.first;
+		arenaBase += c.arena.size() - c.insns[c.first].text;
+	}
+
+	for(auto i=workers.begin(); i!=workers.end(); ++i)
+		i->join();
+
+	rc = 0;
+	cleanup:
 	return rc;
 }
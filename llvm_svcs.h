@@ -21,6 +21,11 @@
 /* misc */
 void llvm_svcs_init(void);
 
+/* per target objects (and the calling thread's disassembler contexts) are
+	made on first use and kept for later calls, this frees them (they're
+	remade as needed) */
+void llvm_svcs_cache_clear(void);
+
 void llvm_svcs_triplet_decompose(const char *triplet, string &arch,
 	string &subArch, string &vendor, string &os, string &environ, 
 	string &objFormat);
@@ -33,10 +38,56 @@ int llvm_svcs_assemble(const char *src, int dialect, const char *triplet,
 	int codeModel, int relocMode, llvm_svcs_assemble_cb_type callback, 
 	string &outBytes, string &err);
 
-/* disassemble */
+/* disassemble
+
+	contexts are kept per thread and per (triple, options), so repeated calls
+	cost just the decode */
+#define LLVM_SVCS_DISASM_HEX_IMM 1      /* immediates in hex */
+#define LLVM_SVCS_DISASM_ALT_SYNTAX 2   /* target's other syntax (x86: intel) */
+#define LLVM_SVCS_DISASM_NO_TEXT 4      /* batch: lengths and flags only */
+
 int llvm_svcs_disasm_single(const char *triplet, uint8_t *src,
-	int src_len, uint64_t addr, string &result, int &instrLen);
+	int src_len, uint64_t addr, string &result, int &instrLen,
+	int options=0);
 
 int llvm_svcs_disasm_lengths(const char *triplet, uint8_t *src, 
-	int src_len, uint64_t addr, vector<int> &lengths);
+	int src_len, uint64_t addr, vector<int> &lengths, int options=0);
+
+/* batch disassembly: a record per instruction, text in a shared arena
+
+	text is "mnemonic operands" at arena[text], textLen long, the mnemonic
+	being its first mnemonicLen characters (textLen is 0 with
+	LLVM_SVCS_DISASM_NO_TEXT, or for invalid bytes) */
+#define LLVM_SVCS_INSN_INVALID 1    /* couldn't decode, length is one unit */
+#define LLVM_SVCS_INSN_BRANCH 2
+#define LLVM_SVCS_INSN_COND 4       /* conditional branch */
+#define LLVM_SVCS_INSN_INDIRECT 8   /* indirect branch */
+#define LLVM_SVCS_INSN_CALL 16
+#define LLVM_SVCS_INSN_RETURN 32
+#define LLVM_SVCS_INSN_TARGET 64    /* target holds the branch/call destination */
+
+struct llvm_svcs_insn {
+	uint64_t offset;    /* from the start of src */
+	uint64_t target;
+	uint32_t text;      /* into the arena */
+	uint16_t textLen;
+	uint16_t mnemonicLen;
+	uint8_t length;
+	uint8_t flags;
+};
+
+int llvm_svcs_disasm_batch(const char *triplet, const uint8_t *src,
+	uint64_t src_len, uint64_t addr, vector<llvm_svcs_insn> &insns,
+	string &arena, int options=0);
+
+/* one basic block's worth: from src[start] (instructions starting before
+	end) through the first branch, return, or undecodable bytes */
+int llvm_svcs_disasm_block(const char *triplet, const uint8_t *src,
+	uint64_t src_len, uint64_t addr, uint64_t start, uint64_t end,
+	vector<llvm_svcs_insn> &insns, string &arena, int options=0);
 
+/* llvm_svcs_disasm_batch() across nThreads threads (0: one per core), with
+	the same result, instruction boundaries included */
+int llvm_svcs_disasm_parallel(const char *triplet, const uint8_t *src,
+	uint64_t src_len, uint64_t addr, vector<llvm_svcs_insn> &insns,
+	string &arena, int options=0, int nThreads=0);
@@ -0,0 +1,55 @@
+#pragma once
+
+/* in-process tagger plugins: hltag_*.so, found where the script taggers are
+
+	hlab maps the target once and hands every plugin a read-only pointer to
+	it; a plugin that wants the file emits its intervals through a callback
+	that stores them directly, no fork, no pipe, no text to format or parse
+
+	a plugin exports, with C linkage:
+
+	hltag_abi()     returns HLTAG_PLUGIN_ABI it was built against, a plugin
+	                with a different answer is not loaded
+	hltag_probe()   nonzero if it services the target (cheap: magic, sizes)
+	hltag_tag()     emits the tags, parents before children like the script
+	                taggers print them, returns 0 on success
+	hltag_tag_range()  optional, for plugins that emit "{expand}" placeholders
+	                (see tagging.h): emits the tags whose left end is in
+	                [left,right), returns 0 on success
+
+	the data stays valid and unchanged for the duration of either call,
+	labels passed to emit are copied before it returns */
+
+#include <stdint.h>
+
+#define HLTAG_PLUGIN_ABI 1
+
+/* label prefix of a placeholder tag, same as the script taggers print */
+#define HLTAG_EXPAND "{expand}"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*hltag_emit_fn)(void *ctx, uint64_t left, uint64_t right,
+	uint32_t color, const char *label, int labelLen);
+
+typedef int (*hltag_abi_fn)(void);
+typedef int (*hltag_probe_fn)(const uint8_t *data, uint64_t len,
+	const char *path);
+typedef int (*hltag_tag_fn)(const uint8_t *data, uint64_t len,
+	const char *path, hltag_emit_fn emit, void *ctx);
+typedef int (*hltag_tag_range_fn)(const uint8_t *data, uint64_t len,
+	const char *path, uint64_t left, uint64_t right, hltag_emit_fn emit,
+	void *ctx);
+
+int hltag_abi(void);
+int hltag_probe(const uint8_t *data, uint64_t len, const char *path);
+int hltag_tag(const uint8_t *data, uint64_t len, const char *path,
+	hltag_emit_fn emit, void *ctx);
+int hltag_tag_range(const uint8_t *data, uint64_t len, const char *path,
+	uint64_t left, uint64_t right, hltag_emit_fn emit, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,417 @@
+/* in-process ELF tagger, the plugin counterpart of hltag_elf32/64.py
+
+	tags the file header, program headers, section headers and contents, and
+	the symbols of .symtab and .dynsym, for either class and either byte
+	order; everything read is bounds checked against the mapping, so truncated
+	or lying tables are tagged as far as they go
+
+	big symbol tables are placeholders, hlab asks for their symbols a range
+	at a time as they're looked at
+
+	built as taggers/hltag_elf_native.so, see the Makefile */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <elf.h>
+
+#include "../tagger_plugin.h"
+
+/* don't let a corrupt e_shnum or sh_size have us emit forever */
+#define ELF_MAX_ENTRIES 0x100000
+
+/* symbol tables bigger than this are left as placeholders, their symbols
+	are tagged a range at a time by hltag_tag_range() */
+#define ELF_LAZY_SYMBOLS 4096
+
+struct elf_ctx {
+	const uint8_t *data;
+	uint64_t len;
+	bool be;
+	bool is64;
+	hltag_emit_fn emit;
+	void *ctx;
+	bool ranged;        /* only the lazy symbols in [left,right) */
+	uint64_t left, right;
+	char label[512];
+};
+
+/* a header field as laid out in the file, tables below are in file order */
+struct elf_field {
+	const char *name;
+	int size;
+};
+
+/*****************************************************************************/
+/* LAYOUTS */
+/*****************************************************************************/
+
+/* same order in both classes, only the sizes differ */
+#define EHDR_PHOFF 5
+#define EHDR_SHOFF 6
+#define EHDR_PHNUM 10
+#define EHDR_SHNUM 12
+#define EHDR_SHSTRNDX 13
+#define EHDR_FIELDS 15
+
+static const elf_field ehdr32[EHDR_FIELDS] = {
+	{"e_ident", 16}, {"e_type", 2}, {"e_machine", 2}, {"e_version", 4},
+	{"e_entry", 4}, {"e_phoff", 4}, {"e_shoff", 4}, {"e_flags", 4},
+	{"e_ehsize", 2}, {"e_phentsize", 2}, {"e_phnum", 2}, {"e_shentsize", 2},
+	{"e_shnum", 2}, {"e_shstrndx", 2}, {NULL, 0}
+};
+
+static const elf_field ehdr64[EHDR_FIELDS] = {
+	{"e_ident", 16}, {"e_type", 2}, {"e_machine", 2}, {"e_version", 4},
+	{"e_entry", 8}, {"e_phoff", 8}, {"e_shoff", 8}, {"e_flags", 4},
+	{"e_ehsize", 2}, {"e_phentsize", 2}, {"e_phnum", 2}, {"e_shentsize", 2},
+	{"e_shnum", 2}, {"e_shstrndx", 2}, {NULL, 0}
+};
+
+#define SHDR_TYPE 1
+#define SHDR_OFFSET 4
+#define SHDR_SIZE 5
+#define SHDR_LINK 6
+#define SHDR_FIELDS 11
+
+static const elf_field shdr32[SHDR_FIELDS] = {
+	{"sh_name", 4}, {"sh_type", 4}, {"sh_flags", 4}, {"sh_addr", 4},
+	{"sh_offset", 4}, {"sh_size", 4}, {"sh_link", 4}, {"sh_info", 4},
+	{"sh_addralign", 4}, {"sh_entsize", 4}, {NULL, 0}
+};
+
+static const elf_field shdr64[SHDR_FIELDS] = {
+	{"sh_name", 4}, {"sh_type", 4}, {"sh_flags", 8}, {"sh_addr", 8},
+	{"sh_offset", 8}, {"sh_size", 8}, {"sh_link", 4}, {"sh_info", 4},
+	{"sh_addralign", 8}, {"sh_entsize", 8}, {NULL, 0}
+};
+
+/* p_type leads in both, p_flags moves */
+#define PHDR_TYPE 0
+#define PHDR_FIELDS 9
+
+static const elf_field phdr32[PHDR_FIELDS] = {
+	{"p_type", 4}, {"p_offset", 4}, {"p_vaddr", 4}, {"p_paddr", 4},
+	{"p_filesz", 4}, {"p_memsz", 4}, {"p_flags", 4}, {"p_align", 4},
+	{NULL, 0}
+};
+
+static const elf_field phdr64[PHDR_FIELDS] = {
+	{"p_type", 4}, {"p_flags", 4}, {"p_offset", 8}, {"p_vaddr", 8},
+	{"p_paddr", 8}, {"p_filesz", 8}, {"p_memsz", 8}, {"p_align", 8},
+	{NULL, 0}
+};
+
+/* st_name leads in both, the rest is rearranged */
+#define SYM_FIELDS 7
+
+static const elf_field sym32[SYM_FIELDS] = {
+	{"st_name", 4}, {"st_value", 4}, {"st_size", 4}, {"st_info", 1},
+	{"st_other", 1}, {"st_shndx", 2}, {NULL, 0}
+};
+
+static const elf_field sym64[SYM_FIELDS] = {
+	{"st_name", 4}, {"st_info", 1}, {"st_other", 1}, {"st_shndx", 2},
+	{"st_value", 8}, {"st_size", 8}, {NULL, 0}
+};
+
+/*****************************************************************************/
+/* READING, EMITTING */
+/*****************************************************************************/
+
+static uint64_t rd(elf_ctx &e, uint64_t off, int size)
+{
+	uint64_t rv = 0;
+
+	if(off > e.len || (uint64_t)size > e.len - off)
+		return 0;
+
+	for(int i=0; i<size; ++i) {
+		int shift = e.be ? 8*(size-1-i) : 8*i;
+		rv |= (uint64_t)e.data[off+i] << shift;
+	}
+
+	return rv;
+}
+
+static void tag(elf_ctx &e, uint64_t left, uint64_t right, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(e.label, sizeof(e.label), fmt, args);
+	va_end(args);
+
+	if(n < 0)
+		return;
+	if(n >= (int)sizeof(e.label))
+		n = sizeof(e.label) - 1;
+
+	e.emit(e.ctx, left, right, 0, e.label, n);
+}
+
+/* NUL terminated string at <off> in a table, NULL if it isn't */
+static const char *str_at(elf_ctx &e, uint64_t tabOff, uint64_t tabSize,
+	uint64_t off)
+{
+	if(tabOff > e.len || tabSize > e.len - tabOff || off >= tabSize)
+		return NULL;
+
+	const char *s = (const char *)e.data + tabOff + off;
+	if(!memchr(s, '\0', tabSize - off))
+		return NULL;
+	return s;
+}
+
+/* read a header's fields at <off> into values[] (0 if truncated) */
+static void read_fields(elf_ctx &e, uint64_t off, const elf_field *fields,
+	uint64_t *values)
+{
+	for(int i=0; fields[i].name; ++i) {
+		values[i] = (fields[i].size <= 8) ? rd(e, off, fields[i].size) : 0;
+		off += fields[i].size;
+	}
+}
+
+/* tag a header's fields at <off>, values[] receives each as in read_fields()
+
+	returns the header's size */
+static uint64_t tag_fields(elf_ctx &e, uint64_t off, const elf_field *fields,
+	uint64_t *values)
+{
+	uint64_t cur = off;
+
+	read_fields(e, off, fields, values);
+
+	for(int i=0; fields[i].name; ++i) {
+		int size = fields[i].size;
+		if(cur + size <= e.len) {
+			if(size <= 8)
+				tag(e, cur, cur+size, "%s=0x%llX", fields[i].name,
+					(unsigned long long)values[i]);
+			else
+				tag(e, cur, cur+size, "%s", fields[i].name);
+		}
+		cur += size;
+	}
+
+	return cur - off;
+}
+
+static uint64_t fields_size(const elf_field *fields)
+{
+	uint64_t rv = 0;
+	for(int i=0; fields[i].name; ++i)
+		rv += fields[i].size;
+	return rv;
+}
+
+/* number of <entSize> entries at <off>, limited to what's in the file */
+static uint64_t entries_fit(elf_ctx &e, uint64_t off, uint64_t n,
+	uint64_t entSize)
+{
+	if(off >= e.len)
+		return 0;
+	if(n > (e.len - off) / entSize)
+		n = (e.len - off) / entSize;
+	if(n > ELF_MAX_ENTRIES)
+		n = ELF_MAX_ENTRIES;
+	return n;
+}
+
+/*****************************************************************************/
+/* TAGGING */
+/*****************************************************************************/
+
+static void tag_symbols(elf_ctx &e, uint64_t off, uint64_t n,
+	uint64_t strOff, uint64_t strSize)
+{
+	const elf_field *fields = e.is64 ? sym64 : sym32;
+	uint64_t entSize = fields_size(fields);
+	uint64_t values[SYM_FIELDS];
+	uint64_t first = 0;
+
+	/* the entries starting in [left,right) */
+	if(e.ranged) {
+		if(e.right <= off)
+			return;
+		if(e.left > off)
+			first = (e.left - off + entSize - 1) / entSize;
+		if((e.right - off + entSize - 1) / entSize < n)
+			n = (e.right - off + entSize - 1) / entSize;
+	}
+
+	for(uint64_t i=first; i<n; ++i) {
+		uint64_t cur = off + i*entSize;
+		const char *name = str_at(e, strOff, strSize, rd(e, cur, 4));
+
+		tag(e, cur, cur+entSize, "%s \"%s\"",
+			e.is64 ? "Elf64_Sym" : "Elf32_Sym", name ? name : "");
+		tag_fields(e, cur, fields, values);
+	}
+}
+
+static void tag_sections(elf_ctx &e, uint64_t shoff, uint64_t shnum,
+	uint64_t shstrndx)
+{
+	const elf_field *fields = e.is64 ? shdr64 : shdr32;
+	const elf_field *symFields = e.is64 ? sym64 : sym32;
+	uint64_t entSize = fields_size(fields);
+	uint64_t values[SHDR_FIELDS], names[SHDR_FIELDS], link[SHDR_FIELDS];
+	uint64_t strOff = 0, strSize = 0;
+	uint64_t n = entries_fit(e, shoff, shnum, entSize);
+
+	/* section names */
+	if(shstrndx < n) {
+		read_fields(e, shoff + shstrndx*entSize, fields, names);
+		strOff = names[SHDR_OFFSET];
+		strSize = names[SHDR_SIZE];
+	}
+
+	for(uint64_t i=0; i<n; ++i) {
+		uint64_t cur = shoff + i*entSize;
+		const char *name = str_at(e, strOff, strSize, rd(e, cur, 4));
+		if(!name)
+			name = "";
+
+		if(e.ranged) {
+			read_fields(e, cur, fields, values);
+		}
+		else {
+			tag(e, cur, cur+entSize, "%s \"%s\"",
+				e.is64 ? "elf64_shdr" : "elf32_shdr", name);
+			tag_fields(e, cur, fields, values);
+		}
+
+		uint64_t type = values[SHDR_TYPE];
+		uint64_t off = values[SHDR_OFFSET];
+		uint64_t size = values[SHDR_SIZE];
+		if(type == SHT_NULL || type == SHT_NOBITS || !size)
+			continue;
+		if(off >= e.len || size > e.len - off)
+			continue;
+
+		bool symbols = (type == SHT_SYMTAB || type == SHT_DYNSYM) &&
+			values[SHDR_LINK] < n;
+		uint64_t nSyms = symbols ? entries_fit(e, off,
+			size / fields_size(symFields), fields_size(symFields)) : 0;
+		bool lazy = nSyms > ELF_LAZY_SYMBOLS;
+
+		if(e.ranged) {
+			if(!lazy || off >= e.right || off + size <= e.left)
+				continue;
+		}
+		else {
+			tag(e, off, off+size, "%ssection \"%s\" contents",
+				lazy ? HLTAG_EXPAND " " : "", name);
+			if(!symbols || lazy)
+				continue;
+		}
+
+		/* symbols go right under their section, parents before children */
+		read_fields(e, shoff + values[SHDR_LINK]*entSize, fields, link);
+		tag_symbols(e, off, nSyms, link[SHDR_OFFSET], link[SHDR_SIZE]);
+	}
+}
+
+static void tag_segments(elf_ctx &e, uint64_t phoff, uint64_t phnum)
+{
+	const elf_field *fields = e.is64 ? phdr64 : phdr32;
+	uint64_t entSize = fields_size(fields);
+	uint64_t values[PHDR_FIELDS];
+	uint64_t n = entries_fit(e, phoff, phnum, entSize);
+
+	for(uint64_t i=0; i<n; ++i) {
+		uint64_t cur = phoff + i*entSize;
+		read_fields(e, cur, fields, values);
+		tag(e, cur, cur+entSize, "%s %d type=0x%X",
+			e.is64 ? "elf64_phdr" : "elf32_phdr", (int)i,
+			(unsigned int)values[PHDR_TYPE]);
+		tag_fields(e, cur, fields, values);
+	}
+}
+
+/*****************************************************************************/
+/* PLUGIN ENTRY POINTS */
+/*****************************************************************************/
+
+extern "C" int hltag_abi(void)
+{
+	return HLTAG_PLUGIN_ABI;
+}
+
+extern "C" int hltag_probe(const uint8_t *data, uint64_t len, const char *path)
+{
+	(void)path; /* ELF is known by its header */
+
+	if(len < sizeof(Elf32_Ehdr) || memcmp(data, ELFMAG, SELFMAG))
+		return 0;
+	if(data[EI_CLASS] != ELFCLASS32 && data[EI_CLASS] != ELFCLASS64)
+		return 0;
+	if(data[EI_DATA] != ELFDATA2LSB && data[EI_DATA] != ELFDATA2MSB)
+		return 0;
+	if(data[EI_CLASS] == ELFCLASS64 && len < sizeof(Elf64_Ehdr))
+		return 0;
+	return 1;
+}
+
+static void ctx_init(elf_ctx &e, const uint8_t *data, uint64_t len,
+	hltag_emit_fn emit, void *ctx)
+{
+	e.data = data;
+	e.len = len;
+	e.is64 = (data[EI_CLASS] == ELFCLASS64);
+	e.be = (data[EI_DATA] == ELFDATA2MSB);
+	e.emit = emit;
+	e.ctx = ctx;
+	e.ranged = false;
+	e.left = e.right = 0;
+}
+
+extern "C" int hltag_tag(const uint8_t *data, uint64_t len, const char *path,
+	hltag_emit_fn emit, void *ctx)
+{
+	elf_ctx e;
+	uint64_t values[EHDR_FIELDS];
+
+	if(!hltag_probe(data, len, path))
+		return -1;
+
+	ctx_init(e, data, len, emit, ctx);
+
+	const elf_field *fields = e.is64 ? ehdr64 : ehdr32;
+	tag(e, 0, fields_size(fields), e.is64 ? "elf64_hdr" : "elf32_hdr");
+	tag_fields(e, 0, fields, values);
+
+	tag_segments(e, values[EHDR_PHOFF], values[EHDR_PHNUM]);
+	tag_sections(e, values[EHDR_SHOFF], values[EHDR_SHNUM],
+		values[EHDR_SHSTRNDX]);
+
+	return 0;
+}
+
+/* the symbols of placeholder symbol tables, whose entries start in
+	[left,right) */
+extern "C" int hltag_tag_range(const uint8_t *data, uint64_t len,
+	const char *path, uint64_t left, uint64_t right, hltag_emit_fn emit,
+	void *ctx)
+{
+	elf_ctx e;
+	uint64_t values[EHDR_FIELDS];
+
+	if(!hltag_probe(data, len, path))
+		return -1;
+
+	ctx_init(e, data, len, emit, ctx);
+	e.ranged = true;
+	e.left = left;
+	e.right = right;
+
+	read_fields(e, 0, e.is64 ? ehdr64 : ehdr32, values);
+	tag_sections(e, values[EHDR_SHOFF], values[EHDR_SHNUM],
+		values[EHDR_SHSTRNDX]);
+
+	return 0;
+}
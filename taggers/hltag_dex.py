@@ -40,8 +40,8 @@ def typeDescriptorToString(td):
 # "main"
 ###############################################################################
 
-if __name__ == '__main__':
-	fp = open(sys.argv[1], "rb")
+def tagFile(path):
+	fp = tagOpen(path)
 
 	magic = fp.read(8)
 	if not (magic in [DEX_FILE_MAGIC_35, DEX_FILE_MAGIC_37]):
@@ -219,3 +219,8 @@ if __name__ == '__main__':
 	fp.close()
 	sys.exit(0)
 
+if __name__ == '__main__':
+	describe([(0, DEX_FILE_MAGIC_35), (0, DEX_FILE_MAGIC_37)], 0x70, serve=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
@@ -309,4 +309,5 @@ def isElf32(fp):
 if __name__ == '__main__':
 	# functions in this file are meant to be "common" functions called from
 	# more specialied taggers like elf32 or elf64
+	describe(library=True)
 	sys.exit(-1)
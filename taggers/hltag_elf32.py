@@ -7,8 +7,8 @@ import binascii
 from hltag_elf import *
 from hltag_lib import *
 
-if __name__ == '__main__':
-	fp = open(sys.argv[1], "rb")
+def tagFile(path):
+	fp = tagOpen(path)
 
 	if not isElf32(fp):
 		sys.exit(-1)
@@ -87,12 +87,12 @@ if __name__ == '__main__':
 		if strName == '.rel.text':
 			relText = [sh_offset, sh_size]
 
-		print '[0x%X,0x%X) 0x0 elf32_shdr "%s" %s' % \
-			(oHdr, fp.tell(), scnStrTab[sh_name], strType)
+		tagEmit(oHdr, fp.tell(), 'elf32_shdr "%s" %s' % \
+			(scnStrTab[sh_name], strType))
 	
 		if(not sh_type in [SHT_NULL, SHT_NOBITS]):
-			print '[0x%X,0x%X) 0x0 section "%s" contents' % \
-				(sh_offset, sh_offset+sh_size, scnStrTab[sh_name])
+			tagEmit(sh_offset, sh_offset+sh_size, 'section "%s" contents' % \
+				scnStrTab[sh_name])
 
 	# certain sections we analyze deeper...
 	if strtab:
@@ -130,28 +130,21 @@ if __name__ == '__main__':
 		# .symbtab is an array of Elf32_Sym entries
 		[offs,size] = symtab
 		fp.seek(offs)
-		while fp.tell() < (offs + size):
-			tmp = fp.tell()
-
-			st_name = uint32(fp, 1)
+		syms = records(fp, 'IIIBBH', size / SIZE_ELF32_SYM)
+		for (i, sym) in enumerate(syms):
+			(st_name, st_value, st_size, st_info, st_other, st_shndx) = sym
+			o = offs + i*SIZE_ELF32_SYM
 			nameStr = strTab[st_name]
-			tag(fp, 4, "st_name=0x%X \"%s\"" % (st_name,nameStr))
-
-			st_value = tagUint32(fp, "st_value")
-
-			st_size = tagUint32(fp, "st_size")
-
-			st_info = uint8(fp, 1)
+			tagEmit(o, o+4, "st_name=0x%X \"%s\"" % (st_name,nameStr))
+			tagEmit(o+4, o+8, "st_value=0x%X " % st_value)
+			tagEmit(o+8, o+12, "st_size=0x%X " % st_size)
 			bindingStr = symbol_binding_tostr(st_info >> 4)
 			typeStr = symbol_type_tostr(st_info & 0xF)
-			tag(fp, 1, "st_info bind:%d(%s) type:%d(%s)" % \
+			tagEmit(o+12, o+13, "st_info bind:%d(%s) type:%d(%s)" % \
 				(st_info>>4, bindingStr, st_info&0xF, typeStr))
-
-			st_other = tagUint8(fp, "st_other")
-
-			st_shndx = tagUint16(fp, "st_shndx")
-			fp.seek(tmp)
-			tag(fp, SIZE_ELF32_SYM, "Elf32_Sym \"%s\"" % nameStr)
+			tagEmit(o+13, o+14, "st_other=0x%X " % st_other)
+			tagEmit(o+14, o+16, "st_shndx=0x%X " % st_shndx)
+			tagEmit(o, o+SIZE_ELF32_SYM, "Elf32_Sym \"%s\"" % nameStr)
 
 	# read program headers
 	fp.seek(e_phoff)
@@ -168,8 +161,14 @@ if __name__ == '__main__':
 	
 		strType = phdr_type_tostr(p_type)
 	
-		print '[0x%X,0x%X) 0x0 elf32_phdr %d %s' % \
-			(oHdr, fp.tell(), i, strType)
+		tagEmit(oHdr, fp.tell(), 'elf32_phdr %d %s' % (i, strType))
 	
 	fp.close()
 	sys.exit(0);
+
+if __name__ == '__main__':
+	describe([(0, ELFMAG + chr(ELFCLASS32))], SIZE_ELF32_HDR, serve=True,
+	  binary=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
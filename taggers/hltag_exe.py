@@ -18,8 +18,8 @@ from hltag_lib import *
 # relocation table
 # binary code
 
-if __name__ == '__main__':
-	fp = open(sys.argv[1], "rb")
+def tagFile(path):
+	fp = tagOpen(path)
 
 	# mz header
 	if not fp.read(2) == 'MZ':
@@ -68,3 +68,8 @@ if __name__ == '__main__':
 	fp.close()
 	sys.exit(0)
 
+if __name__ == '__main__':
+	describe([(0, 'MZ')], 0x1C, serve=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
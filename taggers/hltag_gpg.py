@@ -117,13 +117,13 @@ def litDataFmtToStr(fmt):
 # "main"
 ###############################################################################
 
-if __name__ == '__main__':
+def tagFile(path):
 	# for now, test just the file extension
 	# TODO: see if file would make sense if we treated its bytes like packets
-	if not re.match(r'^.*\.gpg$', sys.argv[1]):
+	if not re.match(r'^.*\.gpg$', path):
 		sys.exit(-1)
 
-	fp = open(sys.argv[1], "rb")
+	fp = tagOpen(path)
 	
 	# for each packet
 	while not IsEof(fp):
@@ -243,3 +243,9 @@ if __name__ == '__main__':
 		
 	fp.close()
 	sys.exit(0)
+
+if __name__ == '__main__':
+	describe(exts=['.gpg'], serve=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
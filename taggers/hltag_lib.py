@@ -1,7 +1,12 @@
 #!/usr/bin/env python
 
+import os
 import sys
+import mmap
+import atexit
+import struct
 import binascii
+import traceback
 from struct import pack, unpack
 
 ###############################################################################
@@ -73,26 +78,78 @@ def colorFromBytes(data):
 	    0xFEFAD7, 0xFEFBDD, 0xFEFBE3, 0xFEFCE8, 0xFEFDEE, 0xFEFDF3, 0xFEFEF9, 0xFEFFFF \
 	]
 
-	avg = int(round(sum(map(ord, list(data))) / len(data)))
+	avg = int(round(sum(bytearray(data)) / len(data)))
 	assert avg >= 0 and avg <= 255
 	return color_lookup[avg]
 	    
 def colorFromBytesFP(FP, length, rewind=0):
+	if FP.__class__ is Cursor:
+		result = colorFromBytes(FP.data[FP.pos:FP.pos+length])
+		if not rewind: FP.pos += length
+		return result
 	tmp = FP.tell()
 	result = colorFromBytes(FP.read(length));
 	if rewind: FP.seek(tmp)
 	return result
 
+###############################################################################
+# file cursor
+###############################################################################
+
+# tagOpen(path) is open(path, "rb") for taggers: a read-only cursor over the
+# mapped file with the same read()/seek()/tell()/close(), which the accessors
+# below decode in place instead of copying each field out with read()
+class Cursor(object):
+	def __init__(self, path):
+		self.fobj = open(path, "rb")
+		self.size = os.fstat(self.fobj.fileno()).st_size
+		self.data = ''
+		if self.size:
+			self.data = mmap.mmap(self.fobj.fileno(), 0, access=mmap.ACCESS_READ)
+		self.pos = 0
+
+	def read(self, length=-1):
+		if length < 0:
+			length = self.size - self.pos
+		value = self.data[self.pos:self.pos+length]
+		self.pos += len(value)
+		return value
+
+	def seek(self, offset, whence=0):
+		if whence == 1:
+			offset += self.pos
+		elif whence == 2:
+			offset += self.size
+		if offset < 0:
+			raise IOError(22, 'Invalid argument')
+		self.pos = offset
+
+	def tell(self):
+		return self.pos
+
+	def close(self):
+		if self.size:
+			self.data.close()
+		self.fobj.close()
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.close()
+
+def tagOpen(path):
+	return Cursor(path)
 
 ###############################################################################
 # FP conveniences
 ###############################################################################
 
 def IsEof(FP):
-	answer = False
+	if FP.__class__ is Cursor:
+		return FP.pos >= FP.size
 	temp = FP.tell()
-	if FP.read()=='':
-	    answer = True
+	answer = (FP.read(1) == '')
 	FP.seek(temp)
 	return answer
 
@@ -105,91 +162,83 @@ def peek(FP,len):
 # endianness
 ###############################################################################
 
-# default to little-endian
-fmtu8 = '<B'
-fmt8 = '<b'
-fmtu16 = '<H'
-fmt16 = '<h'
-fmtu32 = '<I'
-fmt32 = '<i'
-fmtu64 = '<Q'
-fmt64 = '<q'
+# precompiled readers, by endianness; fmt* stay for taggers that unpack
+# themselves
+structs = {}
+for e in '<>':
+	structs[e] = dict((c, struct.Struct(e+c)) for c in 'BbHhIiQq')
 
-def setLittleEndian():
+def setEndian(e):
 	global fmt8, fmtu8, fmt16, fmtu16
 	global fmt32, fmtu32, fmt64, fmtu64
-	fmtu8 = '<B'
-	fmt8 = '<b'
-	fmtu16 = '<H'
-	fmt16 = '<h'
-	fmtu32 = '<I'
-	fmt32 = '<i'
-	fmtu64 = '<Q'
-	fmt64 = '<q'
+	global endian, su8, s8, su16, s16, su32, s32, su64, s64
+	endian = e
+	(fmtu8, fmt8, fmtu16, fmt16) = (e+'B', e+'b', e+'H', e+'h')
+	(fmtu32, fmt32, fmtu64, fmt64) = (e+'I', e+'i', e+'Q', e+'q')
+	s = structs[e]
+	(su8, s8, su16, s16) = (s['B'], s['b'], s['H'], s['h'])
+	(su32, s32, su64, s64) = (s['I'], s['i'], s['Q'], s['q'])
+
+def setLittleEndian():
+	setEndian('<')
 
 def setBigEndian():
-	global fmt8, fmtu8, fmt16, fmtu16
-	global fmt32, fmtu32, fmt64, fmtu64
-	fmtu8 = '>B'
-	fmt8 = '>b'
-	fmtu16 = '>H'
-	fmt16 = '>h'
-	fmtu32 = '>I'
-	fmt32 = '>i'
-	fmtu64 = '>Q'
-	fmt64 = '>q'
+	setEndian('>')
+
+# default to little-endian
+setLittleEndian()
 
 ###############################################################################
 # data accessors
 ###############################################################################
 
-def int8(FP, peek=0):
-	global fmt8
-	value = unpack(fmt8, FP.read(1))[0]
-	if peek: FP.seek(-1,1)
+# one field through a Struct: in place from a Cursor, else read() from FP
+def field(FP, s, peek):
+	if FP.__class__ is Cursor:
+		value = s.unpack_from(FP.data, FP.pos)[0]
+		if not peek: FP.pos += s.size
+		return value
+	value = s.unpack(FP.read(s.size))[0]
+	if peek: FP.seek(-s.size,1)
 	return value
 
+def int8(FP, peek=0):
+	return field(FP, s8, peek)
+
 def uint8(FP, peek=0):
-	global fmtu8
-	value = unpack(fmtu8, FP.read(1))[0]
-	if peek: FP.seek(-1,1)
-	return value
+	return field(FP, su8, peek)
 
 def int16(FP, peek=0):
-	global fmt16
-	value = unpack(fmt16, FP.read(2))[0]
-	if peek: FP.seek(-2,1)
-	return value
+	return field(FP, s16, peek)
 
 def uint16(FP, peek=0):
-	global fmtu16
-	value = unpack(fmtu16, FP.read(2))[0]
-	if peek: FP.seek(-2,1)
-	return value
+	return field(FP, su16, peek)
 
 def int32(FP, peek=0):
-	global fmt32
-	value = unpack(fmt32, FP.read(4))[0]
-	if peek: FP.seek(-4,1)
-	return value
+	return field(FP, s32, peek)
 
 def uint32(FP, peek=0):
-	global fmtu32
-	value = unpack(fmtu32, FP.read(4))[0]
-	if peek: FP.seek(-4,1)
-	return value
+	return field(FP, su32, peek)
 
 def int64(FP, peek=0):
-	global fmt64
-	value = unpack(fmt64, FP.read(8))[0]
-	if peek: FP.seek(-8,1)
-	return value
+	return field(FP, s64, peek)
 
 def uint64(FP, peek=0):
-	global fmtu64
-	value = unpack(fmtu64, FP.read(8))[0]
-	if peek: FP.seek(-8,1)
-	return value
+	return field(FP, su64, peek)
+
+# <count> consecutive records of struct format <fmt> (no byte order, the
+# current endianness applies), as a list of tuples; for tables (symbols,
+# relocations, section headers) decoded in one go instead of field by field
+recordStructs = {}
+
+def records(FP, fmt, count):
+	key = endian + fmt
+	s = recordStructs.get(key)
+	if not s:
+		s = recordStructs[key] = struct.Struct(key)
+	data = FP.read(s.size * count)
+	count = len(data) // s.size
+	return [s.unpack_from(data, i*s.size) for i in xrange(count)]
 
 def uleb128(FP, peek=0):
 	anchor = FP.tell()
@@ -202,7 +251,7 @@ def uleb128(FP, peek=0):
 			sample = binascii.hexlify(FP.read(5))
 			raise Exception("invalid uleb128 at offs=0x%X %s..." % (anchor, sample))
 
-		t = unpack('B', FP.read(1))[0]
+		t = uint8(FP)
 		value = value | ((t & 0x7F)<<(7*nbytes))
 		nbytes += 1
 
@@ -216,14 +265,22 @@ def uleb128(FP, peek=0):
 
 # strings (eats trailing nulls)
 def string(FP, length, peek=0):
-	value = unpack('%ds' % length, FP.read(length))[0]
-	while(value and value[-1]=='\x00'):
-	    value = value[0:-1]
+	value = FP.read(length)
+	if len(value) < length:
+		raise struct.error('string requires %d bytes' % length)
+	value = value.rstrip('\x00')
 	if peek: FP.seek(-1*length, 1)
 	return value
 
 #
 def dataUntil(FP, terminator, peek=0):
+	if FP.__class__ is Cursor:
+		end = FP.data.find(terminator, FP.pos)
+		if end < 0:
+			raise EOFError('no %s after 0x%X' % (repr(terminator), FP.pos))
+		data = FP.data[FP.pos:end+len(terminator)]
+		if not peek: FP.pos += len(data)
+		return data
 	data = ''
 	lenterm = len(terminator)
 	while 1:
@@ -235,62 +292,236 @@ def dataUntil(FP, terminator, peek=0):
 	if peek: FP.seek(-len(data), 1)
 	return data
 
+###############################################################################
+# output
+###############################################################################
+
+# hlab understands binary records when it sets HLTAG_BINARY=1; a tagger that
+# emits only through tagEmit() (and the tag*() helpers) says so with
+# describe(binary=True), and its output is then the magic line followed by
+# records (see IntervalMgr.h), which hlab takes without parsing text
+BINARY_MAGIC = '//hltag binary 1\n'
+BINARY_RECORD = struct.Struct('<QQII')
+BINARY_END = 0xFFFFFFFFFFFFFFFF
+BINARY = False
+binaryStarted = False
+
+# tags leave through a large stdout buffer rather than a write per few tags;
+# print statements share it, so they stay in order with tagEmit()
+OUTPUT_BUFFER = 1 << 16
+
+def outputBuffered():
+	if sys.stdout is not sys.__stdout__ or sys.stdout.isatty():
+		return
+	sys.stdout.flush()
+	sys.stdout = os.fdopen(os.dup(sys.__stdout__.fileno()), 'w', OUTPUT_BUFFER)
+	atexit.register(sys.stdout.flush)
+
+# tags can name their parent instead of hlab inferring it from containment:
+# id = tagId() gives a number, pass it as id= to the parent's tag, then
+# tagParent(id) puts the tags that follow under it until tagParent(None);
+# a parent must be emitted before its children
+PARENT = None
+lastId = -1
+
+def tagId():
+	global lastId
+	lastId += 1
+	return lastId
+
+def tagParent(id):
+	global PARENT
+	PARENT = id
+
+def tagEmit(left, right, label, color=0, id=None, parent=None):
+	global binaryStarted
+	if parent is None:
+		parent = PARENT
+	if parent is not None:
+		label = '{parent %d} %s' % (parent, label)
+	if id is not None:
+		label = '{id %d} %s' % (id, label)
+	if BINARY:
+		if not binaryStarted:
+			sys.stdout.write(BINARY_MAGIC)
+			binaryStarted = True
+		sys.stdout.write(BINARY_RECORD.pack(left, right, color, len(label)) + label)
+	else:
+		sys.stdout.write('[0x%X,0x%X) 0x%X %s\n' % (left, right, color, label))
+
 ###############################################################################
 # taggers
 ###############################################################################
 
-def tag(FP, length, comment, rewind=0):
+def tag(FP, length, comment, rewind=0, id=None):
 	pos = FP.tell()
 	val = FP.read(length)
-	print '[0x%X,0x%X) 0x0 %s' % (pos, pos+length, comment)
+	tagEmit(pos, pos+length, comment, id=id)
 	if rewind: FP.seek(pos)
 	return val
 
 def tagUint8(FP, name, comment='', peek=0):
 	pos = FP.tell()
 	val = uint8(FP, peek)
-	print '[0x%X,0x%X) 0x0 %s=0x%X %s' % (pos, pos+1, name, val, comment)
+	tagEmit(pos, pos+1, '%s=0x%X %s' % (name, val, comment))
 	return val
 
 def tagUint16(FP, name, comment='', peek=0):
 	pos = FP.tell()
 	val = uint16(FP, peek)
-	print '[0x%X,0x%X) 0x0 %s=0x%X %s' % (pos, pos+2, name, val, comment)
+	tagEmit(pos, pos+2, '%s=0x%X %s' % (name, val, comment))
 	return val
 
 def tagUint32(FP, name, comment='', peek=0):
 	pos = FP.tell()
 	val = uint32(FP, peek)
-	print '[0x%X,0x%X) 0x0 %s=0x%X %s' % (pos, pos+4, name, val, comment)
+	tagEmit(pos, pos+4, '%s=0x%X %s' % (name, val, comment))
 	return val
 
 def tagUint64(FP, name, comment='', peek=0):
 	pos = FP.tell()
 	val = uint64(FP, peek)
-	print '[0x%X,0x%X) 0x0 %s=0x%X %s' % (pos, pos+8, name, val, comment)
+	tagEmit(pos, pos+8, '%s=0x%X %s' % (name, val, comment))
 	return val
 
 def tagUleb128(FP, comment, peek=0):
 	pos = FP.tell()
 	(val,length) = uleb128(FP, peek)
-	print '[0x%X,0x%X) 0x0 %s=0x%X' % (pos, pos+length, comment, val)
+	tagEmit(pos, pos+length, '%s=0x%X' % (comment, val))
 	return val
 
 def tagString(FP, length, comment, peek=0):
 	pos = FP.tell()
 	val = string(FP, length, peek)
-	print '[0x%X,0x%X) 0x0 %s=\"%s\"' % (pos, pos+length, comment, val)
+	tagEmit(pos, pos+length, '%s=\"%s\"' % (comment, val))
 	return val
 
 def tagDataUntil(FP, term, comment, peek=0):
 	pos = FP.tell()
 	data = dataUntil(FP, term, peek)
-	print '[0x%X,0x%X) 0x0 %s' % (pos, pos+len(data), comment)
+	tagEmit(pos, pos+len(data), comment)
 	return data
 
+###############################################################################
+# manifest
+###############################################################################
+
+# answer "<tagger> --describe" so hlab can decide from the file header alone
+# whether to spawn us
+#
+# magics: list of (offset, bytes), the file must match at least one
+# minsize: file must be at least this big
+# exts: list of suffixes, the file name must end with one of them
+# library: module isn't a tagger itself, never spawn it
+# serve: tagger calls serve() and can stay running across files
+# binary: tagger emits only through tagEmit(), so may send records
+def describe(magics=[], minsize=0, exts=[], library=False, serve=False,
+  binary=False):
+	global BINARY
+	BINARY = binary and os.environ.get('HLTAG_BINARY') == '1'
+	outputBuffered()
+	if len(sys.argv) < 2 or sys.argv[1] != '--describe':
+		return
+	if library:
+		print 'library'
+	if serve:
+		print 'serve'
+	for (offset, data) in magics:
+		print 'magic 0x%X %s' % (offset, binascii.hexlify(data))
+	if minsize:
+		print 'minsize 0x%X' % minsize
+	for ext in exts:
+		print 'ext %s' % ext
+	sys.exit(0)
+
+###############################################################################
+# lazy tagging
+###############################################################################
+
+# a placeholder tag: what's inside wasn't tagged, hlab asks for it later
+# (a range at a time) through "--range <left> <right> <path>" or a "range"
+# request to serve(); tagFunc checks tagRange() to see which it's running
+RANGE = None
+
+def tagExpand(left, right, comment):
+	tagEmit(left, right, '{expand} %s' % comment)
+
+# (left, right) of a range request, tags whose left end is in it are wanted;
+# None when tagging the whole file
+def tagRange():
+	return RANGE
+
+###############################################################################
+# server
+###############################################################################
+
+def runRequest(tagFunc, path, rng):
+	global RANGE, binaryStarted, PARENT
+	RANGE = rng
+	binaryStarted = False
+	PARENT = None
+	setLittleEndian()
+	status = 0
+	try:
+		tagFunc(path)
+	except SystemExit as e:
+		if e.code is None:
+			status = 0
+		elif isinstance(e.code, int):
+			status = e.code & 0xFF
+		else:
+			status = 1
+	except Exception:
+		traceback.print_exc()
+		status = 1
+	RANGE = None
+	return status
+
+# "<tagger> --serve" stays running, tagging one file per request so the
+# interpreter and imports are paid for once:
+#
+# request (stdin):   tag <path>
+#                    range <left> <right> <path>
+# response (stdout): the usual tag lines, then "end <exit status>" (records
+#                    end with a record of all ones, the status as its color)
+#
+# tagFunc(path) is what the tagger runs in one-shot mode; its sys.exit()
+# becomes the status, an exception is status 1
+#
+# one-shot "<tagger> --range <left> <right> <path>" is handled here too
+def serve(tagFunc):
+	if len(sys.argv) == 5 and sys.argv[1] == '--range':
+		rng = (int(sys.argv[2], 16), int(sys.argv[3], 16))
+		sys.exit(runRequest(tagFunc, sys.argv[4], rng))
+
+	if len(sys.argv) < 2 or sys.argv[1] != '--serve':
+		return
+
+	while 1:
+		line = sys.stdin.readline()
+		if not line:
+			break
+		line = line.rstrip('\n')
+		if line.startswith('tag '):
+			status = runRequest(tagFunc, line[4:], None)
+		elif line.startswith('range '):
+			(left, right, path) = line[6:].split(' ', 2)
+			status = runRequest(tagFunc, path, (int(left, 16), int(right, 16)))
+		else:
+			continue
+
+		if binaryStarted:
+			sys.stdout.write(BINARY_RECORD.pack(BINARY_END, BINARY_END, status, 0))
+		else:
+			sys.stdout.write('end %d\n' % status)
+		sys.stdout.flush()
+
+	sys.exit(0)
+
 ###############################################################################
 # main
 ###############################################################################
 
 if __name__ == '__main__':
+	describe(library=True)
 	sys.exit(-1)
@@ -181,9 +181,8 @@ LC_LINKER_OPTIMIZATION_HINT = 0x2E
 
 (is32,is64) = (False, False)
 
-if __name__ == '__main__':
-	assert len(sys.argv) == 2
-	fp = open(sys.argv[1], "rb")
+def tagFile(path):
+	fp = tagOpen(path)
 
 	# sample the header for sane values
 	magic = uint32(fp)
@@ -205,10 +204,12 @@ if __name__ == '__main__':
 	fp.seek(0)
 
 	# actually read the header now
+	hdr = tagId()
 	if is64:
-		tag(fp, 4+4+4+4+4+4+4+4, "mach_header_64", 1)
+		tag(fp, 4+4+4+4+4+4+4+4, "mach_header_64", 1, hdr)
 	else:
-		tag(fp, 4+4+4+4+4+4+4, "mach_header", 1)
+		tag(fp, 4+4+4+4+4+4+4, "mach_header", 1, hdr)
+	tagParent(hdr)
 	magic = uint32(fp, True)
 	tag(fp, 4, "magic=%08X (%s)" % (magic, lookup_magic[magic]))
 	cputype = uint32(fp, True)
@@ -230,6 +231,7 @@ if __name__ == '__main__':
 	tagUint32(fp, "flags")
 	if is64:
 		tagUint32(fp, "reserved")
+	tagParent(None)
 	
 	for i in range(ncmds):
 		oCmd = fp.tell()
@@ -390,3 +392,10 @@ if __name__ == '__main__':
 			
 	fp.close()
 	sys.exit(0);
+
+if __name__ == '__main__':
+	describe([(0, '\xce\xfa\xed\xfe'), (0, '\xcf\xfa\xed\xfe'),
+		(0, '\xfe\xed\xfa\xce'), (0, '\xfe\xed\xfa\xcf')], 0x1C, serve=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
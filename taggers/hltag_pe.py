@@ -131,5 +131,6 @@ def tagReloc(fp, size, machine=''):
 ###############################################################################
 
 if __name__ == '__main__':
+	describe(library=True)
 	sys.exit(-1)	
 	
@@ -11,8 +11,8 @@ from hltag_lib import *
 # "main"
 ###############################################################################
 
-if __name__ == '__main__':
-	fp = open(sys.argv[1], "rb")
+def tagFile(path):
+	fp = tagOpen(path)
 	if not (pe.idFile(fp) == "pe32"):
 		sys.exit(-1)
 
@@ -132,4 +132,9 @@ if __name__ == '__main__':
 	
 	fp.close()
 	sys.exit(0)
-	
+
+if __name__ == '__main__':
+	describe([(0, 'MZ')], 0x40, serve=True)
+
+	serve(tagFile)
+	tagFile(sys.argv[1])
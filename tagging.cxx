@@ -6,13 +6,19 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* OS */
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <dlfcn.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 /* c++ includes */
 #include <map>
@@ -29,6 +35,19 @@ extern "C" {
 
 /* local stuff */
 #include "IntervalMgr.h"
+#include "tagging.h"
+
+/* output must start like this (or INTERVAL_BINARY_MAGIC) for the tagger to
+	be accepted */
+#define TAGGING_ACCEPT_PREFIX "[0x"
+
+/* taggers see this in their environment, a tagger that can emit records
+	instead of text lines may then do so (see IntervalMgr.h), starting its
+	output with the magic; a warm one ends a binary response with a record
+	whose left and right are all ones and whose color is the exit status */
+#define TAGGING_BINARY_ENV "HLTAG_BINARY"
+#define TAGGING_BINARY_END 0xFFFFFFFFFFFFFFFFULL
+#define TAGGING_READ_CHUNK 4096
 
 int
 tagging_tag(string target, string tagger, IntervalMgr &mgr)
@@ -112,87 +131,1665 @@ tagging_tag(string target, string tagger, IntervalMgr &mgr)
     return rc;
 }
 
-/* "what taggers exist?" */
-int tagging_findall(vector<string> &result)
+/*****************************************************************************/
+/* WIRE FORMAT */
+/*****************************************************************************/
+
+/* tell taggers records are understood (unless the user said otherwise) */
+static void wire_offer(void)
 {
-	string cwd;
-	filesys_cwd(cwd);
-	struct stat sb;
+	setenv(TAGGING_BINARY_ENV, "1", 0);
+}
 
-	/* collect all files named hltag_* from hardcoded paths */
-	vector<string> temp;
-	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", cwd, temp, true);
-	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", cwd+"/taggers", 
-		temp, true);
-	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", "/usr/local/bin", 
-		temp, true);
+/* does the output so far start with the binary magic? it's kept in the
+	output, tagging_parse() skips it */
+static void wire_sniff(tagging_proc &proc)
+{
+	static const size_t n = strlen(INTERVAL_BINARY_MAGIC);
 
-	/* filter executables */
-	result.clear();
-	for(int i=0; i<temp.size(); ++i) {
-		const char *fpath = temp[i].c_str();
-		if(stat(fpath, &sb) == 0 && (sb.st_mode & S_IXUSR)) {
-			result.push_back(fpath);
+	if(proc.binary || proc.lineNum != 1 || proc.output.compare(0, n,
+	  INTERVAL_BINARY_MAGIC))
+		return;
+	proc.binary = true;
+	proc.binScan = n;
+}
+
+static uint64_t wire_le(const char *p, int n)
+{
+	uint64_t v = 0;
+	for(int i=n-1; i>=0; --i)
+		v = (v << 8) | (uint8_t)p[i];
+	return v;
+}
+
+/* -1: output doesn't start like prefix, 0: too short to say, 1: it does */
+static int wire_prefix(string &output, const char *prefix)
+{
+	size_t n = strlen(prefix);
+
+	if(output.compare(0, min(n, output.size()), prefix, min(n, output.size())))
+		return -1;
+	return output.size() >= n ? 1 : 0;
+}
+
+/*****************************************************************************/
+/* WARM SERVERS */
+/*****************************************************************************/
+
+/* taggers that describe themselves with "serve" are started once with
+	--serve and fed targets over stdin, instead of an interpreter per target;
+	anything going wrong with one falls back to launching one-shot */
+
+#define TAGGING_DRAIN_MS 200 /* wait this long for a loser to finish its response */
+
+static map<string, tagging_server *> servers;
+
+static void server_kill(tagging_server *srv)
+{
+	if(srv->fdIn != -1) close(srv->fdIn);
+	if(srv->fdOut != -1) close(srv->fdOut);
+	if(srv->pid != -1) {
+		kill(srv->pid, SIGTERM);
+		waitpid(srv->pid, NULL, 0);
+	}
+	delete srv;
+}
+
+static void server_drop(string tagger)
+{
+	auto iter = servers.find(tagger);
+	if(iter == servers.end())
+		return;
+
+	server_kill(iter->second);
+	servers.erase(iter);
+}
+
+/* idle server for <tagger>, starting one if needed, NULL if it's busy or
+	won't start */
+static tagging_server *server_get(string tagger)
+{
+	tagging_server *srv = NULL;
+	char arg0[PATH_MAX] = {'\0'};
+	char arg1[] = "--serve";
+	char *argv[3] = {arg0, arg1, NULL};
+
+	auto iter = servers.find(tagger);
+	if(iter != servers.end())
+		return iter->second->busy ? NULL : iter->second;
+
+	/* a server that died would otherwise kill us on the next write */
+	signal(SIGPIPE, SIG_IGN);
+	wire_offer();
+
+	srv = new tagging_server;
+	srv->tagger = tagger;
+	srv->pid = -1;
+	srv->fdIn = srv->fdOut = -1;
+	srv->busy = false;
+
+	strncpy(arg0, tagger.c_str(), PATH_MAX-1);
+	if(0 != launch_ex(arg0, argv, &srv->pid, &srv->fdIn, &srv->fdOut, NULL)) {
+		printf("ERROR: launch_ex(%s --serve)\n", arg0);
+		srv->pid = -1;
+		server_kill(srv);
+		return NULL;
+	}
+	fcntl(srv->fdIn, F_SETFD, FD_CLOEXEC);
+	fcntl(srv->fdOut, F_SETFD, FD_CLOEXEC);
+
+	printf("started warm tagger %s (pid=%d)\n", tagger.c_str(), srv->pid);
+	servers[tagger] = srv;
+	return srv;
+}
+
+/* send a request line ("tag <path>", "range <left> <right> <path>"), the
+	response is read through proc like a one-shot's */
+static int server_request(tagging_server *srv, string req, tagging_proc &proc)
+{
+	int rc = -1;
+	size_t done = 0;
+
+	req += "\n";
+
+	while(done < req.size()) {
+		ssize_t n = write(srv->fdIn, req.data() + done, req.size() - done);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0) {
+			printf("ERROR: warm tagger %s went away\n", srv->tagger.c_str());
+			server_drop(srv->tagger);
+			goto cleanup;
 		}
-		else {
-			printf("damn, %s is not executable\n", fpath);
+		done += n;
+	}
+
+	srv->busy = true;
+	proc.server = srv;
+	proc.fd = srv->fdOut;
+	proc.pid = -1;
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* look for the "end <status>" line in what was just appended to output;
+	if it's there the response is over, cut it off and release the server */
+static void server_check_end(tagging_proc &proc, size_t oldSize)
+{
+	size_t line = 0, newline;
+
+	/* records: walk them for the end record */
+	wire_sniff(proc);
+	if(proc.binary) {
+		while(proc.output.size() - proc.binScan >= INTERVAL_RECORD_SIZE) {
+			const char *rec = proc.output.data() + proc.binScan;
+			uint64_t labelLen = wire_le(rec + 20, 4);
+
+			if(wire_le(rec, 8) == TAGGING_BINARY_END &&
+			  wire_le(rec + 8, 8) == TAGGING_BINARY_END) {
+				proc.status = (wire_le(rec + 16, 4) & 0xFF) << 8;
+				proc.output.erase(proc.binScan);
+				proc.eof = true;
+				proc.server->busy = false;
+				proc.server = NULL;
+				proc.fd = -1;
+				return;
+			}
+			if(proc.output.size() - proc.binScan - INTERVAL_RECORD_SIZE < labelLen)
+				return;
+			proc.binScan += INTERVAL_RECORD_SIZE + labelLen;
 		}
+		return;
 	}
 
-	return 0;
+	/* could still turn out to be the magic */
+	if(proc.lineNum == 1 && !wire_prefix(proc.output, INTERVAL_BINARY_MAGIC))
+		return;
+
+	if(oldSize) {
+		line = proc.output.rfind('\n', oldSize - 1);
+		line = (line == string::npos) ? 0 : line + 1;
+	}
+
+	while((newline = proc.output.find('\n', line)) != string::npos) {
+		if(0 == proc.output.compare(line, 4, "end ")) {
+			int status = atoi(proc.output.c_str() + line + 4);
+			proc.output.erase(line);
+			/* same encoding as waitpid() so callers can't tell */
+			proc.status = (status & 0xFF) << 8;
+			proc.eof = true;
+			proc.server->busy = false;
+			proc.server = NULL;
+			proc.fd = -1;
+			return;
+		}
+		line = newline + 1;
+	}
 }
 
-/* "what taggers exist that will agree to service <target>?" */
-int tagging_pollall(string target, vector<string> &results)
+static int oneshot_launch(tagging_proc &proc);
+
+/* server died mid-response: the same request goes to a one-shot, which
+	picks up where the server left off (relaunch), else it's over */
+static void server_lost(tagging_proc &proc, bool relaunch)
+{
+	printf("ERROR: warm tagger %s died or stalled, dropping it\n", proc.server->tagger.c_str());
+	server_drop(proc.server->tagger);
+	proc.server = NULL;
+	proc.fd = -1;
+
+	if(relaunch) {
+		proc.skip = proc.received;
+		if(0 == oneshot_launch(proc)) {
+			printf("retrying %s on %s one-shot\n", proc.tagger.c_str(),
+				proc.target.c_str());
+			return;
+		}
+	}
+
+	proc.eof = true;
+	proc.status = -1;
+}
+
+/* done with a response early: let the server finish it (briefly, if
+	terminating) so it can be reused, otherwise kill it */
+static void server_release(tagging_proc &proc, bool terminate)
+{
+	int waited = 0;
+
+	while(proc.server) {
+		if(terminate) {
+			struct pollfd pfd = {proc.fd, POLLIN, 0};
+			if(waited >= TAGGING_DRAIN_MS) {
+				server_lost(proc, false);
+				break;
+			}
+			if(poll(&pfd, 1, 10) <= 0) {
+				waited += 10;
+				continue;
+			}
+		}
+		tagging_read(proc);
+	}
+}
+
+void tagging_shutdown(void)
+{
+	for(auto i=servers.begin(); i!=servers.end(); ++i) {
+		tagging_server *srv = i->second;
+		/* idle ones exit on EOF, busy ones get killed */
+		if(!srv->busy) {
+			close(srv->fdIn);
+			srv->fdIn = -1;
+			waitpid(srv->pid, NULL, 0);
+			srv->pid = -1;
+		}
+		server_kill(srv);
+	}
+	servers.clear();
+}
+
+/*****************************************************************************/
+/* MANIFESTS */
+/*****************************************************************************/
+
+/* taggers are asked "--describe" once, then only again when their mtime
+	changes; answers persist across runs in this file (under $HOME) */
+#define TAGGING_MANIFEST_CACHE ".hlab_taggers"
+#define TAGGING_DESCRIBE_TIMEOUT 3 /* seconds */
+
+/* tagger path -> manifest */
+static map<string, tagging_manifest> manifests;
+static bool manifestsLoaded = false;
+
+static void manifest_clear(tagging_manifest &m)
+{
+	m.mtime = 0;
+	m.described = false;
+	m.library = false;
+	m.serve = false;
+	m.magics.clear();
+	m.minSize = 0;
+	m.exts.clear();
+}
+
+/* parse one line of a --describe answer, unknown keywords are ignored */
+static int manifest_parse_line(const char *line, tagging_manifest &m)
 {
 	int rc = -1;
-	printf("%s()\n", __func__);
+	char word[16] = {'\0'};
+	char arg0[256] = {'\0'};
+	char arg1[256] = {'\0'};
+	int nargs = sscanf(line, "%15s %255s %255s", word, arg0, arg1);
 
-	/* collect all taggers */
-	vector<string> candidates;
-	if(0 != tagging_findall(candidates))
+	if(nargs <= 0) {
+		rc = 0;
 		goto cleanup;
+	}
 
-	/* execute each one with target as an argument, see who responds */
-	for(auto i=candidates.begin(); i!=candidates.end(); ++i) {
-		#define CHILD_STDOUT_SZ 100
-		int child_ret;
-		char child_stdout[CHILD_STDOUT_SZ] = {'\0'};
-		char arg0[PATH_MAX];
-		char arg1[PATH_MAX];
-		strncpy(arg0, i->c_str(), PATH_MAX-1);
-		strncpy(arg1, target.c_str(), PATH_MAX-1);
-		char *argv[3] = {arg0, arg1, NULL};
-
-		string basename;
-		filesys_basename(*i, basename);
-
-		memset(child_stdout, 0, CHILD_STDOUT_SZ);
-		printf("launching %s %s %s\n", argv[0], argv[1], argv[2]);
-		if(0 != launch(arg0, argv, &child_ret, child_stdout, CHILD_STDOUT_SZ, NULL, 0, 1)) {
-			printf("ERROR: launch()\n");
-			continue;
+	if(!strcmp(word, "magic") && nargs == 3) {
+		tagging_magic magic;
+		int len = strlen(arg1);
+		if(len == 0 || len % 2) {
+			printf("ERROR: magic bytes \"%s\" have odd length\n", arg1);
+			goto cleanup;
+		}
+		magic.offset = strtoull(arg0, NULL, 0);
+		for(int i=0; i<len; i+=2) {
+			char byte[3] = {arg1[i], arg1[i+1], '\0'};
+			magic.bytes.push_back((char)strtoul(byte, NULL, 16));
+		}
+		m.magics.push_back(magic);
+	}
+	else if(!strcmp(word, "minsize") && nargs >= 2) {
+		m.minSize = strtoull(arg0, NULL, 0);
+	}
+	else if(!strcmp(word, "ext") && nargs >= 2) {
+		m.exts.push_back(arg0);
+	}
+	else if(!strcmp(word, "library")) {
+		m.library = true;
+	}
+	else if(!strcmp(word, "serve")) {
+		m.serve = true;
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+static void manifest_parse(string &text, tagging_manifest &m)
+{
+	size_t start = 0, newline;
+
+	while(start < text.size()) {
+		newline = text.find('\n', start);
+		if(newline == string::npos)
+			newline = text.size();
+
+		string line = text.substr(start, newline - start);
+		if(manifest_parse_line(line.c_str(), m))
+			printf("ERROR: bad manifest line: %s\n", line.c_str());
+		start = newline + 1;
+	}
+}
+
+static void manifest_cache_path(string &path)
+{
+	const char *home = getenv("HOME");
+	path = string(home ? home : ".") + "/" + TAGGING_MANIFEST_CACHE;
+}
+
+/* entries look like:
+	tagger <mtime> <path>
+	<manifest lines, or "nodescribe">
+	end */
+static void manifest_cache_load(void)
+{
+	FILE *fp = NULL;
+	char *line = NULL;
+	size_t line_allocd = 0;
+	string path, tagger;
+	tagging_manifest m;
+
+	manifestsLoaded = true;
+
+	manifest_cache_path(path);
+	fp = fopen(path.c_str(), "r");
+	if(!fp)
+		goto cleanup;
+
+	manifest_clear(m);
+	while(getline(&line, &line_allocd, fp) > 0) {
+		long long mtime;
+		int pathStart = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		if(sscanf(line, "tagger %lld %n", &mtime, &pathStart) == 1 && pathStart) {
+			manifest_clear(m);
+			m.mtime = mtime;
+			m.described = true;
+			tagger = line + pathStart;
+		}
+		else if(!strcmp(line, "nodescribe")) {
+			m.described = false;
+		}
+		else if(!strcmp(line, "end")) {
+			if(tagger.size())
+				manifests[tagger] = m;
+			tagger.clear();
+		}
+		else if(tagger.size()) {
+			manifest_parse_line(line, m);
+		}
+	}
+
+	cleanup:
+	if(line) free(line);
+	if(fp) fclose(fp);
+}
+
+static void manifest_cache_save(void)
+{
+	FILE *fp = NULL;
+	string path, pathTmp;
+
+	manifest_cache_path(path);
+	pathTmp = path + ".tmp";
+	fp = fopen(pathTmp.c_str(), "w");
+	if(!fp) {
+		printf("ERROR: can't write %s\n", pathTmp.c_str());
+		return;
+	}
+
+	fprintf(fp, "// hlab tagger manifests, regenerated when a tagger changes\n");
+	for(auto i=manifests.begin(); i!=manifests.end(); ++i) {
+		tagging_manifest &m = i->second;
+
+		fprintf(fp, "tagger %lld %s\n", (long long)m.mtime, i->first.c_str());
+		if(!m.described)
+			fprintf(fp, "nodescribe\n");
+		if(m.library)
+			fprintf(fp, "library\n");
+		if(m.serve)
+			fprintf(fp, "serve\n");
+		for(int j=0; j<m.magics.size(); ++j) {
+			fprintf(fp, "magic 0x%llX ", (unsigned long long)m.magics[j].offset);
+			for(int k=0; k<m.magics[j].bytes.size(); ++k)
+				fprintf(fp, "%02x", (uint8_t)m.magics[j].bytes[k]);
+			fprintf(fp, "\n");
 		}
+		if(m.minSize)
+			fprintf(fp, "minsize 0x%llX\n", (unsigned long long)m.minSize);
+		for(int j=0; j<m.exts.size(); ++j)
+			fprintf(fp, "ext %s\n", m.exts[j].c_str());
+		fprintf(fp, "end\n");
+	}
+
+	fclose(fp);
+	rename(pathTmp.c_str(), path.c_str());
+}
+
+/* bring the manifests of <taggers> up to date, asking the ones that are
+	new or changed (all at once, they're independent) */
+static void manifest_refresh(vector<string> &taggers)
+{
+	vector<tagging_proc> procs;
+	vector<time_t> mtimes;
+
+	if(!manifestsLoaded)
+		manifest_cache_load();
+
+	for(int i=0; i<taggers.size(); ++i) {
+		struct stat sb;
+		if(stat(taggers[i].c_str(), &sb))
+			continue;
+
+		auto iter = manifests.find(taggers[i]);
+		if(iter != manifests.end() && iter->second.mtime == sb.st_mtime)
+			continue;
 
-		printf("tagger(%s) returned %d\n", basename.c_str(), child_ret);
+		/* changed, a warm one is running old code */
+		server_drop(taggers[i]);
 
-		if(child_ret != 0) {
+		tagging_proc proc;
+		if(tagging_launch("--describe", taggers[i], proc))
 			continue;
+		procs.push_back(proc);
+		mtimes.push_back(sb.st_mtime);
+	}
+
+	if(procs.empty())
+		return;
+
+	/* collect answers; an old tagger may take "--describe" for a file name
+		and go do something slow, those get cut off */
+	time_t deadline = time(NULL) + TAGGING_DESCRIBE_TIMEOUT;
+	while(time(NULL) < deadline) {
+		vector<struct pollfd> pfds;
+		for(int i=0; i<procs.size(); ++i) {
+			if(procs[i].eof)
+				continue;
+			struct pollfd pfd = {procs[i].fd, POLLIN, 0};
+			pfds.push_back(pfd);
+		}
+		if(pfds.empty())
+			break;
+
+		if(poll(pfds.data(), pfds.size(), 250) < 0 && errno != EINTR)
+			break;
+
+		for(int j=0; j<pfds.size(); ++j) {
+			if(!pfds[j].revents)
+				continue;
+			for(int i=0; i<procs.size(); ++i)
+				if(!procs[i].eof && procs[i].fd == pfds[j].fd)
+					tagging_read(procs[i]);
+		}
+	}
+
+	for(int i=0; i<procs.size(); ++i) {
+		tagging_proc &proc = procs[i];
+		tagging_manifest m;
+
+		if(!proc.eof) {
+			tagging_reap(proc, true);
+			proc.status = -1;
+		}
+
+		manifest_clear(m);
+		m.mtime = mtimes[i];
+		if(WIFEXITED(proc.status) && WEXITSTATUS(proc.status) == 0) {
+			m.described = true;
+			manifest_parse(proc.output, m);
+		}
+		else {
+			printf("tagger(%s) doesn't describe itself, it'll always be polled\n",
+				proc.tagger.c_str());
+		}
+
+		manifests[proc.tagger] = m;
+	}
+
+	manifest_cache_save();
+}
+
+/* the manifest of a tagger already seen by tagging_findall() */
+int tagging_describe(string tagger, tagging_manifest &result)
+{
+	auto iter = manifests.find(tagger);
+	if(iter == manifests.end())
+		return -1;
+
+	result = iter->second;
+	return 0;
+}
+
+/* could <tagger> possibly service a file with this header? */
+bool tagging_plausible(tagging_manifest &m, string target,
+	const uint8_t *header, uint64_t headerLen, uint64_t fileSize)
+{
+	if(!m.described)
+		return true;
+
+	if(m.library)
+		return false;
+
+	if(fileSize < m.minSize)
+		return false;
+
+	if(m.magics.size()) {
+		int i;
+		for(i=0; i<m.magics.size(); ++i) {
+			tagging_magic &magic = m.magics[i];
+			uint64_t len = magic.bytes.size();
+			if(magic.offset + len <= headerLen &&
+			  0 == memcmp(header + magic.offset, magic.bytes.data(), len))
+				break;
 		}
+		if(i == m.magics.size())
+			return false;
+	}
+
+	if(m.exts.size()) {
+		int i;
+		for(i=0; i<m.exts.size(); ++i) {
+			string &ext = m.exts[i];
+			if(target.size() >= ext.size() &&
+			  0 == target.compare(target.size() - ext.size(), ext.size(), ext))
+				break;
+		}
+		if(i == m.exts.size())
+			return false;
+	}
+
+	return true;
+}
+
+/* drop candidates whose manifest rules out <target>
+
+	data/len is the target's contents if the caller has it mapped, otherwise
+	just enough of the header is read from the file */
+int tagging_filter(string target, const uint8_t *data, uint64_t len,
+	vector<string> &candidates)
+{
+	int rc = -1;
+	vector<uint8_t> header;
+	vector<string> result;
+	uint64_t headerNeed = 0;
+
+	if(!data) {
+		struct stat sb;
+		int fd = -1;
+
+		for(int i=0; i<candidates.size(); ++i) {
+			tagging_manifest m;
+			if(tagging_describe(candidates[i], m))
+				continue;
+			for(int j=0; j<m.magics.size(); ++j) {
+				uint64_t end = m.magics[j].offset + m.magics[j].bytes.size();
+				if(end > headerNeed) headerNeed = end;
+			}
+		}
+
+		fd = open(target.c_str(), O_RDONLY);
+		if(fd == -1 || fstat(fd, &sb)) {
+			printf("ERROR: opening %s\n", target.c_str());
+			if(fd != -1) close(fd);
+			goto cleanup;
+		}
+		len = sb.st_size;
+		if(headerNeed > len)
+			headerNeed = len;
+
+		header.resize(headerNeed);
+		ssize_t n = headerNeed ? pread(fd, header.data(), headerNeed, 0) : 0;
+		header.resize(n > 0 ? n : 0);
+		close(fd);
+	}
+
+	for(int i=0; i<candidates.size(); ++i) {
+		tagging_manifest m;
+		bool ok;
 
-		if(strncmp(child_stdout, "[0x", 3)) {
-			child_stdout[CHILD_STDOUT_SZ-1] = '\0';
-			printf("ERROR: tagger(%s) output didn't look right (\"%s...\")\n",
-				i->c_str(), child_stdout);
+		if(tagging_describe(candidates[i], m)) {
+			result.push_back(candidates[i]);
 			continue;
 		}
-			
-		results.push_back(*i);
+
+		if(data)
+			ok = tagging_plausible(m, target, data, len, len);
+		else
+			ok = tagging_plausible(m, target, header.data(), header.size(), len);
+
+		if(ok)
+			result.push_back(candidates[i]);
 	}
 
+	printf("%d of %d taggers plausible for %s\n", (int)result.size(),
+		(int)candidates.size(), target.c_str());
+	candidates = result;
+
 	rc = 0;
 	cleanup:
 	return rc;
 }
 
+static bool is_plugin_path(string &path)
+{
+	return path.size() > 3 && path.compare(path.size()-3, 3, ".so") == 0;
+}
+
+/* collect all files named hltag_* from hardcoded paths */
+static void tagging_ls(vector<string> &result)
+{
+	string cwd;
+	filesys_cwd(cwd);
+
+	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", cwd, result, true);
+	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", cwd+"/taggers", 
+		result, true);
+	filesys_ls(AUTILS_FILESYS_LS_STARTSWITH, "hltag_", "/usr/local/bin", 
+		result, true);
+}
+
+/* "what taggers exist?" */
+int tagging_findall(vector<string> &result)
+{
+	struct stat sb;
+
+	vector<string> temp;
+	tagging_ls(temp);
+
+	/* filter executables, plugins are loaded rather than run */
+	vector<string> executables;
+	for(int i=0; i<temp.size(); ++i) {
+		const char *fpath = temp[i].c_str();
+		if(is_plugin_path(temp[i]))
+			continue;
+		if(stat(fpath, &sb) == 0 && (sb.st_mode & S_IXUSR)) {
+			executables.push_back(fpath);
+		}
+		else {
+			printf("damn, %s is not executable\n", fpath);
+		}
+	}
+
+	/* ask new taggers what they service, drop the ones that are libraries */
+	manifest_refresh(executables);
+
+	result.clear();
+	for(int i=0; i<executables.size(); ++i) {
+		tagging_manifest m;
+		if(0 == tagging_describe(executables[i], m) && m.library)
+			continue;
+		result.push_back(executables[i]);
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+/* PLUGINS */
+/*****************************************************************************/
+
+/* hltag_*.so are dlopen()'d once and kept, a path that failed to load is
+	remembered as NULL so it isn't retried (and complained about) each open */
+static map<string, tagging_plugin *> plugins;
+
+static tagging_plugin *plugin_load(string path)
+{
+	tagging_plugin *rv = NULL;
+	hltag_abi_fn abi;
+	void *handle;
+
+	if(plugins.count(path))
+		return plugins[path];
+
+	handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if(!handle) {
+		printf("ERROR: dlopen(): %s\n", dlerror());
+		goto cleanup;
+	}
+
+	abi = (hltag_abi_fn)dlsym(handle, "hltag_abi");
+	if(!abi) {
+		printf("ERROR: plugin %s has no hltag_abi()\n", path.c_str());
+		goto cleanup;
+	}
+
+	if(abi() != HLTAG_PLUGIN_ABI) {
+		printf("ERROR: plugin %s is abi %d, expected %d\n", path.c_str(),
+			abi(), HLTAG_PLUGIN_ABI);
+		goto cleanup;
+	}
+
+	rv = new tagging_plugin;
+	rv->path = path;
+	rv->handle = handle;
+	rv->probe = (hltag_probe_fn)dlsym(handle, "hltag_probe");
+	rv->tag = (hltag_tag_fn)dlsym(handle, "hltag_tag");
+	rv->range = (hltag_tag_range_fn)dlsym(handle, "hltag_tag_range");
+	if(!rv->probe || !rv->tag) {
+		printf("ERROR: plugin %s is missing hltag_probe() or hltag_tag()\n",
+			path.c_str());
+		delete rv;
+		rv = NULL;
+	}
+
+	cleanup:
+	if(!rv && handle)
+		dlclose(handle);
+	plugins[path] = rv;
+	return rv;
+}
+
+/* where a plugin's tags go */
+struct plugin_dest {
+	IntervalMgr *mgr;
+	int source;
+};
+
+/* straight into the manager's storage */
+static void plugin_emit(void *ctx, uint64_t left, uint64_t right,
+	uint32_t color, const char *label, int labelLen)
+{
+	plugin_dest *dest = (plugin_dest *)ctx;
+	dest->mgr->add(left, right, label, labelLen, dest->source, color);
+}
+
+/* "what plugins exist?" */
+int tagging_plugins(vector<tagging_plugin *> &result)
+{
+	vector<string> temp;
+	tagging_ls(temp);
+
+	result.clear();
+	for(int i=0; i<temp.size(); ++i) {
+		if(!is_plugin_path(temp[i]))
+			continue;
+		tagging_plugin *plugin = plugin_load(temp[i]);
+		if(plugin)
+			result.push_back(plugin);
+	}
+
+	return 0;
+}
+
+/* map <target> if the caller doesn't have it mapped already */
+static int target_map(string target, const uint8_t **data, uint64_t *len,
+	void **mapped)
+{
+	int rc = -1;
+	int fd = -1;
+	struct stat sb;
+
+	*mapped = MAP_FAILED;
+	if(*data) {
+		rc = 0;
+		goto cleanup;
+	}
+
+	fd = open(target.c_str(), O_RDONLY);
+	if(fd == -1 || fstat(fd, &sb) || !S_ISREG(sb.st_mode) || !sb.st_size)
+		goto cleanup;
+	*mapped = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(*mapped == MAP_FAILED) {
+		printf("ERROR: mmap() on %s\n", target.c_str());
+		goto cleanup;
+	}
+	*data = (const uint8_t *)*mapped;
+	*len = sb.st_size;
+
+	rc = 0;
+	cleanup:
+	if(fd != -1)
+		close(fd);
+	return rc;
+}
+
+int tagging_plugin_tag(string target, const uint8_t *data, uint64_t len,
+	IntervalMgr &mgr, vector<string> &plugins, bool firstOnly)
+{
+	int rc = -1;
+	void *mapped = MAP_FAILED;
+	vector<tagging_plugin *> candidates;
+	bool failed = false;
+
+	plugins.clear();
+
+	if(0 != tagging_plugins(candidates))
+		goto cleanup;
+
+	if(candidates.empty())
+		goto cleanup;
+
+	if(0 != target_map(target, &data, &len, &mapped))
+		goto cleanup;
+
+	for(int i=0; i<candidates.size(); ++i) {
+		tagging_plugin *p = candidates[i];
+		if(!p->probe(data, len, target.c_str()))
+			continue;
+
+		/* it claimed the target: what it emitted is kept even if it fails */
+		plugins.push_back(p->path);
+		printf("going with plugin: %s\n", p->path.c_str());
+		plugin_dest dest = {&mgr, mgr.sourceAdd(p->path)};
+		if(p->tag(data, len, target.c_str(), plugin_emit, &dest)) {
+			printf("ERROR: plugin %s failed on %s\n", p->path.c_str(),
+				target.c_str());
+			failed = true;
+		}
+
+		if(firstOnly)
+			break;
+	}
+
+	if(plugins.size() && !failed)
+		rc = 0;
+
+	cleanup:
+	if(mapped != MAP_FAILED)
+		munmap(mapped, len);
+	return rc;
+}
+
+bool tagging_is_plugin(string tagger)
+{
+	return is_plugin_path(tagger);
+}
+
+int tagging_plugin_range(string target, string plugin, const uint8_t *data,
+	uint64_t len, uint64_t left, uint64_t right, IntervalMgr &mgr)
+{
+	int rc = -1;
+	void *mapped = MAP_FAILED;
+	tagging_plugin *p = plugin_load(plugin);
+	plugin_dest dest;
+
+	if(!p)
+		goto cleanup;
+
+	if(!p->range) {
+		printf("ERROR: plugin %s emitted placeholders but has no "
+			"hltag_tag_range()\n", plugin.c_str());
+		goto cleanup;
+	}
+
+	if(0 != target_map(target, &data, &len, &mapped))
+		goto cleanup;
+
+	dest.mgr = &mgr;
+	dest.source = mgr.sourceAdd(plugin);
+	if(p->range(data, len, target.c_str(), left, right, plugin_emit, &dest)) {
+		printf("ERROR: plugin %s failed on [0x%llX,0x%llX) of %s\n",
+			plugin.c_str(), (unsigned long long)left,
+			(unsigned long long)right, target.c_str());
+		goto cleanup;
+	}
+
+	rc = 0;
+	cleanup:
+	if(mapped != MAP_FAILED)
+		munmap(mapped, len);
+	return rc;
+}
+
+/*****************************************************************************/
+/* CONCURRENT POLLING */
+/*****************************************************************************/
+
+/* start proc's tagger on its target one-shot, stdout on a pipe we can
+	poll() */
+static int oneshot_launch(tagging_proc &proc)
+{
+	int rc = -1;
+	char arg0[PATH_MAX] = {'\0'};
+	char arg1[PATH_MAX] = {'\0'};
+	char arg2[32] = {'\0'};
+	char arg3[32] = {'\0'};
+	char arg4[PATH_MAX] = {'\0'};
+	char *argv[6] = {arg0, arg1, NULL, NULL, NULL, NULL};
+
+	strncpy(arg0, proc.tagger.c_str(), PATH_MAX-1);
+	if(proc.ranged) {
+		strcpy(arg1, "--range");
+		snprintf(arg2, sizeof(arg2), "0x%llX", (unsigned long long)proc.left);
+		snprintf(arg3, sizeof(arg3), "0x%llX", (unsigned long long)proc.right);
+		strncpy(arg4, proc.target.c_str(), PATH_MAX-1);
+		argv[2] = arg2;
+		argv[3] = arg3;
+		argv[4] = arg4;
+	}
+	else {
+		strncpy(arg1, proc.target.c_str(), PATH_MAX-1);
+	}
+
+	wire_offer();
+	if(0 != launch_ex(arg0, argv, &proc.pid, NULL, &proc.fd, NULL)) {
+		printf("ERROR: launch_ex(%s)\n", arg0);
+		proc.pid = -1;
+		proc.fd = -1;
+		goto cleanup;
+	}
+
+	/* taggers launched after this one shouldn't inherit our end of its pipe */
+	fcntl(proc.fd, F_SETFD, FD_CLOEXEC);
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* start <tagger> on <target>, warm if it can be, else one-shot
+
+	ranged: only [left,right) is wanted, see TAGGING_EXPAND */
+static int proc_launch(string target, string tagger, bool ranged,
+	uint64_t left, uint64_t right, tagging_proc &proc)
+{
+	int rc = -1;
+	tagging_manifest m;
+
+	proc.tagger = tagger;
+	proc.pid = -1;
+	proc.fd = -1;
+	proc.server = NULL;
+	proc.output.clear();
+	proc.eof = false;
+	proc.status = -1;
+	proc.lineNum = 1;
+	proc.state = TAGGING_REJECTED;
+	proc.binary = false;
+	proc.binScan = 0;
+	proc.target = target;
+	proc.ranged = ranged;
+	proc.left = left;
+	proc.right = right;
+	proc.received = 0;
+	proc.skip = 0;
+
+	/* warm one? (a request is one line, so no newlines in the target) */
+	if(0 == tagging_describe(tagger, m) && m.serve &&
+	  target.find('\n') == string::npos && target.compare(0, 2, "--")) {
+		tagging_server *srv = server_get(tagger);
+		char buf[64];
+		string req = "tag " + target;
+		if(ranged) {
+			snprintf(buf, sizeof(buf), "range 0x%llX 0x%llX ",
+				(unsigned long long)left, (unsigned long long)right);
+			req = buf + target;
+		}
+		if(srv && 0 == server_request(srv, req, proc)) {
+			proc.state = TAGGING_RUNNING;
+			rc = 0;
+			goto cleanup;
+		}
+	}
+
+	if(oneshot_launch(proc))
+		goto cleanup;
+
+	proc.state = TAGGING_RUNNING;
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+int tagging_launch(string target, string tagger, tagging_proc &proc)
+{
+	return proc_launch(target, tagger, false, 0, 0, proc);
+}
+
+int tagging_launch_range(string target, string tagger, uint64_t left,
+	uint64_t right, tagging_proc &proc)
+{
+	return proc_launch(target, tagger, true, left, right, proc);
+}
+
+/* decide from the output so far (and exit status, if reaped) whether the
+	tagger accepted the target, returns the new state */
+int tagging_classify(tagging_proc &proc)
+{
+	int like;
+
+	if(proc.state != TAGGING_RUNNING)
+		return proc.state;
+
+	like = max(wire_prefix(proc.output, TAGGING_ACCEPT_PREFIX),
+		wire_prefix(proc.output, INTERVAL_BINARY_MAGIC));
+
+	/* non-tag output: reject without waiting for the rest */
+	if(like == -1) {
+		proc.state = TAGGING_REJECTED;
+	}
+	/* finished: a tagger that exits nonzero is rejected whatever it printed */
+	else if(proc.eof && proc.pid == -1) {
+		if(like == 1 && WIFEXITED(proc.status) && WEXITSTATUS(proc.status) == 0)
+			proc.state = TAGGING_ACCEPTED;
+		else
+			proc.state = TAGGING_REJECTED;
+	}
+	/* still going, but the prefix is enough to accept */
+	else if(like == 1) {
+		proc.state = TAGGING_ACCEPTED;
+	}
+
+	return proc.state;
+}
+
+/* close the pipe and collect the child, killing it first if asked to */
+void tagging_reap(tagging_proc &proc, bool terminate)
+{
+	if(proc.server)
+		server_release(proc, terminate);
+
+	if(proc.fd != -1) {
+		close(proc.fd);
+		proc.fd = -1;
+	}
+
+	if(proc.pid != -1) {
+		if(terminate && 0 != kill(proc.pid, SIGTERM))
+			printf("ERROR: kill() on pid=%d\n", proc.pid);
+
+		while(waitpid(proc.pid, &proc.status, 0) == -1) {
+			if(errno != EINTR) {
+				printf("ERROR: waitpid() on pid=%d\n", proc.pid);
+				break;
+			}
+		}
+
+		proc.pid = -1;
+	}
+}
+
+/* read whatever is available from a tagger (blocking if nothing is),
+	reaping it at EOF */
+void tagging_read(tagging_proc &proc)
+{
+	char buf[TAGGING_READ_CHUNK];
+
+	if(proc.fd == -1) {
+		proc.eof = true;
+		return;
+	}
+
+	ssize_t n = read(proc.fd, buf, sizeof(buf));
+	if(n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+
+	if(proc.server) {
+		size_t oldSize = proc.output.size();
+		if(n <= 0) {
+			server_lost(proc, true);
+			return;
+		}
+		proc.received += n;
+		proc.output.append(buf, n);
+		server_check_end(proc, oldSize);
+		return;
+	}
+
+	if(n > 0) {
+		/* a retry repeats what the server already sent */
+		ssize_t drop = (uint64_t)n < proc.skip ? n : proc.skip;
+		proc.skip -= drop;
+		proc.output.append(buf + drop, n - drop);
+		return;
+	}
+
+	proc.eof = true;
+	tagging_reap(proc, false);
+}
+
+/* launch candidates up to the limit; once someone accepted, later
+	candidates can't win so aren't started */
+static void poller_launch(tagging_poller &p)
+{
+	int n = p.procs.size();
+
+	while(p.nRunning < p.maxRunning && p.next < n &&
+	  (p.mode != TAGGING_POLL_FIRST || p.next < p.best)) {
+		if(0 == tagging_launch(p.target, p.procs[p.next].tagger, p.procs[p.next]))
+			p.nRunning++;
+		p.next++;
+	}
+}
+
+static bool poller_decided(tagging_poller &p)
+{
+	if(p.mode == TAGGING_POLL_FIRST) {
+		/* winner is known once everyone before best has rejected */
+		for(int i=0; i<p.best; ++i)
+			if(p.procs[i].state != TAGGING_REJECTED)
+				return false;
+		return true;
+	}
+
+	return p.nRunning == 0 && p.next == p.procs.size();
+}
+
+/* kill everyone left, except the acceptors being kept */
+static void poller_finish(tagging_poller &p)
+{
+	for(int i=0; i<p.procs.size(); ++i) {
+		if(p.mode == TAGGING_POLL_FIRST && i == p.best)
+			continue;
+		if(p.mode == TAGGING_POLL_ALL && p.procs[i].state == TAGGING_ACCEPTED)
+			continue;
+		tagging_reap(p.procs[i], true);
+		if(p.procs[i].state == TAGGING_RUNNING || p.procs[i].state == TAGGING_IDLE)
+			p.procs[i].state = TAGGING_REJECTED;
+	}
+
+	p.nRunning = 0;
+	p.done = true;
+}
+
+/* start running <candidates> on <target>, at most maxRunning at once (0 means
+	one per processor)
+
+	TAGGING_POLL_FIRST: polling is done as soon as the winner is known, the
+	winner being the earliest candidate (in <candidates> order) to accept;
+	it's left running with its stream unread past the classified prefix,
+	everyone else is killed
+
+	TAGGING_POLL_ALL: every acceptor is left running like that, and polling
+	is done when everyone is classified
+
+	TAGGING_POLL_CLASSIFY: each is killed as soon as it's classified, and
+	polling is done when everyone is */
+void tagging_poll_start(tagging_poller &p, string target,
+	vector<string> &candidates, int maxRunning, int mode)
+{
+	int n = candidates.size();
+
+	if(maxRunning <= 0)
+		maxRunning = sysconf(_SC_NPROCESSORS_ONLN);
+	if(maxRunning <= 0)
+		maxRunning = 1;
+
+	p.target = target;
+	p.maxRunning = maxRunning;
+	p.mode = mode;
+	p.nRunning = 0;
+	p.next = 0;
+	p.best = n;
+	p.done = false;
+
+	p.procs.clear();
+	p.procs.resize(n);
+	for(int i=0; i<n; ++i) {
+		p.procs[i].tagger = candidates[i];
+		p.procs[i].pid = -1;
+		p.procs[i].fd = -1;
+		p.procs[i].server = NULL;
+		p.procs[i].eof = false;
+		p.procs[i].status = -1;
+		p.procs[i].lineNum = 1;
+		p.procs[i].binary = false;
+		p.procs[i].binScan = 0;
+		p.procs[i].state = TAGGING_IDLE;
+	}
+
+	poller_launch(p);
+
+	if(poller_decided(p))
+		poller_finish(p);
+}
+
+/* descriptors of the taggers still undecided, wait on these for readability */
+void tagging_poll_fds(tagging_poller &p, vector<int> &fds)
+{
+	fds.clear();
+	for(int i=0; i<p.procs.size(); ++i)
+		if(p.procs[i].state == TAGGING_RUNNING && p.procs[i].fd != -1)
+			fds.push_back(p.procs[i].fd);
+}
+
+/* fd is readable: take its output, classify, launch more
+	returns true when polling is done */
+bool tagging_poll_step(tagging_poller &p, int fd)
+{
+	int n = p.procs.size();
+	int i;
+
+	if(p.done)
+		return true;
+
+	for(i=0; i<n; ++i)
+		if(p.procs[i].state == TAGGING_RUNNING && p.procs[i].fd == fd)
+			break;
+	if(i == n)
+		return false;
+
+	tagging_proc &proc = p.procs[i];
+	tagging_read(proc);
+
+	switch(tagging_classify(proc)) {
+		case TAGGING_RUNNING:
+			break;
+		case TAGGING_ACCEPTED:
+			p.nRunning--;
+			printf("tagger(%s) accepted\n", proc.tagger.c_str());
+			if(p.mode == TAGGING_POLL_FIRST && i < p.best)
+				p.best = i;
+			else if(p.mode == TAGGING_POLL_CLASSIFY)
+				tagging_reap(proc, true);
+			break;
+		case TAGGING_REJECTED:
+			p.nRunning--;
+			tagging_reap(proc, true);
+			break;
+	}
+
+	/* anything after the earliest acceptor is a loser */
+	if(p.mode == TAGGING_POLL_FIRST) {
+		for(int j=p.best+1; j<n; ++j) {
+			if(p.procs[j].state == TAGGING_RUNNING)
+				p.nRunning--;
+			if(p.procs[j].state == TAGGING_RUNNING || p.procs[j].state == TAGGING_ACCEPTED) {
+				tagging_reap(p.procs[j], true);
+				p.procs[j].state = TAGGING_REJECTED;
+			}
+		}
+	}
+
+	poller_launch(p);
+
+	if(poller_decided(p))
+		poller_finish(p);
+
+	return p.done;
+}
+
+/* index of the first-only winner, -1 if nobody accepted */
+int tagging_poll_winner(tagging_poller &p)
+{
+	if(!p.done || p.mode != TAGGING_POLL_FIRST || p.best >= p.procs.size())
+		return -1;
+	return p.best;
+}
+
+/* indices of the acceptors left running, in candidate order */
+void tagging_poll_winners(tagging_poller &p, vector<int> &result)
+{
+	result.clear();
+	if(!p.done)
+		return;
+	for(int i=0; i<p.procs.size(); ++i)
+		if(p.procs[i].state == TAGGING_ACCEPTED && p.mode != TAGGING_POLL_CLASSIFY)
+			result.push_back(i);
+}
+
+/* kill everyone, winner included */
+void tagging_poll_cancel(tagging_poller &p)
+{
+	for(int i=0; i<p.procs.size(); ++i)
+		tagging_reap(p.procs[i], true);
+	p.nRunning = 0;
+	p.done = true;
+}
+
+/* blocking version of the above, for when there's no event loop to drive it
+
+	procs[] has a state for every candidate on return */
+int tagging_poll(string target, vector<string> &candidates, int maxRunning,
+	int mode, vector<tagging_proc> &procs)
+{
+	tagging_poller p;
+	vector<int> fds;
+
+	tagging_poll_start(p, target, candidates, maxRunning, mode);
+
+	while(!p.done) {
+		vector<struct pollfd> pfds;
+
+		tagging_poll_fds(p, fds);
+		for(int i=0; i<fds.size(); ++i) {
+			struct pollfd pfd = {fds[i], POLLIN, 0};
+			pfds.push_back(pfd);
+		}
+
+		if(poll(pfds.data(), pfds.size(), -1) < 0) {
+			if(errno == EINTR)
+				continue;
+			printf("ERROR: poll()\n");
+			tagging_poll_cancel(p);
+			break;
+		}
+
+		for(int i=0; i<pfds.size() && !p.done; ++i)
+			if(pfds[i].revents)
+				tagging_poll_step(p, pfds[i].fd);
+	}
+
+	procs = p.procs;
+	return 0;
+}
+
+/* parse the complete lines of an accepted tagger's output into mgr, leaving
+	any partial last line buffered (parsed too, once the tagger hit EOF) */
+int tagging_parse(tagging_proc &proc, IntervalMgr &mgr)
+{
+	int rc = -1;
+	size_t start = 0, newline;
+	int source = mgr.sourceAdd(proc.tagger);
+
+	/* records: no lines, no regex, straight from the buffer */
+	wire_sniff(proc);
+	if(proc.binary) {
+		static const size_t nMagic = strlen(INTERVAL_BINARY_MAGIC);
+		size_t used;
+		int n;
+
+		if(proc.lineNum == 1 && !proc.output.compare(0, nMagic,
+		  INTERVAL_BINARY_MAGIC))
+			start = nMagic;
+
+		n = mgr.readBinary((const uint8_t *)proc.output.data() + start,
+			proc.output.size() - start, source, &used);
+		start += used;
+		if(n < 0) {
+			printf("ERROR: malformed record %d\n", proc.lineNum);
+			goto cleanup;
+		}
+		proc.lineNum += n;
+
+		if(proc.eof && start < proc.output.size()) {
+			printf("ERROR: truncated record %d\n", proc.lineNum);
+			goto cleanup;
+		}
+
+		rc = 0;
+		goto cleanup;
+	}
+
+	while((newline = proc.output.find('\n', start)) != string::npos) {
+		proc.output[newline] = '\0';
+		if(mgr.readLine(proc.output.c_str() + start, source)) {
+			printf("ERROR: malformed input on line %d: -%s-\n", proc.lineNum,
+				proc.output.c_str() + start);
+			goto cleanup;
+		}
+		start = newline + 1;
+		proc.lineNum++;
+	}
+
+	/* last line might not be newline terminated */
+	if(proc.eof && start < proc.output.size()) {
+		if(mgr.readLine(proc.output.c_str() + start, source)) {
+			printf("ERROR: malformed input on line %d: -%s-\n", proc.lineNum,
+				proc.output.c_str() + start);
+			goto cleanup;
+		}
+		start = proc.output.size();
+	}
+
+	rc = 0;
+	cleanup:
+	proc.output.erase(0, start);
+	proc.binScan = (proc.binScan > start) ? proc.binScan - start : 0;
+	return rc;
+}
+
+/* accepted tagger finished; did it exit cleanly? */
+int tagging_finished(tagging_proc &proc)
+{
+	tagging_reap(proc, false);
+	if(!WIFEXITED(proc.status) || WEXITSTATUS(proc.status) != 0) {
+		printf("ERROR: tagger(%s) exited abnormally (status=%d)\n",
+			proc.tagger.c_str(), proc.status);
+		return -1;
+	}
+	return 0;
+}
+
+/* parse an accepted tagger's output into mgr: the prefix already read while
+	polling, then the rest of its stream, then collect the tagger */
+int tagging_consume(tagging_proc &proc, IntervalMgr &mgr)
+{
+	int rc = -1;
+
+	while(1) {
+		if(tagging_parse(proc, mgr))
+			goto cleanup;
+		if(proc.eof)
+			break;
+		tagging_read(proc);
+	}
+
+	if(tagging_finished(proc))
+		goto cleanup;
+
+	rc = 0;
+	cleanup:
+	tagging_reap(proc, true);
+	proc.output.clear();
+	return rc;
+}
+
+/* "tag <target> with whichever tagger will service it"
+
+	the taggers are polled concurrently and the winner's stream is read
+	directly as its tags, so no tagger runs twice for one target */
+int tagging_tag_auto(string target, IntervalMgr &mgr, string &tagger,
+	const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	vector<string> candidates, plugins;
+	vector<tagging_proc> procs;
+	int winner = -1;
+
+	/* in process is cheapest, if a plugin will have it */
+	rc = tagging_plugin_tag(target, data, len, mgr, plugins, true);
+	if(plugins.size()) {
+		tagger = plugins[0];
+		mgr.merge(mgr.sourceAdd(tagger));
+		goto cleanup;
+	}
+
+	rc = -1;
+	if(0 != tagging_findall(candidates))
+		goto cleanup;
+
+	/* usually leaves just one to spawn */
+	if(0 != tagging_filter(target, data, len, candidates))
+		goto cleanup;
+
+	if(0 != tagging_poll(target, candidates, 0, TAGGING_POLL_FIRST, procs))
+		goto cleanup;
+
+	for(int i=0; i<procs.size(); ++i) {
+		if(procs[i].state == TAGGING_ACCEPTED) {
+			winner = i;
+			break;
+		}
+	}
+
+	if(winner == -1) {
+		printf("no tagger recognized the file\n");
+		goto cleanup;
+	}
+
+	tagger = procs[winner].tagger;
+	printf("going with tagger: %s\n", tagger.c_str());
+
+	if(0 != tagging_consume(procs[winner], mgr))
+		goto cleanup;
+	mgr.merge(mgr.sourceAdd(tagger));
+
+	rc = 0;
+	cleanup:
+	for(int i=0; i<procs.size(); ++i)
+		tagging_reap(procs[i], true);
+	return rc;
+}
+
+/* "tag <target> with <tagger>, if it will", no polling or fallback, for
+	callers that schedule (target, tagger) pairs themselves */
+int tagging_run(string target, string tagger, IntervalMgr &mgr)
+{
+	int state = TAGGING_REJECTED;
+	tagging_plugin *p = NULL;
+	tagging_proc proc;
+	plugin_dest dest;
+	void *mapped = MAP_FAILED;
+	const uint8_t *data = NULL;
+	uint64_t len = 0;
+
+	if(tagging_is_plugin(tagger)) {
+		p = plugin_load(tagger);
+		if(!p || 0 != target_map(target, &data, &len, &mapped))
+			goto cleanup;
+		if(!p->probe(data, len, target.c_str()))
+			goto cleanup;
+
+		dest.mgr = &mgr;
+		dest.source = mgr.sourceAdd(tagger);
+		if(p->tag(data, len, target.c_str(), plugin_emit, &dest)) {
+			printf("ERROR: plugin %s failed on %s\n", tagger.c_str(),
+				target.c_str());
+			state = TAGGING_FAILED;
+		}
+		else
+			state = TAGGING_ACCEPTED;
+		goto cleanup;
+	}
+
+	if(0 != tagging_launch(target, tagger, proc))
+		goto cleanup;
+
+	while(tagging_classify(proc) == TAGGING_RUNNING)
+		tagging_read(proc);
+
+	if(proc.state != TAGGING_ACCEPTED) {
+		tagging_reap(proc, true);
+		goto cleanup;
+	}
+
+	state = tagging_consume(proc, mgr) ? TAGGING_FAILED : TAGGING_ACCEPTED;
+
+	cleanup:
+	if(mapped != MAP_FAILED)
+		munmap(mapped, len);
+	return state;
+}
+
+/* "tag <target> with every tagger that will service it"
+
+	the plugins go first, then the script taggers are polled concurrently
+	and every acceptor's stream is read as its tags; each tagger's run is
+	merged into mgr's index as it completes, taggers lists who contributed */
+int tagging_tag_all(string target, IntervalMgr &mgr, vector<string> &taggers,
+	const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	vector<string> candidates;
+	vector<tagging_proc> procs;
+	bool failed = false;
+
+	/* a failed plugin's tags so far are kept, like a failed script's */
+	if(0 != tagging_plugin_tag(target, data, len, mgr, taggers, false) &&
+	  taggers.size())
+		failed = true;
+	for(int i=0; i<taggers.size(); ++i)
+		mgr.merge(mgr.sourceAdd(taggers[i]));
+
+	if(0 != tagging_findall(candidates))
+		goto cleanup;
+
+	if(0 != tagging_filter(target, data, len, candidates))
+		goto cleanup;
+
+	if(0 != tagging_poll(target, candidates, 0, TAGGING_POLL_ALL, procs))
+		goto cleanup;
+
+	for(int i=0; i<procs.size(); ++i) {
+		if(procs[i].state != TAGGING_ACCEPTED)
+			continue;
+
+		printf("going with tagger: %s\n", procs[i].tagger.c_str());
+		taggers.push_back(procs[i].tagger);
+		if(0 != tagging_consume(procs[i], mgr))
+			failed = true;
+		mgr.merge(mgr.sourceAdd(procs[i].tagger));
+	}
+
+	if(taggers.empty()) {
+		printf("no tagger recognized the file\n");
+		goto cleanup;
+	}
+
+	if(!failed)
+		rc = 0;
+	cleanup:
+	for(int i=0; i<procs.size(); ++i)
+		tagging_reap(procs[i], true);
+	return rc;
+}
+
+/* "tag [left,right) of <target>", which <tagger> left as a placeholder */
+int tagging_tag_range(string target, string tagger, uint64_t left,
+	uint64_t right, IntervalMgr &mgr, const uint8_t *data, uint64_t len)
+{
+	int rc = -1;
+	tagging_proc proc;
+
+	mgr.rangeTagged(left, right);
+
+	if(tagging_is_plugin(tagger)) {
+		rc = tagging_plugin_range(target, tagger, data, len, left, right, mgr);
+		goto cleanup;
+	}
+
+	if(0 != tagging_launch_range(target, tagger, left, right, proc))
+		goto cleanup;
+
+	if(0 != tagging_consume(proc, mgr))
+		goto cleanup;
+
+	rc = 0;
+	cleanup:
+	mgr.merge(mgr.sourceAdd(tagger));
+	return rc;
+}
+
+/* "what taggers exist that will agree to service <target>?" */
+int tagging_pollall(string target, vector<string> &results)
+{
+	int rc = -1;
+	vector<string> candidates;
+	vector<tagging_proc> procs;
+
+	printf("%s()\n", __func__);
+
+	/* collect all taggers */
+	if(0 != tagging_findall(candidates))
+		goto cleanup;
+
+	if(0 != tagging_filter(target, NULL, 0, candidates))
+		goto cleanup;
+
+	/* execute them with target as an argument, see who responds */
+	if(0 != tagging_poll(target, candidates, 0, TAGGING_POLL_CLASSIFY, procs))
+		goto cleanup;
+
+	for(int i=0; i<procs.size(); ++i) {
+		if(procs[i].state == TAGGING_ACCEPTED)
+			results.push_back(procs[i].tagger);
+		else if(procs[i].output.size())
+			printf("ERROR: tagger(%s) output didn't look right (\"%.32s...\")\n",
+				procs[i].tagger.c_str(), procs[i].output.c_str());
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
 
@@ -1,7 +1,181 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "tagger_plugin.h"
+
+class IntervalMgr;
+
+/* a warm "<tagger> --serve", reused across targets
+
+	request:  tag <path>
+	response: tag lines as usual, then "end <exit status>" */
+struct tagging_server {
+	string tagger;
+	pid_t pid;
+	int fdIn, fdOut;
+	bool busy;          /* a response is outstanding */
+};
+
+/* a launched tagger, from the point of view of polling */
+#define TAGGING_IDLE 0      /* not launched yet */
+#define TAGGING_RUNNING 1   /* launched, output inconclusive so far */
+#define TAGGING_ACCEPTED 2  /* output starts like tags */
+#define TAGGING_REJECTED 3  /* failed to launch, exited nonzero, or non-tag output */
+#define TAGGING_FAILED 4    /* accepted, then exited nonzero or printed garbage */
+
+struct tagging_proc {
+	string tagger;
+	pid_t pid;
+	int fd;             /* tagger's stdout */
+	tagging_server *server; /* non-NULL: fd is this server's, pid is -1 */
+	string output;      /* everything read from fd so far */
+	bool eof;
+	int status;         /* exit status, valid once reaped */
+	int lineNum;        /* of the next line (or record) to parse from output */
+	int state;
+	bool binary;        /* output is records, see INTERVAL_BINARY_MAGIC */
+	size_t binScan;     /* records before this offset are whole (servers) */
+	/* what was asked, so a server dying mid-response can be retried
+		one-shot, whose first <skip> bytes were already read from the server */
+	string target;
+	bool ranged = false;
+	uint64_t left = 0, right = 0;
+	uint64_t received = 0; /* response bytes read from a server */
+	uint64_t skip = 0;
+};
+
+/* what polling keeps, see tagging_poll_start() */
+#define TAGGING_POLL_CLASSIFY 0 /* nobody, just find out who accepts */
+#define TAGGING_POLL_FIRST 1    /* the earliest acceptor */
+#define TAGGING_POLL_ALL 2      /* every acceptor */
+
+/* polling state, so an event loop can drive it a descriptor at a time */
+struct tagging_poller {
+	string target;
+	vector<tagging_proc> procs;
+	int maxRunning;
+	int mode;
+	int nRunning;
+	int next;       /* next candidate to launch */
+	int best;       /* earliest accepted candidate */
+	bool done;
+};
+
+/* what a tagger says it can service, from "<tagger> --describe"
+
+	magic <offset> <hex bytes>   file must match at least one of these
+	minsize <n>                  file must be at least this big
+	ext <suffix>                 file name must end with one of these
+	library                      not a tagger, never spawn it
+	serve                        understands --serve (see tagging_server) */
+struct tagging_magic {
+	uint64_t offset;
+	string bytes;
+};
+
+struct tagging_manifest {
+	time_t mtime;       /* of the tagger, when this was taken */
+	bool described;     /* false: tagger didn't answer, so always spawn it */
+	bool library;
+	bool serve;
+	vector<tagging_magic> magics;
+	uint64_t minSize;
+	vector<string> exts;
+};
 
 int tagging_findall(vector<string> &result);
 
+int tagging_describe(string tagger, tagging_manifest &result);
+bool tagging_plausible(tagging_manifest &manifest, string target,
+	const uint8_t *header, uint64_t headerLen, uint64_t fileSize);
+int tagging_filter(string target, const uint8_t *data, uint64_t len,
+	vector<string> &candidates);
+
 int tagging_pollall(string target, vector<string> &results);
 
 int tagging_tag(string target, string tagger, IntervalMgr &mgr);
 
+/* single run: poll concurrently, then read the winner's stream as the tags
+
+	data/len: target's contents if already mapped, to check the manifests
+	against without reading the file again */
+int tagging_tag_auto(string target, IntervalMgr &mgr, string &tagger,
+	const uint8_t *data=NULL, uint64_t len=0);
+
+/* one tagger (script or plugin) to completion, returns TAGGING_ACCEPTED,
+	TAGGING_REJECTED or TAGGING_FAILED (tags so far are kept in mgr) */
+int tagging_run(string target, string tagger, IntervalMgr &mgr);
+
+/* every tagger that will, merged into mgr with each one as a source */
+int tagging_tag_all(string target, IntervalMgr &mgr, vector<string> &taggers,
+	const uint8_t *data=NULL, uint64_t len=0);
+
+/* primitives */
+int tagging_launch(string target, string tagger, tagging_proc &proc);
+int tagging_classify(tagging_proc &proc);
+void tagging_reap(tagging_proc &proc, bool terminate);
+void tagging_read(tagging_proc &proc);
+
+void tagging_poll_start(tagging_poller &p, string target,
+	vector<string> &candidates, int maxRunning, int mode);
+void tagging_poll_fds(tagging_poller &p, vector<int> &fds);
+bool tagging_poll_step(tagging_poller &p, int fd);
+int tagging_poll_winner(tagging_poller &p);
+void tagging_poll_winners(tagging_poller &p, vector<int> &result);
+void tagging_poll_cancel(tagging_poller &p);
+int tagging_poll(string target, vector<string> &candidates, int maxRunning,
+	int mode, vector<tagging_proc> &procs);
+
+int tagging_parse(tagging_proc &proc, IntervalMgr &mgr);
+int tagging_finished(tagging_proc &proc);
+int tagging_consume(tagging_proc &proc, IntervalMgr &mgr);
+
+/* a loaded hltag_*.so, see tagger_plugin.h */
+struct tagging_plugin {
+	string path;
+	void *handle;
+	hltag_probe_fn probe;
+	hltag_tag_fn tag;
+	hltag_tag_range_fn range; /* optional */
+};
+
+int tagging_plugins(vector<tagging_plugin *> &result);
+
+/* tag <target> in process with the plugins whose probe accepts it (just the
+	first, if firstOnly), each as its own source in mgr
+
+	plugins: set to the ones that took the target, left empty if none did
+	(the subprocess taggers are next, then); data/len as in tagging_tag_auto,
+	the target is mapped here if they're not given */
+int tagging_plugin_tag(string target, const uint8_t *data, uint64_t len,
+	IntervalMgr &mgr, vector<string> &plugins, bool firstOnly);
+
+/* lazy tagging
+
+	a tag labelled "{expand} ..." (INTERVAL_EXPAND) is a placeholder: what's
+	inside it wasn't tagged, but the tagger that emitted it will tag any part
+	of it on request, emitting the tags whose left end is in [left,right)
+
+	one-shot:  <tagger> --range <left> <right> <target>
+	warm:      range <left> <right> <path>
+	plugin:    hltag_tag_range()
+
+	requested ranges are recorded in the IntervalMgr, see rangeTagged() */
+bool tagging_is_plugin(string tagger);
+int tagging_launch_range(string target, string tagger, uint64_t left,
+	uint64_t right, tagging_proc &proc);
+int tagging_plugin_range(string target, string plugin, const uint8_t *data,
+	uint64_t len, uint64_t left, uint64_t right, IntervalMgr &mgr);
+int tagging_tag_range(string target, string tagger, uint64_t left,
+	uint64_t right, IntervalMgr &mgr, const uint8_t *data=NULL,
+	uint64_t len=0);
+
+/* stop the warm taggers */
+void tagging_shutdown(void);
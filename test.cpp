@@ -1,10 +1,12 @@
 /* os stuff */
 #include <unistd.h> // pid_t
 #include <dirent.h>
+#include <time.h>
 
 /* c stdlib */
 #include <stdio.h>
 #include <ctype.h> // isdigit()
+#include <stdlib.h>
 #include <string.h>
 
 /* c++ */
@@ -21,6 +23,282 @@ extern "C" {
 #include "IntervalMgr.h"
 #include "tagging.h"
 #include "llvm_svcs.h"
+#include "rsrc.h"
+#include "util.h"
+
+/* what alab assembles when you pick an architecture */
+struct asm_sample {
+	const char *triplet;
+	int dialect;
+	const char *src;
+	int srcLen;
+};
+
+static asm_sample asmSamples[] = {
+	{"i386-none-none", LLVM_SVCS_DIALECT_ATT, (char *)rsrc_x86_s, sizeof(rsrc_x86_s)},
+	{"i386-none-none", LLVM_SVCS_DIALECT_INTEL, (char *)rsrc_x86_intel_s, sizeof(rsrc_x86_intel_s)},
+	{"x86_64-none-none", LLVM_SVCS_DIALECT_ATT, (char *)rsrc_x86_64_s, sizeof(rsrc_x86_64_s)},
+	{"x86_64-none-none", LLVM_SVCS_DIALECT_INTEL, (char *)rsrc_x86_64_intel_s, sizeof(rsrc_x86_64_intel_s)},
+	{"mips-pc-none-o32", 0, (char *)rsrc_mips_s, sizeof(rsrc_mips_s)},
+	{"thumbv7-none-none", 0, (char *)rsrc_thumb_s, sizeof(rsrc_thumb_s)},
+	{"armv7-none-none", 0, (char *)rsrc_arm_s, sizeof(rsrc_arm_s)},
+	{"aarch64-none-none", 0, (char *)rsrc_arm64_s, sizeof(rsrc_arm64_s)},
+	{"powerpc-none-none", 0, (char *)rsrc_ppc_s, sizeof(rsrc_ppc_s)},
+	{"powerpc64-none-none", 0, (char *)rsrc_ppc64_s, sizeof(rsrc_ppc64_s)}
+};
+
+/* assemble each sample <n> times, reporting calls/sec with the per target
+	objects made every call (as before they were cached) and kept */
+static int asm_bench(int n)
+{
+	string bytes, err;
+
+	for(int i=0; i<sizeof(asmSamples)/sizeof(asmSamples[0]); ++i) {
+		asm_sample &s = asmSamples[i];
+		string src(s.src, s.srcLen);
+		double rate[2];
+
+		for(int cached=0; cached<2; ++cached) {
+			llvm_svcs_cache_clear();
+			double start = util_now();
+			for(int j=0; j<n; ++j) {
+				if(!cached)
+					llvm_svcs_cache_clear();
+				if(llvm_svcs_assemble(src.c_str(), s.dialect, s.triplet,
+				  LLVM_SVCS_CM_DEFAULT, LLVM_SVCS_RM_STATIC, NULL, bytes, err)) {
+					printf("ERROR: %s: %s\n", s.triplet, err.c_str());
+					return -1;
+				}
+			}
+			rate[cached] = n / (util_now() - start);
+		}
+
+		printf("%-20s %-5s %10.0f calls/sec uncached %10.0f cached (%.1fx)\n",
+			s.triplet, s.dialect == LLVM_SVCS_DIALECT_INTEL ? "intel" : "",
+			rate[0], rate[1], rate[1] / rate[0]);
+	}
+
+	return 0;
+}
+
+/* decode the first instruction of each assembled sample <n> times, with a
+	fresh disassembler context every call and with the pooled one */
+static int disasm_bench(int n)
+{
+	string bytes, err, text;
+	int len;
+
+	for(int i=0; i<sizeof(asmSamples)/sizeof(asmSamples[0]); ++i) {
+		asm_sample &s = asmSamples[i];
+		string src(s.src, s.srcLen);
+		double rate[2];
+
+		if(llvm_svcs_assemble(src.c_str(), s.dialect, s.triplet,
+		  LLVM_SVCS_CM_DEFAULT, LLVM_SVCS_RM_STATIC, NULL, bytes, err)) {
+			printf("ERROR: %s: %s\n", s.triplet, err.c_str());
+			return -1;
+		}
+
+		for(int pooled=0; pooled<2; ++pooled) {
+			double start = util_now();
+			for(int j=0; j<n; ++j) {
+				if(!pooled)
+					llvm_svcs_cache_clear();
+				if(llvm_svcs_disasm_single(s.triplet, (uint8_t *)bytes.data(),
+				  bytes.size(), 0, text, len)) {
+					printf("ERROR: %s: can't disassemble\n", s.triplet);
+					return -1;
+				}
+			}
+			rate[pooled] = n / (util_now() - start);
+		}
+
+		printf("%-20s %-24s %10.0f decodes/sec fresh %10.0f pooled (%.1fx)\n",
+			s.triplet, text.c_str(), rate[0], rate[1], rate[1] / rate[0]);
+	}
+
+	return 0;
+}
+
+/* batch disassemble <mb> megabytes of the x86_64 sample, assembled over and
+	over, reporting instructions/sec with text and without */
+static int disbatch_bench(int mb)
+{
+	asm_sample &s = asmSamples[2];
+	string src(s.src, s.srcLen), bytes, buf, err, arena;
+	vector<llvm_svcs_insn> insns;
+
+	if(llvm_svcs_assemble(src.c_str(), s.dialect, s.triplet,
+	  LLVM_SVCS_CM_DEFAULT, LLVM_SVCS_RM_STATIC, NULL, bytes, err)) {
+		printf("ERROR: %s: %s\n", s.triplet, err.c_str());
+		return -1;
+	}
+	while(buf.size() < (size_t)mb << 20)
+		buf += bytes;
+
+	for(int text=1; text>=0; --text) {
+		int options = text ? 0 : LLVM_SVCS_DISASM_NO_TEXT;
+
+		/* first pass makes the decoder and sizes the storage */
+		for(int pass=0; pass<2; ++pass) {
+			insns.clear();
+			arena.clear();
+			double start = util_now();
+			if(llvm_svcs_disasm_batch(s.triplet, (uint8_t *)buf.data(),
+			  buf.size(), 0, insns, arena, options)) {
+				printf("ERROR: %s: can't disassemble\n", s.triplet);
+				return -1;
+			}
+			double secs = util_now() - start;
+			if(!pass)
+				continue;
+
+			int invalid = 0;
+			for(size_t i=0; i<insns.size(); ++i)
+				invalid += !!(insns[i].flags & LLVM_SVCS_INSN_INVALID);
+
+			printf("%-8s %zu instructions (%d invalid) in %.3fs, %.1fM insns/sec, "
+				"%zu arena bytes\n", text ? "text" : "no text", insns.size(),
+				invalid, secs, insns.size() / secs / 1e6, arena.size());
+		}
+	}
+
+	return 0;
+}
+
+/* records equal field by field (padding aside) */
+static bool insns_equal(const llvm_svcs_insn &a, const llvm_svcs_insn &b)
+{
+	return a.offset == b.offset && a.target == b.target && a.text == b.text &&
+		a.textLen == b.textLen && a.mnemonicLen == b.mnemonicLen &&
+		a.length == b.length && a.flags == b.flags;
+}
+
+/* sweep <mb> megabytes of each assembled sample (repeated) and of random
+	bytes on x86_64 with llvm_svcs_disasm_parallel(), failing unless the
+	result is llvm_svcs_disasm_batch()'s exactly, and report the speedup */
+static int dissweep_bench(int mb, int nThreads)
+{
+	int nSamples = sizeof(asmSamples)/sizeof(asmSamples[0]);
+	string bytes, buf, err, arena[2];
+	vector<llvm_svcs_insn> insns[2];
+
+	for(int i=0; i<=nSamples; ++i) {
+		const char *triplet;
+		double secs[2];
+
+		buf.clear();
+		if(i < nSamples) {
+			asm_sample &s = asmSamples[i];
+			string src(s.src, s.srcLen);
+			triplet = s.triplet;
+			if(llvm_svcs_assemble(src.c_str(), s.dialect, s.triplet,
+			  LLVM_SVCS_CM_DEFAULT, LLVM_SVCS_RM_STATIC, NULL, bytes, err)) {
+				printf("ERROR: %s: %s\n", s.triplet, err.c_str());
+				return -1;
+			}
+			while(buf.size() < (size_t)mb << 20)
+				buf += bytes;
+		}
+		else {
+			/* worst case for the seams, no alignment to fall into */
+			triplet = "x86_64-none-none";
+			srand(1);
+			while(buf.size() < (size_t)mb << 20)
+				buf += (char)rand();
+		}
+
+		for(int par=0; par<2; ++par) {
+			insns[par].clear();
+			arena[par].clear();
+			double start = util_now();
+			if((par ? llvm_svcs_disasm_parallel(triplet, (uint8_t *)buf.data(),
+			  buf.size(), 0x1000, insns[par], arena[par], 0, nThreads) :
+			  llvm_svcs_disasm_batch(triplet, (uint8_t *)buf.data(),
+			  buf.size(), 0x1000, insns[par], arena[par]))) {
+				printf("ERROR: %s: can't disassemble\n", triplet);
+				return -1;
+			}
+			secs[par] = util_now() - start;
+		}
+
+		if(insns[0].size() != insns[1].size() || arena[0] != arena[1]) {
+			printf("ERROR: %s: parallel sweep differs (%zu vs %zu records)\n",
+				triplet, insns[1].size(), insns[0].size());
+			return -1;
+		}
+		for(size_t j=0; j<insns[0].size(); ++j) {
+			if(!insns_equal(insns[0][j], insns[1][j])) {
+				printf("ERROR: %s: parallel sweep differs at record %zu "
+					"(offset 0x%llx)\n", triplet, j,
+					(unsigned long long)insns[0][j].offset);
+				return -1;
+			}
+		}
+
+		printf("%-20s %-6s %10zu insns %7.3fs single %7.3fs parallel (%.1fx)\n",
+			triplet, i < nSamples ? "" : "random", insns[0].size(), secs[0],
+			secs[1], secs[0] / secs[1]);
+	}
+
+	return 0;
+}
+
+/* resident set size right now, in KB */
+static long rss_kb(void)
+{
+	long pages = 0, resident = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if(!fp)
+		return -1;
+	if(2 != fscanf(fp, "%ld %ld", &pages, &resident))
+		resident = -1;
+	fclose(fp);
+	return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* assemble <n> samples round robin and fail if RSS keeps growing after the
+	first pass (which is allowed to fill caches, LLVM's and ours) */
+#define ASM_SOAK_WARMUP 1000
+#define ASM_SOAK_SLACK_KB 2048
+
+static int asm_soak(int n)
+{
+	int nSamples = sizeof(asmSamples)/sizeof(asmSamples[0]);
+	long base = -1, peak = 0;
+	string bytes, err;
+	vector<string> srcs;
+
+	for(int i=0; i<nSamples; ++i)
+		srcs.push_back(string(asmSamples[i].src, asmSamples[i].srcLen));
+
+	for(int i=0; i<n; ++i) {
+		asm_sample &s = asmSamples[i % nSamples];
+
+		if(llvm_svcs_assemble(srcs[i % nSamples].c_str(), s.dialect, s.triplet,
+		  LLVM_SVCS_CM_DEFAULT, LLVM_SVCS_RM_STATIC, NULL, bytes, err)) {
+			printf("ERROR: %s: %s\n", s.triplet, err.c_str());
+			return -1;
+		}
+
+		if(base == -1 && (i+1 == ASM_SOAK_WARMUP || i+1 == n))
+			base = rss_kb();
+		if((i+1) % 10000 == 0 || i+1 == n) {
+			long rss = rss_kb();
+			peak = rss > peak ? rss : peak;
+			printf("%d assembled, rss %ldKB (%+ldKB since warmup)\n", i+1, rss,
+				rss - base);
+		}
+	}
+
+	if(peak - base > ASM_SOAK_SLACK_KB) {
+		printf("ERROR: rss grew %ldKB over %d assemblies\n", peak - base, n);
+		return -1;
+	}
+	printf("rss flat (within %dKB) over %d assemblies\n", ASM_SOAK_SLACK_KB, n);
+	return 0;
+}
 
 int main(int ac, char **av)
 {
@@ -68,52 +346,47 @@ int main(int ac, char **av)
 		mgr.print();
 	}
 
-	//if(!strcmp(av[1], "asmmem")) {
-	if(1) {
-		string bytes, err;
-
-		/* run this and watch memory */
-		const char *x86z =
-			"main: # comment\n"
-			"pushl	%ebp\n"
-			"movl	%esp, %ebp\n"
-			"subl	$12, %esp\n"
-			"movl	12(%ebp), %eax\n"
-			"movl	8(%ebp), %ecx\n"
-			"movl	$0, -4(%ebp)\n"
-			"movl	%ecx, -8(%ebp)\n"
-			"movl	%eax, -12(%ebp)\n"
-			"movl	-8(%ebp), %eax\n"
-			"addl	$42, %eax\n"
-			"addl	$12, %esp\n"
-			"popl	%ebp\n"
-			"retl\n"
-			"jmp main\n";
-		
-		const char *x86 = "retl\n";
+	if(ac > 1 && !strcmp(av[1], "asmbench")) {
+		llvm_svcs_init();
+		if(asm_bench(ac > 2 ? atoi(av[2]) : 1000))
+			goto cleanup;
+		rc = 0;
+		goto cleanup;
+	}
+
+	if(ac > 1 && !strcmp(av[1], "disbench")) {
+		llvm_svcs_init();
+		if(disasm_bench(ac > 2 ? atoi(av[2]) : 100000))
+			goto cleanup;
+		rc = 0;
+		goto cleanup;
+	}
 
+	if(ac > 1 && !strcmp(av[1], "disbatch")) {
 		llvm_svcs_init();
+		if(disbatch_bench(ac > 2 ? atoi(av[2]) : 16))
+			goto cleanup;
+		rc = 0;
+		goto cleanup;
+	}
 
-		for(int i=0; i<100; ++i) {
-			if(	llvm_svcs_assemble(
-				x86,
-				LLVM_SVCS_DIALECT_ATT,
-				"i386-none-none",
-				LLVM_SVCS_CM_DEFAULT,
-				LLVM_SVCS_RM_STATIC,
-				NULL,
-				bytes, err
-			))
-			{
-				printf("ERROR! %s\n", err.c_str());
-				break;
-			}
+	if(ac > 1 && !strcmp(av[1], "dissweep")) {
+		llvm_svcs_init();
+		if(dissweep_bench(ac > 2 ? atoi(av[2]) : 64, ac > 3 ? atoi(av[3]) : 0))
+			goto cleanup;
+		rc = 0;
+		goto cleanup;
+	}
 
-			printf("it assembled! on test %d\n", i);
-		}
+	if(ac > 1 && !strcmp(av[1], "asmsoak")) {
+		llvm_svcs_init();
+		if(asm_soak(ac > 2 ? atoi(av[2]) : 1000000))
+			goto cleanup;
+		rc = 0;
+		goto cleanup;
 	}
 
 	rc = 0;
 	cleanup:
-	return 0;
+	return rc;
 }
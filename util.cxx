@@ -0,0 +1,71 @@
+/* c stdlib includes */
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+/* OS */
+#include <sys/stat.h>
+#include <dirent.h>
+
+/* c++ includes */
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/* local stuff */
+#include "util.h"
+
+/*****************************************************************************/
+/* TIMING */
+/*****************************************************************************/
+
+double util_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*****************************************************************************/
+/* CORPUS */
+/*****************************************************************************/
+
+void util_file_add(string path, vector<string> &files)
+{
+	struct stat sb;
+
+	if(lstat(path.c_str(), &sb) || !S_ISREG(sb.st_mode))
+		return;
+	files.push_back(path);
+}
+
+void util_dir_walk(string dir, vector<string> &files)
+{
+	DIR *d = opendir(dir.c_str());
+	struct dirent *ent;
+	vector<string> names;
+
+	if(!d) {
+		printf("ERROR: opendir(%s)\n", dir.c_str());
+		return;
+	}
+	while((ent = readdir(d))) {
+		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		names.push_back(ent->d_name);
+	}
+	closedir(d);
+
+	std::sort(names.begin(), names.end());
+	for(int i=0; i<names.size(); ++i) {
+		string path = dir + "/" + names[i];
+		struct stat sb;
+		if(lstat(path.c_str(), &sb))
+			continue;
+		if(S_ISDIR(sb.st_mode))
+			util_dir_walk(path, files);
+		else
+			util_file_add(path, files);
+	}
+}
@@ -0,0 +1,16 @@
+/* helpers the command line tools (hltag-batch, hltag-bench, test) share */
+
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+/* seconds on a monotonic clock, for timing */
+double util_now(void);
+
+/* path, if it's a regular file (a symlink isn't followed) */
+void util_file_add(string path, vector<string> &files);
+
+/* regular files under <dir>, in name order, symlinks aren't followed */
+void util_dir_walk(string dir, vector<string> &files);
@@ -0,0 +1,405 @@
+/* pointer/xref scanner
+
+	every aligned 4 or 8 byte value (in either endianness) is checked against
+	a set of address ranges, the hits are collected and sorted by the value
+	they contain so "who points here?" is a binary search
+
+	32-bit values are range checked four at a time with SSE2, the buffer is
+	split among threads */
+
+/* c stdlib includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* c++ includes */
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* local stuff */
+#include "xrefs.h"
+
+//#define XREFS_DEBUG 1
+
+/*****************************************************************************/
+/* compare functions */
+/*****************************************************************************/
+
+bool compareRangeByLeft(xrefs_range a, xrefs_range b)
+{
+	return a.left < b.left;
+}
+
+bool compareHitByTarget(const xrefs_hit &a, const xrefs_hit &b)
+{
+	if(a.target != b.target) return a.target < b.target;
+	return a.offset < b.offset;
+}
+
+/*****************************************************************************/
+/* range helpers */
+/*****************************************************************************/
+
+/* sort and coalesce overlapping/adjacent ranges, drop empty ones */
+static void
+ranges_normalize(vector<xrefs_range> &ranges)
+{
+	vector<xrefs_range> result;
+
+	std::sort(ranges.begin(), ranges.end(), compareRangeByLeft);
+
+	for(auto i=ranges.begin(); i!=ranges.end(); ++i) {
+		if(i->right <= i->left)
+			continue;
+
+		if(result.size() && i->left <= result.back().right) {
+			if(i->right > result.back().right)
+				result.back().right = i->right;
+		}
+		else {
+			result.push_back(*i);
+		}
+	}
+
+	ranges = result;
+}
+
+/* is value in one of the (normalized) ranges? */
+static inline bool
+ranges_contain(const vector<xrefs_range> &ranges, uint64_t value)
+{
+	/* first range whose left exceeds value, the one before it is the only
+		candidate */
+	int lo = 0, hi = ranges.size();
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if(ranges[mid].left <= value) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo > 0 && value < ranges[lo-1].right;
+}
+
+/* parse "0x1000-0x2000, 0x400000-0x401000" into ranges */
+int
+xrefs_parse_ranges(const char *str, vector<xrefs_range> &result)
+{
+	int rc = -1;
+	const char *p = str;
+
+	result.clear();
+
+	while(*p) {
+		char *end;
+		xrefs_range r;
+
+		while(*p == ' ' || *p == ',' || *p == '\t') ++p;
+		if(!*p) break;
+
+		r.left = strtoull(p, &end, 0);
+		if(end == p) {
+			printf("ERROR: expected range start at \"%s\"\n", p);
+			goto cleanup;
+		}
+		p = end;
+		while(*p == ' ') ++p;
+		if(*p != '-') {
+			printf("ERROR: expected '-' at \"%s\"\n", p);
+			goto cleanup;
+		}
+		++p;
+		r.right = strtoull(p, &end, 0);
+		if(end == p) {
+			printf("ERROR: expected range end at \"%s\"\n", p);
+			goto cleanup;
+		}
+		p = end;
+
+		result.push_back(r);
+	}
+
+	rc = result.size() ? 0 : -1;
+	cleanup:
+	return rc;
+}
+
+/* section tags, as the ELF/PE taggers emit them: section "<name>" contents */
+#define XREFS_SECTION_PREFIX "section \""
+#define XREFS_SECTION_SUFFIX "\" contents"
+
+bool
+xrefs_section_label(const string &label)
+{
+	size_t nPrefix = sizeof(XREFS_SECTION_PREFIX) - 1;
+	size_t nSuffix = sizeof(XREFS_SECTION_SUFFIX) - 1;
+
+	if(label.size() < nPrefix + nSuffix)
+		return false;
+	if(label.compare(0, nPrefix, XREFS_SECTION_PREFIX))
+		return false;
+	return !label.compare(label.size() - nSuffix, nSuffix, XREFS_SECTION_SUFFIX);
+}
+
+int
+xrefs_kind_width(int kind)
+{
+	return (kind == XREFS_64LE || kind == XREFS_64BE) ? 8 : 4;
+}
+
+const char *
+xrefs_kind_tostr(int kind)
+{
+	switch(kind) {
+		case XREFS_32LE: return "u32le";
+		case XREFS_32BE: return "u32be";
+		case XREFS_64LE: return "u64le";
+		case XREFS_64BE: return "u64be";
+	}
+	return "unknown";
+}
+
+/*****************************************************************************/
+/* scanning */
+/*****************************************************************************/
+
+/* 32-bit values at aligned offsets in [start,end) */
+static void
+scan32(const uint8_t *data, uint64_t start, uint64_t end,
+	const vector<xrefs_range> &ranges, bool be, vector<xrefs_hit> &hits)
+{
+	int kind = be ? XREFS_32BE : XREFS_32LE;
+	uint64_t lo = ranges.front().left;
+	uint64_t hi = ranges.back().right - 1; // inclusive
+
+	/* no range reaches down into 32-bit values */
+	if(lo > 0xFFFFFFFF) return;
+	if(hi > 0xFFFFFFFF) hi = 0xFFFFFFFF;
+
+	uint64_t offs = start;
+
+	#ifdef __SSE2__
+	/* SSE2 only has signed compares, so bias everything by 0x80000000 to
+		get unsigned behavior */
+	const __m128i bias = _mm_set1_epi32(0x80000000);
+	const __m128i vLo = _mm_set1_epi32((uint32_t)lo ^ 0x80000000);
+	const __m128i vHi = _mm_set1_epi32((uint32_t)hi ^ 0x80000000);
+
+	for(; offs + 16 <= end; offs += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + offs));
+
+		if(be) {
+			/* byte swap each dword: swap bytes within words, then words */
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			v = _mm_shufflelo_epi16(v, 0xB1);
+			v = _mm_shufflehi_epi16(v, 0xB1);
+		}
+
+		v = _mm_xor_si128(v, bias);
+		__m128i outside = _mm_or_si128(_mm_cmplt_epi32(v, vLo),
+			_mm_cmpgt_epi32(v, vHi));
+
+		/* all four lanes outside the envelope? common case, move on */
+		if(_mm_movemask_epi8(outside) == 0xFFFF)
+			continue;
+
+		for(int i=0; i<16; i+=4) {
+			uint32_t value = *(uint32_t *)(data + offs + i);
+			if(be) value = __builtin_bswap32(value);
+			if(ranges_contain(ranges, value)) {
+				xrefs_hit hit = { value, offs + i, kind };
+				hits.push_back(hit);
+			}
+		}
+	}
+	#endif
+
+	/* leftovers (or everything, without SSE2) */
+	for(; offs + 4 <= end; offs += 4) {
+		uint32_t value = *(uint32_t *)(data + offs);
+		if(be) value = __builtin_bswap32(value);
+		if(value < lo || value > hi) continue;
+		if(ranges_contain(ranges, value)) {
+			xrefs_hit hit = { value, offs, kind };
+			hits.push_back(hit);
+		}
+	}
+}
+
+/* 64-bit values at aligned offsets in [start,end)
+
+	SSE2 has no 64-bit compare, so this is scalar with an envelope check up
+	front, which rejects nearly everything with a well predicted branch */
+static void
+scan64(const uint8_t *data, uint64_t start, uint64_t end,
+	const vector<xrefs_range> &ranges, bool be, vector<xrefs_hit> &hits)
+{
+	int kind = be ? XREFS_64BE : XREFS_64LE;
+	uint64_t lo = ranges.front().left;
+	uint64_t hi = ranges.back().right - 1; // inclusive
+
+	for(uint64_t offs = start; offs + 8 <= end; offs += 8) {
+		uint64_t value = *(uint64_t *)(data + offs);
+		if(be) value = __builtin_bswap64(value);
+		if(value < lo || value > hi) continue;
+		if(ranges_contain(ranges, value)) {
+			xrefs_hit hit = { value, offs, kind };
+			hits.push_back(hit);
+		}
+	}
+}
+
+static void
+scan_chunk(const uint8_t *data, uint64_t start, uint64_t end,
+	const vector<xrefs_range> &ranges, int kinds, vector<xrefs_hit> &hits)
+{
+	/* chunks end on 8-byte offsets (or at the buffer end), so no aligned
+		value straddles one */
+	if(kinds & XREFS_32LE) scan32(data, start, end, ranges, false, hits);
+	if(kinds & XREFS_32BE) scan32(data, start, end, ranges, true, hits);
+	if(kinds & XREFS_64LE) scan64(data, start, end, ranges, false, hits);
+	if(kinds & XREFS_64BE) scan64(data, start, end, ranges, true, hits);
+}
+
+/* scan the buffer, result is sorted by (target,offset) */
+int
+xrefs_scan(const uint8_t *data, uint64_t len, vector<xrefs_range> ranges,
+	int kinds, int nThreads, vector<xrefs_hit> &index)
+{
+	int rc = -1;
+	vector<thread> workers;
+	vector< vector<xrefs_hit> > results;
+	uint64_t chunkSize;
+
+	index.clear();
+
+	ranges_normalize(ranges);
+	if(ranges.size() == 0) {
+		printf("ERROR: no (non-empty) ranges to scan for\n");
+		goto cleanup;
+	}
+
+	if(nThreads <= 0)
+		nThreads = std::max(1u, thread::hardware_concurrency());
+
+	/* chunks start on 8-byte offsets so every thread sees the same
+		alignment, tiny inputs aren't worth splitting */
+	chunkSize = (len + nThreads - 1) / nThreads;
+	chunkSize = (chunkSize + 7) & ~(uint64_t)7;
+	if(chunkSize < 0x10000) chunkSize = 0x10000;
+	nThreads = (len + chunkSize - 1) / chunkSize;
+
+	results.resize(nThreads);
+	for(int i=0; i<nThreads; ++i) {
+		uint64_t start = i * chunkSize;
+		uint64_t end = std::min(start + chunkSize, len);
+		workers.push_back(thread(scan_chunk, data, start, end,
+			std::cref(ranges), kinds, std::ref(results[i])));
+	}
+
+	for(auto i=workers.begin(); i!=workers.end(); ++i)
+		i->join();
+
+	/* chunks cover ascending offsets, so concatenating keeps each target's
+		offsets in order and the sort has less to do */
+	for(auto i=results.begin(); i!=results.end(); ++i)
+		index.insert(index.end(), i->begin(), i->end());
+
+	std::sort(index.begin(), index.end(), compareHitByTarget);
+
+	#ifdef XREFS_DEBUG
+	printf("%s(): %ld hits over 0x%llX bytes with %d threads\n", __func__,
+		index.size(), len, nThreads);
+	#endif
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+
+/* "who points here?" every hit whose target is in [left,right) */
+int
+xrefs_lookup(vector<xrefs_hit> &index, uint64_t left, uint64_t right,
+	vector<xrefs_hit> &result)
+{
+	xrefs_hit key = { left, 0, 0 };
+
+	result.clear();
+
+	auto i = std::lower_bound(index.begin(), index.end(), key,
+		compareHitByTarget);
+
+	for(; i!=index.end() && i->target < right; ++i)
+		result.push_back(*i);
+
+	return 0;
+}
+
+/*****************************************************************************/
+/* TESTS */
+/*****************************************************************************/
+
+#ifdef TEST1
+// g++ -std=c++11 -pthread -DTEST1 xrefs.cxx -o test
+int main(int ac, char **av)
+{
+	int rc = -1;
+	vector<xrefs_range> ranges;
+	vector<xrefs_hit> index, hits;
+	uint8_t buf[0x40000];
+	struct { const char *label; uint64_t left, right; } tags[] = {
+		{"section \".text\" contents", 0x3000, 0x3100},
+		{"section \".text\" header", 0x40, 0x80},
+		{"contents", 0x80, 0x88},
+		{"\" contents", 0x88, 0x90}
+	};
+
+	memset(buf, 0, sizeof(buf));
+	*(uint32_t *)(buf + 0x100) = 0x1010;
+	*(uint32_t *)(buf + 0x204) = __builtin_bswap32(0x1020);
+	*(uint64_t *)(buf + 0x20008) = 0x2000;
+	*(uint32_t *)(buf + 0x3FFFC) = 0x1010;
+
+	if(xrefs_parse_ranges("0x1000-0x1100, 0x2000-0x2001", ranges)) {
+		printf("ERROR: xrefs_parse_ranges()\n");
+		goto cleanup;
+	}
+
+	if(xrefs_scan(buf, sizeof(buf), ranges, XREFS_ALL, 4, index)) {
+		printf("ERROR: xrefs_scan()\n");
+		goto cleanup;
+	}
+
+	for(auto i=index.begin(); i!=index.end(); ++i)
+		printf("[0x%llX] %s -> 0x%llX\n", (unsigned long long)i->offset,
+			xrefs_kind_tostr(i->kind), (unsigned long long)i->target);
+
+	/* u32le and u64le at 0x100, u32le at the very end */
+	xrefs_lookup(index, 0x1010, 0x1011, hits);
+	if(hits.size() != 3) {
+		printf("ERROR: expected 3 refs to 0x1010, got %ld\n", hits.size());
+		goto cleanup;
+	}
+
+	/* only the section contents tag makes a default range */
+	ranges.clear();
+	for(unsigned int i=0; i<sizeof(tags)/sizeof(tags[0]); ++i)
+		if(xrefs_section_label(tags[i].label))
+			ranges.push_back({tags[i].left, tags[i].right});
+	if(ranges.size() != 1 || ranges[0].left != 0x3000 || ranges[0].right != 0x3100) {
+		printf("ERROR: expected section \".text\" contents to yield a range\n");
+		goto cleanup;
+	}
+
+	rc = 0;
+	cleanup:
+	return rc;
+}
+#endif
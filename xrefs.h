@@ -0,0 +1,44 @@
+/* find values in a buffer that look like pointers into given address ranges
+
+	the scan result, sorted by target, doubles as the inverted index that
+	answers "who points here?" */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+/* kinds of values to consider, OR these together */
+#define XREFS_32LE 1
+#define XREFS_32BE 2
+#define XREFS_64LE 4
+#define XREFS_64BE 8
+#define XREFS_ALL (XREFS_32LE|XREFS_32BE|XREFS_64LE|XREFS_64BE)
+
+struct xrefs_range {
+	uint64_t left, right; // [,)
+};
+
+struct xrefs_hit {
+	uint64_t target; /* the value read, falls in one of the scanned ranges */
+	uint64_t offset; /* where in the buffer the value was read */
+	int kind; /* XREFS_32LE, XREFS_64BE, etc. */
+};
+
+int xrefs_parse_ranges(const char *str, vector<xrefs_range> &result);
+
+int xrefs_scan(const uint8_t *data, uint64_t len,
+	vector<xrefs_range> ranges, int kinds, int nThreads,
+	vector<xrefs_hit> &index);
+
+int xrefs_lookup(vector<xrefs_hit> &index, uint64_t left, uint64_t right,
+	vector<xrefs_hit> &result);
+
+/* is this a section contents tag, whose VAs make a default scan range? */
+bool xrefs_section_label(const string &label);
+
+int xrefs_kind_width(int kind);
+const char *xrefs_kind_tostr(int kind);